@@ -0,0 +1,262 @@
+/*
+ *  gstvaapiarena.c - Block allocator for short-lived decoder objects
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#include "sysdeps.h"
+#include "gstvaapiarena.h"
+
+/* Objects are carved out of large blocks with a simple bump pointer.
+   Each block counts the objects that are still alive in it, plus one
+   while it is the current block of the arena. When that count drops
+   to zero, the whole block is reset and kept for reuse, so a steady
+   stream of frames ends up recycling the same few blocks */
+
+#define ARENA_ALIGN             16
+#define ARENA_ROUND_UP(x)       (((x) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+#define ARENA_MAX_SPARE_BLOCKS  4
+
+typedef struct _GstVaapiArenaBlock GstVaapiArenaBlock;
+
+struct _GstVaapiArenaBlock
+{
+  GstVaapiArena *arena;
+  GstVaapiArenaBlock *next;
+  volatile gint ref_count;
+  gsize offset;
+};
+
+#define ARENA_BLOCK_HEADER_SIZE ARENA_ROUND_UP (sizeof (GstVaapiArenaBlock))
+
+/* Each object is preceded by the block it was allocated from, or NULL
+   if it was allocated from the heap */
+typedef union
+{
+  GstVaapiArenaBlock *block;
+  guint8 pad[ARENA_ALIGN];
+} GstVaapiArenaChunk;
+
+struct _GstVaapiArena
+{
+  /* one reference for the owner, plus one per block in use */
+  volatile gint ref_count;
+  GMutex lock;
+  gsize block_size;
+  GstVaapiArenaBlock *current_block;
+  GstVaapiArenaBlock *spare_blocks;
+  guint num_spare_blocks;
+};
+
+static GstVaapiArenaStats g_arena_stats;
+
+static void
+arena_unref (GstVaapiArena * arena)
+{
+  GstVaapiArenaBlock *block;
+
+  if (!g_atomic_int_dec_and_test (&arena->ref_count))
+    return;
+
+  while ((block = arena->spare_blocks) != NULL) {
+    arena->spare_blocks = block->next;
+    g_free (block);
+  }
+  g_mutex_clear (&arena->lock);
+  g_slice_free (GstVaapiArena, arena);
+}
+
+/* Must be called with the arena lock held */
+static GstVaapiArenaBlock *
+arena_block_new_unlocked (GstVaapiArena * arena)
+{
+  GstVaapiArenaBlock *block;
+
+  block = arena->spare_blocks;
+  if (block) {
+    arena->spare_blocks = block->next;
+    arena->num_spare_blocks--;
+    g_atomic_int_inc (&g_arena_stats.num_resets);
+  } else {
+    block = g_malloc (arena->block_size);
+    g_atomic_int_inc (&g_arena_stats.num_blocks);
+  }
+  block->arena = arena;
+  block->next = NULL;
+  block->ref_count = 1;
+  block->offset = ARENA_BLOCK_HEADER_SIZE;
+  g_atomic_int_inc (&arena->ref_count);
+  return block;
+}
+
+static void
+arena_block_unref (GstVaapiArenaBlock * block)
+{
+  GstVaapiArena *const arena = block->arena;
+
+  if (!g_atomic_int_dec_and_test (&block->ref_count))
+    return;
+
+  g_mutex_lock (&arena->lock);
+  if (arena->num_spare_blocks < ARENA_MAX_SPARE_BLOCKS) {
+    block->next = arena->spare_blocks;
+    arena->spare_blocks = block;
+    arena->num_spare_blocks++;
+    block = NULL;
+  }
+  g_mutex_unlock (&arena->lock);
+
+  g_free (block);
+  arena_unref (arena);
+}
+
+/**
+ * gst_vaapi_arena_new:
+ * @block_size: the size of the memory blocks, in bytes
+ *
+ * Creates a new arena that allocates objects from blocks of
+ * @block_size bytes. A block is reset as a whole, and recycled, once
+ * the last object allocated from it is released.
+ *
+ * Return value: the newly allocated #GstVaapiArena
+ */
+GstVaapiArena *
+gst_vaapi_arena_new (gsize block_size)
+{
+  GstVaapiArena *arena;
+
+  g_return_val_if_fail (block_size > ARENA_BLOCK_HEADER_SIZE, NULL);
+
+  arena = g_slice_new (GstVaapiArena);
+  arena->ref_count = 1;
+  g_mutex_init (&arena->lock);
+  arena->block_size = block_size;
+  arena->current_block = NULL;
+  arena->spare_blocks = NULL;
+  arena->num_spare_blocks = 0;
+  return arena;
+}
+
+/**
+ * gst_vaapi_arena_destroy:
+ * @arena: a #GstVaapiArena
+ *
+ * Releases the @arena. Objects allocated from @arena remain valid,
+ * and the underlying memory is released along with the last of them.
+ */
+void
+gst_vaapi_arena_destroy (GstVaapiArena * arena)
+{
+  GstVaapiArenaBlock *block;
+
+  g_return_if_fail (arena != NULL);
+
+  g_mutex_lock (&arena->lock);
+  block = arena->current_block;
+  arena->current_block = NULL;
+  g_mutex_unlock (&arena->lock);
+
+  if (block)
+    arena_block_unref (block);
+  arena_unref (arena);
+}
+
+/**
+ * gst_vaapi_arena_alloc:
+ * @arena: a #GstVaapiArena
+ * @size: the number of bytes to allocate
+ *
+ * Allocates @size bytes from @arena. The memory is not cleared, and it
+ * shall be released with gst_vaapi_arena_free(). This function is
+ * thread-safe.
+ *
+ * Return value: the allocated memory
+ */
+gpointer
+gst_vaapi_arena_alloc (GstVaapiArena * arena, gsize size)
+{
+  GstVaapiArenaBlock *block, *full_block = NULL;
+  GstVaapiArenaChunk *chunk;
+  const gsize chunk_size = sizeof (*chunk) + ARENA_ROUND_UP (size);
+
+  g_return_val_if_fail (arena != NULL, NULL);
+
+  if (G_UNLIKELY (chunk_size > arena->block_size - ARENA_BLOCK_HEADER_SIZE)) {
+    chunk = g_malloc (sizeof (*chunk) + size);
+    chunk->block = NULL;
+    g_atomic_int_inc (&g_arena_stats.num_fallbacks);
+    return chunk + 1;
+  }
+
+  g_mutex_lock (&arena->lock);
+  block = arena->current_block;
+  if (!block || block->offset + chunk_size > arena->block_size) {
+    full_block = block;
+    block = arena_block_new_unlocked (arena);
+    arena->current_block = block;
+  }
+  chunk = (GstVaapiArenaChunk *) ((guint8 *) block + block->offset);
+  block->offset += chunk_size;
+  g_atomic_int_inc (&block->ref_count);
+  g_mutex_unlock (&arena->lock);
+
+  if (full_block)
+    arena_block_unref (full_block);
+
+  chunk->block = block;
+  g_atomic_int_inc (&g_arena_stats.num_allocs);
+  return chunk + 1;
+}
+
+/**
+ * gst_vaapi_arena_free:
+ * @mem: memory allocated with gst_vaapi_arena_alloc()
+ *
+ * Releases @mem. This function is thread-safe, and it can be called
+ * after the arena was destroyed.
+ */
+void
+gst_vaapi_arena_free (gpointer mem)
+{
+  GstVaapiArenaChunk *chunk;
+
+  g_return_if_fail (mem != NULL);
+
+  chunk = (GstVaapiArenaChunk *) mem - 1;
+  if (chunk->block)
+    arena_block_unref (chunk->block);
+  else
+    g_free (chunk);
+}
+
+/**
+ * gst_vaapi_arena_get_stats:
+ * @stats: (out): return location for the allocation counters
+ *
+ * Retrieves the allocation counters of all the arenas created so far.
+ */
+void
+gst_vaapi_arena_get_stats (GstVaapiArenaStats * stats)
+{
+  g_return_if_fail (stats != NULL);
+
+  stats->num_allocs = g_atomic_int_get (&g_arena_stats.num_allocs);
+  stats->num_blocks = g_atomic_int_get (&g_arena_stats.num_blocks);
+  stats->num_resets = g_atomic_int_get (&g_arena_stats.num_resets);
+  stats->num_fallbacks = g_atomic_int_get (&g_arena_stats.num_fallbacks);
+}
@@ -0,0 +1,72 @@
+/*
+ *  gstvaapiarena.h - Block allocator for short-lived decoder objects
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef GST_VAAPI_ARENA_H
+#define GST_VAAPI_ARENA_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstVaapiArena                   GstVaapiArena;
+typedef struct _GstVaapiArenaStats              GstVaapiArenaStats;
+
+/**
+ * GstVaapiArenaStats:
+ * @num_allocs: number of objects allocated from arena blocks
+ * @num_blocks: number of blocks allocated from the heap
+ * @num_resets: number of blocks that were reset for reuse
+ * @num_fallbacks: number of objects too large for a block, hence
+ *   allocated from the heap
+ *
+ * Allocation counters, accumulated over all the arenas of the process.
+ */
+struct _GstVaapiArenaStats
+{
+  guint num_allocs;
+  guint num_blocks;
+  guint num_resets;
+  guint num_fallbacks;
+};
+
+G_GNUC_INTERNAL
+GstVaapiArena *
+gst_vaapi_arena_new (gsize block_size);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_arena_destroy (GstVaapiArena * arena);
+
+G_GNUC_INTERNAL
+gpointer
+gst_vaapi_arena_alloc (GstVaapiArena * arena, gsize size);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_arena_free (gpointer mem);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_arena_get_stats (GstVaapiArenaStats * stats);
+
+G_END_DECLS
+
+#endif /* GST_VAAPI_ARENA_H */
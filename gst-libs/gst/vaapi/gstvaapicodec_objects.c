@@ -72,12 +72,23 @@ GstVaapiCodecObject *
 gst_vaapi_codec_object_new (const GstVaapiCodecObjectClass * object_class,
     GstVaapiCodecBase * codec, gconstpointer param, guint param_size,
     gconstpointer data, guint data_size, guint flags)
+{
+  return gst_vaapi_codec_object_new_with_arena (object_class, codec, NULL,
+      param, param_size, data, data_size, flags);
+}
+
+GstVaapiCodecObject *
+gst_vaapi_codec_object_new_with_arena (const GstVaapiCodecObjectClass *
+    object_class, GstVaapiCodecBase * codec, GstVaapiArena * arena,
+    gconstpointer param, guint param_size, gconstpointer data,
+    guint data_size, guint flags)
 {
   GstVaapiCodecObject *obj;
   GstVaapiCodecObjectConstructorArgs args;
 
   obj = (GstVaapiCodecObject *)
-      gst_vaapi_mini_object_new0 (GST_VAAPI_MINI_OBJECT_CLASS (object_class));
+      gst_vaapi_mini_object_new0_with_arena (GST_VAAPI_MINI_OBJECT_CLASS
+      (object_class), arena);
   if (!obj)
     return NULL;
 
@@ -105,6 +105,13 @@ gst_vaapi_codec_object_new (const GstVaapiCodecObjectClass * object_class,
     GstVaapiCodecBase * codec, gconstpointer param, guint param_size,
     gconstpointer data, guint data_size, guint flags);
 
+G_GNUC_INTERNAL
+GstVaapiCodecObject *
+gst_vaapi_codec_object_new_with_arena (const GstVaapiCodecObjectClass *
+    object_class, GstVaapiCodecBase * codec, GstVaapiArena * arena,
+    gconstpointer param, guint param_size, gconstpointer data,
+    guint data_size, guint flags);
+
 #define gst_vaapi_codec_object_ref(object) \
   ((gpointer) gst_vaapi_mini_object_ref (GST_VAAPI_MINI_OBJECT (object)))
 
@@ -237,11 +244,16 @@ gboolean                                                                \
 G_PASTE (prefix, _create) (type *,                                      \
     const GstVaapiCodecObjectConstructorArgs * args);                   \
                                                                         \
+static GstVaapiMiniObjectCache G_PASTE (type, Cache) = {                \
+  .name = G_STRINGIFY (type),                                           \
+};                                                                      \
+                                                                        \
 static const GstVaapiCodecObjectClass G_PASTE (type, Class) = {         \
   .parent_class = {                                                     \
     .size = sizeof (type),                                              \
     .finalize = (GstVaapiCodecObjectDestroyFunc)                        \
-        G_PASTE (prefix, _destroy)                                      \
+        G_PASTE (prefix, _destroy),                                     \
+    .cache = &G_PASTE (type, Cache),                                    \
   },                                                                    \
   .create = (GstVaapiCodecObjectCreateFunc)                             \
       G_PASTE (prefix, _create),                                        \
@@ -43,18 +43,22 @@ static void
 coded_buffer_proxy_finalize (GstVaapiCodedBufferProxy * proxy)
 {
   if (proxy->buffer) {
+    /* Exported coded buffers are left mapped until then */
+    gst_vaapi_coded_buffer_unmap (proxy->buffer);
     if (proxy->pool)
       gst_vaapi_video_pool_put_object (proxy->pool, proxy->buffer);
     gst_vaapi_object_unref (proxy->buffer);
     proxy->buffer = NULL;
   }
   gst_vaapi_video_pool_replace (&proxy->pool, NULL);
-  coded_buffer_proxy_set_user_data (proxy, NULL, NULL);
 
   /* Notify the user function that the object is now destroyed */
   if (proxy->destroy_func)
     proxy->destroy_func (proxy->destroy_data);
 
+  /* The user data may hold the object the destroy notify refers to */
+  coded_buffer_proxy_set_user_data (proxy, NULL, NULL);
+
 #if USE_H264_FEI_ENCODER
   if (proxy->mbcode)
     gst_vaapi_fei_codec_object_replace ((GstVaapiFeiCodecObject **) &
@@ -72,9 +76,13 @@ coded_buffer_proxy_finalize (GstVaapiCodedBufferProxy * proxy)
 static inline const GstVaapiMiniObjectClass *
 gst_vaapi_coded_buffer_proxy_class (void)
 {
+  static GstVaapiMiniObjectCache GstVaapiCodedBufferProxyCache = {
+    .name = "GstVaapiCodedBufferProxy",
+  };
   static const GstVaapiMiniObjectClass GstVaapiCodedBufferProxyClass = {
     sizeof (GstVaapiCodedBufferProxy),
-    (GDestroyNotify) coded_buffer_proxy_finalize
+    (GDestroyNotify) coded_buffer_proxy_finalize,
+    &GstVaapiCodedBufferProxyCache
   };
   return &GstVaapiCodedBufferProxyClass;
 }
@@ -211,6 +219,44 @@ gst_vaapi_coded_buffer_proxy_get_buffer_size (GstVaapiCodedBufferProxy * proxy)
   return GST_VAAPI_CODED_BUFFER_PROXY_BUFFER_SIZE (proxy);
 }
 
+/**
+ * gst_vaapi_coded_buffer_proxy_export:
+ * @proxy: a #GstVaapiCodedBufferProxy
+ *
+ * Wraps the coded data of @proxy into a new #GstBuffer, without any
+ * copy. Every #GstMemory of the returned buffer is read-only and
+ * holds a reference to @proxy, so the underlying VA coded buffer
+ * stays mapped, and out of its parent pool, until the last of them is
+ * released.
+ *
+ * Return value: a new #GstBuffer, or %NULL if an error occurred
+ */
+GstBuffer *
+gst_vaapi_coded_buffer_proxy_export (GstVaapiCodedBufferProxy * proxy)
+{
+  VACodedBufferSegment *segment;
+  GstBuffer *buffer;
+  GstMemory *mem;
+
+  g_return_val_if_fail (proxy != NULL, NULL);
+  g_return_val_if_fail (proxy->buffer != NULL, NULL);
+
+  if (!gst_vaapi_coded_buffer_map (proxy->buffer, &segment))
+    return NULL;
+
+  buffer = gst_buffer_new ();
+  for (; segment != NULL; segment = segment->next) {
+    if (segment->size == 0)
+      continue;
+    mem = gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY, segment->buf,
+        segment->size, 0, segment->size,
+        gst_vaapi_coded_buffer_proxy_ref (proxy),
+        (GDestroyNotify) gst_vaapi_coded_buffer_proxy_unref);
+    gst_buffer_append_memory (buffer, mem);
+  }
+  return buffer;
+}
+
 /**
  * gst_vaapi_coded_buffer_proxy_set_destroy_notify:
  * @proxy: a @GstVaapiCodedBufferProxy
@@ -70,6 +70,9 @@ gst_vaapi_coded_buffer_proxy_get_buffer (GstVaapiCodedBufferProxy * proxy);
 gssize
 gst_vaapi_coded_buffer_proxy_get_buffer_size (GstVaapiCodedBufferProxy * proxy);
 
+GstBuffer *
+gst_vaapi_coded_buffer_proxy_export (GstVaapiCodedBufferProxy * proxy);
+
 void
 gst_vaapi_coded_buffer_proxy_set_destroy_notify (GstVaapiCodedBufferProxy *
     proxy, GDestroyNotify destroy_func, gpointer user_data);
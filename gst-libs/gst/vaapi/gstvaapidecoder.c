@@ -38,8 +38,13 @@
 #define DEBUG 1
 #include "gstvaapidebug.h"
 
+/* Size of the memory blocks for parser info, slices and parser frames */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
 static void drop_frame (GstVaapiDecoder * decoder, GstVideoCodecFrame * frame);
 
+static GstVaapiDecoderRefListStats g_ref_list_stats;
+
 static void
 parser_state_reset (GstVaapiParserState * ps)
 {
@@ -158,8 +163,8 @@ do_parse (GstVaapiDecoder * decoder,
   frame = gst_video_codec_frame_get_user_data (base_frame);
   if (!frame) {
     GstVideoCodecState *const codec_state = decoder->codec_state;
-    frame = gst_vaapi_parser_frame_new (codec_state->info.width,
-        codec_state->info.height);
+    frame = gst_vaapi_parser_frame_new (decoder->arena,
+        codec_state->info.width, codec_state->info.height);
     if (!frame)
       return GST_VAAPI_DECODER_STATUS_ERROR_ALLOCATION_FAILED;
     gst_video_codec_frame_set_user_data (base_frame,
@@ -271,7 +276,7 @@ do_decode (GstVaapiDecoder * decoder, GstVideoCodecFrame * base_frame)
   GstVaapiParserFrame *const frame = base_frame->user_data;
   GstVaapiDecoderStatus status;
 
-  ps->current_frame = base_frame;
+  ps->decode_frame = base_frame;
 
   gst_vaapi_parser_frame_ref (frame);
   status = do_decode_1 (decoder, frame);
@@ -409,6 +414,55 @@ pop_frame (GstVaapiDecoder * decoder, guint64 timeout)
   return frame;
 }
 
+/* A frame that the decode thread failed to decode */
+typedef struct
+{
+  GstVideoCodecFrame *frame;
+  GstVaapiDecoderStatus status;
+} FailedFrame;
+
+static void
+failed_frame_free (FailedFrame * failed)
+{
+  gst_video_codec_frame_unref (failed->frame);
+  g_slice_free (FailedFrame, failed);
+}
+
+/* Hands over the oldest frame that the decode thread failed to decode,
+   and returns its status, or GST_VAAPI_DECODER_STATUS_ERROR_NO_DATA */
+static GstVaapiDecoderStatus
+pop_failed_frame (GstVaapiDecoder * decoder,
+    GstVideoCodecFrame ** out_frame_ptr)
+{
+  GstVaapiDecoderStatus status = GST_VAAPI_DECODER_STATUS_ERROR_NO_DATA;
+  FailedFrame *failed;
+
+  if (!decoder->decode_thread)
+    return status;
+
+  g_mutex_lock (&decoder->decode_lock);
+  failed = g_queue_pop_head (&decoder->failed_frames);
+  g_mutex_unlock (&decoder->decode_lock);
+
+  if (failed) {
+    *out_frame_ptr = failed->frame;
+    status = failed->status;
+    g_slice_free (FailedFrame, failed);
+  }
+  return status;
+}
+
+static gboolean
+has_failed_frames (GstVaapiDecoder * decoder)
+{
+  gboolean has_failed_frames;
+
+  g_mutex_lock (&decoder->decode_lock);
+  has_failed_frames = !g_queue_is_empty (&decoder->failed_frames);
+  g_mutex_unlock (&decoder->decode_lock);
+  return has_failed_frames;
+}
+
 static gboolean
 set_caps (GstVaapiDecoder * decoder, const GstCaps * caps)
 {
@@ -445,12 +499,284 @@ get_caps (GstVaapiDecoder * decoder)
   return GST_VAAPI_DECODER_CODEC_STATE (decoder)->caps;
 }
 
+static GstVideoCodecState *
+copy_codec_state (const GstVideoCodecState * in_state)
+{
+  GstVideoCodecState *state;
+
+  state = g_slice_new0 (GstVideoCodecState);
+  state->ref_count = 1;
+  state->info = in_state->info;
+  state->caps = gst_caps_copy (in_state->caps);
+  if (in_state->codec_data)
+    state->codec_data = gst_buffer_ref (in_state->codec_data);
+  return state;
+}
+
+static inline gboolean
+is_decode_thread (GstVaapiDecoder * decoder)
+{
+  return decoder->decode_thread && g_thread_self () == decoder->decode_thread;
+}
+
 static void
 notify_codec_state_changed (GstVaapiDecoder * decoder)
 {
+  GstVideoCodecState *codec_state;
+
+  if (!decoder->codec_state_changed_func)
+    return;
+
+  /* Defer the notification to the thread that submits the frames, so
+     that the callback never runs concurrently with it */
+  if (is_decode_thread (decoder)) {
+    codec_state = copy_codec_state (decoder->codec_state);
+    g_mutex_lock (&decoder->decode_lock);
+    if (decoder->pending_codec_state)
+      gst_video_codec_state_unref (decoder->pending_codec_state);
+    decoder->pending_codec_state = codec_state;
+    g_mutex_unlock (&decoder->decode_lock);
+    return;
+  }
+
+  decoder->codec_state_changed_func (decoder, decoder->codec_state,
+      decoder->codec_state_changed_data);
+}
+
+static void
+notify_pending_codec_state (GstVaapiDecoder * decoder)
+{
+  GstVideoCodecState *codec_state;
+
+  g_mutex_lock (&decoder->decode_lock);
+  codec_state = decoder->pending_codec_state;
+  decoder->pending_codec_state = NULL;
+  g_mutex_unlock (&decoder->decode_lock);
+
+  if (!codec_state)
+    return;
   if (decoder->codec_state_changed_func)
-    decoder->codec_state_changed_func (decoder, decoder->codec_state,
+    decoder->codec_state_changed_func (decoder, codec_state,
         decoder->codec_state_changed_data);
+  gst_video_codec_state_unref (codec_state);
+}
+
+/* Interval at which the decode thread checks for free surfaces again,
+   should it ever run out of them */
+#define DECODE_THREAD_POLL_INTERVAL (2 * G_TIME_SPAN_MILLISECOND)
+
+/* Called with decode_lock held */
+static GstVaapiDecoderStatus
+check_status_unlocked (GstVaapiDecoder * decoder)
+{
+  if (decoder->context &&
+      gst_vaapi_context_get_surface_count (decoder->context) < 1)
+    return GST_VAAPI_DECODER_STATUS_ERROR_NO_SURFACE;
+  return GST_VAAPI_DECODER_STATUS_SUCCESS;
+}
+
+/* Called with decode_lock held, which the decode thread also holds
+   while it replaces or resets the context */
+static inline gboolean
+has_free_surfaces (GstVaapiDecoder * decoder, guint count)
+{
+  return !decoder->context ||
+      gst_vaapi_context_get_surface_count (decoder->context) >= count;
+}
+
+static gpointer
+decode_thread_func (gpointer data)
+{
+  GstVaapiDecoder *const decoder = data;
+  GstVideoCodecFrame *frame;
+  GstVaapiDecoderStatus status;
+  FailedFrame *failed;
+
+  g_mutex_lock (&decoder->decode_lock);
+  while (!decoder->decode_stop) {
+    if (g_queue_is_empty (&decoder->decode_queue)) {
+      decoder->decode_stalled = FALSE;
+      g_cond_wait (&decoder->decode_cond, &decoder->decode_lock);
+      continue;
+    }
+
+    /* Frames are only queued once enough surfaces are available for
+       all of them, so this only happens if a frame needed more than
+       one surface (e.g. MVC, or gaps in frame_num) */
+    if (!has_free_surfaces (decoder, 1)) {
+      decoder->decode_stalled = TRUE;
+      g_cond_broadcast (&decoder->decode_cond);
+      g_cond_wait_until (&decoder->decode_cond, &decoder->decode_lock,
+          g_get_monotonic_time () + DECODE_THREAD_POLL_INTERVAL);
+      continue;
+    }
+    decoder->decode_stalled = FALSE;
+
+    frame = g_queue_pop_head (&decoder->decode_queue);
+    decoder->decode_busy = TRUE;
+    g_mutex_unlock (&decoder->decode_lock);
+
+    status = do_decode (decoder, frame);
+    GST_DEBUG ("decode frame %d (status = %d)", frame->system_frame_number,
+        status);
+
+    /* The frame is handed back along with the error, so that the caller
+       can drop it, as if gst_vaapi_decoder_decode() had failed */
+    failed = NULL;
+    if (status != GST_VAAPI_DECODER_STATUS_SUCCESS) {
+      failed = g_slice_new (FailedFrame);
+      failed->frame = frame;
+      failed->status = status;
+    } else
+      gst_video_codec_frame_unref (frame);
+
+    g_mutex_lock (&decoder->decode_lock);
+    decoder->decode_busy = FALSE;
+    if (failed)
+      g_queue_push_tail (&decoder->failed_frames, failed);
+    g_cond_broadcast (&decoder->decode_cond);
+  }
+  g_mutex_unlock (&decoder->decode_lock);
+  return NULL;
+}
+
+/* Called with decode_lock held */
+static gboolean
+ensure_decode_thread (GstVaapiDecoder * decoder)
+{
+  GError *error = NULL;
+
+  if (decoder->decode_thread)
+    return TRUE;
+
+  decoder->decode_stop = FALSE;
+  decoder->decode_thread = g_thread_try_new ("vaapidecoder",
+      decode_thread_func, decoder, &error);
+  if (!decoder->decode_thread) {
+    GST_WARNING ("failed to create decode thread: %s", error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Drops all frames that were not submitted yet, and waits for the
+   frame being decoded, if any */
+static void
+cancel_decode_queue (GstVaapiDecoder * decoder)
+{
+  GstVideoCodecFrame *frame;
+
+  if (!decoder->decode_thread)
+    return;
+
+  g_mutex_lock (&decoder->decode_lock);
+  while ((frame = g_queue_pop_head (&decoder->decode_queue)) != NULL)
+    gst_video_codec_frame_unref (frame);
+  while (decoder->decode_busy)
+    g_cond_wait (&decoder->decode_cond, &decoder->decode_lock);
+  g_queue_foreach (&decoder->failed_frames, (GFunc) failed_frame_free, NULL);
+  g_queue_clear (&decoder->failed_frames);
+  decoder->decode_stalled = FALSE;
+  g_mutex_unlock (&decoder->decode_lock);
+}
+
+static void
+stop_decode_thread (GstVaapiDecoder * decoder)
+{
+  if (!decoder->decode_thread)
+    return;
+
+  cancel_decode_queue (decoder);
+
+  g_mutex_lock (&decoder->decode_lock);
+  decoder->decode_stop = TRUE;
+  g_cond_broadcast (&decoder->decode_cond);
+  g_mutex_unlock (&decoder->decode_lock);
+
+  g_thread_join (decoder->decode_thread);
+  decoder->decode_thread = NULL;
+
+  if (decoder->pending_codec_state) {
+    gst_video_codec_state_unref (decoder->pending_codec_state);
+    decoder->pending_codec_state = NULL;
+  }
+}
+
+/* Errors of the frames decoded by the decode thread are not reported
+   here, as they do not concern @frame. The next
+   gst_vaapi_decoder_get_frame() calls that find no decoded frame return
+   the failed frames along with their status */
+static GstVaapiDecoderStatus
+queue_frame (GstVaapiDecoder * decoder, GstVideoCodecFrame * frame)
+{
+  GstVaapiDecoderStatus status = GST_VAAPI_DECODER_STATUS_SUCCESS;
+  guint num_frames;
+
+  g_mutex_lock (&decoder->decode_lock);
+  if (!ensure_decode_thread (decoder)) {
+    g_mutex_unlock (&decoder->decode_lock);
+    status = gst_vaapi_decoder_check_status (decoder);
+    if (status != GST_VAAPI_DECODER_STATUS_SUCCESS)
+      return status;
+    return do_decode (decoder, frame);
+  }
+
+  for (;;) {
+    num_frames = decoder->decode_queue.length + decoder->decode_busy;
+    if (num_frames == 0) {
+      status = check_status_unlocked (decoder);
+      if (status != GST_VAAPI_DECODER_STATUS_SUCCESS)
+        break;
+    }
+
+    /* Make sure every frame in flight will get a free surface */
+    if (num_frames == 0 ||
+        (decoder->decode_queue.length < decoder->pipeline_depth &&
+            has_free_surfaces (decoder, num_frames + 1))) {
+      g_queue_push_tail (&decoder->decode_queue,
+          gst_video_codec_frame_ref (frame));
+      g_cond_broadcast (&decoder->decode_cond);
+      break;
+    }
+
+    /* Let the caller release some surfaces */
+    if (decoder->decode_stalled) {
+      status = GST_VAAPI_DECODER_STATUS_ERROR_NO_SURFACE;
+      break;
+    }
+    g_cond_wait (&decoder->decode_cond, &decoder->decode_lock);
+  }
+  g_mutex_unlock (&decoder->decode_lock);
+
+  notify_pending_codec_state (decoder);
+  return status;
+}
+
+/**
+ * gst_vaapi_decoder_release_slice_buffers:
+ * @decoder: a #GstVaapiDecoder
+ *
+ * Destroys the VA slice buffers that @decoder keeps across pictures.
+ * This shall be called before the VA context they were created for
+ * goes away.
+ */
+void
+gst_vaapi_decoder_release_slice_buffers (GstVaapiDecoder * decoder)
+{
+  GstVaapiDecoderSliceBuffers *slice_buffers;
+  guint i;
+
+  for (i = 0; i < GST_VAAPI_DECODER_SLICE_BUFFERS; i++) {
+    slice_buffers = &decoder->slice_buffers[i];
+    vaapi_destroy_buffer (decoder->va_display, &slice_buffers->param_id);
+    vaapi_destroy_buffer (decoder->va_display, &slice_buffers->data_id);
+    slice_buffers->param_size = 0;
+    slice_buffers->max_params = 0;
+    slice_buffers->num_params = 0;
+    slice_buffers->data_size = 0;
+  }
+  decoder->slice_buffers_index = 0;
 }
 
 void
@@ -459,6 +785,10 @@ gst_vaapi_decoder_finalize (GstVaapiDecoder * decoder)
   const GstVaapiDecoderClass *const klass =
       GST_VAAPI_DECODER_GET_CLASS (decoder);
 
+  stop_decode_thread (decoder);
+  g_mutex_clear (&decoder->decode_lock);
+  g_cond_clear (&decoder->decode_cond);
+
   if (klass->destroy)
     klass->destroy (decoder);
 
@@ -467,6 +797,10 @@ gst_vaapi_decoder_finalize (GstVaapiDecoder * decoder)
 
   parser_state_finalize (&decoder->parser_state);
 
+  /* Objects still held by pending frames keep their blocks alive */
+  gst_vaapi_arena_destroy (decoder->arena);
+  decoder->arena = NULL;
+
   if (decoder->buffers) {
     g_async_queue_unref (decoder->buffers);
     decoder->buffers = NULL;
@@ -477,6 +811,7 @@ gst_vaapi_decoder_finalize (GstVaapiDecoder * decoder)
     decoder->frames = NULL;
   }
 
+  gst_vaapi_decoder_release_slice_buffers (decoder);
   gst_vaapi_object_replace (&decoder->context, NULL);
   decoder->va_context = VA_INVALID_ID;
 
@@ -491,9 +826,21 @@ gst_vaapi_decoder_init (GstVaapiDecoder * decoder, GstVaapiDisplay * display,
   const GstVaapiDecoderClass *const klass =
       GST_VAAPI_DECODER_GET_CLASS (decoder);
   GstVideoCodecState *codec_state;
-  guint sub_size;
+  guint i, sub_size;
+
+  g_mutex_init (&decoder->decode_lock);
+  g_cond_init (&decoder->decode_cond);
+  g_queue_init (&decoder->decode_queue);
+  g_queue_init (&decoder->failed_frames);
 
   parser_state_init (&decoder->parser_state);
+  decoder->arena = gst_vaapi_arena_new (ARENA_BLOCK_SIZE);
+  memset (decoder->slice_buffers, 0, sizeof (decoder->slice_buffers));
+  for (i = 0; i < GST_VAAPI_DECODER_SLICE_BUFFERS; i++) {
+    decoder->slice_buffers[i].param_id = VA_INVALID_ID;
+    decoder->slice_buffers[i].data_id = VA_INVALID_ID;
+  }
+  decoder->slice_buffers_index = 0;
 
   codec_state = g_slice_new0 (GstVideoCodecState);
   codec_state->ref_count = 1;
@@ -809,6 +1156,11 @@ gst_vaapi_decoder_get_frame (GstVaapiDecoder * decoder,
  * usage. Otherwise, @GST_VAAPI_DECODER_STATUS_ERROR_NO_DATA is
  * returned if no decoded frame is available.
  *
+ * With pipelined decoding, a frame that failed to decode is returned
+ * along with the error status, instead of
+ * @GST_VAAPI_DECODER_STATUS_ERROR_NO_DATA. The caller owns that frame
+ * too, and shall drop it as if gst_vaapi_decoder_decode() had failed.
+ *
  * The actual surface is available as a #GstVaapiSurfaceProxy attached
  * to the user-data anchor of the output frame. Ownership of the proxy
  * is transferred to the frame.
@@ -826,9 +1178,15 @@ gst_vaapi_decoder_get_frame_with_timeout (GstVaapiDecoder * decoder,
   g_return_val_if_fail (out_frame_ptr != NULL,
       GST_VAAPI_DECODER_STATUS_ERROR_INVALID_PARAMETER);
 
+  if (decoder->decode_thread) {
+    notify_pending_codec_state (decoder);
+    if (has_failed_frames (decoder))
+      timeout = 0;
+  }
+
   out_frame = pop_frame (decoder, timeout);
   if (!out_frame)
-    return GST_VAAPI_DECODER_STATUS_ERROR_NO_DATA;
+    return pop_failed_frame (decoder, out_frame_ptr);
 
   *out_frame_ptr = out_frame;
   return GST_VAAPI_DECODER_STATUS_SUCCESS;
@@ -973,16 +1331,26 @@ gst_vaapi_decoder_ensure_context (GstVaapiDecoder * decoder,
   gst_vaapi_decoder_set_picture_size (decoder, cip->width, cip->height);
 
   cip->usage = GST_VAAPI_CONTEXT_USAGE_DECODE;
+  gst_vaapi_decoder_release_slice_buffers (decoder);
+
+  /* The caller thread counts the free surfaces of the context while
+     frames are decoded in the decode thread */
+  g_mutex_lock (&decoder->decode_lock);
   if (decoder->context) {
     if (!gst_vaapi_context_reset (decoder->context, cip))
-      return FALSE;
+      goto error;
   } else {
     decoder->context = gst_vaapi_context_new (decoder->display, cip);
     if (!decoder->context)
-      return FALSE;
+      goto error;
   }
   decoder->va_context = gst_vaapi_context_get_id (decoder->context);
+  g_mutex_unlock (&decoder->decode_lock);
   return TRUE;
+
+error:
+  g_mutex_unlock (&decoder->decode_lock);
+  return FALSE;
 }
 
 void
@@ -995,10 +1363,12 @@ gst_vaapi_decoder_push_frame (GstVaapiDecoder * decoder,
 GstVaapiDecoderStatus
 gst_vaapi_decoder_check_status (GstVaapiDecoder * decoder)
 {
-  if (decoder->context &&
-      gst_vaapi_context_get_surface_count (decoder->context) < 1)
-    return GST_VAAPI_DECODER_STATUS_ERROR_NO_SURFACE;
-  return GST_VAAPI_DECODER_STATUS_SUCCESS;
+  GstVaapiDecoderStatus status;
+
+  g_mutex_lock (&decoder->decode_lock);
+  status = check_status_unlocked (decoder);
+  g_mutex_unlock (&decoder->decode_lock);
+  return status;
 }
 
 GstVaapiDecoderStatus
@@ -1033,12 +1403,99 @@ gst_vaapi_decoder_decode (GstVaapiDecoder * decoder, GstVideoCodecFrame * frame)
   g_return_val_if_fail (frame->user_data != NULL,
       GST_VAAPI_DECODER_STATUS_ERROR_INVALID_PARAMETER);
 
+  if (decoder->pipeline_depth > 0 &&
+      GST_VAAPI_DECODER_GET_CLASS (decoder)->concurrent_parse)
+    return queue_frame (decoder, frame);
+
   status = gst_vaapi_decoder_check_status (decoder);
   if (status != GST_VAAPI_DECODER_STATUS_SUCCESS)
     return status;
   return do_decode (decoder, frame);
 }
 
+/* Waits for the decode thread to complete all submitted frames */
+void
+gst_vaapi_decoder_wait_pipeline (GstVaapiDecoder * decoder)
+{
+  if (!decoder->decode_thread || is_decode_thread (decoder))
+    return;
+
+  g_mutex_lock (&decoder->decode_lock);
+  while (decoder->decode_busy || !g_queue_is_empty (&decoder->decode_queue))
+    g_cond_wait (&decoder->decode_cond, &decoder->decode_lock);
+  g_mutex_unlock (&decoder->decode_lock);
+}
+
+/**
+ * gst_vaapi_decoder_count_ref_lists:
+ * @reused: %TRUE if the reference picture lists of the previous slice
+ *   were reused
+ *
+ * Accounts for the reference picture lists of a slice.
+ */
+void
+gst_vaapi_decoder_count_ref_lists (gboolean reused)
+{
+  if (reused)
+    g_atomic_int_inc (&g_ref_list_stats.num_hits);
+  else
+    g_atomic_int_inc (&g_ref_list_stats.num_builds);
+}
+
+/**
+ * gst_vaapi_decoder_get_ref_list_stats:
+ * @stats: (out): return location for the reference list counters
+ *
+ * Retrieves the reference picture list construction counters.
+ */
+void
+gst_vaapi_decoder_get_ref_list_stats (GstVaapiDecoderRefListStats * stats)
+{
+  g_return_if_fail (stats != NULL);
+
+  stats->num_builds = g_atomic_int_get (&g_ref_list_stats.num_builds);
+  stats->num_hits = g_atomic_int_get (&g_ref_list_stats.num_hits);
+}
+
+/**
+ * gst_vaapi_decoder_sync:
+ * @decoder: a #GstVaapiDecoder
+ *
+ * Waits for all the frames submitted through gst_vaapi_decoder_decode()
+ * to be decoded. This is only useful if a pipeline depth was set with
+ * gst_vaapi_decoder_set_pipeline_depth(), as decoding is otherwise
+ * complete when gst_vaapi_decoder_decode() returns.
+ *
+ * The frames that failed to decode are then returned by
+ * gst_vaapi_decoder_get_frame(), along with their error status.
+ *
+ * Return value: the status of the oldest frame that failed to decode
+ *   and was not returned yet, or %GST_VAAPI_DECODER_STATUS_SUCCESS
+ */
+GstVaapiDecoderStatus
+gst_vaapi_decoder_sync (GstVaapiDecoder * decoder)
+{
+  GstVaapiDecoderStatus status = GST_VAAPI_DECODER_STATUS_SUCCESS;
+  FailedFrame *failed;
+
+  g_return_val_if_fail (decoder != NULL,
+      GST_VAAPI_DECODER_STATUS_ERROR_INVALID_PARAMETER);
+
+  if (!decoder->decode_thread)
+    return GST_VAAPI_DECODER_STATUS_SUCCESS;
+
+  gst_vaapi_decoder_wait_pipeline (decoder);
+
+  g_mutex_lock (&decoder->decode_lock);
+  failed = g_queue_peek_head (&decoder->failed_frames);
+  if (failed)
+    status = failed->status;
+  g_mutex_unlock (&decoder->decode_lock);
+
+  notify_pending_codec_state (decoder);
+  return status;
+}
+
 /* This function really marks the end of input,
  * so that the decoder will drain out any pending
  * frames on calls to gst_vaapi_decoder_get_frame_with_timeout() */
@@ -1046,12 +1503,17 @@ GstVaapiDecoderStatus
 gst_vaapi_decoder_flush (GstVaapiDecoder * decoder)
 {
   GstVaapiDecoderClass *klass;
+  GstVaapiDecoderStatus status;
 
   g_return_val_if_fail (decoder != NULL,
       GST_VAAPI_DECODER_STATUS_ERROR_INVALID_PARAMETER);
 
   klass = GST_VAAPI_DECODER_GET_CLASS (decoder);
 
+  status = gst_vaapi_decoder_sync (decoder);
+  if (status != GST_VAAPI_DECODER_STATUS_SUCCESS)
+    GST_WARNING ("failed to decode pending frames (status %d)", status);
+
   if (klass->flush)
     return klass->flush (decoder);
 
@@ -1074,6 +1536,11 @@ gst_vaapi_decoder_reset (GstVaapiDecoder * decoder)
 
   GST_DEBUG ("Resetting decoder");
 
+  if (decoder->decode_thread) {
+    cancel_decode_queue (decoder);
+    notify_pending_codec_state (decoder);
+  }
+
   if (klass->reset) {
     ret = klass->reset (decoder);
   } else {
@@ -1149,9 +1616,22 @@ gst_vaapi_decoder_decode_codec_data (GstVaapiDecoder * decoder)
 GArray *
 gst_vaapi_decoder_get_surface_formats (GstVaapiDecoder * decoder)
 {
-  if (decoder && decoder->context)
-    return gst_vaapi_context_get_surface_formats (decoder->context);
-  return NULL;
+  GstVaapiContext *context = NULL;
+  GArray *formats;
+
+  if (!decoder)
+    return NULL;
+
+  /* Keep a reference, as the decode thread may replace the context */
+  g_mutex_lock (&decoder->decode_lock);
+  gst_vaapi_object_replace (&context, decoder->context);
+  g_mutex_unlock (&decoder->decode_lock);
+  if (!context)
+    return NULL;
+
+  formats = gst_vaapi_context_get_surface_formats (context);
+  gst_vaapi_object_unref (context);
+  return formats;
 }
 
 /**
@@ -1178,6 +1658,8 @@ gst_vaapi_decoder_update_caps (GstVaapiDecoder * decoder, GstCaps * caps)
   g_return_val_if_fail (decoder != NULL, FALSE);
   g_return_val_if_fail (caps != NULL, FALSE);
 
+  gst_vaapi_decoder_wait_pipeline (decoder);
+
   decoder_caps = get_caps (decoder);
   if (!decoder_caps)
     return FALSE;
@@ -1201,3 +1683,50 @@ gst_vaapi_decoder_update_caps (GstVaapiDecoder * decoder, GstCaps * caps)
 
   return FALSE;
 }
+
+/**
+ * gst_vaapi_decoder_set_pipeline_depth:
+ * @decoder: a #GstVaapiDecoder
+ * @depth: the maximum number of frames waiting to be decoded
+ *
+ * Enables pipelined decoding if @depth is not zero. In that mode,
+ * gst_vaapi_decoder_decode() only queues the frame, and the frames
+ * are submitted to the hardware from a dedicated thread. This allows
+ * the next frames to be parsed while the previous ones are decoded.
+ * The caller shall use gst_vaapi_decoder_sync() to wait for all the
+ * queued frames to be decoded.
+ *
+ * This is only supported by decoders that can parse a frame while
+ * another one is being decoded; other decoders ignore @depth.
+ */
+void
+gst_vaapi_decoder_set_pipeline_depth (GstVaapiDecoder * decoder, guint depth)
+{
+  GstVaapiDecoderStatus status;
+
+  g_return_if_fail (decoder != NULL);
+
+  status = gst_vaapi_decoder_sync (decoder);
+  if (status != GST_VAAPI_DECODER_STATUS_SUCCESS)
+    GST_WARNING ("failed to decode pending frames (status %d)", status);
+
+  GST_DEBUG ("pipeline depth set to %u", depth);
+  decoder->pipeline_depth = depth;
+}
+
+/**
+ * gst_vaapi_decoder_get_pipeline_depth:
+ * @decoder: a #GstVaapiDecoder
+ *
+ * Retrieves the maximum number of frames waiting to be decoded, as
+ * set with gst_vaapi_decoder_set_pipeline_depth().
+ *
+ * Return value: the pipeline depth, or zero if pipelining is disabled
+ */
+guint
+gst_vaapi_decoder_get_pipeline_depth (GstVaapiDecoder * decoder)
+{
+  g_return_val_if_fail (decoder != NULL, 0);
+
+  return decoder->pipeline_depth;
+}
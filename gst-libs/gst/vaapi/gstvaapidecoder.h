@@ -129,6 +129,9 @@ GstVaapiDecoderStatus
 gst_vaapi_decoder_decode (GstVaapiDecoder * decoder,
     GstVideoCodecFrame * frame);
 
+GstVaapiDecoderStatus
+gst_vaapi_decoder_sync (GstVaapiDecoder * decoder);
+
 GstVaapiDecoderStatus
 gst_vaapi_decoder_flush (GstVaapiDecoder * decoder);
 
@@ -141,6 +144,12 @@ gst_vaapi_decoder_check_status (GstVaapiDecoder * decoder);
 gboolean
 gst_vaapi_decoder_update_caps (GstVaapiDecoder * decoder, GstCaps * caps);
 
+void
+gst_vaapi_decoder_set_pipeline_depth (GstVaapiDecoder * decoder, guint depth);
+
+guint
+gst_vaapi_decoder_get_pipeline_depth (GstVaapiDecoder * decoder);
+
 G_END_DECLS
 
 #endif /* GST_VAAPI_DECODER_H */
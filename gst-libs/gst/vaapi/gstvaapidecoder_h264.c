@@ -35,6 +35,8 @@
 #include "gstvaapidisplay_priv.h"
 #include "gstvaapiobject_priv.h"
 #include "gstvaapiutils_h264_priv.h"
+#include "gstvaapiutils_h264_refs.h"
+#include "gstvaapiutils_startcode.h"
 
 #define DEBUG 1
 #include "gstvaapidebug.h"
@@ -131,10 +133,11 @@ gst_vaapi_parser_info_h264_class (void)
 }
 
 static inline GstVaapiParserInfoH264 *
-gst_vaapi_parser_info_h264_new (void)
+gst_vaapi_parser_info_h264_new (GstVaapiArena * arena)
 {
   return (GstVaapiParserInfoH264 *)
-      gst_vaapi_mini_object_new (gst_vaapi_parser_info_h264_class ());
+      gst_vaapi_mini_object_new_with_arena (gst_vaapi_parser_info_h264_class
+      (), arena);
 }
 
 #define gst_vaapi_parser_info_h264_ref(pi) \
@@ -476,6 +479,20 @@ typedef enum
       GST_H264_VIDEO_STATE_GOT_SLICE)
 } GstH264VideoState;
 
+/* Maximum number of ref_pic_list_modification() operations per list */
+#define MAX_REF_LIST_MODIFICATIONS 33
+
+/* The slice header syntax elements that the reference picture lists of
+   a slice derive from, besides the DPB state of the current picture */
+typedef struct
+{
+  guint8 slice_type;
+  guint8 num_ref_idx_active_minus1[2];
+  guint8 num_modifications[2];
+  guint8 modification_idc[2][MAX_REF_LIST_MODIFICATIONS];
+  guint32 modification_value[2][MAX_REF_LIST_MODIFICATIONS];
+} GstVaapiRefListKeyH264;
+
 struct _GstVaapiDecoderH264Private
 {
   GstH264NalParser *parser;
@@ -502,14 +519,14 @@ struct _GstVaapiDecoderH264Private
   GstVaapiEntrypoint entrypoint;
   GstVaapiChromaType chroma_type;
   GPtrArray *inter_views;
-  GstVaapiPictureH264 *short_ref[32];
-  guint short_ref_count;
-  GstVaapiPictureH264 *long_ref[32];
-  guint long_ref_count;
+  GstVaapiH264RefSet short_ref;
+  GstVaapiH264RefSet long_ref;
   GstVaapiPictureH264 *RefPicList0[32];
   guint RefPicList0_count;
   GstVaapiPictureH264 *RefPicList1[32];
   guint RefPicList1_count;
+  GstVaapiRefListKeyH264 ref_list_key;  // slice that RefPicListX was built for
+  gboolean ref_list_valid;
   guint nal_length_size;
   guint mb_width;
   guint mb_height;
@@ -675,46 +692,6 @@ get_max_dec_frame_buffering (GstH264SPS * sps)
   return MAX (1, max_dec_frame_buffering);
 }
 
-static void
-array_remove_index_fast (void *array, guint * array_length_ptr, guint index)
-{
-  gpointer *const entries = array;
-  guint num_entries = *array_length_ptr;
-
-  g_return_if_fail (index < num_entries);
-
-  if (index != --num_entries)
-    entries[index] = entries[num_entries];
-  entries[num_entries] = NULL;
-  *array_length_ptr = num_entries;
-}
-
-#if 1
-static inline void
-array_remove_index (void *array, guint * array_length_ptr, guint index)
-{
-  array_remove_index_fast (array, array_length_ptr, index);
-}
-#else
-static void
-array_remove_index (void *array, guint * array_length_ptr, guint index)
-{
-  gpointer *const entries = array;
-  const guint num_entries = *array_length_ptr - 1;
-  guint i;
-
-  g_return_if_fail (index <= num_entries);
-
-  for (i = index; i < num_entries; i++)
-    entries[i] = entries[i + 1];
-  entries[num_entries] = NULL;
-  *array_length_ptr = num_entries;
-}
-#endif
-
-#define ARRAY_REMOVE_INDEX(array, index) \
-    array_remove_index(array, &array##_count, index)
-
 static void
 dpb_remove_index (GstVaapiDecoderH264 * decoder, guint index)
 {
@@ -1758,6 +1735,10 @@ parse_sps (GstVaapiDecoderH264 * decoder, GstVaapiDecoderUnit * unit)
 
   GST_DEBUG ("parse SPS");
 
+  /* Slices of the frames still being decoded point to the SPS and PPS
+     tables of the parser, so these must not be updated underneath */
+  gst_vaapi_decoder_wait_pipeline (GST_VAAPI_DECODER_CAST (decoder));
+
   priv->parser_state = 0;
 
   /* Variables that don't have inferred values per the H.264
@@ -1782,6 +1763,8 @@ parse_subset_sps (GstVaapiDecoderH264 * decoder, GstVaapiDecoderUnit * unit)
 
   GST_DEBUG ("parse subset SPS");
 
+  gst_vaapi_decoder_wait_pipeline (GST_VAAPI_DECODER_CAST (decoder));
+
   /* Variables that don't have inferred values per the H.264
      standard but that should get a default value anyway */
   sps->log2_max_pic_order_cnt_lsb_minus4 = 0;
@@ -1805,6 +1788,8 @@ parse_pps (GstVaapiDecoderH264 * decoder, GstVaapiDecoderUnit * unit)
 
   GST_DEBUG ("parse PPS");
 
+  gst_vaapi_decoder_wait_pipeline (GST_VAAPI_DECODER_CAST (decoder));
+
   /* Variables that don't have inferred values per the H.264
      standard but that should get a default value anyway */
   pps->slice_group_map_type = 0;
@@ -2197,74 +2182,22 @@ init_picture_poc (GstVaapiDecoderH264 * decoder,
   picture->base.poc = MIN (picture->field_poc[0], picture->field_poc[1]);
 }
 
-static int
-compare_picture_pic_num_dec (const void *a, const void *b)
-{
-  const GstVaapiPictureH264 *const picA = *(GstVaapiPictureH264 **) a;
-  const GstVaapiPictureH264 *const picB = *(GstVaapiPictureH264 **) b;
-
-  return picB->pic_num - picA->pic_num;
-}
-
-static int
-compare_picture_long_term_pic_num_inc (const void *a, const void *b)
-{
-  const GstVaapiPictureH264 *const picA = *(GstVaapiPictureH264 **) a;
-  const GstVaapiPictureH264 *const picB = *(GstVaapiPictureH264 **) b;
-
-  return picA->long_term_pic_num - picB->long_term_pic_num;
-}
-
-static int
-compare_picture_poc_dec (const void *a, const void *b)
-{
-  const GstVaapiPictureH264 *const picA = *(GstVaapiPictureH264 **) a;
-  const GstVaapiPictureH264 *const picB = *(GstVaapiPictureH264 **) b;
-
-  return picB->base.poc - picA->base.poc;
-}
-
-static int
-compare_picture_poc_inc (const void *a, const void *b)
-{
-  const GstVaapiPictureH264 *const picA = *(GstVaapiPictureH264 **) a;
-  const GstVaapiPictureH264 *const picB = *(GstVaapiPictureH264 **) b;
-
-  return picA->base.poc - picB->base.poc;
-}
-
-static int
-compare_picture_frame_num_wrap_dec (const void *a, const void *b)
-{
-  const GstVaapiPictureH264 *const picA = *(GstVaapiPictureH264 **) a;
-  const GstVaapiPictureH264 *const picB = *(GstVaapiPictureH264 **) b;
-
-  return picB->frame_num_wrap - picA->frame_num_wrap;
-}
-
-static int
-compare_picture_long_term_frame_idx_inc (const void *a, const void *b)
-{
-  const GstVaapiPictureH264 *const picA = *(GstVaapiPictureH264 **) a;
-  const GstVaapiPictureH264 *const picB = *(GstVaapiPictureH264 **) b;
-
-  return picA->long_term_frame_idx - picB->long_term_frame_idx;
-}
-
 /* 8.2.4.1 - Decoding process for picture numbers */
 static void
 init_picture_refs_pic_num (GstVaapiDecoderH264 * decoder,
     GstVaapiPictureH264 * picture, GstH264SliceHdr * slice_hdr)
 {
   GstVaapiDecoderH264Private *const priv = &decoder->priv;
+  GstVaapiH264RefSet *const short_ref = &priv->short_ref;
+  GstVaapiH264RefSet *const long_ref = &priv->long_ref;
   GstH264SPS *const sps = get_sps (decoder);
   const gint32 MaxFrameNum = 1 << (sps->log2_max_frame_num_minus4 + 4);
   guint i;
 
   GST_DEBUG ("decode picture numbers");
 
-  for (i = 0; i < priv->short_ref_count; i++) {
-    GstVaapiPictureH264 *const pic = priv->short_ref[i];
+  for (i = 0; i < short_ref->count; i++) {
+    GstVaapiPictureH264 *const pic = short_ref->pictures[i];
 
     // (H.8.2)
     if (pic->base.view_id != picture->base.view_id)
@@ -2285,10 +2218,12 @@ init_picture_refs_pic_num (GstVaapiDecoderH264 * decoder,
       else
         pic->pic_num = 2 * pic->frame_num_wrap;
     }
+    short_ref->frame_idx[i] = pic->frame_num_wrap;
+    short_ref->pic_num[i] = pic->pic_num;
   }
 
-  for (i = 0; i < priv->long_ref_count; i++) {
-    GstVaapiPictureH264 *const pic = priv->long_ref[i];
+  for (i = 0; i < long_ref->count; i++) {
+    GstVaapiPictureH264 *const pic = long_ref->pictures[i];
 
     // (H.8.2)
     if (pic->base.view_id != picture->base.view_id)
@@ -2303,57 +2238,45 @@ init_picture_refs_pic_num (GstVaapiDecoderH264 * decoder,
       else
         pic->long_term_pic_num = 2 * pic->long_term_frame_idx;
     }
+    long_ref->frame_idx[i] = pic->long_term_frame_idx;
+    long_ref->pic_num[i] = pic->long_term_pic_num;
   }
 }
 
-#define SORT_REF_LIST(list, n, compare_func) \
-    qsort(list, n, sizeof(*(list)), compare_picture_##compare_func)
-
-static void
-init_picture_refs_fields_1 (guint picture_structure,
-    GstVaapiPictureH264 * RefPicList[32],
-    guint * RefPicList_count,
-    GstVaapiPictureH264 * ref_list[32], guint ref_list_count)
+/* Appends the reference pictures from @set, sorted by @keys */
+static guint
+append_ref_list (GstVaapiPictureH264 ** ref_list, GstVaapiH264RefSet * set,
+    const gint32 * keys, gboolean descending)
 {
-  guint i, j, n;
+  guint8 order[GST_VAAPI_H264_MAX_REFS];
+  guint n;
 
-  i = 0;
-  j = 0;
-  n = *RefPicList_count;
-  do {
-    g_assert (n < 32);
-    for (; i < ref_list_count; i++) {
-      if (ref_list[i]->structure == picture_structure) {
-        RefPicList[n++] = ref_list[i++];
-        break;
-      }
-    }
-    for (; j < ref_list_count; j++) {
-      if (ref_list[j]->structure != picture_structure) {
-        RefPicList[n++] = ref_list[j++];
-        break;
-      }
-    }
-  } while (i < ref_list_count || j < ref_list_count);
-  *RefPicList_count = n;
+  n = gst_vaapi_h264_ref_set_sort (set, keys, descending, order);
+  return gst_vaapi_h264_ref_set_append (set, order, n, (gpointer *) ref_list);
 }
 
-static inline void
-init_picture_refs_fields (GstVaapiPictureH264 * picture,
-    GstVaapiPictureH264 * RefPicList[32],
-    guint * RefPicList_count,
-    GstVaapiPictureH264 * short_ref[32],
-    guint short_ref_count,
-    GstVaapiPictureH264 * long_ref[32], guint long_ref_count)
+/* Appends the reference pictures from @set, sorted by distance to @poc */
+static guint
+append_ref_list_by_poc (GstVaapiPictureH264 ** ref_list,
+    GstVaapiH264RefSet * set, gint32 poc, gboolean inclusive,
+    gboolean past_first)
 {
-  guint n = 0;
+  guint8 order[GST_VAAPI_H264_MAX_REFS];
+  guint n;
+
+  n = gst_vaapi_h264_ref_set_sort_by_poc (set, poc, inclusive, past_first,
+      order);
+  return gst_vaapi_h264_ref_set_append (set, order, n, (gpointer *) ref_list);
+}
 
-  /* 8.2.4.2.5 - reference picture lists in fields */
-  init_picture_refs_fields_1 (picture->structure, RefPicList, &n,
-      short_ref, short_ref_count);
-  init_picture_refs_fields_1 (picture->structure, RefPicList, &n,
-      long_ref, long_ref_count);
-  *RefPicList_count = n;
+/* 8.2.4.2.5 - reference picture lists in fields */
+static guint
+append_ref_list_fields (GstVaapiPictureH264 ** ref_list,
+    GstVaapiPictureH264 * picture, GstVaapiH264RefSet * set,
+    const guint8 * order, guint n)
+{
+  return gst_vaapi_h264_ref_set_append_fields (set, order, n,
+      picture->structure, (gpointer *) ref_list);
 }
 
 /* Finds the inter-view reference picture with the supplied view id */
@@ -2505,52 +2428,34 @@ init_picture_refs_p_slice (GstVaapiDecoderH264 * decoder,
     GstVaapiPictureH264 * picture, GstH264SliceHdr * slice_hdr)
 {
   GstVaapiDecoderH264Private *const priv = &decoder->priv;
-  GstVaapiPictureH264 **ref_list;
-  guint i;
+  GstVaapiH264RefSet *const short_ref = &priv->short_ref;
+  GstVaapiH264RefSet *const long_ref = &priv->long_ref;
+  guint8 order[GST_VAAPI_H264_MAX_REFS];
+  guint n;
 
   GST_DEBUG ("decode reference picture list for P and SP slices");
 
   if (GST_VAAPI_PICTURE_IS_FRAME (picture)) {
     /* 8.2.4.2.1 - P and SP slices in frames */
-    if (priv->short_ref_count > 0) {
-      ref_list = priv->RefPicList0;
-      for (i = 0; i < priv->short_ref_count; i++)
-        ref_list[i] = priv->short_ref[i];
-      SORT_REF_LIST (ref_list, i, pic_num_dec);
-      priv->RefPicList0_count += i;
-    }
-
-    if (priv->long_ref_count > 0) {
-      ref_list = &priv->RefPicList0[priv->RefPicList0_count];
-      for (i = 0; i < priv->long_ref_count; i++)
-        ref_list[i] = priv->long_ref[i];
-      SORT_REF_LIST (ref_list, i, long_term_pic_num_inc);
-      priv->RefPicList0_count += i;
-    }
+    priv->RefPicList0_count +=
+        append_ref_list (&priv->RefPicList0[priv->RefPicList0_count],
+        short_ref, short_ref->pic_num, TRUE);
+    priv->RefPicList0_count +=
+        append_ref_list (&priv->RefPicList0[priv->RefPicList0_count],
+        long_ref, long_ref->pic_num, FALSE);
   } else {
     /* 8.2.4.2.2 - P and SP slices in fields */
-    GstVaapiPictureH264 *short_ref[32];
-    guint short_ref_count = 0;
-    GstVaapiPictureH264 *long_ref[32];
-    guint long_ref_count = 0;
-
-    if (priv->short_ref_count > 0) {
-      for (i = 0; i < priv->short_ref_count; i++)
-        short_ref[i] = priv->short_ref[i];
-      SORT_REF_LIST (short_ref, i, frame_num_wrap_dec);
-      short_ref_count = i;
-    }
+    n = gst_vaapi_h264_ref_set_sort (short_ref, short_ref->frame_idx, TRUE,
+        order);
+    priv->RefPicList0_count +=
+        append_ref_list_fields (&priv->RefPicList0[priv->RefPicList0_count],
+        picture, short_ref, order, n);
 
-    if (priv->long_ref_count > 0) {
-      for (i = 0; i < priv->long_ref_count; i++)
-        long_ref[i] = priv->long_ref[i];
-      SORT_REF_LIST (long_ref, i, long_term_frame_idx_inc);
-      long_ref_count = i;
-    }
-
-    init_picture_refs_fields (picture,
-        priv->RefPicList0, &priv->RefPicList0_count,
-        short_ref, short_ref_count, long_ref, long_ref_count);
+    n = gst_vaapi_h264_ref_set_sort (long_ref, long_ref->frame_idx, FALSE,
+        order);
+    priv->RefPicList0_count +=
+        append_ref_list_fields (&priv->RefPicList0[priv->RefPicList0_count],
+        picture, long_ref, order, n);
   }
 
   if (GST_VAAPI_PICTURE_IS_MVC (picture)) {
@@ -2564,133 +2469,63 @@ init_picture_refs_b_slice (GstVaapiDecoderH264 * decoder,
     GstVaapiPictureH264 * picture, GstH264SliceHdr * slice_hdr)
 {
   GstVaapiDecoderH264Private *const priv = &decoder->priv;
-  GstVaapiPictureH264 **ref_list;
-  guint i, n;
+  GstVaapiH264RefSet *const short_ref = &priv->short_ref;
+  GstVaapiH264RefSet *const long_ref = &priv->long_ref;
+  guint8 order[GST_VAAPI_H264_MAX_REFS];
+  guint n;
 
   GST_DEBUG ("decode reference picture list for B slices");
 
   if (GST_VAAPI_PICTURE_IS_FRAME (picture)) {
     /* 8.2.4.2.3 - B slices in frames */
 
-    /* RefPicList0 */
-    if (priv->short_ref_count > 0) {
-      // 1. Short-term references
-      ref_list = priv->RefPicList0;
-      for (n = 0, i = 0; i < priv->short_ref_count; i++) {
-        if (priv->short_ref[i]->base.poc < picture->base.poc)
-          ref_list[n++] = priv->short_ref[i];
-      }
-      SORT_REF_LIST (ref_list, n, poc_dec);
-      priv->RefPicList0_count += n;
-
-      ref_list = &priv->RefPicList0[priv->RefPicList0_count];
-      for (n = 0, i = 0; i < priv->short_ref_count; i++) {
-        if (priv->short_ref[i]->base.poc >= picture->base.poc)
-          ref_list[n++] = priv->short_ref[i];
-      }
-      SORT_REF_LIST (ref_list, n, poc_inc);
-      priv->RefPicList0_count += n;
-    }
-
-    if (priv->long_ref_count > 0) {
-      // 2. Long-term references
-      ref_list = &priv->RefPicList0[priv->RefPicList0_count];
-      for (n = 0, i = 0; i < priv->long_ref_count; i++)
-        ref_list[n++] = priv->long_ref[i];
-      SORT_REF_LIST (ref_list, n, long_term_pic_num_inc);
-      priv->RefPicList0_count += n;
-    }
-
-    /* RefPicList1 */
-    if (priv->short_ref_count > 0) {
-      // 1. Short-term references
-      ref_list = priv->RefPicList1;
-      for (n = 0, i = 0; i < priv->short_ref_count; i++) {
-        if (priv->short_ref[i]->base.poc > picture->base.poc)
-          ref_list[n++] = priv->short_ref[i];
-      }
-      SORT_REF_LIST (ref_list, n, poc_inc);
-      priv->RefPicList1_count += n;
-
-      ref_list = &priv->RefPicList1[priv->RefPicList1_count];
-      for (n = 0, i = 0; i < priv->short_ref_count; i++) {
-        if (priv->short_ref[i]->base.poc <= picture->base.poc)
-          ref_list[n++] = priv->short_ref[i];
-      }
-      SORT_REF_LIST (ref_list, n, poc_dec);
-      priv->RefPicList1_count += n;
-    }
-
-    if (priv->long_ref_count > 0) {
-      // 2. Long-term references
-      ref_list = &priv->RefPicList1[priv->RefPicList1_count];
-      for (n = 0, i = 0; i < priv->long_ref_count; i++)
-        ref_list[n++] = priv->long_ref[i];
-      SORT_REF_LIST (ref_list, n, long_term_pic_num_inc);
-      priv->RefPicList1_count += n;
-    }
+    /* RefPicList0: short-term references with POC < current, by
+       decreasing POC, then the other ones by increasing POC, and
+       finally long-term references */
+    priv->RefPicList0_count +=
+        append_ref_list_by_poc (&priv->RefPicList0[priv->RefPicList0_count],
+        short_ref, picture->base.poc, FALSE, TRUE);
+    priv->RefPicList0_count +=
+        append_ref_list (&priv->RefPicList0[priv->RefPicList0_count],
+        long_ref, long_ref->pic_num, FALSE);
+
+    /* RefPicList1: short-term references with POC > current, by
+       increasing POC, then the other ones by decreasing POC, and
+       finally long-term references */
+    priv->RefPicList1_count +=
+        append_ref_list_by_poc (&priv->RefPicList1[priv->RefPicList1_count],
+        short_ref, picture->base.poc, TRUE, FALSE);
+    priv->RefPicList1_count +=
+        append_ref_list (&priv->RefPicList1[priv->RefPicList1_count],
+        long_ref, long_ref->pic_num, FALSE);
   } else {
     /* 8.2.4.2.4 - B slices in fields */
-    GstVaapiPictureH264 *short_ref0[32];
-    guint short_ref0_count = 0;
-    GstVaapiPictureH264 *short_ref1[32];
-    guint short_ref1_count = 0;
-    GstVaapiPictureH264 *long_ref[32];
-    guint long_ref_count = 0;
-
-    /* refFrameList0ShortTerm */
-    if (priv->short_ref_count > 0) {
-      ref_list = short_ref0;
-      for (n = 0, i = 0; i < priv->short_ref_count; i++) {
-        if (priv->short_ref[i]->base.poc <= picture->base.poc)
-          ref_list[n++] = priv->short_ref[i];
-      }
-      SORT_REF_LIST (ref_list, n, poc_dec);
-      short_ref0_count += n;
-
-      ref_list = &short_ref0[short_ref0_count];
-      for (n = 0, i = 0; i < priv->short_ref_count; i++) {
-        if (priv->short_ref[i]->base.poc > picture->base.poc)
-          ref_list[n++] = priv->short_ref[i];
-      }
-      SORT_REF_LIST (ref_list, n, poc_inc);
-      short_ref0_count += n;
-    }
-
-    /* refFrameList1ShortTerm */
-    if (priv->short_ref_count > 0) {
-      ref_list = short_ref1;
-      for (n = 0, i = 0; i < priv->short_ref_count; i++) {
-        if (priv->short_ref[i]->base.poc > picture->base.poc)
-          ref_list[n++] = priv->short_ref[i];
-      }
-      SORT_REF_LIST (ref_list, n, poc_inc);
-      short_ref1_count += n;
-
-      ref_list = &short_ref1[short_ref1_count];
-      for (n = 0, i = 0; i < priv->short_ref_count; i++) {
-        if (priv->short_ref[i]->base.poc <= picture->base.poc)
-          ref_list[n++] = priv->short_ref[i];
-      }
-      SORT_REF_LIST (ref_list, n, poc_dec);
-      short_ref1_count += n;
-    }
+    guint8 long_order[GST_VAAPI_H264_MAX_REFS];
+    guint long_n;
 
     /* refFrameListLongTerm */
-    if (priv->long_ref_count > 0) {
-      for (i = 0; i < priv->long_ref_count; i++)
-        long_ref[i] = priv->long_ref[i];
-      SORT_REF_LIST (long_ref, i, long_term_frame_idx_inc);
-      long_ref_count = i;
-    }
+    long_n = gst_vaapi_h264_ref_set_sort (long_ref, long_ref->frame_idx,
+        FALSE, long_order);
 
-    init_picture_refs_fields (picture,
-        priv->RefPicList0, &priv->RefPicList0_count,
-        short_ref0, short_ref0_count, long_ref, long_ref_count);
+    /* refFrameList0ShortTerm */
+    n = gst_vaapi_h264_ref_set_sort_by_poc (short_ref, picture->base.poc,
+        TRUE, TRUE, order);
+    priv->RefPicList0_count +=
+        append_ref_list_fields (&priv->RefPicList0[priv->RefPicList0_count],
+        picture, short_ref, order, n);
+    priv->RefPicList0_count +=
+        append_ref_list_fields (&priv->RefPicList0[priv->RefPicList0_count],
+        picture, long_ref, long_order, long_n);
 
-    init_picture_refs_fields (picture,
-        priv->RefPicList1, &priv->RefPicList1_count,
-        short_ref1, short_ref1_count, long_ref, long_ref_count);
+    /* refFrameList1ShortTerm */
+    n = gst_vaapi_h264_ref_set_sort_by_poc (short_ref, picture->base.poc,
+        TRUE, FALSE, order);
+    priv->RefPicList1_count +=
+        append_ref_list_fields (&priv->RefPicList1[priv->RefPicList1_count],
+        picture, short_ref, order, n);
+    priv->RefPicList1_count +=
+        append_ref_list_fields (&priv->RefPicList1[priv->RefPicList1_count],
+        picture, long_ref, long_order, long_n);
   }
 
   /* Check whether RefPicList1 is identical to RefPicList0, then
@@ -2713,35 +2548,49 @@ init_picture_refs_b_slice (GstVaapiDecoderH264 * decoder,
   }
 }
 
-#undef SORT_REF_LIST
-
 static gint
 find_short_term_reference (GstVaapiDecoderH264 * decoder, gint32 pic_num)
 {
   GstVaapiDecoderH264Private *const priv = &decoder->priv;
-  guint i;
+  gint i;
 
-  for (i = 0; i < priv->short_ref_count; i++) {
-    if (priv->short_ref[i]->pic_num == pic_num)
-      return i;
-  }
-  GST_ERROR ("found no short-term reference picture with PicNum = %d", pic_num);
-  return -1;
+  i = gst_vaapi_h264_ref_set_find (&priv->short_ref, priv->short_ref.pic_num,
+      pic_num);
+  if (i < 0)
+    GST_ERROR ("found no short-term reference picture with PicNum = %d",
+        pic_num);
+  return i;
 }
 
 static gint
 find_long_term_reference (GstVaapiDecoderH264 * decoder,
     gint32 long_term_pic_num)
+{
+  GstVaapiDecoderH264Private *const priv = &decoder->priv;
+  gint i;
+
+  i = gst_vaapi_h264_ref_set_find (&priv->long_ref, priv->long_ref.pic_num,
+      long_term_pic_num);
+  if (i < 0)
+    GST_ERROR ("found no long-term reference picture with LongTermPicNum = %d",
+        long_term_pic_num);
+  return i;
+}
+
+/* LongTermFrameIdx is also assigned to the other field of long-term
+   reference pictures, so look it up from the pictures themselves */
+static gint
+find_long_term_frame_idx (GstVaapiDecoderH264 * decoder,
+    gint32 long_term_frame_idx)
 {
   GstVaapiDecoderH264Private *const priv = &decoder->priv;
   guint i;
 
-  for (i = 0; i < priv->long_ref_count; i++) {
-    if (priv->long_ref[i]->long_term_pic_num == long_term_pic_num)
+  for (i = 0; i < priv->long_ref.count; i++) {
+    GstVaapiPictureH264 *const pic = priv->long_ref.pictures[i];
+    if (pic->long_term_frame_idx == long_term_frame_idx)
       return i;
   }
-  GST_ERROR ("found no long-term reference picture with LongTermPicNum = %d",
-      long_term_pic_num);
   return -1;
 }
 
@@ -2848,7 +2697,7 @@ exec_picture_refs_modification_1 (GstVaapiDecoderH264 * decoder,
         ref_list[j] = ref_list[j - 1];
       found_ref_idx = find_short_term_reference (decoder, picNum);
       ref_list[ref_list_idx++] =
-          found_ref_idx >= 0 ? priv->short_ref[found_ref_idx] : NULL;
+          found_ref_idx >= 0 ? priv->short_ref.pictures[found_ref_idx] : NULL;
       n = ref_list_idx;
       for (j = ref_list_idx; j <= num_refs; j++) {
         gint32 PicNumF;
@@ -2871,7 +2720,7 @@ exec_picture_refs_modification_1 (GstVaapiDecoderH264 * decoder,
       found_ref_idx =
           find_long_term_reference (decoder, l->value.long_term_pic_num);
       ref_list[ref_list_idx++] =
-          found_ref_idx >= 0 ? priv->long_ref[found_ref_idx] : NULL;
+          found_ref_idx >= 0 ? priv->long_ref.pictures[found_ref_idx] : NULL;
       n = ref_list_idx;
       for (j = ref_list_idx; j <= num_refs; j++) {
         gint32 LongTermPicNumF;
@@ -2984,15 +2833,29 @@ mark_picture_refs (GstVaapiDecoderH264 * decoder, GstVaapiPictureH264 * picture)
     GST_VAAPI_PICTURE_FLAG_SET (picture, GST_VAAPI_PICTURE_FLAG_CORRUPTED);
 }
 
+/* Adds the picture to the short-term or long-term reference set */
+static void
+add_ref_picture (GstVaapiDecoderH264 * decoder, GstVaapiPictureH264 * pic)
+{
+  GstVaapiDecoderH264Private *const priv = &decoder->priv;
+
+  if (GST_VAAPI_PICTURE_IS_SHORT_TERM_REFERENCE (pic))
+    gst_vaapi_h264_ref_set_add (&priv->short_ref, pic, pic->base.poc,
+        pic->frame_num_wrap, pic->pic_num, pic->structure);
+  else if (GST_VAAPI_PICTURE_IS_LONG_TERM_REFERENCE (pic))
+    gst_vaapi_h264_ref_set_add (&priv->long_ref, pic, pic->base.poc,
+        pic->long_term_frame_idx, pic->long_term_pic_num, pic->structure);
+}
+
 static void
 init_picture_ref_lists (GstVaapiDecoderH264 * decoder,
     GstVaapiPictureH264 * picture)
 {
   GstVaapiDecoderH264Private *const priv = &decoder->priv;
-  guint i, j, short_ref_count, long_ref_count;
+  guint i, j;
 
-  short_ref_count = 0;
-  long_ref_count = 0;
+  gst_vaapi_h264_ref_set_clear (&priv->short_ref);
+  gst_vaapi_h264_ref_set_clear (&priv->long_ref);
   if (GST_VAAPI_PICTURE_IS_FRAME (picture)) {
     for (i = 0; i < priv->dpb_count; i++) {
       GstVaapiFrameStore *const fs = priv->dpb[i];
@@ -3002,12 +2865,9 @@ init_picture_ref_lists (GstVaapiDecoderH264 * decoder,
       pic = fs->buffers[0];
       if (pic->base.view_id != picture->base.view_id)
         continue;
-      if (GST_VAAPI_PICTURE_IS_SHORT_TERM_REFERENCE (pic))
-        priv->short_ref[short_ref_count++] = pic;
-      else if (GST_VAAPI_PICTURE_IS_LONG_TERM_REFERENCE (pic))
-        priv->long_ref[long_ref_count++] = pic;
       pic->structure = GST_VAAPI_PICTURE_STRUCTURE_FRAME;
       pic->other_field = fs->buffers[1];
+      add_ref_picture (decoder, pic);
     }
   } else {
     for (i = 0; i < priv->dpb_count; i++) {
@@ -3016,23 +2876,73 @@ init_picture_ref_lists (GstVaapiDecoderH264 * decoder,
         GstVaapiPictureH264 *const pic = fs->buffers[j];
         if (pic->base.view_id != picture->base.view_id)
           continue;
-        if (GST_VAAPI_PICTURE_IS_SHORT_TERM_REFERENCE (pic))
-          priv->short_ref[short_ref_count++] = pic;
-        else if (GST_VAAPI_PICTURE_IS_LONG_TERM_REFERENCE (pic))
-          priv->long_ref[long_ref_count++] = pic;
         pic->structure = pic->base.structure;
         pic->other_field = fs->buffers[j ^ 1];
+        add_ref_picture (decoder, pic);
       }
     }
   }
+}
 
-  for (i = short_ref_count; i < priv->short_ref_count; i++)
-    priv->short_ref[i] = NULL;
-  priv->short_ref_count = short_ref_count;
+static gboolean
+ref_list_key_init_list (GstVaapiRefListKeyH264 * key, guint list,
+    guint8 modification_flag, const GstH264RefPicListModification * mods,
+    guint num_mods)
+{
+  guint i;
+
+  if (!modification_flag)
+    num_mods = 0;
+  else if (num_mods > MAX_REF_LIST_MODIFICATIONS)
+    return FALSE;
 
-  for (i = long_ref_count; i < priv->long_ref_count; i++)
-    priv->long_ref[i] = NULL;
-  priv->long_ref_count = long_ref_count;
+  key->num_modifications[list] = num_mods;
+  for (i = 0; i < num_mods; i++) {
+    key->modification_idc[list][i] = mods[i].modification_of_pic_nums_idc;
+    key->modification_value[list][i] = mods[i].value.abs_diff_pic_num_minus1;
+  }
+  return TRUE;
+}
+
+static gboolean
+ref_list_key_init (GstVaapiRefListKeyH264 * key,
+    const GstH264SliceHdr * slice_hdr)
+{
+  memset (key, 0, sizeof (*key));
+  key->slice_type = slice_hdr->type % 5;
+  key->num_ref_idx_active_minus1[0] = slice_hdr->num_ref_idx_l0_active_minus1;
+  key->num_ref_idx_active_minus1[1] = slice_hdr->num_ref_idx_l1_active_minus1;
+  return ref_list_key_init_list (key, 0,
+      slice_hdr->ref_pic_list_modification_flag_l0,
+      slice_hdr->ref_pic_list_modification_l0,
+      slice_hdr->n_ref_pic_list_modification_l0) &&
+      ref_list_key_init_list (key, 1,
+      slice_hdr->ref_pic_list_modification_flag_l1,
+      slice_hdr->ref_pic_list_modification_l1,
+      slice_hdr->n_ref_pic_list_modification_l1);
+}
+
+/* Checks whether RefPicList0/1 were built for a previous slice of the
+   current picture with the same reference list syntax. The DPB does not
+   change in between slices of a picture, so those lists still apply */
+static gboolean
+lookup_picture_refs (GstVaapiDecoderH264 * decoder,
+    GstH264SliceHdr * slice_hdr)
+{
+  GstVaapiDecoderH264Private *const priv = &decoder->priv;
+  GstVaapiRefListKeyH264 key;
+
+  if (!ref_list_key_init (&key, slice_hdr)) {
+    priv->ref_list_valid = FALSE;
+    return FALSE;
+  }
+  if (priv->ref_list_valid &&
+      memcmp (&key, &priv->ref_list_key, sizeof (key)) == 0)
+    return TRUE;
+
+  priv->ref_list_key = key;
+  priv->ref_list_valid = TRUE;
+  return FALSE;
 }
 
 static void
@@ -3042,6 +2952,12 @@ init_picture_refs (GstVaapiDecoderH264 * decoder,
   GstVaapiDecoderH264Private *const priv = &decoder->priv;
   guint i, num_refs;
 
+  if (lookup_picture_refs (decoder, slice_hdr)) {
+    gst_vaapi_decoder_count_ref_lists (TRUE);
+    return;
+  }
+  gst_vaapi_decoder_count_ref_lists (FALSE);
+
   init_picture_ref_lists (decoder, picture);
   init_picture_refs_pic_num (decoder, picture, slice_hdr);
 
@@ -3375,6 +3291,7 @@ init_picture (GstVaapiDecoderH264 * decoder,
     priv->prev_ref_frame_num = priv->frame_num;
   priv->prev_frame_num = priv->frame_num;
   priv->frame_num = slice_hdr->frame_num;
+  priv->ref_list_valid = FALSE;
   picture->frame_num = priv->frame_num;
   picture->frame_num_wrap = priv->frame_num;
   picture->output_flag = TRUE;  /* XXX: conformant to Annex A only */
@@ -3473,6 +3390,7 @@ static gboolean
 exec_ref_pic_marking_sliding_window (GstVaapiDecoderH264 * decoder)
 {
   GstVaapiDecoderH264Private *const priv = &decoder->priv;
+  GstVaapiH264RefSet *const short_ref = &priv->short_ref;
   GstH264SPS *const sps = get_sps (decoder);
   GstVaapiPictureH264 *ref_picture;
   guint i, m, max_num_ref_frames;
@@ -3488,28 +3406,27 @@ exec_ref_pic_marking_sliding_window (GstVaapiDecoderH264 * decoder)
   if (!GST_VAAPI_PICTURE_IS_FRAME (priv->current_picture))
     max_num_ref_frames <<= 1;
 
-  if (priv->short_ref_count + priv->long_ref_count < max_num_ref_frames)
+  if (short_ref->count + priv->long_ref.count < max_num_ref_frames)
     return TRUE;
-  if (priv->short_ref_count < 1)
+  if (short_ref->count < 1)
     return FALSE;
 
-  for (m = 0, i = 1; i < priv->short_ref_count; i++) {
-    GstVaapiPictureH264 *const picture = priv->short_ref[i];
-    if (picture->frame_num_wrap < priv->short_ref[m]->frame_num_wrap)
+  for (m = 0, i = 1; i < short_ref->count; i++) {
+    if (short_ref->frame_idx[i] < short_ref->frame_idx[m])
       m = i;
   }
 
-  ref_picture = priv->short_ref[m];
+  ref_picture = short_ref->pictures[m];
   gst_vaapi_picture_h264_set_reference (ref_picture, 0, TRUE);
-  ARRAY_REMOVE_INDEX (priv->short_ref, m);
+  gst_vaapi_h264_ref_set_remove_index (short_ref, m);
 
   /* Both fields need to be marked as "unused for reference", so
      remove the other field from the short_ref[] list as well */
   if (!GST_VAAPI_PICTURE_IS_FRAME (priv->current_picture)
       && ref_picture->other_field) {
-    for (i = 0; i < priv->short_ref_count; i++) {
-      if (priv->short_ref[i] == ref_picture->other_field) {
-        ARRAY_REMOVE_INDEX (priv->short_ref, i);
+    for (i = 0; i < short_ref->count; i++) {
+      if (short_ref->pictures[i] == ref_picture->other_field) {
+        gst_vaapi_h264_ref_set_remove_index (short_ref, i);
         break;
       }
     }
@@ -3544,9 +3461,9 @@ exec_ref_pic_marking_adaptive_mmco_1 (GstVaapiDecoderH264 * decoder,
   if (i < 0)
     return;
 
-  gst_vaapi_picture_h264_set_reference (priv->short_ref[i], 0,
+  gst_vaapi_picture_h264_set_reference (priv->short_ref.pictures[i], 0,
       GST_VAAPI_PICTURE_IS_FRAME (picture));
-  ARRAY_REMOVE_INDEX (priv->short_ref, i);
+  gst_vaapi_h264_ref_set_remove_index (&priv->short_ref, i);
 }
 
 /* 8.2.5.4.2. Mark long-term reference picture as "unused for reference" */
@@ -3561,9 +3478,9 @@ exec_ref_pic_marking_adaptive_mmco_2 (GstVaapiDecoderH264 * decoder,
   if (i < 0)
     return;
 
-  gst_vaapi_picture_h264_set_reference (priv->long_ref[i], 0,
+  gst_vaapi_picture_h264_set_reference (priv->long_ref.pictures[i], 0,
       GST_VAAPI_PICTURE_IS_FRAME (picture));
-  ARRAY_REMOVE_INDEX (priv->long_ref, i);
+  gst_vaapi_h264_ref_set_remove_index (&priv->long_ref, i);
 }
 
 /* 8.2.5.4.3. Assign LongTermFrameIdx to a short-term reference picture */
@@ -3575,14 +3492,10 @@ exec_ref_pic_marking_adaptive_mmco_3 (GstVaapiDecoderH264 * decoder,
   GstVaapiPictureH264 *ref_picture, *other_field;
   gint32 i, picNumX;
 
-  for (i = 0; i < priv->long_ref_count; i++) {
-    if (priv->long_ref[i]->long_term_frame_idx ==
-        ref_pic_marking->long_term_frame_idx)
-      break;
-  }
-  if (i != priv->long_ref_count) {
-    gst_vaapi_picture_h264_set_reference (priv->long_ref[i], 0, TRUE);
-    ARRAY_REMOVE_INDEX (priv->long_ref, i);
+  i = find_long_term_frame_idx (decoder, ref_pic_marking->long_term_frame_idx);
+  if (i >= 0) {
+    gst_vaapi_picture_h264_set_reference (priv->long_ref.pictures[i], 0, TRUE);
+    gst_vaapi_h264_ref_set_remove_index (&priv->long_ref, i);
   }
 
   picNumX = get_picNumX (picture, ref_pic_marking);
@@ -3590,11 +3503,13 @@ exec_ref_pic_marking_adaptive_mmco_3 (GstVaapiDecoderH264 * decoder,
   if (i < 0)
     return;
 
-  ref_picture = priv->short_ref[i];
-  ARRAY_REMOVE_INDEX (priv->short_ref, i);
-  priv->long_ref[priv->long_ref_count++] = ref_picture;
+  ref_picture = priv->short_ref.pictures[i];
+  gst_vaapi_h264_ref_set_remove_index (&priv->short_ref, i);
 
   ref_picture->long_term_frame_idx = ref_pic_marking->long_term_frame_idx;
+  gst_vaapi_h264_ref_set_add (&priv->long_ref, ref_picture,
+      ref_picture->base.poc, ref_picture->long_term_frame_idx,
+      ref_picture->long_term_pic_num, ref_picture->structure);
   gst_vaapi_picture_h264_set_reference (ref_picture,
       GST_VAAPI_PICTURE_FLAG_LONG_TERM_REFERENCE,
       GST_VAAPI_PICTURE_IS_COMPLETE (picture));
@@ -3617,11 +3532,12 @@ exec_ref_pic_marking_adaptive_mmco_4 (GstVaapiDecoderH264 * decoder,
 
   long_term_frame_idx = ref_pic_marking->max_long_term_frame_idx_plus1 - 1;
 
-  for (i = 0; i < priv->long_ref_count; i++) {
-    if (priv->long_ref[i]->long_term_frame_idx <= long_term_frame_idx)
+  for (i = 0; i < priv->long_ref.count; i++) {
+    GstVaapiPictureH264 *const pic = priv->long_ref.pictures[i];
+    if (pic->long_term_frame_idx <= long_term_frame_idx)
       continue;
-    gst_vaapi_picture_h264_set_reference (priv->long_ref[i], 0, FALSE);
-    ARRAY_REMOVE_INDEX (priv->long_ref, i);
+    gst_vaapi_picture_h264_set_reference (pic, 0, FALSE);
+    gst_vaapi_h264_ref_set_remove_index (&priv->long_ref, i);
     i--;
   }
 }
@@ -3657,16 +3573,12 @@ exec_ref_pic_marking_adaptive_mmco_6 (GstVaapiDecoderH264 * decoder,
 {
   GstVaapiDecoderH264Private *const priv = &decoder->priv;
   GstVaapiPictureH264 *other_field;
-  guint i;
+  gint i;
 
-  for (i = 0; i < priv->long_ref_count; i++) {
-    if (priv->long_ref[i]->long_term_frame_idx ==
-        ref_pic_marking->long_term_frame_idx)
-      break;
-  }
-  if (i != priv->long_ref_count) {
-    gst_vaapi_picture_h264_set_reference (priv->long_ref[i], 0, TRUE);
-    ARRAY_REMOVE_INDEX (priv->long_ref, i);
+  i = find_long_term_frame_idx (decoder, ref_pic_marking->long_term_frame_idx);
+  if (i >= 0) {
+    gst_vaapi_picture_h264_set_reference (priv->long_ref.pictures[i], 0, TRUE);
+    gst_vaapi_h264_ref_set_remove_index (&priv->long_ref, i);
   }
 
   picture->long_term_frame_idx = ref_pic_marking->long_term_frame_idx;
@@ -4273,7 +4185,6 @@ decode_slice (GstVaapiDecoderH264 * decoder, GstVaapiDecoderUnit * unit)
   GstVaapiSlice *slice;
   GstBuffer *const buffer =
       GST_VAAPI_DECODER_CODEC_FRAME (decoder)->input_buffer;
-  GstMapInfo map_info;
 
   GST_DEBUG ("slice (%u bytes)", pi->nalu.size);
 
@@ -4292,20 +4203,14 @@ decode_slice (GstVaapiDecoderH264 * decoder, GstVaapiDecoderUnit * unit)
     return GST_VAAPI_DECODER_STATUS_ERROR_UNKNOWN;
   }
 
-  if (!gst_buffer_map (buffer, &map_info, GST_MAP_READ)) {
-    GST_ERROR ("failed to map buffer");
-    return GST_VAAPI_DECODER_STATUS_ERROR_UNKNOWN;
-  }
-
   /* Check wether this is the first/last slice in the current access unit */
   if (pi->flags & GST_VAAPI_DECODER_UNIT_FLAG_AU_START)
     GST_VAAPI_PICTURE_FLAG_SET (picture, GST_VAAPI_PICTURE_FLAG_AU_START);
   if (pi->flags & GST_VAAPI_DECODER_UNIT_FLAG_AU_END)
     GST_VAAPI_PICTURE_FLAG_SET (picture, GST_VAAPI_PICTURE_FLAG_AU_END);
 
-  slice = GST_VAAPI_SLICE_NEW (H264, decoder,
-      (map_info.data + unit->offset + pi->nalu.offset), pi->nalu.size);
-  gst_buffer_unmap (buffer, &map_info);
+  slice = GST_VAAPI_SLICE_NEW_FROM_BUFFER (H264, decoder, buffer,
+      unit->offset + pi->nalu.offset, pi->nalu.size);
   if (!slice) {
     GST_ERROR ("failed to allocate slice");
     return GST_VAAPI_DECODER_STATUS_ERROR_ALLOCATION_FAILED;
@@ -4325,8 +4230,7 @@ decode_slice (GstVaapiDecoderH264 * decoder, GstVaapiDecoderUnit * unit)
 static inline gint
 scan_for_start_code (GstAdapter * adapter, guint ofs, guint size, guint32 * scp)
 {
-  return (gint) gst_adapter_masked_scan_uint32_peek (adapter,
-      0xffffff00, 0x00000100, ofs, size, scp);
+  return gst_vaapi_adapter_scan_for_start_code (adapter, ofs, size, scp);
 }
 
 static GstVaapiDecoderStatus
@@ -4400,7 +4304,7 @@ gst_vaapi_decoder_h264_decode_codec_data (GstVaapiDecoder * base_decoder,
   ofs = 6;
 
   for (i = 0; i < num_sps; i++) {
-    pi = gst_vaapi_parser_info_h264_new ();
+    pi = gst_vaapi_parser_info_h264_new (NULL);
     if (!pi)
       return GST_VAAPI_DECODER_STATUS_ERROR_ALLOCATION_FAILED;
     unit.parsed_info = pi;
@@ -4430,7 +4334,7 @@ gst_vaapi_decoder_h264_decode_codec_data (GstVaapiDecoder * base_decoder,
   ofs++;
 
   for (i = 0; i < num_pps; i++) {
-    pi = gst_vaapi_parser_info_h264_new ();
+    pi = gst_vaapi_parser_info_h264_new (NULL);
     if (!pi)
       return GST_VAAPI_DECODER_STATUS_ERROR_ALLOCATION_FAILED;
     unit.parsed_info = pi;
@@ -4485,6 +4389,20 @@ ensure_decoder (GstVaapiDecoderH264 * decoder)
   return GST_VAAPI_DECODER_STATUS_SUCCESS;
 }
 
+/* Checks whether the NAL unit is an SPS, subset SPS or PPS */
+static inline gboolean
+is_parameter_set_nalu (const GstH264NalUnit * nalu)
+{
+  switch (nalu->type) {
+    case GST_H264_NAL_SPS:
+    case GST_H264_NAL_SUBSET_SPS:
+    case GST_H264_NAL_PPS:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
 static GstVaapiDecoderStatus
 gst_vaapi_decoder_h264_parse (GstVaapiDecoder * base_decoder,
     GstAdapter * adapter, gboolean at_eos, GstVaapiDecoderUnit * unit)
@@ -4496,6 +4414,7 @@ gst_vaapi_decoder_h264_parse (GstVaapiDecoder * base_decoder,
   GstVaapiParserInfoH264 *pi;
   GstVaapiDecoderStatus status;
   GstH264ParserResult result;
+  GstH264NalUnit nalu;
   guchar *buf;
   guint i, size, buf_size, nalu_size, flags;
   guint32 start_code;
@@ -4580,22 +4499,26 @@ gst_vaapi_decoder_h264_parse (GstVaapiDecoder * base_decoder,
 
   unit->size = buf_size;
 
-  pi = gst_vaapi_parser_info_h264_new ();
-  if (!pi)
-    return GST_VAAPI_DECODER_STATUS_ERROR_ALLOCATION_FAILED;
-
-  gst_vaapi_decoder_unit_set_parsed_info (unit,
-      pi, (GDestroyNotify) gst_vaapi_mini_object_unref);
-
   if (priv->is_avcC)
     result = gst_h264_parser_identify_nalu_avc (priv->parser,
-        buf, 0, buf_size, priv->nal_length_size, &pi->nalu);
+        buf, 0, buf_size, priv->nal_length_size, &nalu);
   else
     result = gst_h264_parser_identify_nalu_unchecked (priv->parser,
-        buf, 0, buf_size, &pi->nalu);
+        buf, 0, buf_size, &nalu);
   status = get_status (result);
   if (status != GST_VAAPI_DECODER_STATUS_SUCCESS)
-    goto exit;
+    return status;
+
+  /* Parameter sets are kept by the parser, whereas other NAL units are
+     released along with their frame, hence allocated from the arena */
+  pi = gst_vaapi_parser_info_h264_new (is_parameter_set_nalu (&nalu) ?
+      NULL : GST_VAAPI_DECODER_ARENA (decoder));
+  if (!pi)
+    return GST_VAAPI_DECODER_STATUS_ERROR_ALLOCATION_FAILED;
+  pi->nalu = nalu;
+
+  gst_vaapi_decoder_unit_set_parsed_info (unit,
+      pi, (GDestroyNotify) gst_vaapi_mini_object_unref);
 
   if (priv->base_only && (pi->nalu.type == GST_H264_NAL_PREFIX_UNIT
           || pi->nalu.type == GST_H264_NAL_SUBSET_SPS
@@ -4778,6 +4701,7 @@ gst_vaapi_decoder_h264_class_init (GstVaapiDecoderH264Class * klass)
   decoder_class->flush = gst_vaapi_decoder_h264_flush;
 
   decoder_class->decode_codec_data = gst_vaapi_decoder_h264_decode_codec_data;
+  decoder_class->concurrent_parse = TRUE;
 }
 
 static inline const GstVaapiDecoderClass *
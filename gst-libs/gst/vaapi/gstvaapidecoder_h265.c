@@ -37,6 +37,7 @@
 #include "gstvaapidisplay_priv.h"
 #include "gstvaapiobject_priv.h"
 #include "gstvaapiutils_h265_priv.h"
+#include "gstvaapiutils_startcode.h"
 
 #define DEBUG 1
 #include "gstvaapidebug.h"
@@ -125,10 +126,11 @@ gst_vaapi_parser_info_h265_class (void)
 }
 
 static inline GstVaapiParserInfoH265 *
-gst_vaapi_parser_info_h265_new (void)
+gst_vaapi_parser_info_h265_new (GstVaapiArena * arena)
 {
   return (GstVaapiParserInfoH265 *)
-      gst_vaapi_mini_object_new (gst_vaapi_parser_info_h265_class ());
+      gst_vaapi_mini_object_new_with_arena (gst_vaapi_parser_info_h265_class
+      (), arena);
 }
 
 #define gst_vaapi_parser_info_h265_ref(pi) \
@@ -352,6 +354,16 @@ typedef enum
       GST_H265_VIDEO_STATE_GOT_SLICE)
 } GstH265VideoState;
 
+/* The slice header syntax elements that the reference picture lists of
+   a slice derive from, besides the RPS of the current picture */
+typedef struct
+{
+  guint8 slice_type;
+  guint8 num_ref_idx_active_minus1[2];
+  guint8 modification_flag[2];
+  guint8 list_entry[2][16];
+} GstVaapiRefListKeyH265;
+
 struct _GstVaapiDecoderH265Private
 {
   GstH265Parser *parser;
@@ -386,6 +398,8 @@ struct _GstVaapiDecoderH265Private
   guint RefPicList0_count;
   GstVaapiPictureH265 *RefPicList1[16];
   guint RefPicList1_count;
+  GstVaapiRefListKeyH265 ref_list_key;  // slice that RefPicListX was built for
+  gboolean ref_list_valid;
 
   guint32 SpsMaxLatencyPictures;
   gint32 WpOffsetHalfRangeC;
@@ -420,6 +434,8 @@ struct _GstVaapiDecoderH265Private
   guint new_bitstream:1;
   guint prev_nal_is_eos:1;      /*previous nal type is EOS */
   guint associated_irap_NoRaslOutputFlag:1;
+  guint low_latency:1;
+  guint force_low_latency:1;
 };
 
 /**
@@ -815,6 +831,27 @@ check_latency_cnt (GstVaapiDecoderH265 * decoder)
   return FALSE;
 }
 
+/* Checks whether pictures can be output in decoding order, i.e. if
+   the active SPS rules out any picture reordering, or if the user
+   asserted that the stream has none regardless */
+static gboolean
+is_reorder_free (GstVaapiDecoderH265 * decoder)
+{
+  GstVaapiDecoderH265Private *const priv = &decoder->priv;
+  GstH265SPS *const sps = get_sps (decoder);
+
+  if (priv->force_low_latency)
+    return TRUE;
+  return sps && sps->max_num_reorder_pics[sps->max_sub_layers_minus1] == 0;
+}
+
+/* Outputs all the pictures waiting for output, in POC order */
+static void
+dpb_output_ready_frames (GstVaapiDecoderH265 * decoder)
+{
+  while (dpb_bump (decoder, NULL));
+}
+
 static gboolean
 dpb_add (GstVaapiDecoderH265 * decoder, GstVaapiPictureH265 * picture)
 {
@@ -1311,6 +1348,9 @@ decode_current_picture (GstVaapiDecoderH265 * decoder)
   if (!dpb_add (decoder, picture))
     goto error;
 
+  if ((priv->low_latency || priv->force_low_latency)
+      && is_reorder_free (decoder))
+    dpb_output_ready_frames (decoder);
   gst_vaapi_picture_replace (&priv->current_picture, NULL);
   return GST_VAAPI_DECODER_STATUS_SUCCESS;
 
@@ -1337,6 +1377,10 @@ parse_vps (GstVaapiDecoderH265 * decoder, GstVaapiDecoderUnit * unit)
   GstH265ParserResult result;
 
   GST_DEBUG ("parse VPS");
+
+  /* Wait for the frames that still use the parser VPS/SPS/PPS */
+  gst_vaapi_decoder_wait_pipeline (GST_VAAPI_DECODER_CAST (decoder));
+
   priv->parser_state = 0;
 
   memset (vps, 0, sizeof (GstH265VPS));
@@ -1358,6 +1402,9 @@ parse_sps (GstVaapiDecoderH265 * decoder, GstVaapiDecoderUnit * unit)
   GstH265ParserResult result;
 
   GST_DEBUG ("parse SPS");
+
+  gst_vaapi_decoder_wait_pipeline (GST_VAAPI_DECODER_CAST (decoder));
+
   priv->parser_state = 0;
 
   memset (sps, 0, sizeof (GstH265SPS));
@@ -1380,6 +1427,9 @@ parse_pps (GstVaapiDecoderH265 * decoder, GstVaapiDecoderUnit * unit)
   guint col_width[19], row_height[21];
 
   GST_DEBUG ("parse PPS");
+
+  gst_vaapi_decoder_wait_pipeline (GST_VAAPI_DECODER_CAST (decoder));
+
   priv->parser_state &= GST_H265_VIDEO_STATE_GOT_SPS;
 
   memset (col_width, 0, sizeof (col_width));
@@ -1600,6 +1650,57 @@ init_picture_poc (GstVaapiDecoderH265 * decoder,
   }
 }
 
+static void
+ref_list_key_init (GstVaapiRefListKeyH265 * key,
+    const GstH265SliceHdr * slice_hdr)
+{
+  const GstH265RefPicListModification *const mods =
+      &slice_hdr->ref_pic_list_modification;
+  guint i;
+
+  memset (key, 0, sizeof (*key));
+  key->slice_type = slice_hdr->type;
+  if (key->slice_type == GST_H265_I_SLICE)
+    return;
+
+  key->num_ref_idx_active_minus1[0] = slice_hdr->num_ref_idx_l0_active_minus1;
+  key->modification_flag[0] = mods->ref_pic_list_modification_flag_l0;
+  if (key->modification_flag[0]) {
+    for (i = 0; i <= key->num_ref_idx_active_minus1[0]; i++)
+      key->list_entry[0][i] = mods->list_entry_l0[i];
+  }
+
+  if (key->slice_type != GST_H265_B_SLICE)
+    return;
+
+  key->num_ref_idx_active_minus1[1] = slice_hdr->num_ref_idx_l1_active_minus1;
+  key->modification_flag[1] = mods->ref_pic_list_modification_flag_l1;
+  if (key->modification_flag[1]) {
+    for (i = 0; i <= key->num_ref_idx_active_minus1[1]; i++)
+      key->list_entry[1][i] = mods->list_entry_l1[i];
+  }
+}
+
+/* Checks whether RefPicList0/1 were built for a previous slice of the
+   current picture with the same reference list syntax. The RPS is only
+   derived once per picture, so those lists still apply */
+static gboolean
+lookup_picture_refs (GstVaapiDecoderH265 * decoder,
+    GstH265SliceHdr * slice_hdr)
+{
+  GstVaapiDecoderH265Private *const priv = &decoder->priv;
+  GstVaapiRefListKeyH265 key;
+
+  ref_list_key_init (&key, slice_hdr);
+  if (priv->ref_list_valid &&
+      memcmp (&key, &priv->ref_list_key, sizeof (key)) == 0)
+    return TRUE;
+
+  priv->ref_list_key = key;
+  priv->ref_list_valid = TRUE;
+  return FALSE;
+}
+
 static void
 init_picture_refs (GstVaapiDecoderH265 * decoder,
     GstVaapiPictureH265 * picture, GstH265SliceHdr * slice_hdr)
@@ -1614,6 +1715,12 @@ init_picture_refs (GstVaapiDecoderH265 * decoder,
   GstH265RefPicListModification *ref_pic_list_modification;
   guint type;
 
+  if (lookup_picture_refs (decoder, slice_hdr)) {
+    gst_vaapi_decoder_count_ref_lists (TRUE);
+    return;
+  }
+  gst_vaapi_decoder_count_ref_lists (FALSE);
+
   memset (priv->RefPicList0, 0, sizeof (GstVaapiPictureH265 *) * 16);
   memset (priv->RefPicList1, 0, sizeof (GstVaapiPictureH265 *) * 16);
   priv->RefPicList0_count = priv->RefPicList1_count = 0;
@@ -2106,6 +2213,9 @@ decode_ref_pic_set (GstVaapiDecoderH265 * decoder,
   const gint32 MaxPicOrderCntLsb =
       1 << (sps->log2_max_pic_order_cnt_lsb_minus4 + 4);
 
+  /* The reference picture lists of the previous picture no longer apply */
+  priv->ref_list_valid = FALSE;
+
   /* if it is an irap pic, set all ref pics in dpb as unused for ref */
   if (nal_is_irap (pi->nalu.type) && picture->NoRaslOutputFlag) {
     for (i = 0; i < priv->dpb_count; i++) {
@@ -2517,7 +2627,6 @@ decode_slice (GstVaapiDecoderH265 * decoder, GstVaapiDecoderUnit * unit)
   GstVaapiSlice *slice;
   GstBuffer *const buffer =
       GST_VAAPI_DECODER_CODEC_FRAME (decoder)->input_buffer;
-  GstMapInfo map_info;
 
   GST_DEBUG ("slice (%u bytes)", pi->nalu.size);
   if (!is_valid_state (pi->state, GST_H265_VIDEO_STATE_VALID_PICTURE_HEADERS)) {
@@ -2535,11 +2644,6 @@ decode_slice (GstVaapiDecoderH265 * decoder, GstVaapiDecoderUnit * unit)
     return GST_VAAPI_DECODER_STATUS_ERROR_UNKNOWN;
   }
 
-  if (!gst_buffer_map (buffer, &map_info, GST_MAP_READ)) {
-    GST_ERROR ("failed to map buffer");
-    return GST_VAAPI_DECODER_STATUS_ERROR_UNKNOWN;
-  }
-
   /* Check wether this is the first/last slice in the current access unit */
   if (pi->flags & GST_VAAPI_DECODER_UNIT_FLAG_AU_START)
     GST_VAAPI_PICTURE_FLAG_SET (picture, GST_VAAPI_PICTURE_FLAG_AU_START);
@@ -2547,10 +2651,8 @@ decode_slice (GstVaapiDecoderH265 * decoder, GstVaapiDecoderUnit * unit)
   if (pi->flags & GST_VAAPI_DECODER_UNIT_FLAG_AU_END)
     GST_VAAPI_PICTURE_FLAG_SET (picture, GST_VAAPI_PICTURE_FLAG_AU_END);
 
-  slice = GST_VAAPI_SLICE_NEW (HEVC, decoder,
-      (map_info.data + unit->offset + pi->nalu.offset), pi->nalu.size);
-
-  gst_buffer_unmap (buffer, &map_info);
+  slice = GST_VAAPI_SLICE_NEW_FROM_BUFFER (HEVC, decoder, buffer,
+      unit->offset + pi->nalu.offset, pi->nalu.size);
   if (!slice) {
     GST_ERROR ("failed to allocate slice");
     return GST_VAAPI_DECODER_STATUS_ERROR_ALLOCATION_FAILED;
@@ -2572,8 +2674,7 @@ decode_slice (GstVaapiDecoderH265 * decoder, GstVaapiDecoderUnit * unit)
 static inline gint
 scan_for_start_code (GstAdapter * adapter, guint ofs, guint size, guint32 * scp)
 {
-  return (gint) gst_adapter_masked_scan_uint32_peek (adapter,
-      0xffffff00, 0x00000100, ofs, size, scp);
+  return gst_vaapi_adapter_scan_for_start_code (adapter, ofs, size, scp);
 }
 
 static GstVaapiDecoderStatus
@@ -2678,7 +2779,7 @@ gst_vaapi_decoder_h265_decode_codec_data (GstVaapiDecoder *
     ofs += 3;
 
     for (j = 0; j < num_nals; j++) {
-      pi = gst_vaapi_parser_info_h265_new ();
+      pi = gst_vaapi_parser_info_h265_new (NULL);
       if (!pi)
         return GST_VAAPI_DECODER_STATUS_ERROR_ALLOCATION_FAILED;
       unit.parsed_info = pi;
@@ -2767,6 +2868,20 @@ populate_dependent_slice_hdr (GstVaapiParserInfoH265 * pi,
       offsetof (GstH265SliceHdr, type));
 }
 
+/* Checks whether the NAL unit is a VPS, SPS or PPS */
+static inline gboolean
+is_parameter_set_nalu (const GstH265NalUnit * nalu)
+{
+  switch (nalu->type) {
+    case GST_H265_NAL_VPS:
+    case GST_H265_NAL_SPS:
+    case GST_H265_NAL_PPS:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
 static GstVaapiDecoderStatus
 gst_vaapi_decoder_h265_parse (GstVaapiDecoder * base_decoder,
     GstAdapter * adapter, gboolean at_eos, GstVaapiDecoderUnit * unit)
@@ -2778,6 +2893,7 @@ gst_vaapi_decoder_h265_parse (GstVaapiDecoder * base_decoder,
   GstVaapiParserInfoH265 *pi;
   GstVaapiDecoderStatus status;
   GstH265ParserResult result;
+  GstH265NalUnit nalu;
   guchar *buf;
   guint i, size, buf_size, nalu_size, flags;
   guint32 start_code;
@@ -2853,20 +2969,24 @@ gst_vaapi_decoder_h265_parse (GstVaapiDecoder * base_decoder,
   if (!buf)
     return GST_VAAPI_DECODER_STATUS_ERROR_NO_DATA;
   unit->size = buf_size;
-  pi = gst_vaapi_parser_info_h265_new ();
-  if (!pi)
-    return GST_VAAPI_DECODER_STATUS_ERROR_ALLOCATION_FAILED;
-  gst_vaapi_decoder_unit_set_parsed_info (unit,
-      pi, (GDestroyNotify) gst_vaapi_mini_object_unref);
   if (priv->is_hvcC)
     result = gst_h265_parser_identify_nalu_hevc (priv->parser,
-        buf, 0, buf_size, priv->nal_length_size, &pi->nalu);
+        buf, 0, buf_size, priv->nal_length_size, &nalu);
   else
     result = gst_h265_parser_identify_nalu_unchecked (priv->parser,
-        buf, 0, buf_size, &pi->nalu);
+        buf, 0, buf_size, &nalu);
   status = get_status (result);
   if (status != GST_VAAPI_DECODER_STATUS_SUCCESS)
-    goto exit;
+    return status;
+  /* Parameter sets are kept by the parser, whereas other NAL units are
+     released along with their frame, hence allocated from the arena */
+  pi = gst_vaapi_parser_info_h265_new (is_parameter_set_nalu (&nalu) ?
+      NULL : GST_VAAPI_DECODER_ARENA (decoder));
+  if (!pi)
+    return GST_VAAPI_DECODER_STATUS_ERROR_ALLOCATION_FAILED;
+  pi->nalu = nalu;
+  gst_vaapi_decoder_unit_set_parsed_info (unit,
+      pi, (GDestroyNotify) gst_vaapi_mini_object_unref);
   switch (pi->nalu.type) {
     case GST_H265_NAL_VPS:
       status = parse_vps (decoder, unit);
@@ -3045,6 +3165,7 @@ gst_vaapi_decoder_h265_class_init (GstVaapiDecoderH265Class * klass)
   decoder_class->end_frame = gst_vaapi_decoder_h265_end_frame;
   decoder_class->flush = gst_vaapi_decoder_h265_flush;
   decoder_class->decode_codec_data = gst_vaapi_decoder_h265_decode_codec_data;
+  decoder_class->concurrent_parse = TRUE;
 }
 
 static inline const GstVaapiDecoderClass *
@@ -3077,6 +3198,85 @@ gst_vaapi_decoder_h265_set_alignment (GstVaapiDecoderH265 * decoder,
   decoder->priv.stream_alignment = alignment;
 }
 
+/**
+ * gst_vaapi_decoder_h265_set_low_latency:
+ * @decoder: a #GstVaapiDecoderH265
+ * @low_latency: %TRUE to enable the low latency mode
+ *
+ * If @low_latency is %TRUE, and the active SPS signals that no
+ * picture reordering can occur (sps_max_num_reorder_pics is zero),
+ * decoded pictures are output as soon as they are complete, instead
+ * of waiting for the decoded picture buffer (DPB) bumping process.
+ * Streams that allow reordering are output in conformance with the
+ * H.265 specification, unless gst_vaapi_decoder_h265_set_force_low_latency()
+ * is used.
+ *
+ * A picture can only be decoded once it is known to be complete. With
+ * access unit aligned input, this is the end of each input buffer.
+ * With NAL unit aligned input, this is only when the first NAL unit of
+ * the next access unit, or an end of sequence NAL unit, is received.
+ */
+void
+gst_vaapi_decoder_h265_set_low_latency (GstVaapiDecoderH265 * decoder,
+    gboolean low_latency)
+{
+  g_return_if_fail (decoder != NULL);
+
+  decoder->priv.low_latency = low_latency;
+}
+
+/**
+ * gst_vaapi_decoder_h265_get_low_latency:
+ * @decoder: a #GstVaapiDecoderH265
+ *
+ * Returns: %TRUE if the low latency mode is enabled; otherwise
+ * %FALSE.
+ */
+gboolean
+gst_vaapi_decoder_h265_get_low_latency (GstVaapiDecoderH265 * decoder)
+{
+  g_return_val_if_fail (decoder != NULL, FALSE);
+
+  return decoder->priv.low_latency;
+}
+
+/**
+ * gst_vaapi_decoder_h265_set_force_low_latency:
+ * @decoder: a #GstVaapiDecoderH265
+ * @force_low_latency: %TRUE to force the low latency mode
+ *
+ * If @force_low_latency is %TRUE, the low latency mode is enabled, and
+ * decoded pictures are output as soon as they are complete, even if
+ * the active SPS signals that picture reordering can occur. This is
+ * meant for streams that are coded without reordering (e.g. IPPP) but
+ * do not signal it.
+ *
+ * This violates the H.265 specification, and outputs pictures out of
+ * order if the stream actually has reordering.
+ */
+void
+gst_vaapi_decoder_h265_set_force_low_latency (GstVaapiDecoderH265 * decoder,
+    gboolean force_low_latency)
+{
+  g_return_if_fail (decoder != NULL);
+
+  decoder->priv.force_low_latency = force_low_latency;
+}
+
+/**
+ * gst_vaapi_decoder_h265_get_force_low_latency:
+ * @decoder: a #GstVaapiDecoderH265
+ *
+ * Returns: %TRUE if the low latency mode is forced; otherwise %FALSE.
+ */
+gboolean
+gst_vaapi_decoder_h265_get_force_low_latency (GstVaapiDecoderH265 * decoder)
+{
+  g_return_val_if_fail (decoder != NULL, FALSE);
+
+  return decoder->priv.force_low_latency;
+}
+
 /**
  * gst_vaapi_decoder_h265_new:
  * @display: a #GstVaapiDisplay
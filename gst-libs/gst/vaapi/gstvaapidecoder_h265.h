@@ -56,6 +56,20 @@ void
 gst_vaapi_decoder_h265_set_alignment(GstVaapiDecoderH265 *decoder,
     GstVaapiStreamAlignH265 alignment);
 
+void
+gst_vaapi_decoder_h265_set_low_latency(GstVaapiDecoderH265 * decoder,
+    gboolean low_latency);
+
+gboolean
+gst_vaapi_decoder_h265_get_low_latency(GstVaapiDecoderH265 * decoder);
+
+void
+gst_vaapi_decoder_h265_set_force_low_latency(GstVaapiDecoderH265 * decoder,
+    gboolean force_low_latency);
+
+gboolean
+gst_vaapi_decoder_h265_get_force_low_latency(GstVaapiDecoderH265 * decoder);
+
 G_END_DECLS
 
 #endif /* GST_VAAPI_DECODER_H265_H */
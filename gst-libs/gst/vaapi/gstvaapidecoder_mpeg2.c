@@ -35,6 +35,7 @@
 #include "gstvaapidecoder_priv.h"
 #include "gstvaapidisplay_priv.h"
 #include "gstvaapiobject_priv.h"
+#include "gstvaapiutils_startcode.h"
 
 #define DEBUG 1
 #include "gstvaapidebug.h"
@@ -1157,21 +1158,14 @@ decode_slice (GstVaapiDecoderMpeg2 * decoder, GstVaapiDecoderUnit * unit)
   GstMpegVideoSliceHdr *const slice_hdr = unit->parsed_info;
   GstBuffer *const buffer =
       GST_VAAPI_DECODER_CODEC_FRAME (decoder)->input_buffer;
-  GstMapInfo map_info;
 
   if (!is_valid_state (decoder, GST_MPEG_VIDEO_STATE_VALID_PIC_HEADERS))
     return GST_VAAPI_DECODER_STATUS_SUCCESS;
 
-  if (!gst_buffer_map (buffer, &map_info, GST_MAP_READ)) {
-    GST_ERROR ("failed to map buffer");
-    return GST_VAAPI_DECODER_STATUS_ERROR_UNKNOWN;
-  }
-
   GST_DEBUG ("slice %d (%u bytes)", slice_hdr->mb_row, unit->size);
 
-  slice = GST_VAAPI_SLICE_NEW (MPEG2, decoder,
-      (map_info.data + unit->offset), unit->size);
-  gst_buffer_unmap (buffer, &map_info);
+  slice = GST_VAAPI_SLICE_NEW_FROM_BUFFER (MPEG2, decoder, buffer,
+      unit->offset, unit->size);
   if (!slice) {
     GST_ERROR ("failed to allocate slice");
     return GST_VAAPI_DECODER_STATUS_ERROR_ALLOCATION_FAILED;
@@ -1194,25 +1188,12 @@ static inline gint
 scan_for_start_code (const guchar * buf, guint buf_size,
     GstMpegVideoPacketTypeCode * type_ptr)
 {
-  guint i = 0;
-
-  while (i <= (buf_size - 4)) {
-    if (buf[i + 2] > 1)
-      i += 3;
-    else if (buf[i + 1])
-      i += 2;
-    else if (buf[i] || buf[i + 2] != 1)
-      i++;
-    else
-      break;
-  }
+  gint ofs;
 
-  if (i <= (buf_size - 4)) {
-    if (type_ptr)
-      *type_ptr = buf[i + 3];
-    return i;
-  }
-  return -1;
+  ofs = gst_vaapi_scan_for_start_code (buf, buf_size);
+  if (ofs >= 0 && type_ptr)
+    *type_ptr = buf[ofs + 3];
+  return ofs;
 }
 
 static GstVaapiDecoderStatus
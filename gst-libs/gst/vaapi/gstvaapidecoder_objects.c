@@ -27,6 +27,7 @@
 #include <gst/vaapi/gstvaapicontext.h>
 #include "gstvaapidecoder_objects.h"
 #include "gstvaapidecoder_priv.h"
+#include "gstvaapiarena.h"
 #include "gstvaapisurfaceproxy_priv.h"
 #include "gstvaapicompat.h"
 #include "gstvaapiutils.h"
@@ -226,95 +227,367 @@ gst_vaapi_picture_add_slice (GstVaapiPicture * picture, GstVaapiSlice * slice)
   g_ptr_array_add (picture->slices, slice);
 }
 
+static GstVaapiSliceDataStats g_slice_data_stats;
+static GstVaapiPictureDecodeStats g_picture_decode_stats;
+
+/* Slice buffers are grown by this many bytes at once, so that they get
+   reused by the next pictures of a similar size */
+#define SLICE_DATA_ALIGN 65536
+
+static inline void
+slice_data_stats_update (gsize num_bytes)
+{
+  g_atomic_int_inc (&g_slice_data_stats.num_buffers);
+  g_atomic_pointer_add (&g_slice_data_stats.num_bytes, num_bytes);
+}
+
 static gboolean
-do_decode (VADisplay dpy, VAContextID ctx, VABufferID * buf_id, void **buf_ptr)
+is_deferred_slice (GstVaapiSlice * slice)
+{
+  return slice->buffer != NULL && !slice->huf_table;
+}
+
+/* Makes the next slice buffers of the decoder suitable for num_params
+   slice parameters of param_size bytes each and data_size bytes of slice
+   data, creating them again only if they are too small */
+static GstVaapiDecoderSliceBuffers *
+acquire_slice_buffers (GstVaapiDecoder * decoder, guint param_size,
+    guint num_params, guint data_size, guint * num_va_calls)
 {
+  VADisplay const va_display = decoder->va_display;
+  VAContextID const va_context = decoder->va_context;
+  GstVaapiDecoderSliceBuffers *slice_buffers;
   VAStatus status;
 
-  vaapi_unmap_buffer (dpy, *buf_id, buf_ptr);
+  slice_buffers = &decoder->slice_buffers[decoder->slice_buffers_index];
+  decoder->slice_buffers_index = (decoder->slice_buffers_index + 1) %
+      GST_VAAPI_DECODER_SLICE_BUFFERS;
 
-  status = vaRenderPicture (dpy, ctx, buf_id, 1);
-  if (!vaapi_check_status (status, "vaRenderPicture()"))
+  if (slice_buffers->param_id == VA_INVALID_ID ||
+      slice_buffers->param_size != param_size ||
+      slice_buffers->max_params < num_params) {
+    if (slice_buffers->param_id != VA_INVALID_ID) {
+      vaapi_destroy_buffer (va_display, &slice_buffers->param_id);
+      (*num_va_calls)++;
+    }
+    slice_buffers->param_size = param_size;
+    slice_buffers->max_params = GST_ROUND_UP_16 (num_params);
+    slice_buffers->num_params = slice_buffers->max_params;
+    status = vaCreateBuffer (va_display, va_context,
+        VASliceParameterBufferType, param_size, slice_buffers->max_params,
+        NULL, &slice_buffers->param_id);
+    (*num_va_calls)++;
+    if (!vaapi_check_status (status, "vaCreateBuffer()"))
+      goto error;
+    g_atomic_int_inc (&g_picture_decode_stats.num_slice_buffers);
+  }
+
+  if (slice_buffers->num_params != num_params) {
+    status = vaBufferSetNumElements (va_display, slice_buffers->param_id,
+        num_params);
+    (*num_va_calls)++;
+    if (!vaapi_check_status (status, "vaBufferSetNumElements()"))
+      goto error;
+    slice_buffers->num_params = num_params;
+  }
+
+  if (slice_buffers->data_id == VA_INVALID_ID ||
+      slice_buffers->data_size < data_size) {
+    if (slice_buffers->data_id != VA_INVALID_ID) {
+      vaapi_destroy_buffer (va_display, &slice_buffers->data_id);
+      (*num_va_calls)++;
+    }
+    slice_buffers->data_size = GST_ROUND_UP_N (MAX (data_size, 1),
+        SLICE_DATA_ALIGN);
+    status = vaCreateBuffer (va_display, va_context, VASliceDataBufferType,
+        slice_buffers->data_size, 1, NULL, &slice_buffers->data_id);
+    (*num_va_calls)++;
+    if (!vaapi_check_status (status, "vaCreateBuffer()"))
+      goto error;
+    g_atomic_int_inc (&g_picture_decode_stats.num_slice_buffers);
+  }
+  return slice_buffers;
+
+  /* ERRORS */
+error:
+  {
+    vaapi_destroy_buffer (va_display, &slice_buffers->param_id);
+    vaapi_destroy_buffer (va_display, &slice_buffers->data_id);
+    slice_buffers->max_params = 0;
+    slice_buffers->num_params = 0;
+    slice_buffers->data_size = 0;
+    return NULL;
+  }
+}
+
+/* Copies the slice data of all deferred slices into a single slice data
+   buffer, mapping each input buffer only once, and fills in a single
+   slice parameter buffer whose elements refer to that data. The buffers
+   are returned in va_buffers, ready for submission */
+static gboolean
+prepare_slices (GstVaapiPicture * picture, VABufferID va_buffers[2],
+    guint * num_va_calls)
+{
+  GstVaapiDecoder *const decoder = GET_DECODER (picture);
+  VADisplay const va_display = GET_VA_DISPLAY (picture);
+  GstVaapiDecoderSliceBuffers *slice_buffers;
+  GstVaapiSlice *slice;
+  GstBuffer *mapped_buffer = NULL;
+  GstMapInfo map_info;
+  VASliceParameterBufferBase *slice_param;
+  guint8 *data = NULL, *params = NULL;
+  guint i, n = 0, param_size = 0, data_size = 0;
+  gboolean success = FALSE;
+
+  for (i = 0; i < picture->slices->len; i++) {
+    slice = g_ptr_array_index (picture->slices, i);
+    if (!is_deferred_slice (slice))
+      continue;
+    if (n > 0 && slice->param_size != param_size) {
+      GST_ERROR ("mismatching slice parameter sizes (%u, %u)",
+          slice->param_size, param_size);
+      return FALSE;
+    }
+    param_size = slice->param_size;
+    data_size += slice->data_size;
+    n++;
+  }
+
+  slice_buffers = acquire_slice_buffers (decoder, param_size, n, data_size,
+      num_va_calls);
+  if (!slice_buffers)
     return FALSE;
 
-  /* XXX: vaRenderPicture() is meant to destroy the VA buffer implicitly */
+  data = vaapi_map_buffer (va_display, slice_buffers->data_id);
+  (*num_va_calls)++;
+  if (!data)
+    goto cleanup;
+  params = vaapi_map_buffer (va_display, slice_buffers->param_id);
+  (*num_va_calls)++;
+  if (!params)
+    goto cleanup;
+
+  data_size = 0;
+  for (i = 0, n = 0; i < picture->slices->len; i++) {
+    slice = g_ptr_array_index (picture->slices, i);
+    if (!is_deferred_slice (slice))
+      continue;
+    if (slice->buffer != mapped_buffer) {
+      if (mapped_buffer)
+        gst_buffer_unmap (mapped_buffer, &map_info);
+      mapped_buffer = NULL;
+      if (!gst_buffer_map (slice->buffer, &map_info, GST_MAP_READ))
+        goto cleanup;
+      mapped_buffer = slice->buffer;
+    }
+    memcpy (data + data_size, map_info.data + slice->data_offset,
+        slice->data_size);
+
+    slice_param = slice->param;
+    slice_param->slice_data_offset = data_size;
+    memcpy (params + n * param_size, slice_param, param_size);
+    data_size += slice->data_size;
+    n++;
+  }
+  slice_data_stats_update (data_size);
+
+  va_buffers[0] = slice_buffers->param_id;
+  va_buffers[1] = slice_buffers->data_id;
+  success = TRUE;
+
+cleanup:
+  if (mapped_buffer)
+    gst_buffer_unmap (mapped_buffer, &map_info);
+  if (params) {
+    vaapi_unmap_buffer (va_display, slice_buffers->param_id, NULL);
+    (*num_va_calls)++;
+  }
+  if (data) {
+    vaapi_unmap_buffer (va_display, slice_buffers->data_id, NULL);
+    (*num_va_calls)++;
+  }
+  return success;
+}
+
+/* Unmaps a VA buffer created with vaapi_create_buffer(), and queues it
+   for submission */
+static inline void
+add_buffer (VADisplay dpy, VABufferID buf_id, void **buf_ptr,
+    VABufferID * va_buffers, guint * num_buffers, guint * num_va_calls)
+{
+  vaapi_unmap_buffer (dpy, buf_id, buf_ptr);
+  (*num_va_calls)++;
+  va_buffers[(*num_buffers)++] = buf_id;
+}
+
+static inline void
+destroy_buffer (VADisplay dpy, VABufferID * buf_id, guint * num_va_calls)
+{
+  if (*buf_id == VA_INVALID_ID)
+    return;
   vaapi_destroy_buffer (dpy, buf_id);
-  return TRUE;
+  (*num_va_calls)++;
 }
 
-gboolean
-gst_vaapi_picture_decode (GstVaapiPicture * picture)
+/* Collects the VA buffers of the picture, and submits them all with a
+   single vaRenderPicture() call */
+static gboolean
+render_picture (GstVaapiPicture * picture, VABufferID * va_buffers,
+    guint * num_va_calls)
 {
   GstVaapiIqMatrix *iq_matrix;
   GstVaapiBitPlane *bitplane;
   GstVaapiHuffmanTable *huf_table;
   GstVaapiProbabilityTable *prob_table;
-  VADisplay va_display;
-  VAContextID va_context;
+  VADisplay const va_display = GET_VA_DISPLAY (picture);
+  VAContextID const va_context = GET_VA_CONTEXT (picture);
+  gboolean has_deferred_slices = FALSE;
+  guint i, n = 0;
   VAStatus status;
-  guint i;
-
-  g_return_val_if_fail (GST_VAAPI_IS_PICTURE (picture), FALSE);
-
-  va_display = GET_VA_DISPLAY (picture);
-  va_context = GET_VA_CONTEXT (picture);
-
-  GST_DEBUG ("decode picture 0x%08x", picture->surface_id);
 
-  status = vaBeginPicture (va_display, va_context, picture->surface_id);
-  if (!vaapi_check_status (status, "vaBeginPicture()"))
-    return FALSE;
-
-  if (!do_decode (va_display, va_context, &picture->param_id, &picture->param))
-    return FALSE;
+  add_buffer (va_display, picture->param_id, &picture->param,
+      va_buffers, &n, num_va_calls);
 
   iq_matrix = picture->iq_matrix;
-  if (iq_matrix && !do_decode (va_display, va_context,
-          &iq_matrix->param_id, &iq_matrix->param))
-    return FALSE;
+  if (iq_matrix)
+    add_buffer (va_display, iq_matrix->param_id, &iq_matrix->param,
+        va_buffers, &n, num_va_calls);
 
   bitplane = picture->bitplane;
-  if (bitplane && !do_decode (va_display, va_context,
-          &bitplane->data_id, (void **) &bitplane->data))
-    return FALSE;
+  if (bitplane)
+    add_buffer (va_display, bitplane->data_id, (void **) &bitplane->data,
+        va_buffers, &n, num_va_calls);
 
   huf_table = picture->huf_table;
-  if (huf_table && !do_decode (va_display, va_context,
-          &huf_table->param_id, (void **) &huf_table->param))
-    return FALSE;
+  if (huf_table)
+    add_buffer (va_display, huf_table->param_id, (void **) &huf_table->param,
+        va_buffers, &n, num_va_calls);
 
   prob_table = picture->prob_table;
-  if (prob_table && !do_decode (va_display, va_context,
-          &prob_table->param_id, (void **) &prob_table->param))
-    return FALSE;
+  if (prob_table)
+    add_buffer (va_display, prob_table->param_id,
+        (void **) &prob_table->param, va_buffers, &n, num_va_calls);
 
   for (i = 0; i < picture->slices->len; i++) {
     GstVaapiSlice *const slice = g_ptr_array_index (picture->slices, i);
-    VABufferID va_buffers[2];
-
-    huf_table = slice->huf_table;
-    if (huf_table && !do_decode (va_display, va_context,
-            &huf_table->param_id, (void **) &huf_table->param))
-      return FALSE;
 
-    vaapi_unmap_buffer (va_display, slice->param_id, NULL);
-    va_buffers[0] = slice->param_id;
-    va_buffers[1] = slice->data_id;
+    if (is_deferred_slice (slice)) {
+      /* Submitted at the position of the first one, all at once */
+      if (!has_deferred_slices) {
+        if (!prepare_slices (picture, &va_buffers[n], num_va_calls))
+          return FALSE;
+        n += 2;
+        has_deferred_slices = TRUE;
+      }
+      continue;
+    }
 
-    status = vaRenderPicture (va_display, va_context, va_buffers, 2);
-    if (!vaapi_check_status (status, "vaRenderPicture()"))
-      return FALSE;
+    huf_table = slice->huf_table;
+    if (huf_table)
+      add_buffer (va_display, huf_table->param_id,
+          (void **) &huf_table->param, va_buffers, &n, num_va_calls);
 
-    vaapi_destroy_buffer (va_display, &slice->param_id);
-    vaapi_destroy_buffer (va_display, &slice->data_id);
+    add_buffer (va_display, slice->param_id, NULL, va_buffers, &n,
+        num_va_calls);
+    va_buffers[n++] = slice->data_id;
   }
 
-  status = vaEndPicture (va_display, va_context);
-  if (!vaapi_check_status (status, "vaEndPicture()"))
+  status = vaRenderPicture (va_display, va_context, va_buffers, n);
+  (*num_va_calls)++;
+  if (!vaapi_check_status (status, "vaRenderPicture()"))
     return FALSE;
   return TRUE;
 }
 
+gboolean
+gst_vaapi_picture_decode (GstVaapiPicture * picture)
+{
+  VABufferID stack_buffers[16], *va_buffers = stack_buffers;
+  VADisplay va_display;
+  VAContextID va_context;
+  VAStatus status;
+  guint i, max_buffers, num_va_calls = 0;
+  gboolean success;
+
+  g_return_val_if_fail (GST_VAAPI_IS_PICTURE (picture), FALSE);
+
+  va_display = GET_VA_DISPLAY (picture);
+  va_context = GET_VA_CONTEXT (picture);
+
+  GST_DEBUG ("decode picture 0x%08x", picture->surface_id);
+
+  /* picture param, IQ matrix, bitplane, Huffman and probability tables,
+     then at most a per-slice Huffman table, param and data per slice */
+  max_buffers = 5 + 3 * picture->slices->len;
+  if (max_buffers > G_N_ELEMENTS (stack_buffers))
+    va_buffers = g_new (VABufferID, max_buffers);
+
+  status = vaBeginPicture (va_display, va_context, picture->surface_id);
+  num_va_calls++;
+  success = vaapi_check_status (status, "vaBeginPicture()") &&
+      render_picture (picture, va_buffers, &num_va_calls);
+
+  /* Always end the picture, even on error, so that the context does not
+     remain stuck in the middle of a picture */
+  if (status == VA_STATUS_SUCCESS) {
+    status = vaEndPicture (va_display, va_context);
+    num_va_calls++;
+    if (!vaapi_check_status (status, "vaEndPicture()"))
+      success = FALSE;
+  }
+
+  if (va_buffers != stack_buffers)
+    g_free (va_buffers);
+
+  /* The slice buffers of the decoder are kept for the next pictures,
+     the other ones are per-picture objects */
+  destroy_buffer (va_display, &picture->param_id, &num_va_calls);
+  if (picture->iq_matrix)
+    destroy_buffer (va_display, &picture->iq_matrix->param_id, &num_va_calls);
+  if (picture->bitplane)
+    destroy_buffer (va_display, &picture->bitplane->data_id, &num_va_calls);
+  if (picture->huf_table)
+    destroy_buffer (va_display, &picture->huf_table->param_id, &num_va_calls);
+  if (picture->prob_table)
+    destroy_buffer (va_display, &picture->prob_table->param_id,
+        &num_va_calls);
+  for (i = 0; i < picture->slices->len; i++) {
+    GstVaapiSlice *const slice = g_ptr_array_index (picture->slices, i);
+
+    if (slice->huf_table)
+      destroy_buffer (va_display, &slice->huf_table->param_id, &num_va_calls);
+    destroy_buffer (va_display, &slice->param_id, &num_va_calls);
+    destroy_buffer (va_display, &slice->data_id, &num_va_calls);
+  }
+
+  /* Slices are not needed anymore, release them now rather than when
+     the picture leaves the DPB so that their arena blocks get recycled */
+  g_ptr_array_set_size (picture->slices, 0);
+
+  g_atomic_int_inc (&g_picture_decode_stats.num_pictures);
+  g_atomic_int_add (&g_picture_decode_stats.num_va_calls, num_va_calls);
+  return success;
+}
+
+/**
+ * gst_vaapi_picture_get_decode_stats:
+ * @stats: (out): return location for the picture submission counters
+ *
+ * Retrieves the picture submission counters.
+ */
+void
+gst_vaapi_picture_get_decode_stats (GstVaapiPictureDecodeStats * stats)
+{
+  g_return_if_fail (stats != NULL);
+
+  stats->num_pictures =
+      g_atomic_int_get (&g_picture_decode_stats.num_pictures);
+  stats->num_va_calls =
+      g_atomic_int_get (&g_picture_decode_stats.num_va_calls);
+  stats->num_slice_buffers =
+      g_atomic_int_get (&g_picture_decode_stats.num_slice_buffers);
+}
+
 /* Mark picture as output for internal purposes only. Don't push frame out */
 static void
 do_output_internal (GstVaapiPicture * picture)
@@ -425,6 +698,11 @@ gst_vaapi_picture_set_crop_rect (GstVaapiPicture * picture,
 
 GST_VAAPI_CODEC_DEFINE_TYPE (GstVaapiSlice, gst_vaapi_slice);
 
+enum
+{
+  GST_VAAPI_CREATE_SLICE_FLAG_DEFERRED = 1 << 0,
+};
+
 void
 gst_vaapi_slice_destroy (GstVaapiSlice * slice)
 {
@@ -432,6 +710,12 @@ gst_vaapi_slice_destroy (GstVaapiSlice * slice)
 
   gst_vaapi_codec_object_replace (&slice->huf_table, NULL);
 
+  if (slice->buffer) {
+    gst_buffer_unref (slice->buffer);
+    slice->buffer = NULL;
+    gst_vaapi_arena_free (slice->param);
+  }
+
   vaapi_destroy_buffer (va_display, &slice->data_id);
   vaapi_destroy_buffer (va_display, &slice->param_id);
   slice->param = NULL;
@@ -446,18 +730,34 @@ gst_vaapi_slice_create (GstVaapiSlice * slice,
 
   slice->param_id = VA_INVALID_ID;
   slice->data_id = VA_INVALID_ID;
+  slice->param_size = args->param_size;
+  slice->data_size = args->data_size;
+
+  if (args->flags & GST_VAAPI_CREATE_SLICE_FLAG_DEFERRED) {
+    /* The slice data buffer and parameter buffer are created along with
+       those of the other slices, when the picture is decoded */
+    slice->param = gst_vaapi_arena_alloc (GST_VAAPI_DECODER_ARENA
+        (GET_DECODER (slice)), args->param_size);
+    if (!slice->param)
+      return FALSE;
+    if (args->param)
+      memcpy (slice->param, args->param, args->param_size);
+    else
+      memset (slice->param, 0, args->param_size);
+  } else {
+    success = vaapi_create_buffer (GET_VA_DISPLAY (slice),
+        GET_VA_CONTEXT (slice), VASliceDataBufferType, args->data_size,
+        args->data, &slice->data_id, NULL);
+    if (!success)
+      return FALSE;
+    slice_data_stats_update (args->data_size);
 
-  success = vaapi_create_buffer (GET_VA_DISPLAY (slice), GET_VA_CONTEXT (slice),
-      VASliceDataBufferType, args->data_size, args->data, &slice->data_id,
-      NULL);
-  if (!success)
-    return FALSE;
-
-  success = vaapi_create_buffer (GET_VA_DISPLAY (slice), GET_VA_CONTEXT (slice),
-      VASliceParameterBufferType, args->param_size, args->param,
-      &slice->param_id, &slice->param);
-  if (!success)
-    return FALSE;
+    success = vaapi_create_buffer (GET_VA_DISPLAY (slice),
+        GET_VA_CONTEXT (slice), VASliceParameterBufferType, args->param_size,
+        args->param, &slice->param_id, &slice->param);
+    if (!success)
+      return FALSE;
+  }
 
   slice_param = slice->param;
   slice_param->slice_data_size = args->data_size;
@@ -472,7 +772,62 @@ gst_vaapi_slice_new (GstVaapiDecoder * decoder,
 {
   GstVaapiCodecObject *object;
 
-  object = gst_vaapi_codec_object_new (&GstVaapiSliceClass,
-      GST_VAAPI_CODEC_BASE (decoder), param, param_size, data, data_size, 0);
+  object = gst_vaapi_codec_object_new_with_arena (&GstVaapiSliceClass,
+      GST_VAAPI_CODEC_BASE (decoder), GST_VAAPI_DECODER_ARENA (decoder),
+      param, param_size, data, data_size, 0);
   return GST_VAAPI_SLICE_CAST (object);
 }
+
+/**
+ * gst_vaapi_slice_new_from_buffer:
+ * @decoder: a #GstVaapiDecoder
+ * @param: (allow-none): the initial slice parameter, or %NULL
+ * @param_size: the size of the slice parameter
+ * @buffer: the #GstBuffer holding the slice data
+ * @data_offset: the offset of the slice data in @buffer
+ * @data_size: the size of the slice data
+ *
+ * Creates a slice whose data is only copied when the picture is
+ * decoded, at once with the data of the other slices of the picture
+ * created with this function. The slice holds a reference to @buffer
+ * until then.
+ *
+ * Return value: the newly allocated #GstVaapiSlice
+ */
+GstVaapiSlice *
+gst_vaapi_slice_new_from_buffer (GstVaapiDecoder * decoder,
+    gconstpointer param, guint param_size, GstBuffer * buffer,
+    guint data_offset, guint data_size)
+{
+  GstVaapiCodecObject *object;
+  GstVaapiSlice *slice;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+
+  object = gst_vaapi_codec_object_new_with_arena (&GstVaapiSliceClass,
+      GST_VAAPI_CODEC_BASE (decoder), GST_VAAPI_DECODER_ARENA (decoder),
+      param, param_size, NULL, data_size, GST_VAAPI_CREATE_SLICE_FLAG_DEFERRED);
+  if (!object)
+    return NULL;
+
+  slice = GST_VAAPI_SLICE_CAST (object);
+  slice->buffer = gst_buffer_ref (buffer);
+  slice->data_offset = data_offset;
+  return slice;
+}
+
+/**
+ * gst_vaapi_slice_get_data_stats:
+ * @stats: (out): return location for the slice data counters
+ *
+ * Retrieves the slice data submission counters.
+ */
+void
+gst_vaapi_slice_get_data_stats (GstVaapiSliceDataStats * stats)
+{
+  g_return_if_fail (stats != NULL);
+
+  stats->num_buffers = g_atomic_int_get (&g_slice_data_stats.num_buffers);
+  stats->num_bytes = (gsize) g_atomic_pointer_get
+      (&g_slice_data_stats.num_bytes);
+}
@@ -166,6 +166,24 @@ struct _GstVaapiPicture
   guint has_crop_rect:1;
 };
 
+/**
+ * GstVaapiPictureDecodeStats:
+ * @num_pictures: number of pictures submitted for decoding
+ * @num_va_calls: number of VA entry points called to submit them,
+ *   from vaBeginPicture() to vaEndPicture()
+ * @num_slice_buffers: number of batched slice buffers created, the
+ *   other batched slice submissions reused existing buffers
+ *
+ * Picture submission counters, accumulated over all the decoders of
+ * the process.
+ */
+typedef struct
+{
+  guint num_pictures;
+  guint num_va_calls;
+  guint num_slice_buffers;
+} GstVaapiPictureDecodeStats;
+
 G_GNUC_INTERNAL
 void
 gst_vaapi_picture_destroy (GstVaapiPicture * picture);
@@ -196,6 +214,10 @@ G_GNUC_INTERNAL
 gboolean
 gst_vaapi_picture_decode (GstVaapiPicture * picture);
 
+G_GNUC_INTERNAL
+void
+gst_vaapi_picture_get_decode_stats (GstVaapiPictureDecodeStats * stats);
+
 G_GNUC_INTERNAL
 gboolean
 gst_vaapi_picture_output (GstVaapiPicture * picture);
@@ -244,8 +266,28 @@ struct _GstVaapiSlice
 
   /* Per-slice overrides */
   GstVaapiHuffmanTable *huf_table;
+
+  /* Slice data not copied yet (gst_vaapi_slice_new_from_buffer()) */
+  GstBuffer *buffer;
+  guint data_offset;
+  guint data_size;
+  guint param_size;
 };
 
+/**
+ * GstVaapiSliceDataStats:
+ * @num_buffers: number of slice data buffers created
+ * @num_bytes: number of bytes copied into slice data buffers
+ *
+ * Slice data submission counters, accumulated over all the decoders of
+ * the process.
+ */
+typedef struct
+{
+  guint num_buffers;
+  gsize num_bytes;
+} GstVaapiSliceDataStats;
+
 G_GNUC_INTERNAL
 void
 gst_vaapi_slice_destroy (GstVaapiSlice * slice);
@@ -260,6 +302,16 @@ GstVaapiSlice *
 gst_vaapi_slice_new (GstVaapiDecoder * decoder, gconstpointer param,
     guint param_size, const guchar * data, guint data_size);
 
+G_GNUC_INTERNAL
+GstVaapiSlice *
+gst_vaapi_slice_new_from_buffer (GstVaapiDecoder * decoder,
+    gconstpointer param, guint param_size, GstBuffer * buffer,
+    guint data_offset, guint data_size);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_slice_get_data_stats (GstVaapiSliceDataStats * stats);
+
 /* ------------------------------------------------------------------------- */
 /* --- Helpers to create codec-dependent objects                         --- */
 /* ------------------------------------------------------------------------- */
@@ -273,6 +325,11 @@ gst_vaapi_slice_new (GstVaapiDecoder * decoder, gconstpointer param,
       NULL, sizeof (G_PASTE (VASliceParameterBuffer, codec)),   \
       buf, buf_size)
 
+#define GST_VAAPI_SLICE_NEW_FROM_BUFFER(codec, decoder, buffer, offset, size) \
+  gst_vaapi_slice_new_from_buffer (GST_VAAPI_DECODER_CAST (decoder),          \
+      NULL, sizeof (G_PASTE (VASliceParameterBuffer, codec)),                 \
+      buffer, offset, size)
+
 G_END_DECLS
 
 #endif /* GST_VAAPI_DECODER_OBJECTS_H */
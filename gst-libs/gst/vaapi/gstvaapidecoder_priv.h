@@ -46,6 +46,7 @@ G_BEGIN_DECLS
     GST_VAAPI_DECODER_CLASS(GST_VAAPI_MINI_OBJECT_GET_CLASS(obj))
 
 typedef struct _GstVaapiDecoderClass GstVaapiDecoderClass;
+typedef struct _GstVaapiDecoderRefListStats GstVaapiDecoderRefListStats;
 struct _GstVaapiDecoderUnit;
 
 /**
@@ -126,7 +127,19 @@ struct _GstVaapiDecoderUnit;
  */
 #undef  GST_VAAPI_DECODER_CODEC_FRAME
 #define GST_VAAPI_DECODER_CODEC_FRAME(decoder) \
-    GST_VAAPI_PARSER_STATE(decoder)->current_frame
+    GST_VAAPI_PARSER_STATE(decoder)->decode_frame
+
+/**
+ * GST_VAAPI_DECODER_ARENA:
+ * @decoder: a #GstVaapiDecoder
+ *
+ * Macro that evaluates to the #GstVaapiArena used to allocate the
+ * short-lived objects of @decoder.
+ * This is an internal macro that does not do any run-time type check.
+ */
+#undef  GST_VAAPI_DECODER_ARENA
+#define GST_VAAPI_DECODER_ARENA(decoder) \
+    GST_VAAPI_DECODER_CAST(decoder)->arena
 
 /**
  * GST_VAAPI_DECODER_WIDTH:
@@ -169,6 +182,7 @@ typedef struct _GstVaapiParserState GstVaapiParserState;
 struct _GstVaapiParserState
 {
   GstVideoCodecFrame *current_frame;
+  GstVideoCodecFrame *decode_frame;
   guint32 current_frame_number;
   GstAdapter *current_adapter;
   GstAdapter *input_adapter;
@@ -185,6 +199,29 @@ struct _GstVaapiParserState
  *
  * A VA decoder base instance.
  */
+#define GST_VAAPI_DECODER_SLICE_BUFFERS 4
+
+/**
+ * GstVaapiDecoderSliceBuffers:
+ * @param_id: VA slice parameter buffer
+ * @param_size: size of one slice parameter element
+ * @max_params: number of elements @param_id was created with
+ * @num_params: number of elements @param_id currently holds
+ * @data_id: VA slice data buffer
+ * @data_size: size @data_id was created with
+ *
+ * A pair of VA slice buffers that is reused across pictures.
+ */
+typedef struct
+{
+  VABufferID param_id;
+  guint param_size;
+  guint max_params;
+  guint num_params;
+  VABufferID data_id;
+  guint data_size;
+} GstVaapiDecoderSliceBuffers;
+
 struct _GstVaapiDecoder
 {
   /*< private >*/
@@ -202,6 +239,26 @@ struct _GstVaapiDecoder
   GstVaapiParserState parser_state;
   GstVaapiDecoderStateChangedFunc codec_state_changed_func;
   gpointer codec_state_changed_data;
+
+  /* short-lived objects (parser info, slices) */
+  GstVaapiArena *arena;
+
+  /* slice buffers, used round-robin so that a picture never waits for
+     the buffers of the previous one to be consumed by the hardware */
+  GstVaapiDecoderSliceBuffers slice_buffers[GST_VAAPI_DECODER_SLICE_BUFFERS];
+  guint slice_buffers_index;
+
+  /* pipelined decoding */
+  guint pipeline_depth;
+  GThread *decode_thread;
+  GMutex decode_lock;
+  GCond decode_cond;
+  GQueue decode_queue;
+  GQueue failed_frames;
+  GstVideoCodecState *pending_codec_state;
+  guint decode_busy:1;
+  guint decode_stalled:1;
+  guint decode_stop:1;
 };
 
 /**
@@ -228,6 +285,24 @@ struct _GstVaapiDecoderClass
   GstVaapiDecoderStatus (*reset) (GstVaapiDecoder * decoder);
   GstVaapiDecoderStatus (*decode_codec_data) (GstVaapiDecoder * decoder,
       const guchar * buf, guint buf_size);
+
+  /* parse() can run while a previous frame is being decoded */
+  guint concurrent_parse:1;
+};
+
+/**
+ * GstVaapiDecoderRefListStats:
+ * @num_builds: number of slices whose reference picture lists were built
+ * @num_hits: number of slices that reused the reference picture lists
+ *   of the previous slice of the same picture
+ *
+ * Reference picture list construction counters, accumulated over all
+ * the decoders of the process.
+ */
+struct _GstVaapiDecoderRefListStats
+{
+  guint num_builds;
+  guint num_hits;
 };
 
 G_GNUC_INTERNAL
@@ -239,6 +314,10 @@ G_GNUC_INTERNAL
 void
 gst_vaapi_decoder_finalize (GstVaapiDecoder * decoder);
 
+G_GNUC_INTERNAL
+void
+gst_vaapi_decoder_release_slice_buffers (GstVaapiDecoder * decoder);
+
 G_GNUC_INTERNAL
 void
 gst_vaapi_decoder_set_picture_size (GstVaapiDecoder * decoder,
@@ -283,6 +362,18 @@ G_GNUC_INTERNAL
 GstVaapiDecoderStatus
 gst_vaapi_decoder_decode_codec_data (GstVaapiDecoder * decoder);
 
+G_GNUC_INTERNAL
+void
+gst_vaapi_decoder_wait_pipeline (GstVaapiDecoder * decoder);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_decoder_count_ref_lists (gboolean reused);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_decoder_get_ref_list_stats (GstVaapiDecoderRefListStats * stats);
+
 G_END_DECLS
 
 #endif /* GST_VAAPI_DECODER_PRIV_H */
@@ -35,6 +35,7 @@
 #include "gstvaapidecoder_priv.h"
 #include "gstvaapidisplay_priv.h"
 #include "gstvaapiobject_priv.h"
+#include "gstvaapiutils_startcode.h"
 
 #define DEBUG 1
 #include "gstvaapidebug.h"
@@ -1250,8 +1251,7 @@ ensure_decoder (GstVaapiDecoderVC1 * decoder)
 static inline gint
 scan_for_start_code (GstAdapter * adapter, guint ofs, guint size, guint32 * scp)
 {
-  return (gint) gst_adapter_masked_scan_uint32_peek (adapter,
-      0xffffff00, 0x00000100, ofs, size, scp);
+  return gst_vaapi_adapter_scan_for_start_code (adapter, ofs, size, scp);
 }
 
 static GstVaapiDecoderStatus
@@ -1260,10 +1260,11 @@ gst_vaapi_decoder_vc1_parse (GstVaapiDecoder * base_decoder,
 {
   GstVaapiDecoderVC1 *const decoder = GST_VAAPI_DECODER_VC1_CAST (base_decoder);
   GstVaapiDecoderVC1Private *const priv = &decoder->priv;
+  GstVaapiParserState *const ps = GST_VAAPI_PARSER_STATE (base_decoder);
   GstVaapiDecoderStatus status;
   guint8 bdu_type;
   guint size, buf_size, flags = 0;
-  gint ofs;
+  gint ofs, ofs2;
 
   status = ensure_decoder (decoder);
   if (status != GST_VAAPI_DECODER_STATUS_SUCCESS)
@@ -1284,20 +1285,30 @@ gst_vaapi_decoder_vc1_parse (GstVaapiDecoder * base_decoder,
     ofs = scan_for_start_code (adapter, 0, size, NULL);
     if (ofs < 0)
       return GST_VAAPI_DECODER_STATUS_ERROR_NO_DATA;
-    gst_adapter_flush (adapter, ofs);
-    size -= ofs;
+    if (ofs > 0) {
+      gst_adapter_flush (adapter, ofs);
+      size -= ofs;
+    }
+
+    // Resume the search where the previous call left off
+    ofs2 = ps->input_offset2 - ofs - 4;
+    if (ofs2 < 4)
+      ofs2 = 4;
 
-    ofs = G_UNLIKELY (size < 8) ? -1 :
-        scan_for_start_code (adapter, 4, size - 4, NULL);
+    ofs = G_UNLIKELY (size < ofs2 + 4) ? -1 :
+        scan_for_start_code (adapter, ofs2, size - ofs2, NULL);
     if (ofs < 0) {
       // Assume the whole packet is present if end-of-stream
-      if (!at_eos)
+      if (!at_eos) {
+        ps->input_offset2 = size;
         return GST_VAAPI_DECODER_STATUS_ERROR_NO_DATA;
+      }
       ofs = size;
     }
     buf_size = ofs;
     gst_adapter_copy (adapter, &bdu_type, 3, 1);
   }
+  ps->input_offset2 = 0;
 
   unit->size = buf_size;
 
@@ -137,6 +137,10 @@ gst_vaapi_display_type_get_type (void)
 #if USE_DRM
     {GST_VAAPI_DISPLAY_TYPE_DRM,
         "VA/DRM display", "drm"},
+#endif
+#if USE_MOCK
+    {GST_VAAPI_DISPLAY_TYPE_MOCK,
+        "VA/Mock display", "mock"},
 #endif
     {0, NULL, NULL},
   };
@@ -832,7 +836,11 @@ gst_vaapi_display_destroy (GstVaapiDisplay * display)
   }
 
   if (priv->display) {
-    vaTerminate (priv->display);
+    GstVaapiDisplayClass *klass = GST_VAAPI_DISPLAY_GET_CLASS (display);
+    if (klass->va_terminate)
+      klass->va_terminate (display);
+    else
+      vaTerminate (priv->display);
     priv->display = NULL;
   }
 
@@ -893,7 +901,10 @@ gst_vaapi_display_create_unlocked (GstVaapiDisplay * display,
   if (!priv->display)
     return FALSE;
 
-  if (!vaapi_initialize (priv->display))
+  if (klass->va_initialize) {
+    if (!klass->va_initialize (display))
+      return FALSE;
+  } else if (!vaapi_initialize (priv->display))
     return FALSE;
 
   GST_INFO_OBJECT (display, "new display addr=%p", display);
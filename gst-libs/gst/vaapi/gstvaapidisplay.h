@@ -95,6 +95,7 @@ typedef struct _GstVaapiDisplay                 GstVaapiDisplay;
  * @GST_VAAPI_DISPLAY_TYPE_WAYLAND: VA/Wayland display.
  * @GST_VAAPI_DISPLAY_TYPE_DRM: VA/DRM display.
  * @GST_VAAPI_DISPLAY_TYPE_EGL: VA/EGL display.
+ * @GST_VAAPI_DISPLAY_TYPE_MOCK: VA/Mock display, without GPU.
  */
 typedef enum
 {
@@ -104,6 +105,7 @@ typedef enum
   GST_VAAPI_DISPLAY_TYPE_WAYLAND,
   GST_VAAPI_DISPLAY_TYPE_DRM,
   GST_VAAPI_DISPLAY_TYPE_EGL,
+  GST_VAAPI_DISPLAY_TYPE_MOCK,
 } GstVaapiDisplayType;
 
 #define GST_VAAPI_TYPE_DISPLAY_TYPE \
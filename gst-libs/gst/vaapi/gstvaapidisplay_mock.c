@@ -0,0 +1,157 @@
+/*
+ *  gstvaapidisplay_mock.c - VA/Mock display abstraction
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+/**
+ * SECTION:gstvaapidisplay_mock
+ * @short_description: VA/Mock display abstraction
+ *
+ * A #GstVaapiDisplayMock does not need any GPU. Its VA driver runs in
+ * process: surfaces and images live in host memory, nothing is
+ * decoded nor encoded, and the VA buffers that are submitted get
+ * counted. This is meant for benchmarking and profiling the CPU side
+ * of the library, and for testing it on machines without VA drivers.
+ */
+
+#include "sysdeps.h"
+#include "gstvaapidisplay_priv.h"
+#include "gstvaapidisplay_mock.h"
+#include "gstvaapidisplay_mock_priv.h"
+#include "gstvaapidriver_mock.h"
+
+#define DEBUG_VAAPI_DISPLAY 1
+#include "gstvaapidebug.h"
+
+G_DEFINE_TYPE (GstVaapiDisplayMock, gst_vaapi_display_mock,
+    GST_TYPE_VAAPI_DISPLAY);
+
+static gboolean
+gst_vaapi_display_mock_get_display_info (GstVaapiDisplay * display,
+    GstVaapiDisplayInfo * info)
+{
+  info->native_display = NULL;
+  info->display_name = "mock";
+  if (!info->va_display) {
+    info->va_display = gst_vaapi_driver_mock_get_display ();
+    if (!info->va_display)
+      return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean
+gst_vaapi_display_mock_va_initialize (GstVaapiDisplay * display)
+{
+  return gst_vaapi_driver_mock_initialize (GST_VAAPI_DISPLAY_VADISPLAY
+      (display));
+}
+
+static void
+gst_vaapi_display_mock_va_terminate (GstVaapiDisplay * display)
+{
+  gst_vaapi_driver_mock_terminate (GST_VAAPI_DISPLAY_VADISPLAY (display));
+}
+
+static void
+gst_vaapi_display_mock_init (GstVaapiDisplayMock * display)
+{
+}
+
+static void
+gst_vaapi_display_mock_class_init (GstVaapiDisplayMockClass * klass)
+{
+  GstVaapiDisplayClass *const dpy_class = GST_VAAPI_DISPLAY_CLASS (klass);
+
+  dpy_class->display_type = GST_VAAPI_DISPLAY_TYPE_MOCK;
+  dpy_class->get_display = gst_vaapi_display_mock_get_display_info;
+  dpy_class->va_initialize = gst_vaapi_display_mock_va_initialize;
+  dpy_class->va_terminate = gst_vaapi_display_mock_va_terminate;
+}
+
+/**
+ * gst_vaapi_display_mock_new:
+ *
+ * Creates a #GstVaapiDisplay backed by an in-process VA driver, which
+ * neither needs a GPU nor a native display.
+ *
+ * Return value: a newly allocated #GstVaapiDisplay object
+ */
+GstVaapiDisplay *
+gst_vaapi_display_mock_new (void)
+{
+  return gst_vaapi_display_new (g_object_new (GST_TYPE_VAAPI_DISPLAY_MOCK,
+          NULL), GST_VAAPI_DISPLAY_INIT_FROM_DISPLAY_NAME, NULL);
+}
+
+/**
+ * gst_vaapi_display_mock_get_stats:
+ * @display: a #GstVaapiDisplayMock
+ * @stats: (out): return location for the VA call counters
+ *
+ * Retrieves the counters of the VA calls handled by @display, since
+ * its creation or since the last gst_vaapi_display_mock_reset_stats()
+ * call.
+ */
+void
+gst_vaapi_display_mock_get_stats (GstVaapiDisplayMock * display,
+    GstVaapiDisplayMockStats * stats)
+{
+  g_return_if_fail (GST_VAAPI_IS_DISPLAY_MOCK (display));
+  g_return_if_fail (stats != NULL);
+
+  gst_vaapi_driver_mock_get_stats (GST_VAAPI_DISPLAY_VADISPLAY (display),
+      stats);
+}
+
+/**
+ * gst_vaapi_display_mock_get_rendered_buffers:
+ * @display: a #GstVaapiDisplayMock
+ * @type: a #VABufferType
+ *
+ * Returns the number of VA buffers of @type that were submitted with
+ * vaRenderPicture(), since the creation of @display or since the last
+ * gst_vaapi_display_mock_reset_stats() call.
+ *
+ * Return value: the number of rendered VA buffers of @type
+ */
+guint
+gst_vaapi_display_mock_get_rendered_buffers (GstVaapiDisplayMock * display,
+    VABufferType type)
+{
+  g_return_val_if_fail (GST_VAAPI_IS_DISPLAY_MOCK (display), 0);
+
+  return gst_vaapi_driver_mock_get_rendered_buffers
+      (GST_VAAPI_DISPLAY_VADISPLAY (display), type);
+}
+
+/**
+ * gst_vaapi_display_mock_reset_stats:
+ * @display: a #GstVaapiDisplayMock
+ *
+ * Resets the VA call counters of @display. The number of surfaces
+ * currently allocated is preserved.
+ */
+void
+gst_vaapi_display_mock_reset_stats (GstVaapiDisplayMock * display)
+{
+  g_return_if_fail (GST_VAAPI_IS_DISPLAY_MOCK (display));
+
+  gst_vaapi_driver_mock_reset_stats (GST_VAAPI_DISPLAY_VADISPLAY (display));
+}
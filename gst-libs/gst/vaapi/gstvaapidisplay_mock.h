@@ -0,0 +1,81 @@
+/*
+ *  gstvaapidisplay_mock.h - VA/Mock display abstraction
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef GST_VAAPI_DISPLAY_MOCK_H
+#define GST_VAAPI_DISPLAY_MOCK_H
+
+#include <gst/vaapi/gstvaapidisplay.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_VAAPI_DISPLAY_MOCK             (gst_vaapi_display_mock_get_type ())
+#define GST_VAAPI_DISPLAY_MOCK(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_VAAPI_DISPLAY_MOCK, GstVaapiDisplayMock))
+
+typedef struct _GstVaapiDisplayMock             GstVaapiDisplayMock;
+typedef struct _GstVaapiDisplayMockStats        GstVaapiDisplayMockStats;
+
+/**
+ * GstVaapiDisplayMockStats:
+ * @num_va_calls: number of VA driver entry points called
+ * @num_buffers: number of VA buffers created
+ * @num_buffer_bytes: total size of the VA buffers created
+ * @num_render_calls: number of vaRenderPicture() calls
+ * @num_rendered_buffers: number of VA buffers submitted to
+ *   vaRenderPicture()
+ * @num_pictures: number of vaEndPicture() calls
+ * @num_surfaces: number of VA surfaces currently allocated
+ * @num_surface_bytes: size of the VA surfaces currently allocated
+ *
+ * Counters of the VA calls handled by a #GstVaapiDisplayMock.
+ */
+struct _GstVaapiDisplayMockStats
+{
+  guint num_va_calls;
+  guint num_buffers;
+  gsize num_buffer_bytes;
+  guint num_render_calls;
+  guint num_rendered_buffers;
+  guint num_pictures;
+  guint num_surfaces;
+  gsize num_surface_bytes;
+};
+
+GstVaapiDisplay *
+gst_vaapi_display_mock_new (void);
+
+void
+gst_vaapi_display_mock_get_stats (GstVaapiDisplayMock * display,
+    GstVaapiDisplayMockStats * stats);
+
+guint
+gst_vaapi_display_mock_get_rendered_buffers (GstVaapiDisplayMock * display,
+    VABufferType type);
+
+void
+gst_vaapi_display_mock_reset_stats (GstVaapiDisplayMock * display);
+
+GType
+gst_vaapi_display_mock_get_type (void) G_GNUC_CONST;
+
+G_END_DECLS
+
+#endif /* GST_VAAPI_DISPLAY_MOCK_H */
@@ -0,0 +1,52 @@
+/*
+ *  gstvaapidisplay_mock_priv.h - Internal VA/Mock interface
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef GST_VAAPI_DISPLAY_MOCK_PRIV_H
+#define GST_VAAPI_DISPLAY_MOCK_PRIV_H
+
+#include <gst/vaapi/gstvaapidisplay_mock.h>
+#include "gstvaapidisplay_priv.h"
+
+G_BEGIN_DECLS
+
+#define GST_VAAPI_IS_DISPLAY_MOCK(display) \
+    (G_TYPE_CHECK_INSTANCE_TYPE ((display), GST_TYPE_VAAPI_DISPLAY_MOCK))
+
+#define GST_VAAPI_DISPLAY_MOCK_CAST(display) \
+    ((GstVaapiDisplayMock *)(display))
+
+typedef struct _GstVaapiDisplayMockClass        GstVaapiDisplayMockClass;
+
+struct _GstVaapiDisplayMock
+{
+  /*< private >*/
+  GstVaapiDisplay parent_instance;
+};
+
+struct _GstVaapiDisplayMockClass
+{
+  /*< private >*/
+  GstVaapiDisplayClass parent_class;
+};
+
+G_END_DECLS
+
+#endif /* GST_VAAPI_DISPLAY_MOCK_PRIV_H */
@@ -160,6 +160,10 @@ struct _GstVaapiDisplay
  * @create_window: (optional) virtual function to create a window
  * @create_texture: (optional) virtual function to create a texture
  * @get_texture_map: (optional) virtual function to get texture map
+ * @va_initialize: (optional) virtual function to initialize the
+ *   #VADisplay, instead of vaInitialize()
+ * @va_terminate: (optional) virtual function to terminate the
+ *   #VADisplay, instead of vaTerminate()
  *
  * Base class for VA displays.
  */
@@ -189,6 +193,8 @@ struct _GstVaapiDisplayClass
   GstVaapiTexture    *(*create_texture)  (GstVaapiDisplay * display, GstVaapiID id, guint target, guint format,
     guint width, guint height);
   GstVaapiTextureMap *(*get_texture_map) (GstVaapiDisplay * display);
+  gboolean            (*va_initialize)   (GstVaapiDisplay * display);
+  void                (*va_terminate)    (GstVaapiDisplay * display);
 };
 
 /* Initialization types */
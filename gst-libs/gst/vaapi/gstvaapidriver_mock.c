@@ -0,0 +1,1409 @@
+/*
+ *  gstvaapidriver_mock.c - In-process VA driver for the mock display
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+/*
+ * This is a VA driver that libva does not load: the display context
+ * and the driver context are set up here, and the driver entry points
+ * are plugged in directly. The VA API calls of the library then go
+ * through libva as usual, and end up in the functions below.
+ *
+ * Surfaces and images are plain host memory. Nothing gets decoded,
+ * encoded or processed, so the surface contents are left untouched
+ * by vaEndPicture(), and coded buffers are always empty. Only the
+ * VA entry points the library uses for decoding and encoding are
+ * implemented; there is no video processing, no subpicture and no
+ * display attribute.
+ */
+
+#include "sysdeps.h"
+#include <va/va_backend.h>
+#include "gstvaapidriver_mock.h"
+
+#define DEBUG 1
+#include "gstvaapidebug.h"
+
+#ifndef VA_DISPLAY_MAGIC
+#define VA_DISPLAY_MAGIC 0x56414430     /* VAD0 */
+#endif
+
+#define MOCK_VENDOR_STRING      "GStreamer VA-API mock driver"
+#define MOCK_MAX_PROFILES       16
+#define MOCK_MAX_ENTRYPOINTS    2
+#define MOCK_MAX_ATTRIBUTES     8
+#define MOCK_MAX_IMAGE_FORMATS  12
+#define MOCK_MAX_SIZE           8192
+#define MOCK_MAX_BUFFER_TYPES   64
+
+typedef enum
+{
+  MOCK_OBJECT_CONFIG = 1,
+  MOCK_OBJECT_CONTEXT,
+  MOCK_OBJECT_SURFACE,
+  MOCK_OBJECT_BUFFER,
+  MOCK_OBJECT_IMAGE,
+} MockObjectType;
+
+typedef struct
+{
+  MockObjectType type;
+  guint id;
+} MockObject;
+
+typedef struct
+{
+  guint fourcc;
+  guint width;
+  guint height;
+  guint num_planes;
+  guint pitches[3];
+  guint offsets[3];
+  guint data_size;
+} MockLayout;
+
+typedef struct
+{
+  MockObject base;
+  VAProfile profile;
+  VAEntrypoint entrypoint;
+} MockConfig;
+
+typedef struct
+{
+  MockObject base;
+  VAEntrypoint entrypoint;
+  VASurfaceID render_target;
+} MockContext;
+
+typedef struct
+{
+  MockObject base;
+  MockLayout layout;
+  guint8 *data;
+} MockSurface;
+
+typedef struct
+{
+  MockObject base;
+  VABufferType type;
+  guint size;
+  guint num_elements;
+  guint max_elements;
+  guint8 *data;
+  guint owns_data:1;
+} MockBuffer;
+
+typedef struct
+{
+  MockObject base;
+  VAImage image;
+} MockImage;
+
+typedef struct
+{
+  struct VADriverVTable vtable;
+  struct VADriverVTableVPP vtable_vpp;
+  GMutex lock;
+  GHashTable *objects;
+  guint next_id;
+  GstVaapiDisplayMockStats stats;
+  guint rendered_buffers[MOCK_MAX_BUFFER_TYPES];
+} MockDriver;
+
+/* Profiles, all of them support VLD decoding */
+static const VAProfile g_profiles[] = {
+  VAProfileMPEG2Simple,
+  VAProfileMPEG2Main,
+  VAProfileH264ConstrainedBaseline,
+  VAProfileH264Main,
+  VAProfileH264High,
+#if VA_CHECK_VERSION(0,32,0)
+  VAProfileJPEGBaseline,
+#endif
+#if VA_CHECK_VERSION(0,37,0)
+  VAProfileHEVCMain,
+#endif
+};
+
+#define DEF_YUV(FOURCC, BPP) \
+  { VA_FOURCC FOURCC, VA_LSB_FIRST, BPP, }
+#define DEF_RGB(FOURCC, DEPTH, R, G, B, A) \
+  { VA_FOURCC FOURCC, VA_LSB_FIRST, 32, DEPTH, R, G, B, A }
+
+/* Image formats, all of them are also surface formats */
+/* *INDENT-OFF* */
+static const VAImageFormat g_image_formats[] = {
+  DEF_YUV (('N', 'V', '1', '2'), 12),
+  DEF_YUV (('Y', 'V', '1', '2'), 12),
+  DEF_YUV (('I', '4', '2', '0'), 12),
+  DEF_YUV (('Y', 'U', 'Y', '2'), 16),
+  DEF_YUV (('U', 'Y', 'V', 'Y'), 16),
+  DEF_YUV (('P', '0', '1', '0'), 24),
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+  DEF_RGB (('B', 'G', 'R', 'A'), 32,
+      0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000),
+  DEF_RGB (('R', 'G', 'B', 'A'), 32,
+      0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000),
+  DEF_RGB (('B', 'G', 'R', 'X'), 24,
+      0x00ff0000, 0x0000ff00, 0x000000ff, 0x00000000),
+  DEF_RGB (('R', 'G', 'B', 'X'), 24,
+      0x000000ff, 0x0000ff00, 0x00ff0000, 0x00000000),
+#endif
+};
+/* *INDENT-ON* */
+
+#undef DEF_RGB
+#undef DEF_YUV
+
+/* ------------------------------------------------------------------------- */
+/* --- Objects                                                           --- */
+/* ------------------------------------------------------------------------- */
+
+static void
+mock_object_free (MockObject * object)
+{
+  switch (object->type) {
+    case MOCK_OBJECT_SURFACE:
+      g_free (((MockSurface *) object)->data);
+      break;
+    case MOCK_OBJECT_BUFFER:{
+      MockBuffer *const buffer = (MockBuffer *) object;
+      if (buffer->owns_data)
+        g_free (buffer->data);
+      break;
+    }
+    default:
+      break;
+  }
+  g_free (object);
+}
+
+static gpointer
+mock_object_new (MockDriver * driver, MockObjectType type, gsize size)
+{
+  MockObject *const object = g_malloc0 (size);
+
+  object->type = type;
+  object->id = ++driver->next_id;
+  g_hash_table_insert (driver->objects, GUINT_TO_POINTER (object->id), object);
+  return object;
+}
+
+static gpointer
+mock_object_lookup (MockDriver * driver, guint id, MockObjectType type)
+{
+  MockObject *const object =
+      g_hash_table_lookup (driver->objects, GUINT_TO_POINTER (id));
+
+  if (!object || object->type != type)
+    return NULL;
+  return object;
+}
+
+static void
+mock_object_destroy (MockDriver * driver, gpointer object)
+{
+  g_hash_table_remove (driver->objects,
+      GUINT_TO_POINTER (((MockObject *) object)->id));
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Host memory layouts                                               --- */
+/* ------------------------------------------------------------------------- */
+
+typedef struct
+{
+  guint bpp;                    /* bytes per sample (group) */
+  guint x_shift;
+  guint y_shift;
+} MockPlaneInfo;
+
+static gboolean
+get_plane_info (guint fourcc, guint plane, MockPlaneInfo * info)
+{
+  switch (fourcc) {
+    case VA_FOURCC ('N', 'V', '1', '2'):
+      info->bpp = plane ? 2 : 1;
+      info->x_shift = info->y_shift = plane ? 1 : 0;
+      return plane < 2;
+    case VA_FOURCC ('P', '0', '1', '0'):
+      info->bpp = plane ? 4 : 2;
+      info->x_shift = info->y_shift = plane ? 1 : 0;
+      return plane < 2;
+    case VA_FOURCC ('I', '4', '2', '0'):
+    case VA_FOURCC ('Y', 'V', '1', '2'):
+      info->bpp = 1;
+      info->x_shift = info->y_shift = plane ? 1 : 0;
+      return plane < 3;
+    case VA_FOURCC ('Y', 'U', 'Y', '2'):
+    case VA_FOURCC ('U', 'Y', 'V', 'Y'):
+      info->bpp = 2;
+      info->x_shift = info->y_shift = 0;
+      return plane < 1;
+    case VA_FOURCC ('B', 'G', 'R', 'A'):
+    case VA_FOURCC ('R', 'G', 'B', 'A'):
+    case VA_FOURCC ('B', 'G', 'R', 'X'):
+    case VA_FOURCC ('R', 'G', 'B', 'X'):
+      info->bpp = 4;
+      info->x_shift = info->y_shift = 0;
+      return plane < 1;
+    default:
+      break;
+  }
+  return FALSE;
+}
+
+static gboolean
+layout_init (MockLayout * layout, guint fourcc, guint width, guint height)
+{
+  MockPlaneInfo info;
+  guint i, plane_height, offset = 0;
+
+  if (width == 0 || height == 0 ||
+      width > MOCK_MAX_SIZE || height > MOCK_MAX_SIZE)
+    return FALSE;
+
+  memset (layout, 0, sizeof (*layout));
+  layout->fourcc = fourcc;
+  layout->width = width;
+  layout->height = height;
+
+  for (i = 0; get_plane_info (fourcc, i, &info); i++) {
+    layout->pitches[i] = GST_ROUND_UP_64 (((width + (1 << info.x_shift) - 1)
+            >> info.x_shift) * info.bpp);
+    layout->offsets[i] = offset;
+    plane_height = (height + (1 << info.y_shift) - 1) >> info.y_shift;
+    offset += layout->pitches[i] * plane_height;
+  }
+  if (i == 0)
+    return FALSE;
+  layout->num_planes = i;
+  layout->data_size = offset;
+  return TRUE;
+}
+
+static gboolean
+is_yuv420 (guint fourcc)
+{
+  return fourcc == VA_FOURCC ('N', 'V', '1', '2') ||
+      fourcc == VA_FOURCC ('I', '4', '2', '0') ||
+      fourcc == VA_FOURCC ('Y', 'V', '1', '2');
+}
+
+/* Returns the address of the U (component 0) or V (component 1) sample
+   at chroma position (x, y), and the distance between two samples */
+static guint8 *
+get_chroma (const MockLayout * layout, guint8 * data, guint component,
+    guint x, guint y, guint * step)
+{
+  guint plane;
+
+  if (layout->fourcc == VA_FOURCC ('N', 'V', '1', '2')) {
+    *step = 2;
+    return data + layout->offsets[1] + y * layout->pitches[1] + 2 * x +
+        component;
+  }
+  plane = (layout->fourcc == VA_FOURCC ('Y', 'V', '1', '2')) ?
+      2 - component : 1 + component;
+  *step = 1;
+  return data + layout->offsets[plane] + y * layout->pitches[plane] + x;
+}
+
+/* Copies a width x height rectangle, possibly converting between the
+   4:2:0 formats. There is no scaling */
+static VAStatus
+copy_rect (const MockLayout * dst_layout, guint8 * dst, guint dst_x,
+    guint dst_y, const MockLayout * src_layout, guint8 * src, guint src_x,
+    guint src_y, guint width, guint height)
+{
+  MockPlaneInfo info;
+  guint8 *d, *s;
+  guint i, c, x, y, w, h, d_step, s_step;
+
+  if (dst_x + width > dst_layout->width || dst_y + height > dst_layout->height
+      || src_x + width > src_layout->width ||
+      src_y + height > src_layout->height)
+    return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+  if (dst_layout->fourcc == src_layout->fourcc) {
+    for (i = 0; get_plane_info (src_layout->fourcc, i, &info); i++) {
+      d = dst + dst_layout->offsets[i] + (dst_y >> info.y_shift) *
+          dst_layout->pitches[i] + (dst_x >> info.x_shift) * info.bpp;
+      s = src + src_layout->offsets[i] + (src_y >> info.y_shift) *
+          src_layout->pitches[i] + (src_x >> info.x_shift) * info.bpp;
+      w = ((width + (1 << info.x_shift) - 1) >> info.x_shift) * info.bpp;
+      h = (height + (1 << info.y_shift) - 1) >> info.y_shift;
+      for (y = 0; y < h; y++) {
+        memcpy (d, s, w);
+        d += dst_layout->pitches[i];
+        s += src_layout->pitches[i];
+      }
+    }
+    return VA_STATUS_SUCCESS;
+  }
+
+  if (!is_yuv420 (dst_layout->fourcc) || !is_yuv420 (src_layout->fourcc))
+    return VA_STATUS_ERROR_UNIMPLEMENTED;
+
+  d = dst + dst_layout->offsets[0] + dst_y * dst_layout->pitches[0] + dst_x;
+  s = src + src_layout->offsets[0] + src_y * src_layout->pitches[0] + src_x;
+  for (y = 0; y < height; y++) {
+    memcpy (d, s, width);
+    d += dst_layout->pitches[0];
+    s += src_layout->pitches[0];
+  }
+
+  w = (width + 1) >> 1;
+  h = (height + 1) >> 1;
+  for (c = 0; c < 2; c++) {
+    for (y = 0; y < h; y++) {
+      d = get_chroma (dst_layout, dst, c, dst_x >> 1, (dst_y >> 1) + y,
+          &d_step);
+      s = get_chroma (src_layout, src, c, src_x >> 1, (src_y >> 1) + y,
+          &s_step);
+      for (x = 0; x < w; x++) {
+        *d = *s;
+        d += d_step;
+        s += s_step;
+      }
+    }
+  }
+  return VA_STATUS_SUCCESS;
+}
+
+static const VAImageFormat *
+get_image_format (guint fourcc)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (g_image_formats); i++) {
+    if (g_image_formats[i].fourcc == fourcc)
+      return &g_image_formats[i];
+  }
+  return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Driver entry points                                               --- */
+/* ------------------------------------------------------------------------- */
+
+#define DRIVER_ENTER(ctx) \
+  MockDriver *const driver = driver_enter (ctx)
+#define DRIVER_LEAVE(status) \
+  return driver_leave (driver, status)
+
+static inline MockDriver *
+driver_enter (VADriverContextP ctx)
+{
+  MockDriver *const driver = ctx->pDriverData;
+
+  g_mutex_lock (&driver->lock);
+  driver->stats.num_va_calls++;
+  return driver;
+}
+
+static inline VAStatus
+driver_leave (MockDriver * driver, VAStatus status)
+{
+  g_mutex_unlock (&driver->lock);
+  return status;
+}
+
+static VAStatus
+mock_terminate (VADriverContextP ctx)
+{
+  return VA_STATUS_SUCCESS;
+}
+
+static gboolean
+has_profile (VAProfile profile)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (g_profiles); i++) {
+    if (g_profiles[i] == profile)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+static gboolean
+has_encoder (VAProfile profile)
+{
+  return profile == VAProfileH264ConstrainedBaseline ||
+      profile == VAProfileH264Main || profile == VAProfileH264High;
+}
+
+static VAStatus
+mock_query_config_profiles (VADriverContextP ctx, VAProfile * profile_list,
+    int *num_profiles)
+{
+  DRIVER_ENTER (ctx);
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (g_profiles); i++)
+    profile_list[i] = g_profiles[i];
+  *num_profiles = i;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_query_config_entrypoints (VADriverContextP ctx, VAProfile profile,
+    VAEntrypoint * entrypoint_list, int *num_entrypoints)
+{
+  DRIVER_ENTER (ctx);
+  guint n = 0;
+
+  if (!has_profile (profile))
+    DRIVER_LEAVE (VA_STATUS_ERROR_UNSUPPORTED_PROFILE);
+
+  entrypoint_list[n++] = VAEntrypointVLD;
+  if (has_encoder (profile))
+    entrypoint_list[n++] = VAEntrypointEncSlice;
+  *num_entrypoints = n;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static gboolean
+check_entrypoint (VAProfile profile, VAEntrypoint entrypoint)
+{
+  if (!has_profile (profile))
+    return FALSE;
+  return entrypoint == VAEntrypointVLD ||
+      (entrypoint == VAEntrypointEncSlice && has_encoder (profile));
+}
+
+static void
+get_config_attribute (VAEntrypoint entrypoint, VAConfigAttrib * attrib)
+{
+  switch (attrib->type) {
+    case VAConfigAttribRTFormat:
+      attrib->value = VA_RT_FORMAT_YUV420;
+      break;
+    case VAConfigAttribRateControl:
+      attrib->value = entrypoint == VAEntrypointEncSlice ?
+          VA_RC_CQP | VA_RC_CBR | VA_RC_VBR : VA_ATTRIB_NOT_SUPPORTED;
+      break;
+    case VAConfigAttribEncPackedHeaders:
+      attrib->value = entrypoint == VAEntrypointEncSlice ?
+          VA_ENC_PACKED_HEADER_SEQUENCE | VA_ENC_PACKED_HEADER_PICTURE |
+          VA_ENC_PACKED_HEADER_SLICE | VA_ENC_PACKED_HEADER_MISC :
+          VA_ATTRIB_NOT_SUPPORTED;
+      break;
+    case VAConfigAttribEncMaxRefFrames:
+      attrib->value = entrypoint == VAEntrypointEncSlice ?
+          (1 << 16) | 4 : VA_ATTRIB_NOT_SUPPORTED;
+      break;
+    default:
+      attrib->value = VA_ATTRIB_NOT_SUPPORTED;
+      break;
+  }
+}
+
+static VAStatus
+mock_get_config_attributes (VADriverContextP ctx, VAProfile profile,
+    VAEntrypoint entrypoint, VAConfigAttrib * attrib_list, int num_attribs)
+{
+  DRIVER_ENTER (ctx);
+  gint i;
+
+  if (!check_entrypoint (profile, entrypoint))
+    DRIVER_LEAVE (VA_STATUS_ERROR_UNSUPPORTED_ENTRYPOINT);
+
+  for (i = 0; i < num_attribs; i++)
+    get_config_attribute (entrypoint, &attrib_list[i]);
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_create_config (VADriverContextP ctx, VAProfile profile,
+    VAEntrypoint entrypoint, VAConfigAttrib * attrib_list, int num_attribs,
+    VAConfigID * config_id)
+{
+  DRIVER_ENTER (ctx);
+  MockConfig *config;
+
+  if (!check_entrypoint (profile, entrypoint))
+    DRIVER_LEAVE (VA_STATUS_ERROR_UNSUPPORTED_ENTRYPOINT);
+
+  config = mock_object_new (driver, MOCK_OBJECT_CONFIG, sizeof (*config));
+  config->profile = profile;
+  config->entrypoint = entrypoint;
+  *config_id = config->base.id;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_destroy_config (VADriverContextP ctx, VAConfigID config_id)
+{
+  DRIVER_ENTER (ctx);
+  MockConfig *config;
+
+  config = mock_object_lookup (driver, config_id, MOCK_OBJECT_CONFIG);
+  if (!config)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_CONFIG);
+
+  mock_object_destroy (driver, config);
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_query_config_attributes (VADriverContextP ctx, VAConfigID config_id,
+    VAProfile * profile, VAEntrypoint * entrypoint,
+    VAConfigAttrib * attrib_list, int *num_attribs)
+{
+  DRIVER_ENTER (ctx);
+  MockConfig *config;
+
+  config = mock_object_lookup (driver, config_id, MOCK_OBJECT_CONFIG);
+  if (!config)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_CONFIG);
+
+  *profile = config->profile;
+  *entrypoint = config->entrypoint;
+  attrib_list[0].type = VAConfigAttribRTFormat;
+  attrib_list[0].value = VA_RT_FORMAT_YUV420;
+  *num_attribs = 1;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static guint
+get_surface_fourcc (guint rt_format)
+{
+  switch (rt_format) {
+    case VA_RT_FORMAT_YUV420:
+      return VA_FOURCC ('N', 'V', '1', '2');
+    case VA_RT_FORMAT_YUV422:
+      return VA_FOURCC ('Y', 'U', 'Y', '2');
+#ifdef VA_RT_FORMAT_YUV420_10BPP
+    case VA_RT_FORMAT_YUV420_10BPP:
+      return VA_FOURCC ('P', '0', '1', '0');
+#endif
+    case VA_RT_FORMAT_RGB32:
+      return VA_FOURCC ('B', 'G', 'R', 'A');
+    default:
+      break;
+  }
+  return 0;
+}
+
+static VAStatus
+create_surfaces (MockDriver * driver, const MockLayout * layout,
+    VASurfaceID * surfaces, guint num_surfaces)
+{
+  MockSurface *surface;
+  guint i;
+
+  for (i = 0; i < num_surfaces; i++) {
+    surface = mock_object_new (driver, MOCK_OBJECT_SURFACE, sizeof (*surface));
+    surface->layout = *layout;
+    surface->data = g_malloc0 (layout->data_size);
+    surfaces[i] = surface->base.id;
+
+    driver->stats.num_surfaces++;
+    driver->stats.num_surface_bytes += layout->data_size;
+  }
+  return VA_STATUS_SUCCESS;
+}
+
+static VAStatus
+mock_create_surfaces2 (VADriverContextP ctx, unsigned int format,
+    unsigned int width, unsigned int height, VASurfaceID * surfaces,
+    unsigned int num_surfaces, VASurfaceAttrib * attrib_list,
+    unsigned int num_attribs)
+{
+  DRIVER_ENTER (ctx);
+  VASurfaceAttribExternalBuffers *extbuf = NULL;
+  MockLayout layout;
+  guint i, fourcc;
+
+  fourcc = get_surface_fourcc (format);
+  for (i = 0; i < num_attribs; i++) {
+    const VASurfaceAttrib *const attrib = &attrib_list[i];
+
+    switch (attrib->type) {
+      case VASurfaceAttribPixelFormat:
+        fourcc = attrib->value.value.i;
+        break;
+      case VASurfaceAttribMemoryType:
+        if (attrib->value.value.i != VA_SURFACE_ATTRIB_MEM_TYPE_VA)
+          DRIVER_LEAVE (VA_STATUS_ERROR_UNSUPPORTED_MEMORY_TYPE);
+        break;
+      case VASurfaceAttribExternalBufferDescriptor:
+        extbuf = attrib->value.value.p;
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (!fourcc)
+    DRIVER_LEAVE (VA_STATUS_ERROR_UNSUPPORTED_RT_FORMAT);
+  if (!layout_init (&layout, fourcc, width, height))
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_IMAGE_FORMAT);
+
+  /* Honour the requested layout, should it be large enough */
+  if (extbuf && extbuf->num_planes == layout.num_planes) {
+    for (i = 0; i < layout.num_planes; i++) {
+      if (extbuf->pitches[i] < layout.pitches[i])
+        DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_PARAMETER);
+      layout.pitches[i] = extbuf->pitches[i];
+      layout.offsets[i] = extbuf->offsets[i];
+    }
+    layout.data_size = MAX (layout.data_size, extbuf->data_size);
+  }
+
+  DRIVER_LEAVE (create_surfaces (driver, &layout, surfaces, num_surfaces));
+}
+
+static VAStatus
+mock_create_surfaces (VADriverContextP ctx, int width, int height,
+    int format, int num_surfaces, VASurfaceID * surfaces)
+{
+  return mock_create_surfaces2 (ctx, format, width, height, surfaces,
+      num_surfaces, NULL, 0);
+}
+
+static VAStatus
+mock_destroy_surfaces (VADriverContextP ctx, VASurfaceID * surface_list,
+    int num_surfaces)
+{
+  DRIVER_ENTER (ctx);
+  MockSurface *surface;
+  gint i;
+
+  for (i = 0; i < num_surfaces; i++) {
+    surface = mock_object_lookup (driver, surface_list[i],
+        MOCK_OBJECT_SURFACE);
+    if (!surface)
+      DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_SURFACE);
+
+    driver->stats.num_surfaces--;
+    driver->stats.num_surface_bytes -= surface->layout.data_size;
+    mock_object_destroy (driver, surface);
+  }
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_query_surface_attributes (VADriverContextP ctx, VAConfigID config_id,
+    VASurfaceAttrib * attrib_list, unsigned int *num_attribs)
+{
+  DRIVER_ENTER (ctx);
+  VASurfaceAttrib attribs[G_N_ELEMENTS (g_image_formats) + 5], *attrib;
+  guint i, n;
+
+  if (!mock_object_lookup (driver, config_id, MOCK_OBJECT_CONFIG))
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_CONFIG);
+
+  memset (attribs, 0, sizeof (attribs));
+  attrib = attribs;
+  for (i = 0; i < G_N_ELEMENTS (g_image_formats); i++, attrib++) {
+    attrib->type = VASurfaceAttribPixelFormat;
+    attrib->flags = VA_SURFACE_ATTRIB_GETTABLE | VA_SURFACE_ATTRIB_SETTABLE;
+    attrib->value.type = VAGenericValueTypeInteger;
+    attrib->value.value.i = g_image_formats[i].fourcc;
+  }
+
+#define ADD_ATTRIB(TYPE, VALUE) do {                    \
+    attrib->type = G_PASTE (VASurfaceAttrib, TYPE);     \
+    attrib->flags = VA_SURFACE_ATTRIB_GETTABLE;         \
+    attrib->value.type = VAGenericValueTypeInteger;     \
+    attrib->value.value.i = VALUE;                      \
+    attrib++;                                           \
+  } while (0)
+
+  ADD_ATTRIB (MinWidth, 1);
+  ADD_ATTRIB (MaxWidth, MOCK_MAX_SIZE);
+  ADD_ATTRIB (MinHeight, 1);
+  ADD_ATTRIB (MaxHeight, MOCK_MAX_SIZE);
+  ADD_ATTRIB (MemoryType, VA_SURFACE_ATTRIB_MEM_TYPE_VA);
+  attrib[-1].flags |= VA_SURFACE_ATTRIB_SETTABLE;
+
+#undef ADD_ATTRIB
+
+  n = attrib - attribs;
+  if (attrib_list) {
+    if (*num_attribs < n)
+      DRIVER_LEAVE (VA_STATUS_ERROR_MAX_NUM_EXCEEDED);
+    memcpy (attrib_list, attribs, n * sizeof (*attrib_list));
+  }
+  *num_attribs = n;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_sync_surface (VADriverContextP ctx, VASurfaceID render_target)
+{
+  DRIVER_ENTER (ctx);
+
+  if (!mock_object_lookup (driver, render_target, MOCK_OBJECT_SURFACE))
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_SURFACE);
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_query_surface_status (VADriverContextP ctx, VASurfaceID render_target,
+    VASurfaceStatus * status)
+{
+  DRIVER_ENTER (ctx);
+
+  if (!mock_object_lookup (driver, render_target, MOCK_OBJECT_SURFACE))
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_SURFACE);
+  *status = VASurfaceReady;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_create_context (VADriverContextP ctx, VAConfigID config_id,
+    int picture_width, int picture_height, int flag,
+    VASurfaceID * render_targets, int num_render_targets,
+    VAContextID * context_id)
+{
+  DRIVER_ENTER (ctx);
+  MockConfig *config;
+  MockContext *context;
+
+  config = mock_object_lookup (driver, config_id, MOCK_OBJECT_CONFIG);
+  if (!config)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_CONFIG);
+
+  context = mock_object_new (driver, MOCK_OBJECT_CONTEXT, sizeof (*context));
+  context->entrypoint = config->entrypoint;
+  context->render_target = VA_INVALID_ID;
+  *context_id = context->base.id;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_destroy_context (VADriverContextP ctx, VAContextID context_id)
+{
+  DRIVER_ENTER (ctx);
+  MockContext *context;
+
+  context = mock_object_lookup (driver, context_id, MOCK_OBJECT_CONTEXT);
+  if (!context)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_CONTEXT);
+
+  mock_object_destroy (driver, context);
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static MockBuffer *
+create_buffer (MockDriver * driver, VABufferType type, guint size,
+    guint num_elements)
+{
+  MockBuffer *buffer;
+  gsize data_size;
+
+  buffer = mock_object_new (driver, MOCK_OBJECT_BUFFER, sizeof (*buffer));
+  buffer->type = type;
+  buffer->size = size;
+  buffer->num_elements = num_elements;
+  buffer->max_elements = num_elements;
+  buffer->owns_data = TRUE;
+
+  data_size = (gsize) size * num_elements;
+  driver->stats.num_buffers++;
+  driver->stats.num_buffer_bytes += data_size;
+
+  /* Coded buffers start with an empty segment, nothing gets encoded */
+  if (type == VAEncCodedBufferType) {
+    VACodedBufferSegment *segment;
+
+    buffer->data = g_malloc0 (sizeof (*segment) + data_size);
+    segment = (VACodedBufferSegment *) buffer->data;
+    segment->buf = buffer->data + sizeof (*segment);
+  } else
+    buffer->data = g_malloc (data_size);
+  return buffer;
+}
+
+static VAStatus
+mock_create_buffer (VADriverContextP ctx, VAContextID context_id,
+    VABufferType type, unsigned int size, unsigned int num_elements,
+    void *data, VABufferID * buf_id)
+{
+  DRIVER_ENTER (ctx);
+  MockBuffer *buffer;
+
+  if (size == 0 || num_elements == 0)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_PARAMETER);
+
+  buffer = create_buffer (driver, type, size, num_elements);
+  if (data && type != VAEncCodedBufferType)
+    memcpy (buffer->data, data, (gsize) size * num_elements);
+  *buf_id = buffer->base.id;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_buffer_set_num_elements (VADriverContextP ctx, VABufferID buf_id,
+    unsigned int num_elements)
+{
+  DRIVER_ENTER (ctx);
+  MockBuffer *buffer;
+
+  buffer = mock_object_lookup (driver, buf_id, MOCK_OBJECT_BUFFER);
+  if (!buffer)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_BUFFER);
+  if (num_elements == 0 || num_elements > buffer->max_elements)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_PARAMETER);
+
+  buffer->num_elements = num_elements;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_map_buffer (VADriverContextP ctx, VABufferID buf_id, void **pbuf)
+{
+  DRIVER_ENTER (ctx);
+  MockBuffer *buffer;
+
+  buffer = mock_object_lookup (driver, buf_id, MOCK_OBJECT_BUFFER);
+  if (!buffer)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_BUFFER);
+
+  *pbuf = buffer->data;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_unmap_buffer (VADriverContextP ctx, VABufferID buf_id)
+{
+  DRIVER_ENTER (ctx);
+
+  if (!mock_object_lookup (driver, buf_id, MOCK_OBJECT_BUFFER))
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_BUFFER);
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_destroy_buffer (VADriverContextP ctx, VABufferID buf_id)
+{
+  DRIVER_ENTER (ctx);
+  MockBuffer *buffer;
+
+  buffer = mock_object_lookup (driver, buf_id, MOCK_OBJECT_BUFFER);
+  if (!buffer)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_BUFFER);
+
+  mock_object_destroy (driver, buffer);
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_begin_picture (VADriverContextP ctx, VAContextID context_id,
+    VASurfaceID render_target)
+{
+  DRIVER_ENTER (ctx);
+  MockContext *context;
+
+  context = mock_object_lookup (driver, context_id, MOCK_OBJECT_CONTEXT);
+  if (!context)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_CONTEXT);
+  if (!mock_object_lookup (driver, render_target, MOCK_OBJECT_SURFACE))
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_SURFACE);
+  if (context->render_target != VA_INVALID_ID)
+    DRIVER_LEAVE (VA_STATUS_ERROR_OPERATION_FAILED);
+
+  context->render_target = render_target;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_render_picture (VADriverContextP ctx, VAContextID context_id,
+    VABufferID * buffers, int num_buffers)
+{
+  DRIVER_ENTER (ctx);
+  MockContext *context;
+  MockBuffer *buffer;
+  gint i;
+
+  context = mock_object_lookup (driver, context_id, MOCK_OBJECT_CONTEXT);
+  if (!context)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_CONTEXT);
+  if (context->render_target == VA_INVALID_ID)
+    DRIVER_LEAVE (VA_STATUS_ERROR_OPERATION_FAILED);
+
+  for (i = 0; i < num_buffers; i++) {
+    buffer = mock_object_lookup (driver, buffers[i], MOCK_OBJECT_BUFFER);
+    if (!buffer)
+      DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_BUFFER);
+    if (buffer->type < MOCK_MAX_BUFFER_TYPES)
+      driver->rendered_buffers[buffer->type]++;
+  }
+  driver->stats.num_render_calls++;
+  driver->stats.num_rendered_buffers += num_buffers;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_end_picture (VADriverContextP ctx, VAContextID context_id)
+{
+  DRIVER_ENTER (ctx);
+  MockContext *context;
+
+  context = mock_object_lookup (driver, context_id, MOCK_OBJECT_CONTEXT);
+  if (!context)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_CONTEXT);
+  if (context->render_target == VA_INVALID_ID)
+    DRIVER_LEAVE (VA_STATUS_ERROR_OPERATION_FAILED);
+
+  context->render_target = VA_INVALID_ID;
+  driver->stats.num_pictures++;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_query_image_formats (VADriverContextP ctx, VAImageFormat * format_list,
+    int *num_formats)
+{
+  DRIVER_ENTER (ctx);
+
+  memcpy (format_list, g_image_formats, sizeof (g_image_formats));
+  *num_formats = G_N_ELEMENTS (g_image_formats);
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+/* Creates an image, whose buffer either holds the pixels or refers to
+   the pixels of a surface */
+static MockImage *
+create_image (MockDriver * driver, const VAImageFormat * format,
+    const MockLayout * layout, guint8 * data)
+{
+  MockImage *image;
+  MockBuffer *buffer;
+  guint i;
+
+  if (data) {
+    buffer = mock_object_new (driver, MOCK_OBJECT_BUFFER, sizeof (*buffer));
+    buffer->type = VAImageBufferType;
+    buffer->size = layout->data_size;
+    buffer->num_elements = buffer->max_elements = 1;
+    buffer->data = data;
+  } else
+    buffer = create_buffer (driver, VAImageBufferType, layout->data_size, 1);
+
+  image = mock_object_new (driver, MOCK_OBJECT_IMAGE, sizeof (*image));
+  image->image.image_id = image->base.id;
+  image->image.format = *format;
+  image->image.buf = buffer->base.id;
+  image->image.width = layout->width;
+  image->image.height = layout->height;
+  image->image.data_size = layout->data_size;
+  image->image.num_planes = layout->num_planes;
+  for (i = 0; i < layout->num_planes; i++) {
+    image->image.pitches[i] = layout->pitches[i];
+    image->image.offsets[i] = layout->offsets[i];
+  }
+  return image;
+}
+
+static void
+get_image_layout (const VAImage * image, MockLayout * layout)
+{
+  guint i;
+
+  memset (layout, 0, sizeof (*layout));
+  layout->fourcc = image->format.fourcc;
+  layout->width = image->width;
+  layout->height = image->height;
+  layout->num_planes = image->num_planes;
+  for (i = 0; i < image->num_planes && i < 3; i++) {
+    layout->pitches[i] = image->pitches[i];
+    layout->offsets[i] = image->offsets[i];
+  }
+  layout->data_size = image->data_size;
+}
+
+static VAStatus
+mock_create_image (VADriverContextP ctx, VAImageFormat * format, int width,
+    int height, VAImage * out_image)
+{
+  DRIVER_ENTER (ctx);
+  const VAImageFormat *va_format;
+  MockLayout layout;
+  MockImage *image;
+
+  va_format = get_image_format (format->fourcc);
+  if (!va_format)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_IMAGE_FORMAT);
+  if (!layout_init (&layout, format->fourcc, width, height))
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_PARAMETER);
+
+  image = create_image (driver, va_format, &layout, NULL);
+  *out_image = image->image;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_derive_image (VADriverContextP ctx, VASurfaceID surface_id,
+    VAImage * out_image)
+{
+  DRIVER_ENTER (ctx);
+  const VAImageFormat *va_format;
+  MockSurface *surface;
+  MockImage *image;
+
+  surface = mock_object_lookup (driver, surface_id, MOCK_OBJECT_SURFACE);
+  if (!surface)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_SURFACE);
+  va_format = get_image_format (surface->layout.fourcc);
+  if (!va_format)
+    DRIVER_LEAVE (VA_STATUS_ERROR_OPERATION_FAILED);
+
+  image = create_image (driver, va_format, &surface->layout, surface->data);
+  *out_image = image->image;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_destroy_image (VADriverContextP ctx, VAImageID image_id)
+{
+  DRIVER_ENTER (ctx);
+  MockImage *image;
+  MockBuffer *buffer;
+
+  image = mock_object_lookup (driver, image_id, MOCK_OBJECT_IMAGE);
+  if (!image)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_IMAGE);
+
+  buffer = mock_object_lookup (driver, image->image.buf, MOCK_OBJECT_BUFFER);
+  if (buffer)
+    mock_object_destroy (driver, buffer);
+  mock_object_destroy (driver, image);
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_get_image (VADriverContextP ctx, VASurfaceID surface_id, int x, int y,
+    unsigned int width, unsigned int height, VAImageID image_id)
+{
+  DRIVER_ENTER (ctx);
+  MockSurface *surface;
+  MockImage *image;
+  MockBuffer *buffer;
+  MockLayout layout;
+
+  surface = mock_object_lookup (driver, surface_id, MOCK_OBJECT_SURFACE);
+  if (!surface)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_SURFACE);
+  image = mock_object_lookup (driver, image_id, MOCK_OBJECT_IMAGE);
+  if (!image)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_IMAGE);
+  buffer = mock_object_lookup (driver, image->image.buf, MOCK_OBJECT_BUFFER);
+  if (!buffer)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_BUFFER);
+  if (x < 0 || y < 0)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_PARAMETER);
+
+  /* Derived images share the pixels of the surface */
+  if (buffer->data == surface->data)
+    DRIVER_LEAVE (VA_STATUS_SUCCESS);
+
+  get_image_layout (&image->image, &layout);
+  DRIVER_LEAVE (copy_rect (&layout, buffer->data, 0, 0, &surface->layout,
+          surface->data, x, y, width, height));
+}
+
+static VAStatus
+mock_put_image (VADriverContextP ctx, VASurfaceID surface_id,
+    VAImageID image_id, int src_x, int src_y, unsigned int src_width,
+    unsigned int src_height, int dest_x, int dest_y, unsigned int dest_width,
+    unsigned int dest_height)
+{
+  DRIVER_ENTER (ctx);
+  MockSurface *surface;
+  MockImage *image;
+  MockBuffer *buffer;
+  MockLayout layout;
+
+  surface = mock_object_lookup (driver, surface_id, MOCK_OBJECT_SURFACE);
+  if (!surface)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_SURFACE);
+  image = mock_object_lookup (driver, image_id, MOCK_OBJECT_IMAGE);
+  if (!image)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_IMAGE);
+  buffer = mock_object_lookup (driver, image->image.buf, MOCK_OBJECT_BUFFER);
+  if (!buffer)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_BUFFER);
+  if (src_x < 0 || src_y < 0 || dest_x < 0 || dest_y < 0)
+    DRIVER_LEAVE (VA_STATUS_ERROR_INVALID_PARAMETER);
+  if (src_width != dest_width || src_height != dest_height)
+    DRIVER_LEAVE (VA_STATUS_ERROR_UNIMPLEMENTED);
+
+  if (buffer->data == surface->data)
+    DRIVER_LEAVE (VA_STATUS_SUCCESS);
+
+  get_image_layout (&image->image, &layout);
+  DRIVER_LEAVE (copy_rect (&surface->layout, surface->data, dest_x, dest_y,
+          &layout, buffer->data, src_x, src_y, src_width, src_height));
+}
+
+static VAStatus
+mock_query_subpicture_formats (VADriverContextP ctx,
+    VAImageFormat * format_list, unsigned int *flags,
+    unsigned int *num_formats)
+{
+  DRIVER_ENTER (ctx);
+
+  *num_formats = 0;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_query_display_attributes (VADriverContextP ctx,
+    VADisplayAttribute * attr_list, int *num_attributes)
+{
+  DRIVER_ENTER (ctx);
+
+  *num_attributes = 0;
+  DRIVER_LEAVE (VA_STATUS_SUCCESS);
+}
+
+static VAStatus
+mock_get_display_attributes (VADriverContextP ctx,
+    VADisplayAttribute * attr_list, int num_attributes)
+{
+  DRIVER_ENTER (ctx);
+  DRIVER_LEAVE (VA_STATUS_ERROR_UNIMPLEMENTED);
+}
+
+static VAStatus
+mock_set_display_attributes (VADriverContextP ctx,
+    VADisplayAttribute * attr_list, int num_attributes)
+{
+  DRIVER_ENTER (ctx);
+  DRIVER_LEAVE (VA_STATUS_ERROR_UNIMPLEMENTED);
+}
+
+static void
+mock_driver_init_vtable (struct VADriverVTable *vtable)
+{
+  vtable->vaTerminate = mock_terminate;
+  vtable->vaQueryConfigProfiles = mock_query_config_profiles;
+  vtable->vaQueryConfigEntrypoints = mock_query_config_entrypoints;
+  vtable->vaGetConfigAttributes = mock_get_config_attributes;
+  vtable->vaCreateConfig = mock_create_config;
+  vtable->vaDestroyConfig = mock_destroy_config;
+  vtable->vaQueryConfigAttributes = mock_query_config_attributes;
+  vtable->vaCreateSurfaces = mock_create_surfaces;
+  vtable->vaCreateSurfaces2 = mock_create_surfaces2;
+  vtable->vaDestroySurfaces = mock_destroy_surfaces;
+  vtable->vaQuerySurfaceAttributes = mock_query_surface_attributes;
+  vtable->vaSyncSurface = mock_sync_surface;
+  vtable->vaQuerySurfaceStatus = mock_query_surface_status;
+  vtable->vaCreateContext = mock_create_context;
+  vtable->vaDestroyContext = mock_destroy_context;
+  vtable->vaCreateBuffer = mock_create_buffer;
+  vtable->vaBufferSetNumElements = mock_buffer_set_num_elements;
+  vtable->vaMapBuffer = mock_map_buffer;
+  vtable->vaUnmapBuffer = mock_unmap_buffer;
+  vtable->vaDestroyBuffer = mock_destroy_buffer;
+  vtable->vaBeginPicture = mock_begin_picture;
+  vtable->vaRenderPicture = mock_render_picture;
+  vtable->vaEndPicture = mock_end_picture;
+  vtable->vaQueryImageFormats = mock_query_image_formats;
+  vtable->vaCreateImage = mock_create_image;
+  vtable->vaDeriveImage = mock_derive_image;
+  vtable->vaDestroyImage = mock_destroy_image;
+  vtable->vaGetImage = mock_get_image;
+  vtable->vaPutImage = mock_put_image;
+  vtable->vaQuerySubpictureFormats = mock_query_subpicture_formats;
+  vtable->vaQueryDisplayAttributes = mock_query_display_attributes;
+  vtable->vaGetDisplayAttributes = mock_get_display_attributes;
+  vtable->vaSetDisplayAttributes = mock_set_display_attributes;
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Display                                                           --- */
+/* ------------------------------------------------------------------------- */
+
+static int
+mock_display_is_valid (VADisplayContextP dctx)
+{
+  return dctx->pDriverContext != NULL;
+}
+
+static void
+mock_display_destroy (VADisplayContextP dctx)
+{
+  g_free (dctx->pDriverContext);
+  g_free (dctx);
+}
+
+static inline MockDriver *
+get_driver (VADisplay va_display)
+{
+  return ((VADisplayContextP) va_display)->pDriverContext->pDriverData;
+}
+
+/**
+ * gst_vaapi_driver_mock_get_display:
+ *
+ * Creates a #VADisplay for the mock VA driver. The driver is set up
+ * by gst_vaapi_driver_mock_initialize().
+ *
+ * Return value: the newly allocated #VADisplay
+ */
+VADisplay
+gst_vaapi_driver_mock_get_display (void)
+{
+  VADisplayContextP dctx;
+
+  dctx = g_new0 (VADisplayContext, 1);
+  dctx->vadpy_magic = VA_DISPLAY_MAGIC;
+  dctx->pDriverContext = g_new0 (VADriverContext, 1);
+  dctx->vaIsValid = mock_display_is_valid;
+  dctx->vaDestroy = mock_display_destroy;
+  return dctx;
+}
+
+/**
+ * gst_vaapi_driver_mock_initialize:
+ * @va_display: a #VADisplay from gst_vaapi_driver_mock_get_display()
+ *
+ * Sets up the mock VA driver for @va_display. This replaces the
+ * vaInitialize() call, which would try to load a driver module.
+ *
+ * Return value: %TRUE on success
+ */
+gboolean
+gst_vaapi_driver_mock_initialize (VADisplay va_display)
+{
+  VADriverContextP const ctx =
+      ((VADisplayContextP) va_display)->pDriverContext;
+  MockDriver *driver;
+
+  g_return_val_if_fail (ctx != NULL, FALSE);
+  g_return_val_if_fail (ctx->pDriverData == NULL, FALSE);
+
+  driver = g_new0 (MockDriver, 1);
+  g_mutex_init (&driver->lock);
+  driver->objects = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) mock_object_free);
+  mock_driver_init_vtable (&driver->vtable);
+
+  ctx->pDriverData = driver;
+  ctx->vtable = &driver->vtable;
+  ctx->vtable_vpp = &driver->vtable_vpp;
+  ctx->version_major = VA_MAJOR_VERSION;
+  ctx->version_minor = VA_MINOR_VERSION;
+  ctx->max_profiles = MOCK_MAX_PROFILES;
+  ctx->max_entrypoints = MOCK_MAX_ENTRYPOINTS;
+  ctx->max_attributes = MOCK_MAX_ATTRIBUTES;
+  ctx->max_image_formats = MOCK_MAX_IMAGE_FORMATS;
+  ctx->max_subpic_formats = 1;
+  ctx->max_display_attributes = 1;
+  ctx->str_vendor = MOCK_VENDOR_STRING;
+
+  G_STATIC_ASSERT (G_N_ELEMENTS (g_profiles) <= MOCK_MAX_PROFILES);
+  G_STATIC_ASSERT (G_N_ELEMENTS (g_image_formats) <= MOCK_MAX_IMAGE_FORMATS);
+  return TRUE;
+}
+
+/**
+ * gst_vaapi_driver_mock_terminate:
+ * @va_display: a #VADisplay from gst_vaapi_driver_mock_get_display()
+ *
+ * Releases the mock VA driver and all the objects that were not
+ * destroyed, then @va_display itself. This replaces vaTerminate().
+ */
+void
+gst_vaapi_driver_mock_terminate (VADisplay va_display)
+{
+  VADisplayContextP const dctx = va_display;
+  MockDriver *const driver = dctx->pDriverContext->pDriverData;
+
+  if (driver) {
+    if (g_hash_table_size (driver->objects) > 0)
+      GST_DEBUG ("%u VA objects were not destroyed",
+          g_hash_table_size (driver->objects));
+    g_hash_table_unref (driver->objects);
+    g_mutex_clear (&driver->lock);
+    g_free (driver);
+  }
+  mock_display_destroy (dctx);
+}
+
+/**
+ * gst_vaapi_driver_mock_get_stats:
+ * @va_display: a #VADisplay from gst_vaapi_driver_mock_get_display()
+ * @stats: (out): return location for the VA call counters
+ *
+ * Retrieves the VA call counters of the mock driver.
+ */
+void
+gst_vaapi_driver_mock_get_stats (VADisplay va_display,
+    GstVaapiDisplayMockStats * stats)
+{
+  MockDriver *const driver = get_driver (va_display);
+
+  g_mutex_lock (&driver->lock);
+  *stats = driver->stats;
+  g_mutex_unlock (&driver->lock);
+}
+
+/**
+ * gst_vaapi_driver_mock_get_rendered_buffers:
+ * @va_display: a #VADisplay from gst_vaapi_driver_mock_get_display()
+ * @type: a #VABufferType
+ *
+ * Return value: the number of VA buffers of @type that were submitted
+ *   to vaRenderPicture()
+ */
+guint
+gst_vaapi_driver_mock_get_rendered_buffers (VADisplay va_display,
+    VABufferType type)
+{
+  MockDriver *const driver = get_driver (va_display);
+  guint count = 0;
+
+  g_mutex_lock (&driver->lock);
+  if (type < MOCK_MAX_BUFFER_TYPES)
+    count = driver->rendered_buffers[type];
+  g_mutex_unlock (&driver->lock);
+  return count;
+}
+
+/**
+ * gst_vaapi_driver_mock_reset_stats:
+ * @va_display: a #VADisplay from gst_vaapi_driver_mock_get_display()
+ *
+ * Resets the VA call counters of the mock driver, except the ones
+ * that account for the live surfaces.
+ */
+void
+gst_vaapi_driver_mock_reset_stats (VADisplay va_display)
+{
+  MockDriver *const driver = get_driver (va_display);
+  guint num_surfaces;
+  gsize num_surface_bytes;
+
+  g_mutex_lock (&driver->lock);
+  num_surfaces = driver->stats.num_surfaces;
+  num_surface_bytes = driver->stats.num_surface_bytes;
+  memset (&driver->stats, 0, sizeof (driver->stats));
+  memset (driver->rendered_buffers, 0, sizeof (driver->rendered_buffers));
+  driver->stats.num_surfaces = num_surfaces;
+  driver->stats.num_surface_bytes = num_surface_bytes;
+  g_mutex_unlock (&driver->lock);
+}
@@ -0,0 +1,58 @@
+/*
+ *  gstvaapidriver_mock.h - In-process VA driver for the mock display
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef GST_VAAPI_DRIVER_MOCK_H
+#define GST_VAAPI_DRIVER_MOCK_H
+
+#include <va/va.h>
+#include <gst/vaapi/gstvaapidisplay_mock.h>
+
+G_BEGIN_DECLS
+
+G_GNUC_INTERNAL
+VADisplay
+gst_vaapi_driver_mock_get_display (void);
+
+G_GNUC_INTERNAL
+gboolean
+gst_vaapi_driver_mock_initialize (VADisplay va_display);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_driver_mock_terminate (VADisplay va_display);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_driver_mock_get_stats (VADisplay va_display,
+    GstVaapiDisplayMockStats * stats);
+
+G_GNUC_INTERNAL
+guint
+gst_vaapi_driver_mock_get_rendered_buffers (VADisplay va_display,
+    VABufferType type);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_driver_mock_reset_stats (VADisplay va_display);
+
+G_END_DECLS
+
+#endif /* GST_VAAPI_DRIVER_MOCK_H */
@@ -34,6 +34,10 @@
 #define DEBUG 1
 #include "gstvaapidebug.h"
 
+/* Interval at which the status of the oldest submitted picture is
+   checked, while it is within the async depth (microseconds) */
+#define CODED_BUFFER_POLL_INTERVAL 1000
+
 /* Helper function to create a new encoder property object */
 static GstVaapiEncoderPropData *
 prop_new (gint id, GParamSpec * pspec)
@@ -193,6 +197,35 @@ gst_vaapi_encoder_properties_get_default (const GstVaapiEncoderClass * klass)
           " higher value means lower-quality/fast-encode)",
           1, 7, 4, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * GstVaapiEncoder:async-depth:
+   *
+   * The number of pictures kept submitted to the hardware before
+   * waiting for the oldest one to be encoded. Coded buffers that the
+   * hardware already completed are output regardless.
+   */
+  GST_VAAPI_ENCODER_PROPERTIES_APPEND (props,
+      GST_VAAPI_ENCODER_PROP_ASYNC_DEPTH,
+      g_param_spec_uint ("async-depth",
+          "Async Depth",
+          "Number of pictures submitted ahead of the one being output",
+          0, 16, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstVaapiEncoder:lookahead:
+   *
+   * The number of frames analysed ahead of the one being encoded. A
+   * frame that starts a new scene lasting over the lookahead is
+   * encoded as a key frame, by the encoders that support forcing key
+   * frames. Zero disables the analysis.
+   */
+  GST_VAAPI_ENCODER_PROPERTIES_APPEND (props,
+      GST_VAAPI_ENCODER_PROP_LOOKAHEAD,
+      g_param_spec_uint ("lookahead",
+          "Lookahead",
+          "Number of frames analysed ahead for scene cut detection",
+          0, 16, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   return props;
 }
 
@@ -260,6 +293,76 @@ gst_vaapi_encoder_ensure_param_control_rate (GstVaapiEncoder * encoder,
   return TRUE;
 }
 
+gboolean
+gst_vaapi_encoder_ensure_param_roi_regions (GstVaapiEncoder * encoder,
+    GstVaapiEncPicture * picture)
+{
+#if VA_CHECK_VERSION(0,39,1)
+  const GstVaapiConfigInfoEncoder *const config =
+      &encoder->context_info.config.encoder;
+  GstVaapiEncMiscParam *misc;
+  VAEncMiscParameterBufferROI *roi_param;
+  VAEncROI *region_roi;
+  gpointer ptr;
+  GList *tmp;
+  guint num_roi;
+  gint qp_hint = 0;
+
+  num_roi = encoder->roi_regions ? g_list_length (encoder->roi_regions) : 0;
+
+  /* With bitrate control, the QP hint of the lookahead applies to the
+     whole picture through a region that covers it, and offsets the
+     other regions. With CQP, it is part of the slice QP instead */
+  if (config->roi_capability && num_roi < config->roi_num_supported &&
+      GST_VAAPI_ENCODER_RATE_CONTROL (encoder) != GST_VAAPI_RATECONTROL_CQP)
+    qp_hint = gst_vaapi_encoder_get_qp_hint (encoder, picture->frame);
+  if (qp_hint != 0)
+    num_roi++;
+  if (num_roi == 0)
+    return TRUE;
+
+  /* ROI(Region of Interest) params */
+  misc = gst_vaapi_enc_misc_param_new (encoder, VAEncMiscParameterTypeROI,
+      sizeof (VAEncMiscParameterBufferROI) + num_roi * sizeof (VAEncROI));
+  if (!misc)
+    return FALSE;
+
+  roi_param = misc->data;
+  roi_param->roi_flags.bits.roi_value_is_qp_delta = 1;
+  roi_param->max_delta_qp = 10;
+  roi_param->min_delta_qp = 10;
+
+  ptr = (guchar *) misc->param + sizeof (VAEncMiscParameterBuffer) +
+      sizeof (VAEncMiscParameterBufferROI);
+  region_roi = ptr;
+
+  /* The first regions take precedence where they overlap */
+  for (tmp = encoder->roi_regions; tmp; tmp = tmp->next) {
+    GstVaapiROI *item = tmp->data;
+    region_roi->roi_value = item->roi_value + qp_hint;
+    region_roi->roi_rectangle.x = item->rect.x;
+    region_roi->roi_rectangle.y = item->rect.y;
+    region_roi->roi_rectangle.width = item->rect.width;
+    region_roi->roi_rectangle.height = item->rect.height;
+    region_roi++;
+  }
+  if (qp_hint != 0) {
+    region_roi->roi_value = qp_hint;
+    region_roi->roi_rectangle.x = 0;
+    region_roi->roi_rectangle.y = 0;
+    region_roi->roi_rectangle.width = GST_VAAPI_ENCODER_WIDTH (encoder);
+    region_roi->roi_rectangle.height = GST_VAAPI_ENCODER_HEIGHT (encoder);
+  }
+
+  roi_param->roi = ptr;
+  roi_param->num_roi = num_roi;
+
+  gst_vaapi_enc_picture_add_misc_param (picture, misc);
+  gst_vaapi_codec_object_replace (&misc, NULL);
+#endif
+  return TRUE;
+}
+
 /**
  * gst_vaapi_encoder_ref:
  * @encoder: a #GstVaapiEncoder
@@ -339,6 +442,14 @@ gst_vaapi_encoder_create_coded_buffer (GstVaapiEncoder * encoder)
   return codedbuf_proxy;
 }
 
+/* Notifies the encoder that an exported coded buffer was released */
+static void
+_coded_buffer_proxy_unexported_notify (GstVaapiEncoder * encoder)
+{
+  g_atomic_int_add (&encoder->num_codedbuf_exported, -1);
+  gst_vaapi_encoder_unref (encoder);
+}
+
 /* Notifies gst_vaapi_encoder_create_surface() that a new surface is free */
 static void
 _surface_proxy_released_notify (GstVaapiEncoder * encoder)
@@ -373,19 +484,8 @@ gst_vaapi_encoder_create_surface (GstVaapiEncoder * encoder)
   return proxy;
 }
 
-/**
- * gst_vaapi_encoder_put_frame:
- * @encoder: a #GstVaapiEncoder
- * @frame: a #GstVideoCodecFrame
- *
- * Queues a #GstVideoCodedFrame to the HW encoder. The encoder holds
- * an extra reference to the @frame.
- *
- * Return value: a #GstVaapiEncoderStatus
- */
-GstVaapiEncoderStatus
-gst_vaapi_encoder_put_frame (GstVaapiEncoder * encoder,
-    GstVideoCodecFrame * frame)
+static GstVaapiEncoderStatus
+put_frame (GstVaapiEncoder * encoder, GstVideoCodecFrame * frame)
 {
   GstVaapiEncoderClass *const klass = GST_VAAPI_ENCODER_GET_CLASS (encoder);
   GstVaapiEncoderStatus status;
@@ -410,8 +510,13 @@ gst_vaapi_encoder_put_frame (GstVaapiEncoder * encoder,
 
     gst_vaapi_coded_buffer_proxy_set_user_data (codedbuf_proxy,
         picture, (GDestroyNotify) gst_vaapi_mini_object_unref);
-    g_async_queue_push (encoder->codedbuf_queue, codedbuf_proxy);
+
+    g_mutex_lock (&encoder->mutex);
+    g_queue_push_tail (&encoder->codedbuf_queue, codedbuf_proxy);
     encoder->num_codedbuf_queued++;
+    encoder->codedbuf_drain = FALSE;
+    g_cond_signal (&encoder->codedbuf_ready);
+    g_mutex_unlock (&encoder->mutex);
 
     /* Try again with any pending reordered frame now available for encoding */
     frame = NULL;
@@ -439,6 +544,90 @@ error_encode:
   }
 }
 
+/**
+ * gst_vaapi_encoder_put_frame:
+ * @encoder: a #GstVaapiEncoder
+ * @frame: a #GstVideoCodecFrame
+ *
+ * Queues a #GstVideoCodedFrame to the HW encoder. The encoder holds
+ * an extra reference to the @frame. With a lookahead, the @frame is
+ * analysed first, and only submitted once the lookahead is full.
+ *
+ * Return value: a #GstVaapiEncoderStatus
+ */
+GstVaapiEncoderStatus
+gst_vaapi_encoder_put_frame (GstVaapiEncoder * encoder,
+    GstVideoCodecFrame * frame)
+{
+  GstVaapiEncoderStatus status;
+
+  if (!encoder->lookahead)
+    return put_frame (encoder, frame);
+
+  if (frame)
+    gst_vaapi_encoder_lookahead_push (encoder->lookahead, frame);
+
+  /* More than one frame may be released if the analysis lagged behind */
+  while ((frame = gst_vaapi_encoder_lookahead_pop (encoder->lookahead,
+              FALSE))) {
+    status = put_frame (encoder, frame);
+    gst_video_codec_frame_unref (frame);
+    if (status != GST_VAAPI_ENCODER_STATUS_SUCCESS)
+      return status;
+  }
+  return GST_VAAPI_ENCODER_STATUS_SUCCESS;
+}
+
+/* Returns the QP offset that the lookahead suggests for frame */
+gint
+gst_vaapi_encoder_get_qp_hint (GstVaapiEncoder * encoder,
+    GstVideoCodecFrame * frame)
+{
+  GstVaapiEncoderLookaheadHints hints;
+
+  if (!encoder->lookahead || !frame ||
+      !gst_vaapi_encoder_lookahead_get_hints (encoder->lookahead, frame,
+          &hints))
+    return 0;
+  return hints.qp_delta;
+}
+
+/* Checks whether the lookahead found high motion in frame, which is
+   then better coded as a P frame than as a B frame */
+gboolean
+gst_vaapi_encoder_is_high_motion (GstVaapiEncoder * encoder,
+    GstVideoCodecFrame * frame)
+{
+  GstVaapiEncoderLookaheadHints hints;
+
+  if (!encoder->lookahead || !frame ||
+      !gst_vaapi_encoder_lookahead_get_hints (encoder->lookahead, frame,
+          &hints))
+    return FALSE;
+  return hints.high_motion;
+}
+
+/* Checks whether the oldest coded buffer can be output: either the
+   async depth is exceeded, the stream is drained, or the hardware is
+   done with it already. Called with the encoder lock held */
+static gboolean
+is_coded_buffer_ready (GstVaapiEncoder * encoder,
+    GstVaapiCodedBufferProxy * codedbuf_proxy)
+{
+  GstVaapiEncPicture *picture;
+  GstVaapiSurfaceStatus status;
+
+  if (encoder->codedbuf_queue.length > encoder->async_depth)
+    return TRUE;
+  if (encoder->codedbuf_drain || encoder->codedbuf_flushing)
+    return TRUE;
+
+  picture = gst_vaapi_coded_buffer_proxy_get_user_data (codedbuf_proxy);
+  if (!gst_vaapi_surface_query_status (picture->surface, &status))
+    return TRUE;
+  return !(status & GST_VAAPI_SURFACE_STATUS_RENDERING);
+}
+
 /**
  * gst_vaapi_encoder_get_buffer_with_timeout:
  * @encoder: a #GstVaapiEncoder
@@ -451,6 +640,10 @@ error_encode:
  * after usage. Otherwise, @GST_VAAPI_DECODER_STATUS_ERROR_NO_BUFFER
  * is returned if no coded buffer is available so far (timeout).
  *
+ * With a non-zero #GstVaapiEncoder:async-depth, the oldest coded
+ * buffer is only returned once more pictures were submitted, once the
+ * hardware completed it, or after gst_vaapi_encoder_flush().
+ *
  * The parent frame is available as a #GstVideoCodecFrame attached to
  * the user-data anchor of the output coded buffer. Ownership of the
  * frame is transferred to the coded buffer.
@@ -463,8 +656,29 @@ gst_vaapi_encoder_get_buffer_with_timeout (GstVaapiEncoder * encoder,
 {
   GstVaapiEncPicture *picture;
   GstVaapiCodedBufferProxy *codedbuf_proxy;
+  gint64 now, end_time, wait_time;
+
+  now = g_get_monotonic_time ();
+  end_time = now + MIN (timeout, G_MAXINT64 - now);
 
-  codedbuf_proxy = g_async_queue_timeout_pop (encoder->codedbuf_queue, timeout);
+  g_mutex_lock (&encoder->mutex);
+  for (;;) {
+    codedbuf_proxy = g_queue_peek_head (&encoder->codedbuf_queue);
+    if (codedbuf_proxy && is_coded_buffer_ready (encoder, codedbuf_proxy)) {
+      g_queue_pop_head (&encoder->codedbuf_queue);
+      break;
+    }
+    if (encoder->codedbuf_flushing || now >= end_time)
+      break;
+
+    /* The hardware does not signal completion, so the status of the
+       oldest picture is polled while it is within the async depth */
+    wait_time = codedbuf_proxy ?
+        MIN (end_time, now + CODED_BUFFER_POLL_INTERVAL) : end_time;
+    g_cond_wait_until (&encoder->codedbuf_ready, &encoder->mutex, wait_time);
+    now = g_get_monotonic_time ();
+  }
+  g_mutex_unlock (&encoder->mutex);
   if (!codedbuf_proxy)
     return GST_VAAPI_ENCODER_STATUS_NO_BUFFER;
 
@@ -491,11 +705,62 @@ error_invalid_buffer:
   }
 }
 
+/**
+ * gst_vaapi_encoder_export_buffer:
+ * @encoder: a #GstVaapiEncoder
+ * @codedbuf_proxy: a #GstVaapiCodedBufferProxy retrieved from @encoder
+ *
+ * Wraps the coded data of @codedbuf_proxy into a new #GstBuffer,
+ * without any copy, see gst_vaapi_coded_buffer_proxy_export(). The
+ * user data of @codedbuf_proxy is replaced. At most the number of
+ * buffers set with gst_vaapi_encoder_set_export_buffers() are held
+ * at a time, so that the coded buffer pool never runs dry: past that,
+ * or if there is no coded data, %NULL is returned and the caller
+ * shall copy the coded buffer instead.
+ *
+ * Return value: a new #GstBuffer, or %NULL if @codedbuf_proxy was not
+ *   exported
+ */
+GstBuffer *
+gst_vaapi_encoder_export_buffer (GstVaapiEncoder * encoder,
+    GstVaapiCodedBufferProxy * codedbuf_proxy)
+{
+  GstBuffer *buffer;
+
+  g_return_val_if_fail (encoder != NULL, NULL);
+  g_return_val_if_fail (codedbuf_proxy != NULL, NULL);
+
+  if (g_atomic_int_add (&encoder->num_codedbuf_exported, 1) >=
+      (gint) encoder->export_buffers)
+    goto error_no_export;
+
+  buffer = gst_vaapi_coded_buffer_proxy_export (codedbuf_proxy);
+  if (!buffer)
+    goto error_no_export;
+  if (gst_buffer_get_size (buffer) == 0) {
+    gst_buffer_unref (buffer);
+    goto error_no_export;
+  }
+
+  gst_vaapi_coded_buffer_proxy_set_user_data (codedbuf_proxy,
+      gst_vaapi_encoder_ref (encoder),
+      (GDestroyNotify) _coded_buffer_proxy_unexported_notify);
+  return buffer;
+
+  /* ERRORS */
+error_no_export:
+  {
+    g_atomic_int_add (&encoder->num_codedbuf_exported, -1);
+    return NULL;
+  }
+}
+
 /**
  * gst_vaapi_encoder_flush:
  * @encoder: a #GstVaapiEncoder
  *
- * Submits any pending (reordered) frame for encoding.
+ * Submits any pending (reordered) frame for encoding, including the
+ * frames held by the lookahead.
  *
  * Return value: a #GstVaapiEncoderStatus
  */
@@ -503,8 +768,50 @@ GstVaapiEncoderStatus
 gst_vaapi_encoder_flush (GstVaapiEncoder * encoder)
 {
   GstVaapiEncoderClass *const klass = GST_VAAPI_ENCODER_GET_CLASS (encoder);
+  GstVaapiEncoderStatus status;
+  GstVideoCodecFrame *frame;
+
+  /* Submit the frames held by the lookahead first */
+  while (encoder->lookahead &&
+      (frame = gst_vaapi_encoder_lookahead_pop (encoder->lookahead, TRUE))) {
+    status = put_frame (encoder, frame);
+    gst_video_codec_frame_unref (frame);
+    if (status != GST_VAAPI_ENCODER_STATUS_SUCCESS) {
+      gst_vaapi_encoder_lookahead_reset (encoder->lookahead);
+      return status;
+    }
+  }
+
+  status = klass->flush (encoder);
+
+  /* All the submitted pictures can be output, regardless of the depth */
+  g_mutex_lock (&encoder->mutex);
+  encoder->codedbuf_drain = TRUE;
+  g_cond_broadcast (&encoder->codedbuf_ready);
+  g_mutex_unlock (&encoder->mutex);
+  return status;
+}
+
+/**
+ * gst_vaapi_encoder_set_flushing:
+ * @encoder: a #GstVaapiEncoder
+ * @flushing: whether to stop waiting for coded buffers
+ *
+ * While @flushing is set, gst_vaapi_encoder_get_buffer_with_timeout()
+ * no longer waits: it returns any coded buffer still queued, or
+ * %GST_VAAPI_ENCODER_STATUS_NO_BUFFER right away. Any thread blocked
+ * in there is woken up. This is meant for stopping the thread that
+ * retrieves the coded buffers.
+ */
+void
+gst_vaapi_encoder_set_flushing (GstVaapiEncoder * encoder, gboolean flushing)
+{
+  g_return_if_fail (encoder != NULL);
 
-  return klass->flush (encoder);
+  g_mutex_lock (&encoder->mutex);
+  encoder->codedbuf_flushing = flushing;
+  g_cond_broadcast (&encoder->codedbuf_ready);
+  g_mutex_unlock (&encoder->mutex);
 }
 
 /**
@@ -869,10 +1176,13 @@ gst_vaapi_encoder_reconfigure_internal (GstVaapiEncoder * encoder)
     pool = gst_vaapi_coded_buffer_pool_new (encoder, encoder->codedbuf_size);
     if (!pool)
       goto error_alloc_codedbuf_pool;
-    gst_vaapi_video_pool_set_capacity (pool, 5);
     gst_vaapi_video_pool_replace (&encoder->codedbuf_pool, pool);
     gst_vaapi_video_pool_unref (pool);
   }
+  /* Leave room for the pictures kept in flight, and for the coded
+     buffers held downstream */
+  gst_vaapi_video_pool_set_capacity (encoder->codedbuf_pool,
+      5 + encoder->async_depth + encoder->export_buffers);
   return GST_VAAPI_ENCODER_STATUS_SUCCESS;
 
   /* ERRORS */
@@ -982,6 +1292,14 @@ set_property (GstVaapiEncoder * encoder, gint prop_id, const GValue * value)
       status = gst_vaapi_encoder_set_quality_level (encoder,
           g_value_get_uint (value));
       break;
+    case GST_VAAPI_ENCODER_PROP_ASYNC_DEPTH:
+      status = gst_vaapi_encoder_set_async_depth (encoder,
+          g_value_get_uint (value));
+      break;
+    case GST_VAAPI_ENCODER_PROP_LOOKAHEAD:
+      status = gst_vaapi_encoder_set_lookahead (encoder,
+          g_value_get_uint (value));
+      break;
   }
   return status;
 
@@ -1243,6 +1561,124 @@ error_operation_failed:
   }
 }
 
+/**
+ * gst_vaapi_encoder_set_async_depth:
+ * @encoder: a #GstVaapiEncoder
+ * @async_depth: the number of pictures to keep submitted
+ *
+ * Notifies the @encoder to keep up to @async_depth pictures submitted
+ * to the hardware before gst_vaapi_encoder_get_buffer_with_timeout()
+ * waits for the oldest one to be encoded. Pictures that the hardware
+ * completed earlier are output right away. The default, zero, outputs
+ * each picture as soon as it is submitted.
+ *
+ * Note: the async depth can only be specified before the first frame
+ * is encoded. Afterwards, any change to this parameter causes
+ * gst_vaapi_encoder_set_async_depth() to return
+ * @GST_VAAPI_ENCODER_STATUS_ERROR_OPERATION_FAILED.
+ *
+ * Return value: a #GstVaapiEncoderStatus
+ */
+GstVaapiEncoderStatus
+gst_vaapi_encoder_set_async_depth (GstVaapiEncoder * encoder,
+    guint async_depth)
+{
+  g_return_val_if_fail (encoder != NULL, 0);
+
+  if (encoder->async_depth != async_depth && encoder->num_codedbuf_queued > 0)
+    goto error_operation_failed;
+
+  encoder->async_depth = async_depth;
+  return GST_VAAPI_ENCODER_STATUS_SUCCESS;
+
+  /* ERRORS */
+error_operation_failed:
+  {
+    GST_ERROR ("could not change async depth after encoding started");
+    return GST_VAAPI_ENCODER_STATUS_ERROR_OPERATION_FAILED;
+  }
+}
+
+/**
+ * gst_vaapi_encoder_set_export_buffers:
+ * @encoder: a #GstVaapiEncoder
+ * @export_buffers: the number of coded buffers held outside
+ *
+ * Notifies the @encoder that up to @export_buffers coded buffers may
+ * be held by the user once retrieved, e.g. when they are exported
+ * with gst_vaapi_coded_buffer_proxy_export(). The coded buffer pool
+ * is enlarged accordingly, so that encoding does not stall on them.
+ *
+ * Note: the number of exported buffers can only be specified before
+ * the first frame is encoded. Afterwards, any change to this
+ * parameter causes gst_vaapi_encoder_set_export_buffers() to return
+ * @GST_VAAPI_ENCODER_STATUS_ERROR_OPERATION_FAILED.
+ *
+ * Return value: a #GstVaapiEncoderStatus
+ */
+GstVaapiEncoderStatus
+gst_vaapi_encoder_set_export_buffers (GstVaapiEncoder * encoder,
+    guint export_buffers)
+{
+  g_return_val_if_fail (encoder != NULL, 0);
+
+  if (encoder->export_buffers != export_buffers &&
+      encoder->num_codedbuf_queued > 0)
+    goto error_operation_failed;
+
+  encoder->export_buffers = export_buffers;
+  return GST_VAAPI_ENCODER_STATUS_SUCCESS;
+
+  /* ERRORS */
+error_operation_failed:
+  {
+    GST_ERROR ("could not change exported buffers after encoding started");
+    return GST_VAAPI_ENCODER_STATUS_ERROR_OPERATION_FAILED;
+  }
+}
+
+/**
+ * gst_vaapi_encoder_set_lookahead:
+ * @encoder: a #GstVaapiEncoder
+ * @lookahead: the number of frames analysed ahead
+ *
+ * Notifies the @encoder to analyse each frame, and to hold it until
+ * @lookahead more frames are analysed. A frame that starts a new
+ * scene, which lasts over the @lookahead frames that follow, is
+ * marked as a forced key frame. Zero, the default, disables the
+ * analysis.
+ *
+ * Note: the lookahead can only be specified before the first frame
+ * is encoded. Afterwards, any change to this parameter causes
+ * gst_vaapi_encoder_set_lookahead() to return
+ * @GST_VAAPI_ENCODER_STATUS_ERROR_OPERATION_FAILED.
+ *
+ * Return value: a #GstVaapiEncoderStatus
+ */
+GstVaapiEncoderStatus
+gst_vaapi_encoder_set_lookahead (GstVaapiEncoder * encoder, guint lookahead)
+{
+  g_return_val_if_fail (encoder != NULL, 0);
+
+  if (encoder->lookahead_depth == lookahead)
+    return GST_VAAPI_ENCODER_STATUS_SUCCESS;
+  if (encoder->num_codedbuf_queued > 0)
+    goto error_operation_failed;
+
+  gst_vaapi_encoder_lookahead_free (encoder->lookahead);
+  encoder->lookahead = lookahead > 0 ?
+      gst_vaapi_encoder_lookahead_new (lookahead) : NULL;
+  encoder->lookahead_depth = lookahead;
+  return GST_VAAPI_ENCODER_STATUS_SUCCESS;
+
+  /* ERRORS */
+error_operation_failed:
+  {
+    GST_ERROR ("could not change lookahead after encoding started");
+    return GST_VAAPI_ENCODER_STATUS_ERROR_OPERATION_FAILED;
+  }
+}
+
 /* Initialize default values for configurable properties */
 static gboolean
 gst_vaapi_encoder_init_properties (GstVaapiEncoder * encoder)
@@ -1299,11 +1735,8 @@ gst_vaapi_encoder_init (GstVaapiEncoder * encoder, GstVaapiDisplay * display)
   g_mutex_init (&encoder->mutex);
   g_cond_init (&encoder->surface_free);
   g_cond_init (&encoder->codedbuf_free);
-
-  encoder->codedbuf_queue = g_async_queue_new_full ((GDestroyNotify)
-      gst_vaapi_coded_buffer_proxy_unref);
-  if (!encoder->codedbuf_queue)
-    return FALSE;
+  g_cond_init (&encoder->codedbuf_ready);
+  g_queue_init (&encoder->codedbuf_queue);
 
   if (!klass->init (encoder))
     return FALSE;
@@ -1327,6 +1760,9 @@ gst_vaapi_encoder_finalize (GstVaapiEncoder * encoder)
 
   klass->finalize (encoder);
 
+  gst_vaapi_encoder_lookahead_free (encoder->lookahead);
+  encoder->lookahead = NULL;
+
   if (encoder->roi_regions)
     g_list_free_full (encoder->roi_regions, g_free);
 
@@ -1339,13 +1775,13 @@ gst_vaapi_encoder_finalize (GstVaapiEncoder * encoder)
     encoder->properties = NULL;
   }
 
+  g_queue_foreach (&encoder->codedbuf_queue,
+      (GFunc) gst_vaapi_coded_buffer_proxy_unref, NULL);
+  g_queue_clear (&encoder->codedbuf_queue);
   gst_vaapi_video_pool_replace (&encoder->codedbuf_pool, NULL);
-  if (encoder->codedbuf_queue) {
-    g_async_queue_unref (encoder->codedbuf_queue);
-    encoder->codedbuf_queue = NULL;
-  }
   g_cond_clear (&encoder->surface_free);
   g_cond_clear (&encoder->codedbuf_free);
+  g_cond_clear (&encoder->codedbuf_ready);
   g_mutex_clear (&encoder->mutex);
 }
 
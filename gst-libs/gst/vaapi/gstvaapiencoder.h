@@ -117,6 +117,11 @@ typedef enum {
  * @GST_VAAPI_ENCODER_PROP_KEYFRAME_PERIOD: The maximal distance
  *   between two keyframes (uint).
  * @GST_VAAPI_ENCODER_PROP_TUNE: The tuning options (#GstVaapiEncoderTune).
+ * @GST_VAAPI_ENCODER_PROP_QUALITY_LEVEL: The encoding quality level (uint).
+ * @GST_VAAPI_ENCODER_PROP_ASYNC_DEPTH: The number of pictures kept
+ *   submitted to the hardware before waiting for the oldest one (uint).
+ * @GST_VAAPI_ENCODER_PROP_LOOKAHEAD: The number of frames analysed
+ *   ahead of the one being encoded, for scene cut detection (uint).
  *
  * The set of configurable properties for the encoder.
  */
@@ -125,7 +130,9 @@ typedef enum {
   GST_VAAPI_ENCODER_PROP_BITRATE,
   GST_VAAPI_ENCODER_PROP_KEYFRAME_PERIOD,
   GST_VAAPI_ENCODER_PROP_TUNE,
-  GST_VAAPI_ENCODER_PROP_QUALITY_LEVEL
+  GST_VAAPI_ENCODER_PROP_QUALITY_LEVEL,
+  GST_VAAPI_ENCODER_PROP_ASYNC_DEPTH,
+  GST_VAAPI_ENCODER_PROP_LOOKAHEAD
 } GstVaapiEncoderProp;
 
 /**
@@ -196,6 +203,25 @@ GstVaapiEncoderStatus
 gst_vaapi_encoder_set_quality_level (GstVaapiEncoder * encoder,
     guint quality_level);
 
+GstVaapiEncoderStatus
+gst_vaapi_encoder_set_async_depth (GstVaapiEncoder * encoder,
+    guint async_depth);
+
+GstVaapiEncoderStatus
+gst_vaapi_encoder_set_export_buffers (GstVaapiEncoder * encoder,
+    guint export_buffers);
+
+GstVaapiEncoderStatus
+gst_vaapi_encoder_set_lookahead (GstVaapiEncoder * encoder, guint lookahead);
+
+void
+gst_vaapi_encoder_set_flushing (GstVaapiEncoder * encoder,
+    gboolean flushing);
+
+GstBuffer *
+gst_vaapi_encoder_export_buffer (GstVaapiEncoder * encoder,
+    GstVaapiCodedBufferProxy * codedbuf_proxy);
+
 GstVaapiEncoderStatus
 gst_vaapi_encoder_get_buffer_with_timeout (GstVaapiEncoder * encoder,
     GstVaapiCodedBufferProxy ** out_codedbuf_proxy_ptr, guint64 timeout);
@@ -145,6 +145,32 @@ typedef struct _GstVaapiH264ViewReorderPool
   guint cur_present_index;
 } GstVaapiH264ViewReorderPool;
 
+/* Parameters a packed SPS is generated from */
+typedef struct
+{
+  VAEncSequenceParameterBufferH264 seq_param;
+  guint32 hrd_buffer_size;
+  guint32 hrd_initial_buffer_fullness;
+  GstVaapiProfile profile;
+} GstVaapiH264SpsCacheKey;
+
+/* Parameters a packed PPS is generated from, i.e. the picture
+   parameters without the ones specific to the current picture */
+typedef struct
+{
+  VAEncPictureParameterBufferH264 pic_param;
+  GstVaapiProfile profile;
+} GstVaapiH264PpsCacheKey;
+
+/* Packed slice header template. The slices of a picture only differ in
+   first_mb_in_slice, so everything around it is written once */
+typedef struct
+{
+  GstBitWriter head;            /* start code and NAL unit header */
+  GstBitWriter tail;            /* syntax elements after first_mb_in_slice */
+  gboolean is_valid;
+} GstVaapiH264SliceHeaderTemplate;
+
 static inline gboolean
 _poc_greater_than (guint poc1, guint poc2, guint max_poc)
 {
@@ -734,6 +760,10 @@ struct _GstVaapiEncoderH264
   GstBuffer *subset_sps_data;
   GstBuffer *pps_data;
 
+  /* packed headers reused until the next reconfiguration */
+  GstVaapiEncPackedHeaderCache sps_cache;
+  GstVaapiEncPackedHeaderCache pps_cache[MAX_NUM_VIEWS];
+
   guint bitrate_bits;           // bitrate (bits)
   guint cpb_length;             // length of CPB buffer (ms)
   guint cpb_length_bits;        // length of CPB buffer (bits)
@@ -844,9 +874,9 @@ bs_error:
   }
 }
 
-/* Write a Slice NAL unit */
+/* Write the Slice header syntax elements that follow first_mb_in_slice */
 static gboolean
-bs_write_slice (GstBitWriter * bs,
+bs_write_slice_tail (GstBitWriter * bs,
     const VAEncSliceParameterBufferH264 * slice_param,
     GstVaapiEncoderH264 * encoder, GstVaapiEncPicture * picture)
 {
@@ -858,8 +888,6 @@ bs_write_slice (GstBitWriter * bs,
   guint32 long_term_reference_flag = 0;
   guint32 adaptive_ref_pic_marking_mode_flag = 0;
 
-  /* first_mb_in_slice */
-  WRITE_UE (bs, slice_param->macroblock_address);
   /* slice_type */
   WRITE_UE (bs, slice_param->slice_type);
   /* pic_parameter_set_id */
@@ -1331,16 +1359,49 @@ fill_hrd_params (GstVaapiEncoderH264 * encoder, VAEncMiscParameterHRD * hrd)
   }
 }
 
+static void
+sps_cache_key_init (GstVaapiH264SpsCacheKey * key,
+    const VAEncSequenceParameterBufferH264 * seq_param,
+    const VAEncMiscParameterHRD * hrd_params, GstVaapiProfile profile)
+{
+  memset (key, 0, sizeof (*key));
+  memcpy (&key->seq_param, seq_param, sizeof (key->seq_param));
+  key->hrd_buffer_size = hrd_params->buffer_size;
+  key->hrd_initial_buffer_fullness = hrd_params->initial_buffer_fullness;
+  key->profile = profile;
+}
+
+static void
+pps_cache_key_init (GstVaapiH264PpsCacheKey * key,
+    const VAEncPictureParameterBufferH264 * pic_param, GstVaapiProfile profile)
+{
+  VAEncPictureParameterBufferH264 *const param = &key->pic_param;
+
+  memset (key, 0, sizeof (*key));
+  memcpy (param, pic_param, sizeof (*param));
+  memset (&param->CurrPic, 0, sizeof (param->CurrPic));
+  memset (param->ReferenceFrames, 0, sizeof (param->ReferenceFrames));
+  param->coded_buf = VA_INVALID_ID;
+  param->frame_num = 0;
+  param->last_picture = 0;
+  param->pic_fields.bits.idr_pic_flag = 0;
+  param->pic_fields.bits.reference_pic_flag = 0;
+  key->profile = profile;
+}
+
 static gboolean
 add_packed_au_delimiter (GstVaapiEncoderH264 * encoder,
     GstVaapiEncPicture * picture)
 {
   GstVaapiEncPackedHeader *packed_aud;
   GstBitWriter bs;
+  gint64 start_time;
   VAEncPackedHeaderParameterBuffer packed_header_param_buffer = { 0 };
   guint32 data_bit_size;
   guint8 *data;
 
+  start_time = gst_vaapi_encoder_header_stats_start (GST_VAAPI_ENCODER
+      (encoder));
   gst_bit_writer_init (&bs, 128 * 8);
   WRITE_UINT32 (&bs, 0x00000001, 32);   /* start code */
   bs_write_nal_header (&bs, GST_H264_NAL_REF_IDC_NONE,
@@ -1361,6 +1422,8 @@ add_packed_au_delimiter (GstVaapiEncoderH264 * encoder,
       &packed_header_param_buffer, sizeof (packed_header_param_buffer),
       data, (data_bit_size + 7) / 8);
   g_assert (packed_aud);
+  gst_vaapi_encoder_header_stats_add (GST_VAAPI_ENCODER (encoder),
+      start_time, (data_bit_size + 7) / 8);
 
   gst_vaapi_enc_picture_add_packed_header (picture, packed_aud);
   gst_vaapi_codec_object_replace (&packed_aud, NULL);
@@ -1385,20 +1448,18 @@ add_packed_sequence_header (GstVaapiEncoderH264 * encoder,
 {
   GstVaapiEncPackedHeader *packed_seq;
   GstBitWriter bs;
+  gint64 start_time;
   VAEncPackedHeaderParameterBuffer packed_seq_param = { 0 };
   const VAEncSequenceParameterBufferH264 *const seq_param = sequence->param;
   GstVaapiProfile profile = encoder->profile;
 
   VAEncMiscParameterHRD hrd_params;
+  GstVaapiH264SpsCacheKey key;
   guint32 data_bit_size;
   guint8 *data;
 
   fill_hrd_params (encoder, &hrd_params);
 
-  gst_bit_writer_init (&bs, 128 * 8);
-  WRITE_UINT32 (&bs, 0x00000001, 32);   /* start code */
-  bs_write_nal_header (&bs, GST_H264_NAL_REF_IDC_HIGH, GST_H264_NAL_SPS);
-
   /* Set High profile for encoding the MVC base view. Otherwise, some
      traditional decoder cannot recognize MVC profile streams with
      only the base view in there */
@@ -1406,6 +1467,22 @@ add_packed_sequence_header (GstVaapiEncoderH264 * encoder,
       profile == GST_VAAPI_PROFILE_H264_STEREO_HIGH)
     profile = GST_VAAPI_PROFILE_H264_HIGH;
 
+  /* Submit the previous SPS again, if it is still up-to-date */
+  sps_cache_key_init (&key, seq_param, &hrd_params, profile);
+  packed_seq = gst_vaapi_enc_packed_header_cache_lookup (&encoder->sps_cache,
+      &key, sizeof (key));
+  if (packed_seq) {
+    gst_vaapi_enc_picture_add_packed_header (picture, packed_seq);
+    gst_vaapi_codec_object_replace (&packed_seq, NULL);
+    return TRUE;
+  }
+
+  start_time = gst_vaapi_encoder_header_stats_start (GST_VAAPI_ENCODER
+      (encoder));
+  gst_bit_writer_init (&bs, 128 * 8);
+  WRITE_UINT32 (&bs, 0x00000001, 32);   /* start code */
+  bs_write_nal_header (&bs, GST_H264_NAL_REF_IDC_HIGH, GST_H264_NAL_SPS);
+
   bs_write_sps (&bs, seq_param, profile, &hrd_params);
 
   g_assert (GST_BIT_WRITER_BIT_SIZE (&bs) % 8 == 0);
@@ -1420,6 +1497,10 @@ add_packed_sequence_header (GstVaapiEncoderH264 * encoder,
       &packed_seq_param, sizeof (packed_seq_param),
       data, (data_bit_size + 7) / 8);
   g_assert (packed_seq);
+  gst_vaapi_encoder_header_stats_add (GST_VAAPI_ENCODER (encoder),
+      start_time, (data_bit_size + 7) / 8);
+  gst_vaapi_enc_packed_header_cache_store (&encoder->sps_cache, packed_seq,
+      &key, sizeof (key));
 
   gst_vaapi_enc_picture_add_packed_header (picture, packed_seq);
   gst_vaapi_codec_object_replace (&packed_seq, NULL);
@@ -1444,6 +1525,7 @@ add_packed_sequence_header_mvc (GstVaapiEncoderH264 * encoder,
 {
   GstVaapiEncPackedHeader *packed_seq;
   GstBitWriter bs;
+  gint64 start_time;
   VAEncPackedHeaderParameterBuffer packed_header_param_buffer = { 0 };
   const VAEncSequenceParameterBufferH264 *const seq_param = sequence->param;
   VAEncMiscParameterHRD hrd_params;
@@ -1453,6 +1535,8 @@ add_packed_sequence_header_mvc (GstVaapiEncoderH264 * encoder,
   fill_hrd_params (encoder, &hrd_params);
 
   /* non-base layer, pack one subset sps */
+  start_time = gst_vaapi_encoder_header_stats_start (GST_VAAPI_ENCODER
+      (encoder));
   gst_bit_writer_init (&bs, 128 * 8);
   WRITE_UINT32 (&bs, 0x00000001, 32);   /* start code */
   bs_write_nal_header (&bs, GST_H264_NAL_REF_IDC_HIGH, GST_H264_NAL_SUBSET_SPS);
@@ -1472,6 +1556,8 @@ add_packed_sequence_header_mvc (GstVaapiEncoderH264 * encoder,
       &packed_header_param_buffer, sizeof (packed_header_param_buffer),
       data, (data_bit_size + 7) / 8);
   g_assert (packed_seq);
+  gst_vaapi_encoder_header_stats_add (GST_VAAPI_ENCODER (encoder),
+      start_time, (data_bit_size + 7) / 8);
 
   gst_vaapi_enc_picture_add_packed_header (picture, packed_seq);
   gst_vaapi_mini_object_replace ((GstVaapiMiniObject **) & packed_seq, NULL);
@@ -1498,11 +1584,27 @@ add_packed_picture_header (GstVaapiEncoderH264 * encoder,
 {
   GstVaapiEncPackedHeader *packed_pic;
   GstBitWriter bs;
+  gint64 start_time;
   VAEncPackedHeaderParameterBuffer packed_pic_param = { 0 };
   const VAEncPictureParameterBufferH264 *const pic_param = picture->param;
+  GstVaapiEncPackedHeaderCache *const pps_cache =
+      &encoder->pps_cache[encoder->view_idx];
+  GstVaapiH264PpsCacheKey key;
   guint32 data_bit_size;
   guint8 *data;
 
+  /* Submit the previous PPS again, if it is still up-to-date */
+  pps_cache_key_init (&key, pic_param, encoder->profile);
+  packed_pic = gst_vaapi_enc_packed_header_cache_lookup (pps_cache,
+      &key, sizeof (key));
+  if (packed_pic) {
+    gst_vaapi_enc_picture_add_packed_header (picture, packed_pic);
+    gst_vaapi_codec_object_replace (&packed_pic, NULL);
+    return TRUE;
+  }
+
+  start_time = gst_vaapi_encoder_header_stats_start (GST_VAAPI_ENCODER
+      (encoder));
   gst_bit_writer_init (&bs, 128 * 8);
   WRITE_UINT32 (&bs, 0x00000001, 32);   /* start code */
   bs_write_nal_header (&bs, GST_H264_NAL_REF_IDC_HIGH, GST_H264_NAL_PPS);
@@ -1519,6 +1621,10 @@ add_packed_picture_header (GstVaapiEncoderH264 * encoder,
       &packed_pic_param, sizeof (packed_pic_param),
       data, (data_bit_size + 7) / 8);
   g_assert (packed_pic);
+  gst_vaapi_encoder_header_stats_add (GST_VAAPI_ENCODER (encoder),
+      start_time, (data_bit_size + 7) / 8);
+  gst_vaapi_enc_packed_header_cache_store (pps_cache, packed_pic,
+      &key, sizeof (key));
 
   gst_vaapi_enc_picture_add_packed_header (picture, packed_pic);
   gst_vaapi_codec_object_replace (&packed_pic, NULL);
@@ -1543,12 +1649,15 @@ add_packed_sei_header (GstVaapiEncoderH264 * encoder,
 {
   GstVaapiEncPackedHeader *packed_sei;
   GstBitWriter bs, bs_buf_period, bs_pic_timing;
+  gint64 start_time;
   VAEncPackedHeaderParameterBuffer packed_sei_param = { 0 };
   guint32 data_bit_size;
   guint8 buf_period_payload_size = 0, pic_timing_payload_size = 0;
   guint8 *data, *buf_period_payload = NULL, *pic_timing_payload = NULL;
   gboolean need_buf_period, need_pic_timing;
 
+  start_time = gst_vaapi_encoder_header_stats_start (GST_VAAPI_ENCODER
+      (encoder));
   gst_bit_writer_init (&bs_buf_period, 128 * 8);
   gst_bit_writer_init (&bs_pic_timing, 128 * 8);
   gst_bit_writer_init (&bs, 128 * 8);
@@ -1610,6 +1719,8 @@ add_packed_sei_header (GstVaapiEncoderH264 * encoder,
       &packed_sei_param, sizeof (packed_sei_param),
       data, (data_bit_size + 7) / 8);
   g_assert (packed_sei);
+  gst_vaapi_encoder_header_stats_add (GST_VAAPI_ENCODER (encoder),
+      start_time, (data_bit_size + 7) / 8);
 
   gst_vaapi_enc_picture_add_packed_header (picture, packed_sei);
   gst_vaapi_codec_object_replace (&packed_sei, NULL);
@@ -1664,11 +1775,14 @@ add_packed_prefix_nal_header (GstVaapiEncoderH264 * encoder,
 {
   GstVaapiEncPackedHeader *packed_prefix_nal;
   GstBitWriter bs;
+  gint64 start_time;
   VAEncPackedHeaderParameterBuffer packed_prefix_nal_param = { 0 };
   guint32 data_bit_size;
   guint8 *data;
   guint8 nal_ref_idc, nal_unit_type;
 
+  start_time = gst_vaapi_encoder_header_stats_start (GST_VAAPI_ENCODER
+      (encoder));
   gst_bit_writer_init (&bs, 128 * 8);
   WRITE_UINT32 (&bs, 0x00000001, 32);   /* start code */
 
@@ -1691,6 +1805,8 @@ add_packed_prefix_nal_header (GstVaapiEncoderH264 * encoder,
       &packed_prefix_nal_param, sizeof (packed_prefix_nal_param), data,
       (data_bit_size + 7) / 8);
   g_assert (packed_prefix_nal);
+  gst_vaapi_encoder_header_stats_add (GST_VAAPI_ENCODER (encoder),
+      start_time, (data_bit_size + 7) / 8);
 
   gst_vaapi_enc_slice_add_packed_header (slice, packed_prefix_nal);
   gst_vaapi_codec_object_replace (&packed_prefix_nal, NULL);
@@ -1710,32 +1826,85 @@ bs_error:
 
 /* Adds the supplied slice header to the list of packed
    headers to pass down as-is to the encoder */
+static void
+slice_header_template_clear (GstVaapiH264SliceHeaderTemplate * tmpl)
+{
+  if (!tmpl->is_valid)
+    return;
+
+  gst_bit_writer_clear (&tmpl->head, TRUE);
+  gst_bit_writer_clear (&tmpl->tail, TRUE);
+  tmpl->is_valid = FALSE;
+}
+
+/* Writes the slice header template of the picture from its first slice */
 static gboolean
-add_packed_slice_header (GstVaapiEncoderH264 * encoder,
-    GstVaapiEncPicture * picture, GstVaapiEncSlice * slice)
+ensure_slice_header_template (GstVaapiH264SliceHeaderTemplate * tmpl,
+    GstVaapiEncoderH264 * encoder, GstVaapiEncPicture * picture,
+    const VAEncSliceParameterBufferH264 * slice_param)
 {
-  GstVaapiEncPackedHeader *packed_slice;
-  GstBitWriter bs;
-  VAEncPackedHeaderParameterBuffer packed_slice_param = { 0 };
-  const VAEncSliceParameterBufferH264 *const slice_param = slice->param;
-  guint32 data_bit_size;
-  guint8 *data;
   guint8 nal_ref_idc, nal_unit_type;
 
-  gst_bit_writer_init (&bs, 128 * 8);
-  WRITE_UINT32 (&bs, 0x00000001, 32);   /* start code */
+  if (tmpl->is_valid)
+    return TRUE;
+
+  gst_bit_writer_init (&tmpl->head, 16 * 8);
+  gst_bit_writer_init (&tmpl->tail, 128 * 8);
+  tmpl->is_valid = TRUE;
+
+  WRITE_UINT32 (&tmpl->head, 0x00000001, 32);   /* start code */
 
   if (!get_nal_hdr_attributes (picture, &nal_ref_idc, &nal_unit_type))
     goto bs_error;
   /* pack nal_unit_header_mvc_extension() for the non base view */
   if (encoder->is_mvc && encoder->view_idx) {
-    bs_write_nal_header (&bs, nal_ref_idc, GST_H264_NAL_SLICE_EXT);
-    bs_write_nal_header_mvc_extension (&bs, picture,
+    bs_write_nal_header (&tmpl->head, nal_ref_idc, GST_H264_NAL_SLICE_EXT);
+    bs_write_nal_header_mvc_extension (&tmpl->head, picture,
         encoder->view_ids[encoder->view_idx]);
   } else
-    bs_write_nal_header (&bs, nal_ref_idc, nal_unit_type);
+    bs_write_nal_header (&tmpl->head, nal_ref_idc, nal_unit_type);
 
-  bs_write_slice (&bs, slice_param, encoder, picture);
+  if (!bs_write_slice_tail (&tmpl->tail, slice_param, encoder, picture))
+    goto bs_error;
+  return TRUE;
+
+  /* ERRORS */
+bs_error:
+  {
+    slice_header_template_clear (tmpl);
+    return FALSE;
+  }
+}
+
+/* Adds the slice header to the list of packed headers of the slice,
+   from the slice header template of the picture */
+static gboolean
+add_packed_slice_header (GstVaapiEncoderH264 * encoder,
+    GstVaapiEncPicture * picture, GstVaapiEncSlice * slice,
+    GstVaapiH264SliceHeaderTemplate * tmpl)
+{
+  GstVaapiEncPackedHeader *packed_slice;
+  GstBitWriter bs;
+  gint64 start_time;
+  VAEncPackedHeaderParameterBuffer packed_slice_param = { 0 };
+  const VAEncSliceParameterBufferH264 *const slice_param = slice->param;
+  guint32 data_bit_size;
+  guint8 *data;
+
+  start_time = gst_vaapi_encoder_header_stats_start (GST_VAAPI_ENCODER
+      (encoder));
+  if (!ensure_slice_header_template (tmpl, encoder, picture, slice_param)) {
+    GST_WARNING ("failed to write Slice NAL unit header");
+    return FALSE;
+  }
+
+  gst_bit_writer_init (&bs, 128 * 8);
+  if (!bs_write_bits (&bs, &tmpl->head))
+    goto bs_error;
+  /* first_mb_in_slice */
+  WRITE_UE (&bs, slice_param->macroblock_address);
+  if (!bs_write_bits (&bs, &tmpl->tail))
+    goto bs_error;
   data_bit_size = GST_BIT_WRITER_BIT_SIZE (&bs);
   data = GST_BIT_WRITER_DATA (&bs);
 
@@ -1747,6 +1916,8 @@ add_packed_slice_header (GstVaapiEncoderH264 * encoder,
       &packed_slice_param, sizeof (packed_slice_param),
       data, (data_bit_size + 7) / 8);
   g_assert (packed_slice);
+  gst_vaapi_encoder_header_stats_add (GST_VAAPI_ENCODER (encoder),
+      start_time, (data_bit_size + 7) / 8);
 
   gst_vaapi_enc_slice_add_packed_header (slice, packed_slice);
   gst_vaapi_codec_object_replace (&packed_slice, NULL);
@@ -2043,6 +2214,7 @@ add_slice_headers (GstVaapiEncoderH264 * encoder, GstVaapiEncPicture * picture,
 {
   VAEncSliceParameterBufferH264 *slice_param;
   GstVaapiEncSlice *slice;
+  GstVaapiH264SliceHeaderTemplate slice_tmpl = { {0,}, {0,}, FALSE };
   guint slice_of_mbs, slice_mod_mbs, cur_slice_mbs;
   guint mb_size;
   guint last_mb_index;
@@ -2162,6 +2334,9 @@ add_slice_headers (GstVaapiEncoderH264 * encoder, GstVaapiEncPicture * picture,
       } else if (picture->type == GST_VAAPI_PICTURE_TYPE_B) {
         slice_param->slice_qp_delta += encoder->qp_ib;
       }
+      slice_param->slice_qp_delta +=
+          gst_vaapi_encoder_get_qp_hint (GST_VAAPI_ENCODER_CAST (encoder),
+          picture->frame);
       if ((gint) encoder->init_qp + slice_param->slice_qp_delta <
           (gint) encoder->min_qp) {
         slice_param->slice_qp_delta = encoder->min_qp - encoder->init_qp;
@@ -2186,25 +2361,28 @@ add_slice_headers (GstVaapiEncoderH264 * encoder, GstVaapiEncPicture * picture,
       goto error_create_packed_prefix_nal_hdr;
     if ((GST_VAAPI_ENCODER_PACKED_HEADERS (encoder) &
             VA_ENC_PACKED_HEADER_SLICE)
-        && !add_packed_slice_header (encoder, picture, slice))
+        && !add_packed_slice_header (encoder, picture, slice, &slice_tmpl))
       goto error_create_packed_slice_hdr;
 
     gst_vaapi_enc_picture_add_slice (picture, slice);
     gst_vaapi_codec_object_replace (&slice, NULL);
   }
   g_assert (last_mb_index == mb_size);
+  slice_header_template_clear (&slice_tmpl);
   return TRUE;
 
 error_create_packed_slice_hdr:
   {
     GST_ERROR ("failed to create packed slice header buffer");
     gst_vaapi_codec_object_replace (&slice, NULL);
+    slice_header_template_clear (&slice_tmpl);
     return FALSE;
   }
 error_create_packed_prefix_nal_hdr:
   {
     GST_ERROR ("failed to create packed prefix nal header buffer");
     gst_vaapi_codec_object_replace (&slice, NULL);
+    slice_header_template_clear (&slice_tmpl);
     return FALSE;
   }
 }
@@ -2301,10 +2479,6 @@ static gboolean
 ensure_misc_params (GstVaapiEncoderH264 * encoder, GstVaapiEncPicture * picture)
 {
   GstVaapiEncoder *const base_encoder = GST_VAAPI_ENCODER_CAST (encoder);
-#if VA_CHECK_VERSION(0,39,1)
-  GstVaapiEncMiscParam *misc;
-  guint num_roi;
-#endif
 
   if (!gst_vaapi_encoder_ensure_param_control_rate (base_encoder, picture))
     return FALSE;
@@ -2327,47 +2501,9 @@ ensure_misc_params (GstVaapiEncoderH264 * encoder, GstVaapiEncPicture * picture)
         goto error_create_packed_sei_hdr;
     }
   }
-#if VA_CHECK_VERSION(0,39,1)
   /* region-of-interest params */
-  num_roi = base_encoder->roi_regions ?
-      g_list_length (base_encoder->roi_regions) : 0;
-  if (num_roi > 0) {
-    /* ROI(Region of Interest) params */
-    VAEncMiscParameterBufferROI *roi_param;
-    VAEncROI *region_roi;
-    gpointer ptr;
-    GList *tmp;
-
-    misc =
-        gst_vaapi_enc_misc_param_new (base_encoder, VAEncMiscParameterTypeROI,
-        sizeof (VAEncMiscParameterBufferROI) + num_roi * sizeof (VAEncROI));
-
-    roi_param = misc->data;
-    roi_param->roi_flags.bits.roi_value_is_qp_delta = 1;
-    roi_param->max_delta_qp = 10;
-    roi_param->min_delta_qp = 10;
-
-    ptr = (guchar *) misc->param + sizeof (VAEncMiscParameterBuffer) +
-        sizeof (VAEncMiscParameterBufferROI);
-    region_roi = ptr;
-
-    for (tmp = base_encoder->roi_regions; tmp; tmp = tmp->next) {
-      GstVaapiROI *item = tmp->data;
-      region_roi->roi_value = item->roi_value;
-      region_roi->roi_rectangle.x = item->rect.x;
-      region_roi->roi_rectangle.y = item->rect.y;
-      region_roi->roi_rectangle.width = item->rect.width;
-      region_roi->roi_rectangle.height = item->rect.height;
-      region_roi++;
-    }
-
-    roi_param->roi = ptr;
-    roi_param->num_roi = num_roi;
-
-    gst_vaapi_enc_picture_add_misc_param (picture, misc);
-    gst_vaapi_codec_object_replace (&misc, NULL);
-  }
-#endif
+  if (!gst_vaapi_encoder_ensure_param_roi_regions (base_encoder, picture))
+    return FALSE;
 
   if (!gst_vaapi_encoder_ensure_param_quality_level (base_encoder, picture))
     return FALSE;
@@ -2852,11 +2988,13 @@ gst_vaapi_encoder_h264_reordering (GstVaapiEncoder * base_encoder,
     goto end;
   }
 
-  /* new p/b frames coming */
+  /* new p/b frames coming. A frame with high motion is coded as a P
+     frame right away, with fewer B frames before it */
   ++reorder_pool->frame_index;
   if (reorder_pool->reorder_state == GST_VAAPI_ENC_H264_REORD_WAIT_FRAMES &&
       g_queue_get_length (&reorder_pool->reorder_frame_list) <
-      encoder->num_bframes) {
+      encoder->num_bframes &&
+      !gst_vaapi_encoder_is_high_motion (base_encoder, frame)) {
     g_queue_push_tail (&reorder_pool->reorder_frame_list, picture);
     return GST_VAAPI_ENCODER_STATUS_NO_SURFACE;
   }
@@ -2864,11 +3002,11 @@ gst_vaapi_encoder_h264_reordering (GstVaapiEncoder * base_encoder,
   ++reorder_pool->cur_frame_num;
   set_p_frame (picture, encoder);
 
-  if (reorder_pool->reorder_state == GST_VAAPI_ENC_H264_REORD_WAIT_FRAMES) {
+  if (reorder_pool->reorder_state == GST_VAAPI_ENC_H264_REORD_WAIT_FRAMES &&
+      !g_queue_is_empty (&reorder_pool->reorder_frame_list)) {
     g_queue_foreach (&reorder_pool->reorder_frame_list, (GFunc) set_b_frame,
         encoder);
     reorder_pool->reorder_state = GST_VAAPI_ENC_H264_REORD_DUMP_FRAMES;
-    g_assert (!g_queue_is_empty (&reorder_pool->reorder_frame_list));
   }
 
 end:
@@ -2940,6 +3078,17 @@ set_context_info (GstVaapiEncoder * base_encoder)
   return GST_VAAPI_ENCODER_STATUS_SUCCESS;
 }
 
+/* Drops the packed headers bound to the previous configuration */
+static void
+clear_packed_header_caches (GstVaapiEncoderH264 * encoder)
+{
+  guint i;
+
+  gst_vaapi_enc_packed_header_cache_clear (&encoder->sps_cache);
+  for (i = 0; i < MAX_NUM_VIEWS; i++)
+    gst_vaapi_enc_packed_header_cache_clear (&encoder->pps_cache[i]);
+}
+
 static GstVaapiEncoderStatus
 gst_vaapi_encoder_h264_reconfigure (GstVaapiEncoder * base_encoder)
 {
@@ -2948,6 +3097,8 @@ gst_vaapi_encoder_h264_reconfigure (GstVaapiEncoder * base_encoder)
   GstVaapiEncoderStatus status;
   guint mb_width, mb_height;
 
+  clear_packed_header_caches (encoder);
+
   mb_width = (GST_VAAPI_ENCODER_WIDTH (encoder) + 15) / 16;
   mb_height = (GST_VAAPI_ENCODER_HEIGHT (encoder) + 15) / 16;
   if (mb_width != encoder->mb_width || mb_height != encoder->mb_height) {
@@ -3029,6 +3180,7 @@ gst_vaapi_encoder_h264_finalize (GstVaapiEncoder * base_encoder)
   gst_buffer_replace (&encoder->sps_data, NULL);
   gst_buffer_replace (&encoder->subset_sps_data, NULL);
   gst_buffer_replace (&encoder->pps_data, NULL);
+  clear_packed_header_caches (encoder);
 
   /* reference list info de-init */
   for (i = 0; i < MAX_NUM_VIEWS; i++) {
@@ -81,6 +81,33 @@ typedef struct _GstVaapiH265ReorderPool
   guint cur_present_index;
 } GstVaapiH265ReorderPool;
 
+/* Parameters a packed VPS or SPS is generated from, along with the
+   encoder configuration */
+typedef struct
+{
+  VAEncSequenceParameterBufferHEVC seq_param;
+  guint32 hrd_buffer_size;
+  guint32 hrd_initial_buffer_fullness;
+  GstVaapiProfile profile;
+} GstVaapiH265SeqCacheKey;
+
+/* Parameters a packed PPS is generated from, i.e. the picture
+   parameters without the ones specific to the current picture */
+typedef struct
+{
+  VAEncPictureParameterBufferHEVC pic_param;
+} GstVaapiH265PpsCacheKey;
+
+/* Packed slice header template. The slices of a picture only differ in
+   first_slice_segment_in_pic_flag and slice_segment_address, so
+   everything around them is written once */
+typedef struct
+{
+  GstBitWriter head;            /* start code and NAL unit header */
+  GstBitWriter tail;            /* syntax elements after slice_segment_address */
+  gboolean is_valid;
+} GstVaapiH265SliceHeaderTemplate;
+
 /* ------------------------------------------------------------------------- */
 /* --- H.265 Encoder                                                     --- */
 /* ------------------------------------------------------------------------- */
@@ -127,6 +154,11 @@ struct _GstVaapiEncoderH265
   GstBuffer *sps_data;
   GstBuffer *pps_data;
 
+  /* packed headers reused until the next reconfiguration */
+  GstVaapiEncPackedHeaderCache vps_cache;
+  GstVaapiEncPackedHeaderCache sps_cache;
+  GstVaapiEncPackedHeaderCache pps_cache;
+
   guint bitrate_bits;           // bitrate (bits)
   guint cpb_length;             // length of CPB buffer (ms)
   guint cpb_length_bits;        // length of CPB buffer (bits)
@@ -654,21 +686,13 @@ bs_error:
   }
 }
 
-/* Write a Slice NAL unit */
+/* Write the Slice header syntax elements up to slice_segment_address */
 static gboolean
-bs_write_slice (GstBitWriter * bs,
+bs_write_slice_address (GstBitWriter * bs,
     const VAEncSliceParameterBufferHEVC * slice_param,
-    GstVaapiEncoderH265 * encoder, GstVaapiEncPicture * picture,
-    guint8 nal_unit_type)
+    GstVaapiEncoderH265 * encoder, GstVaapiEncPicture * picture)
 {
-  const VAEncPictureParameterBufferHEVC *const pic_param = picture->param;
-
   guint8 no_output_of_prior_pics_flag = 0;
-  guint8 dependent_slice_segment_flag = 0;
-  guint8 short_term_ref_pic_set_sps_flag = 0;
-  guint8 slice_deblocking_filter_disabled_flag = 0;
-  guint8 num_ref_idx_active_override_flag =
-      slice_param->slice_fields.bits.num_ref_idx_active_override_flag;
 
   /* first_slice_segment_in_pic_flag */
   WRITE_UINT32 (bs, encoder->first_slice_segment_in_pic_flag, 1);
@@ -687,6 +711,30 @@ bs_write_slice (GstBitWriter * bs,
     guint bits_size = (guint) ceil ((log2 (pic_size_ctb)));
     WRITE_UINT32 (bs, slice_param->slice_segment_address, bits_size);
   }
+  return TRUE;
+
+  /* ERRORS */
+bs_error:
+  {
+    GST_WARNING ("failed to write Slice NAL unit");
+    return FALSE;
+  }
+}
+
+/* Write the Slice header syntax elements that follow slice_segment_address,
+   but byte_alignment() */
+static gboolean
+bs_write_slice_tail (GstBitWriter * bs,
+    const VAEncSliceParameterBufferHEVC * slice_param,
+    GstVaapiEncoderH265 * encoder, GstVaapiEncPicture * picture)
+{
+  const VAEncPictureParameterBufferHEVC *const pic_param = picture->param;
+
+  guint8 dependent_slice_segment_flag = 0;
+  guint8 short_term_ref_pic_set_sps_flag = 0;
+  guint8 slice_deblocking_filter_disabled_flag = 0;
+  guint8 num_ref_idx_active_override_flag =
+      slice_param->slice_fields.bits.num_ref_idx_active_override_flag;
 
   if (!dependent_slice_segment_flag) {
     /* slice_type */
@@ -825,17 +873,26 @@ bs_write_slice (GstBitWriter * bs,
           slice_loop_filter_across_slices_enabled_flag, 1);
 
   }
+  return TRUE;
 
-  /* byte_alignment() */
+  /* ERRORS */
+bs_error:
   {
-    /* alignment_bit_equal_to_one */
-    WRITE_UINT32 (bs, 1, 1);
-    while (GST_BIT_WRITER_BIT_SIZE (bs) % 8 != 0) {
-      /* alignment_bit_equal_to_zero */
-      WRITE_UINT32 (bs, 0, 1);
-    }
+    GST_WARNING ("failed to write Slice NAL unit");
+    return FALSE;
   }
+}
 
+/* Write the byte_alignment() that ends the Slice header */
+static gboolean
+bs_write_slice_byte_alignment (GstBitWriter * bs)
+{
+  /* alignment_bit_equal_to_one */
+  WRITE_UINT32 (bs, 1, 1);
+  while (GST_BIT_WRITER_BIT_SIZE (bs) % 8 != 0) {
+    /* alignment_bit_equal_to_zero */
+    WRITE_UINT32 (bs, 0, 1);
+  }
   return TRUE;
 
   /* ERRORS */
@@ -1151,6 +1208,40 @@ fill_hrd_params (GstVaapiEncoderH265 * encoder, VAEncMiscParameterHRD * hrd)
   }
 }
 
+static void
+seq_cache_key_init (GstVaapiH265SeqCacheKey * key,
+    const VAEncSequenceParameterBufferHEVC * seq_param,
+    const VAEncMiscParameterHRD * hrd_params, GstVaapiProfile profile)
+{
+  memset (key, 0, sizeof (*key));
+  memcpy (&key->seq_param, seq_param, sizeof (key->seq_param));
+  if (hrd_params) {
+    key->hrd_buffer_size = hrd_params->buffer_size;
+    key->hrd_initial_buffer_fullness = hrd_params->initial_buffer_fullness;
+  }
+  key->profile = profile;
+}
+
+static void
+pps_cache_key_init (GstVaapiH265PpsCacheKey * key,
+    const VAEncPictureParameterBufferHEVC * pic_param)
+{
+  VAEncPictureParameterBufferHEVC *const param = &key->pic_param;
+
+  memset (key, 0, sizeof (*key));
+  memcpy (param, pic_param, sizeof (*param));
+  memset (&param->decoded_curr_pic, 0, sizeof (param->decoded_curr_pic));
+  memset (param->reference_frames, 0, sizeof (param->reference_frames));
+  param->coded_buf = VA_INVALID_ID;
+  param->collocated_ref_pic_index = 0;
+  param->last_picture = 0;
+  param->nal_unit_type = 0;
+  param->pic_fields.bits.idr_pic_flag = 0;
+  param->pic_fields.bits.coding_type = 0;
+  param->pic_fields.bits.reference_pic_flag = 0;
+  param->pic_fields.bits.no_output_of_prior_pics_flag = 0;
+}
+
 /* Adds the supplied video parameter set header (VPS) to the list of packed
    headers to pass down as-is to the encoder */
 static gboolean
@@ -1159,13 +1250,27 @@ add_packed_vps_header (GstVaapiEncoderH265 * encoder,
 {
   GstVaapiEncPackedHeader *packed_vps;
   GstBitWriter bs;
+  gint64 start_time;
   VAEncPackedHeaderParameterBuffer packed_vps_param = { 0 };
   const VAEncSequenceParameterBufferHEVC *const seq_param = sequence->param;
   GstVaapiProfile profile = encoder->profile;
 
+  GstVaapiH265SeqCacheKey key;
   guint32 data_bit_size;
   guint8 *data;
 
+  /* Submit the previous VPS again, if it is still up-to-date */
+  seq_cache_key_init (&key, seq_param, NULL, profile);
+  packed_vps = gst_vaapi_enc_packed_header_cache_lookup (&encoder->vps_cache,
+      &key, sizeof (key));
+  if (packed_vps) {
+    gst_vaapi_enc_picture_add_packed_header (picture, packed_vps);
+    gst_vaapi_codec_object_replace (&packed_vps, NULL);
+    return TRUE;
+  }
+
+  start_time = gst_vaapi_encoder_header_stats_start (GST_VAAPI_ENCODER
+      (encoder));
   gst_bit_writer_init (&bs, 128 * 8);
   WRITE_UINT32 (&bs, 0x00000001, 32);   /* start code */
   bs_write_nal_header (&bs, GST_H265_NAL_VPS);
@@ -1184,6 +1289,10 @@ add_packed_vps_header (GstVaapiEncoderH265 * encoder,
       &packed_vps_param, sizeof (packed_vps_param),
       data, (data_bit_size + 7) / 8);
   g_assert (packed_vps);
+  gst_vaapi_encoder_header_stats_add (GST_VAAPI_ENCODER (encoder),
+      start_time, (data_bit_size + 7) / 8);
+  gst_vaapi_enc_packed_header_cache_store (&encoder->vps_cache, packed_vps,
+      &key, sizeof (key));
 
   gst_vaapi_enc_picture_add_packed_header (picture, packed_vps);
   gst_vaapi_codec_object_replace (&packed_vps, NULL);
@@ -1210,16 +1319,30 @@ add_packed_sequence_header (GstVaapiEncoderH265 * encoder,
 {
   GstVaapiEncPackedHeader *packed_seq;
   GstBitWriter bs;
+  gint64 start_time;
   VAEncPackedHeaderParameterBuffer packed_seq_param = { 0 };
   const VAEncSequenceParameterBufferHEVC *const seq_param = sequence->param;
   GstVaapiProfile profile = encoder->profile;
 
   VAEncMiscParameterHRD hrd_params;
+  GstVaapiH265SeqCacheKey key;
   guint32 data_bit_size;
   guint8 *data;
 
   fill_hrd_params (encoder, &hrd_params);
 
+  /* Submit the previous SPS again, if it is still up-to-date */
+  seq_cache_key_init (&key, seq_param, &hrd_params, profile);
+  packed_seq = gst_vaapi_enc_packed_header_cache_lookup (&encoder->sps_cache,
+      &key, sizeof (key));
+  if (packed_seq) {
+    gst_vaapi_enc_picture_add_packed_header (picture, packed_seq);
+    gst_vaapi_codec_object_replace (&packed_seq, NULL);
+    return TRUE;
+  }
+
+  start_time = gst_vaapi_encoder_header_stats_start (GST_VAAPI_ENCODER
+      (encoder));
   gst_bit_writer_init (&bs, 128 * 8);
   WRITE_UINT32 (&bs, 0x00000001, 32);   /* start code */
   bs_write_nal_header (&bs, GST_H265_NAL_SPS);
@@ -1238,6 +1361,10 @@ add_packed_sequence_header (GstVaapiEncoderH265 * encoder,
       &packed_seq_param, sizeof (packed_seq_param),
       data, (data_bit_size + 7) / 8);
   g_assert (packed_seq);
+  gst_vaapi_encoder_header_stats_add (GST_VAAPI_ENCODER (encoder),
+      start_time, (data_bit_size + 7) / 8);
+  gst_vaapi_enc_packed_header_cache_store (&encoder->sps_cache, packed_seq,
+      &key, sizeof (key));
 
   gst_vaapi_enc_picture_add_packed_header (picture, packed_seq);
   gst_vaapi_codec_object_replace (&packed_seq, NULL);
@@ -1264,11 +1391,25 @@ add_packed_picture_header (GstVaapiEncoderH265 * encoder,
 {
   GstVaapiEncPackedHeader *packed_pic;
   GstBitWriter bs;
+  gint64 start_time;
   VAEncPackedHeaderParameterBuffer packed_pic_param = { 0 };
   const VAEncPictureParameterBufferHEVC *const pic_param = picture->param;
+  GstVaapiH265PpsCacheKey key;
   guint32 data_bit_size;
   guint8 *data;
 
+  /* Submit the previous PPS again, if it is still up-to-date */
+  pps_cache_key_init (&key, pic_param);
+  packed_pic = gst_vaapi_enc_packed_header_cache_lookup (&encoder->pps_cache,
+      &key, sizeof (key));
+  if (packed_pic) {
+    gst_vaapi_enc_picture_add_packed_header (picture, packed_pic);
+    gst_vaapi_codec_object_replace (&packed_pic, NULL);
+    return TRUE;
+  }
+
+  start_time = gst_vaapi_encoder_header_stats_start (GST_VAAPI_ENCODER
+      (encoder));
   gst_bit_writer_init (&bs, 128 * 8);
   WRITE_UINT32 (&bs, 0x00000001, 32);   /* start code */
   bs_write_nal_header (&bs, GST_H265_NAL_PPS);
@@ -1285,6 +1426,10 @@ add_packed_picture_header (GstVaapiEncoderH265 * encoder,
       &packed_pic_param, sizeof (packed_pic_param),
       data, (data_bit_size + 7) / 8);
   g_assert (packed_pic);
+  gst_vaapi_encoder_header_stats_add (GST_VAAPI_ENCODER (encoder),
+      start_time, (data_bit_size + 7) / 8);
+  gst_vaapi_enc_packed_header_cache_store (&encoder->pps_cache, packed_pic,
+      &key, sizeof (key));
 
   gst_vaapi_enc_picture_add_packed_header (picture, packed_pic);
   gst_vaapi_codec_object_replace (&packed_pic, NULL);
@@ -1325,28 +1470,81 @@ get_nal_unit_type (GstVaapiEncPicture * picture, guint8 * nal_unit_type)
   return TRUE;
 }
 
-/* Adds the supplied slice header to the list of packed
-   headers to pass down as-is to the encoder */
+static void
+slice_header_template_clear (GstVaapiH265SliceHeaderTemplate * tmpl)
+{
+  if (!tmpl->is_valid)
+    return;
+
+  gst_bit_writer_clear (&tmpl->head, TRUE);
+  gst_bit_writer_clear (&tmpl->tail, TRUE);
+  tmpl->is_valid = FALSE;
+}
+
+/* Writes the slice header template of the picture from its first slice */
+static gboolean
+ensure_slice_header_template (GstVaapiH265SliceHeaderTemplate * tmpl,
+    GstVaapiEncoderH265 * encoder, GstVaapiEncPicture * picture,
+    const VAEncSliceParameterBufferHEVC * slice_param)
+{
+  guint8 nal_unit_type;
+
+  if (tmpl->is_valid)
+    return TRUE;
+
+  gst_bit_writer_init (&tmpl->head, 16 * 8);
+  gst_bit_writer_init (&tmpl->tail, 128 * 8);
+  tmpl->is_valid = TRUE;
+
+  WRITE_UINT32 (&tmpl->head, 0x00000001, 32);   /* start code */
+
+  if (!get_nal_unit_type (picture, &nal_unit_type))
+    goto bs_error;
+  bs_write_nal_header (&tmpl->head, nal_unit_type);
+
+  if (!bs_write_slice_tail (&tmpl->tail, slice_param, encoder, picture))
+    goto bs_error;
+  return TRUE;
+
+  /* ERRORS */
+bs_error:
+  {
+    slice_header_template_clear (tmpl);
+    return FALSE;
+  }
+}
+
+/* Adds the slice header to the list of packed headers of the slice,
+   from the slice header template of the picture */
 static gboolean
 add_packed_slice_header (GstVaapiEncoderH265 * encoder,
-    GstVaapiEncPicture * picture, GstVaapiEncSlice * slice)
+    GstVaapiEncPicture * picture, GstVaapiEncSlice * slice,
+    GstVaapiH265SliceHeaderTemplate * tmpl)
 {
   GstVaapiEncPackedHeader *packed_slice;
   GstBitWriter bs;
+  gint64 start_time;
   VAEncPackedHeaderParameterBuffer packed_slice_param = { 0 };
   const VAEncSliceParameterBufferHEVC *const slice_param = slice->param;
   guint32 data_bit_size;
   guint8 *data;
-  guint8 nal_unit_type;
 
-  gst_bit_writer_init (&bs, 128 * 8);
-  WRITE_UINT32 (&bs, 0x00000001, 32);   /* start code */
+  start_time = gst_vaapi_encoder_header_stats_start (GST_VAAPI_ENCODER
+      (encoder));
+  if (!ensure_slice_header_template (tmpl, encoder, picture, slice_param)) {
+    GST_WARNING ("failed to write Slice NAL unit header");
+    return FALSE;
+  }
 
-  if (!get_nal_unit_type (picture, &nal_unit_type))
+  gst_bit_writer_init (&bs, 128 * 8);
+  if (!bs_write_bits (&bs, &tmpl->head))
+    goto bs_error;
+  if (!bs_write_slice_address (&bs, slice_param, encoder, picture))
+    goto bs_error;
+  if (!bs_write_bits (&bs, &tmpl->tail))
+    goto bs_error;
+  if (!bs_write_slice_byte_alignment (&bs))
     goto bs_error;
-  bs_write_nal_header (&bs, nal_unit_type);
-
-  bs_write_slice (&bs, slice_param, encoder, picture, nal_unit_type);
   data_bit_size = GST_BIT_WRITER_BIT_SIZE (&bs);
   data = GST_BIT_WRITER_DATA (&bs);
 
@@ -1358,6 +1556,8 @@ add_packed_slice_header (GstVaapiEncoderH265 * encoder,
       &packed_slice_param, sizeof (packed_slice_param),
       data, (data_bit_size + 7) / 8);
   g_assert (packed_slice);
+  gst_vaapi_encoder_header_stats_add (GST_VAAPI_ENCODER (encoder),
+      start_time, (data_bit_size + 7) / 8);
 
   gst_vaapi_enc_slice_add_packed_header (slice, packed_slice);
   gst_vaapi_codec_object_replace (&packed_slice, NULL);
@@ -1639,6 +1839,7 @@ add_slice_headers (GstVaapiEncoderH265 * encoder, GstVaapiEncPicture * picture,
 {
   VAEncSliceParameterBufferHEVC *slice_param;
   GstVaapiEncSlice *slice;
+  GstVaapiH265SliceHeaderTemplate slice_tmpl = { {0,}, {0,}, FALSE };
   guint slice_of_ctus, slice_mod_ctus, cur_slice_ctus;
   guint ctu_size;
   guint ctu_width_round_factor;
@@ -1731,6 +1932,9 @@ add_slice_headers (GstVaapiEncoderH265 * encoder, GstVaapiEncPicture * picture,
       } else if (picture->type == GST_VAAPI_PICTURE_TYPE_B) {
         slice_param->slice_qp_delta += encoder->qp_ib;
       }
+      slice_param->slice_qp_delta +=
+          gst_vaapi_encoder_get_qp_hint (GST_VAAPI_ENCODER_CAST (encoder),
+          picture->frame);
       if ((gint) encoder->init_qp + slice_param->slice_qp_delta <
           (gint) encoder->min_qp) {
         slice_param->slice_qp_delta = encoder->min_qp - encoder->init_qp;
@@ -1752,7 +1956,7 @@ add_slice_headers (GstVaapiEncoderH265 * encoder, GstVaapiEncPicture * picture,
 
     if ((GST_VAAPI_ENCODER_PACKED_HEADERS (encoder) &
             VA_ENC_PACKED_HEADER_SLICE)
-        && !add_packed_slice_header (encoder, picture, slice))
+        && !add_packed_slice_header (encoder, picture, slice, &slice_tmpl))
       goto error_create_packed_slice_hdr;
 
     gst_vaapi_enc_picture_add_slice (picture, slice);
@@ -1763,6 +1967,7 @@ add_slice_headers (GstVaapiEncoderH265 * encoder, GstVaapiEncPicture * picture,
         ("Using less number of slices than requested, Number of slices per pictures is %d",
         i_slice);
   g_assert (last_ctu_index == ctu_size);
+  slice_header_template_clear (&slice_tmpl);
 
   return TRUE;
 
@@ -1770,6 +1975,7 @@ error_create_packed_slice_hdr:
   {
     GST_ERROR ("failed to create packed slice header buffer");
     gst_vaapi_codec_object_replace (&slice, NULL);
+    slice_header_template_clear (&slice_tmpl);
     return FALSE;
   }
 }
@@ -1849,6 +2055,8 @@ ensure_misc_params (GstVaapiEncoderH265 * encoder, GstVaapiEncPicture * picture)
 
   if (!gst_vaapi_encoder_ensure_param_control_rate (base_encoder, picture))
     return FALSE;
+  if (!gst_vaapi_encoder_ensure_param_roi_regions (base_encoder, picture))
+    return FALSE;
   if (!gst_vaapi_encoder_ensure_param_quality_level (base_encoder, picture))
     return FALSE;
   return TRUE;
@@ -2360,22 +2568,24 @@ gst_vaapi_encoder_h265_reordering (GstVaapiEncoder * base_encoder,
     goto end;
   }
 
-  /* new p/b frames coming */
+  /* new p/b frames coming. A frame with high motion is coded as a P
+     frame right away, with fewer B frames before it */
   ++reorder_pool->frame_index;
   if (reorder_pool->reorder_state == GST_VAAPI_ENC_H265_REORD_WAIT_FRAMES &&
       g_queue_get_length (&reorder_pool->reorder_frame_list) <
-      encoder->num_bframes) {
+      encoder->num_bframes &&
+      !gst_vaapi_encoder_is_high_motion (base_encoder, frame)) {
     g_queue_push_tail (&reorder_pool->reorder_frame_list, picture);
     return GST_VAAPI_ENCODER_STATUS_NO_SURFACE;
   }
 
   set_p_frame (picture, encoder);
 
-  if (reorder_pool->reorder_state == GST_VAAPI_ENC_H265_REORD_WAIT_FRAMES) {
+  if (reorder_pool->reorder_state == GST_VAAPI_ENC_H265_REORD_WAIT_FRAMES &&
+      !g_queue_is_empty (&reorder_pool->reorder_frame_list)) {
     g_queue_foreach (&reorder_pool->reorder_frame_list, (GFunc) set_b_frame,
         encoder);
     reorder_pool->reorder_state = GST_VAAPI_ENC_H265_REORD_DUMP_FRAMES;
-    g_assert (!g_queue_is_empty (&reorder_pool->reorder_frame_list));
   }
 
 end:
@@ -2440,6 +2650,15 @@ set_context_info (GstVaapiEncoder * base_encoder)
   return GST_VAAPI_ENCODER_STATUS_SUCCESS;
 }
 
+/* Drops the packed headers bound to the previous configuration */
+static void
+clear_packed_header_caches (GstVaapiEncoderH265 * encoder)
+{
+  gst_vaapi_enc_packed_header_cache_clear (&encoder->vps_cache);
+  gst_vaapi_enc_packed_header_cache_clear (&encoder->sps_cache);
+  gst_vaapi_enc_packed_header_cache_clear (&encoder->pps_cache);
+}
+
 static GstVaapiEncoderStatus
 gst_vaapi_encoder_h265_reconfigure (GstVaapiEncoder * base_encoder)
 {
@@ -2447,6 +2666,8 @@ gst_vaapi_encoder_h265_reconfigure (GstVaapiEncoder * base_encoder)
   GstVaapiEncoderStatus status;
   guint luma_width, luma_height;
 
+  clear_packed_header_caches (encoder);
+
   luma_width = GST_VAAPI_ENCODER_WIDTH (encoder);
   luma_height = GST_VAAPI_ENCODER_HEIGHT (encoder);
 
@@ -2525,6 +2746,7 @@ gst_vaapi_encoder_h265_finalize (GstVaapiEncoder * base_encoder)
   gst_buffer_replace (&encoder->vps_data, NULL);
   gst_buffer_replace (&encoder->sps_data, NULL);
   gst_buffer_replace (&encoder->pps_data, NULL);
+  clear_packed_header_caches (encoder);
 
   /* reference list info de-init */
   ref_pool = &encoder->ref_pool;
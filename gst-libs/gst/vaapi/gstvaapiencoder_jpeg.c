@@ -607,10 +607,13 @@ add_packed_header (GstVaapiEncoderJpeg * encoder, GstVaapiEncPicture * picture)
 {
   GstVaapiEncPackedHeader *packed_raw_data_hdr;
   GstBitWriter bs;
+  gint64 start_time;
   VAEncPackedHeaderParameterBuffer packed_raw_data_hdr_param = { 0 };
   guint32 data_bit_size;
   guint8 *data;
 
+  start_time = gst_vaapi_encoder_header_stats_start (GST_VAAPI_ENCODER
+      (encoder));
   gst_bit_writer_init (&bs, 128 * 8);
   bs_write_jpeg_header (&bs, encoder, picture);
   data_bit_size = GST_BIT_WRITER_BIT_SIZE (&bs);
@@ -625,6 +628,8 @@ add_packed_header (GstVaapiEncoderJpeg * encoder, GstVaapiEncPicture * picture)
       &packed_raw_data_hdr_param, sizeof (packed_raw_data_hdr_param), data,
       (data_bit_size + 7) / 8);
   g_assert (packed_raw_data_hdr);
+  gst_vaapi_encoder_header_stats_add (GST_VAAPI_ENCODER (encoder),
+      start_time, (data_bit_size + 7) / 8);
 
   gst_vaapi_enc_picture_add_packed_header (picture, packed_raw_data_hdr);
   gst_vaapi_codec_object_replace (&packed_raw_data_hdr, NULL);
@@ -0,0 +1,505 @@
+/*
+ *  gstvaapiencoder_ladder.c - Multi-resolution encoding from one upload
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+/**
+ * SECTION:gstvaapiencoder_ladder
+ * @short_description: Multi-resolution encoding from one upload
+ *
+ * A #GstVaapiEncoderLadder encodes the same source at several
+ * resolutions at once, e.g. for an adaptive bitrate ladder. Each
+ * source frame is uploaded once to a VA surface, which is then scaled
+ * into one surface per rung of the ladder with a single
+ * #GstVaapiFilter. All the encoders share the same VA display, and
+ * each rung has its own thread retrieving the coded buffers, so that
+ * a slow rung does not delay the other ones.
+ *
+ * This is what a set of vaapipostproc ! vaapiencode branches does in
+ * a pipeline, without uploading and converting the source once per
+ * branch.
+ */
+
+#include "sysdeps.h"
+#include "gstvaapiencoder_ladder.h"
+#include "gstvaapifilter.h"
+#include "gstvaapisurfacepool.h"
+#include "gstvaapisurface.h"
+
+#define DEBUG 1
+#include "gstvaapidebug.h"
+
+/* Timeout of the output threads when waiting for a coded buffer, in
+   microseconds. The threads check whether the input stopped that often */
+#define OUTPUT_TIMEOUT 50000
+
+typedef struct
+{
+  GstVaapiEncoderLadder *ladder;
+  guint index;
+  guint width;
+  guint height;
+  GstVaapiEncoder *encoder;
+  /* Scaled surfaces, or NULL if the rung is at the source resolution */
+  GstVaapiVideoPool *pool;
+  GThread *thread;
+  /* Set once the output failed. The thread then keeps retrieving the
+     coded buffers, and discards them, so that the encoder never runs
+     out of coded buffers and blocks gst_vaapi_encoder_put_frame() */
+  volatile gint output_failed;
+} Rung;
+
+struct _GstVaapiEncoderLadder
+{
+  GstVaapiDisplay *display;
+  guint width;
+  guint height;
+  /* Source surfaces, for gst_vaapi_encoder_ladder_put_image() */
+  GstVaapiVideoPool *pool;
+  /* Scaler, only created if a rung differs from the source */
+  GstVaapiFilter *filter;
+  GPtrArray *rungs;
+  GstVaapiEncoderLadderOutputFunc output_func;
+  gpointer output_data;
+  guint32 frame_number;
+  volatile gint input_stopped;
+};
+
+static GstVaapiVideoPool *
+surface_pool_new (GstVaapiDisplay * display, guint width, guint height)
+{
+  GstVideoInfo vi;
+
+  gst_video_info_set_format (&vi, GST_VIDEO_FORMAT_ENCODED, width, height);
+  return gst_vaapi_surface_pool_new_full (display, &vi, 0);
+}
+
+static void
+rung_free (Rung * rung)
+{
+  g_assert (rung->thread == NULL);
+
+  gst_vaapi_encoder_replace (&rung->encoder, NULL);
+  gst_vaapi_video_pool_replace (&rung->pool, NULL);
+  g_slice_free (Rung, rung);
+}
+
+/**
+ * gst_vaapi_encoder_ladder_new:
+ * @display: a #GstVaapiDisplay
+ * @width: the width of the source frames
+ * @height: the height of the source frames
+ *
+ * Creates an empty ladder for sources of @width x @height pixels. The
+ * rungs are then added with gst_vaapi_encoder_ladder_add_rung().
+ *
+ * Return value: the newly allocated #GstVaapiEncoderLadder
+ */
+GstVaapiEncoderLadder *
+gst_vaapi_encoder_ladder_new (GstVaapiDisplay * display, guint width,
+    guint height)
+{
+  GstVaapiEncoderLadder *ladder;
+
+  g_return_val_if_fail (display != NULL, NULL);
+  g_return_val_if_fail (width > 0 && height > 0, NULL);
+
+  ladder = g_slice_new0 (GstVaapiEncoderLadder);
+  ladder->display = gst_vaapi_display_ref (display);
+  ladder->width = width;
+  ladder->height = height;
+  ladder->rungs = g_ptr_array_new_with_free_func ((GDestroyNotify) rung_free);
+  return ladder;
+}
+
+/**
+ * gst_vaapi_encoder_ladder_free:
+ * @ladder: a #GstVaapiEncoderLadder
+ *
+ * Stops the output threads if gst_vaapi_encoder_ladder_finish() was
+ * not called, and destroys @ladder.
+ */
+void
+gst_vaapi_encoder_ladder_free (GstVaapiEncoderLadder * ladder)
+{
+  if (!ladder)
+    return;
+
+  gst_vaapi_encoder_ladder_finish (ladder);
+  g_ptr_array_unref (ladder->rungs);
+  gst_vaapi_filter_replace (&ladder->filter, NULL);
+  gst_vaapi_video_pool_replace (&ladder->pool, NULL);
+  gst_vaapi_display_unref (ladder->display);
+  g_slice_free (GstVaapiEncoderLadder, ladder);
+}
+
+/**
+ * gst_vaapi_encoder_ladder_add_rung:
+ * @ladder: a #GstVaapiEncoderLadder
+ * @encoder: a #GstVaapiEncoder created on the display of @ladder
+ * @width: the width of the rung
+ * @height: the height of the rung
+ *
+ * Adds a rung that encodes the source frames, scaled to @width x
+ * @height pixels, with @encoder. The codec state and the properties of
+ * @encoder are set by the caller, and @ladder holds a new reference to
+ * it. The rungs are added before gst_vaapi_encoder_ladder_start().
+ *
+ * Return value: the index of the new rung, or -1 on error
+ */
+gint
+gst_vaapi_encoder_ladder_add_rung (GstVaapiEncoderLadder * ladder,
+    GstVaapiEncoder * encoder, guint width, guint height)
+{
+  Rung *rung;
+
+  g_return_val_if_fail (ladder != NULL, -1);
+  g_return_val_if_fail (encoder != NULL, -1);
+  g_return_val_if_fail (ladder->output_func == NULL, -1);
+
+  rung = g_slice_new0 (Rung);
+  rung->ladder = ladder;
+  rung->index = ladder->rungs->len;
+  rung->width = width;
+  rung->height = height;
+
+  if (width != ladder->width || height != ladder->height) {
+    rung->pool = surface_pool_new (ladder->display, width, height);
+    if (!rung->pool)
+      goto error_create_pool;
+
+    if (!ladder->filter) {
+      ladder->filter = gst_vaapi_filter_new (ladder->display);
+      if (!ladder->filter)
+        goto error_create_filter;
+      if (!gst_vaapi_filter_set_format (ladder->filter,
+              GST_VIDEO_FORMAT_NV12))
+        goto error_create_filter;
+    }
+  }
+
+  rung->encoder = gst_vaapi_encoder_ref (encoder);
+  g_ptr_array_add (ladder->rungs, rung);
+  return rung->index;
+
+  /* ERRORS */
+error_create_pool:
+  {
+    GST_ERROR ("failed to create %ux%u surface pool", width, height);
+    rung_free (rung);
+    return -1;
+  }
+error_create_filter:
+  {
+    GST_ERROR ("failed to create video processing filter");
+    gst_vaapi_filter_replace (&ladder->filter, NULL);
+    rung_free (rung);
+    return -1;
+  }
+}
+
+/**
+ * gst_vaapi_encoder_ladder_get_num_rungs:
+ * @ladder: a #GstVaapiEncoderLadder
+ *
+ * Return value: the number of rungs of @ladder
+ */
+guint
+gst_vaapi_encoder_ladder_get_num_rungs (GstVaapiEncoderLadder * ladder)
+{
+  g_return_val_if_fail (ladder != NULL, 0);
+
+  return ladder->rungs->len;
+}
+
+static gpointer
+output_thread (gpointer data)
+{
+  Rung *const rung = data;
+  GstVaapiEncoderLadder *const ladder = rung->ladder;
+  GstVaapiCodedBufferProxy *proxy;
+  GstVaapiEncoderStatus status;
+
+  for (;;) {
+    proxy = NULL;
+    status = gst_vaapi_encoder_get_buffer_with_timeout (rung->encoder,
+        &proxy, OUTPUT_TIMEOUT);
+    if (status == GST_VAAPI_ENCODER_STATUS_SUCCESS) {
+      if (!g_atomic_int_get (&rung->output_failed) &&
+          !ladder->output_func (ladder, rung->index, proxy,
+              ladder->output_data))
+        g_atomic_int_set (&rung->output_failed, TRUE);
+      gst_vaapi_coded_buffer_proxy_unref (proxy);
+      continue;
+    }
+    if (status < GST_VAAPI_ENCODER_STATUS_SUCCESS) {
+      GST_ERROR ("failed to output %ux%u frame (status %d)", rung->width,
+          rung->height, status);
+      g_atomic_int_set (&rung->output_failed, TRUE);
+      continue;
+    }
+    /* No buffer within the timeout */
+    if (g_atomic_int_get (&ladder->input_stopped))
+      break;
+  }
+  return NULL;
+}
+
+/**
+ * gst_vaapi_encoder_ladder_start:
+ * @ladder: a #GstVaapiEncoderLadder
+ * @func: the function called for each coded frame
+ * @user_data: the data passed to @func
+ *
+ * Starts one output thread per rung, which calls @func for each frame
+ * coded by the encoder of the rung.
+ *
+ * Return value: %TRUE on success
+ */
+gboolean
+gst_vaapi_encoder_ladder_start (GstVaapiEncoderLadder * ladder,
+    GstVaapiEncoderLadderOutputFunc func, gpointer user_data)
+{
+  guint i;
+
+  g_return_val_if_fail (ladder != NULL, FALSE);
+  g_return_val_if_fail (func != NULL, FALSE);
+  g_return_val_if_fail (ladder->output_func == NULL, FALSE);
+
+  if (ladder->rungs->len == 0)
+    return FALSE;
+
+  ladder->output_func = func;
+  ladder->output_data = user_data;
+  g_atomic_int_set (&ladder->input_stopped, FALSE);
+  for (i = 0; i < ladder->rungs->len; i++) {
+    Rung *const rung = g_ptr_array_index (ladder->rungs, i);
+    g_atomic_int_set (&rung->output_failed, FALSE);
+    rung->thread = g_thread_new ("ladder output", output_thread, rung);
+  }
+  return TRUE;
+}
+
+static gboolean
+put_frame (GstVaapiEncoder * encoder, GstVaapiSurfaceProxy * proxy,
+    guint32 frame_number)
+{
+  GstVideoCodecFrame *frame;
+  GstVaapiEncoderStatus status;
+
+  frame = g_slice_new0 (GstVideoCodecFrame);
+  frame->ref_count = 1;
+  frame->system_frame_number = frame_number;
+  frame->pts = GST_CLOCK_TIME_NONE;
+  frame->dts = GST_CLOCK_TIME_NONE;
+  frame->duration = GST_CLOCK_TIME_NONE;
+  gst_video_codec_frame_set_user_data (frame,
+      gst_vaapi_surface_proxy_ref (proxy),
+      (GDestroyNotify) gst_vaapi_surface_proxy_unref);
+
+  status = gst_vaapi_encoder_put_frame (encoder, frame);
+  gst_video_codec_frame_unref (frame);
+  return status == GST_VAAPI_ENCODER_STATUS_SUCCESS;
+}
+
+/**
+ * gst_vaapi_encoder_ladder_put_surface:
+ * @ladder: a #GstVaapiEncoderLadder
+ * @src_proxy: a #GstVaapiSurfaceProxy holding a source frame
+ *
+ * Scales the source frame in @src_proxy once per rung that differs from
+ * the source resolution, and submits the surfaces to the encoders of
+ * all the rungs. The rungs at the source resolution encode
+ * @src_proxy itself.
+ *
+ * Once the output of a rung failed, no further frame is accepted, and
+ * %FALSE is returned. The coded frames of that rung are discarded until
+ * gst_vaapi_encoder_ladder_finish().
+ *
+ * Return value: %TRUE on success
+ */
+gboolean
+gst_vaapi_encoder_ladder_put_surface (GstVaapiEncoderLadder * ladder,
+    GstVaapiSurfaceProxy * src_proxy)
+{
+  GstVaapiSurfaceProxy *proxy;
+  Rung *rung;
+  GstVaapiFilterStatus status;
+  guint32 frame_number;
+  guint i;
+
+  g_return_val_if_fail (ladder != NULL, FALSE);
+  g_return_val_if_fail (src_proxy != NULL, FALSE);
+
+  for (i = 0; i < ladder->rungs->len; i++) {
+    rung = g_ptr_array_index (ladder->rungs, i);
+    if (g_atomic_int_get (&rung->output_failed))
+      goto error_output;
+  }
+
+  /* The frame number is used up even if a rung fails, since the rungs
+     before it already got the frame */
+  frame_number = ladder->frame_number++;
+  for (i = 0; i < ladder->rungs->len; i++) {
+    rung = g_ptr_array_index (ladder->rungs, i);
+
+    if (!rung->pool)
+      proxy = gst_vaapi_surface_proxy_ref (src_proxy);
+    else {
+      proxy = gst_vaapi_surface_proxy_new_from_pool
+          (GST_VAAPI_SURFACE_POOL (rung->pool));
+      if (!proxy)
+        goto error_create_proxy;
+      status = gst_vaapi_filter_process (ladder->filter,
+          GST_VAAPI_SURFACE_PROXY_SURFACE (src_proxy),
+          GST_VAAPI_SURFACE_PROXY_SURFACE (proxy), 0);
+      if (status != GST_VAAPI_FILTER_STATUS_SUCCESS)
+        goto error_process;
+    }
+
+    if (!put_frame (rung->encoder, proxy, frame_number))
+      goto error_encode;
+    gst_vaapi_surface_proxy_unref (proxy);
+  }
+  return TRUE;
+
+  /* ERRORS */
+error_output:
+  {
+    GST_ERROR ("failed to output %ux%u frames", rung->width, rung->height);
+    return FALSE;
+  }
+error_create_proxy:
+  {
+    GST_ERROR ("failed to get %ux%u surface", rung->width, rung->height);
+    return FALSE;
+  }
+error_process:
+  {
+    GST_ERROR ("failed to scale frame to %ux%u (status %d)",
+        rung->width, rung->height, status);
+    gst_vaapi_surface_proxy_unref (proxy);
+    return FALSE;
+  }
+error_encode:
+  {
+    GST_ERROR ("failed to encode %ux%u frame", rung->width, rung->height);
+    gst_vaapi_surface_proxy_unref (proxy);
+    return FALSE;
+  }
+}
+
+/**
+ * gst_vaapi_encoder_ladder_put_image:
+ * @ladder: a #GstVaapiEncoderLadder
+ * @image: a #GstVaapiImage holding a source frame
+ *
+ * Uploads @image once to a VA surface, and submits it to all the
+ * rungs, see gst_vaapi_encoder_ladder_put_surface().
+ *
+ * Return value: %TRUE on success
+ */
+gboolean
+gst_vaapi_encoder_ladder_put_image (GstVaapiEncoderLadder * ladder,
+    GstVaapiImage * image)
+{
+  GstVaapiSurfaceProxy *proxy;
+  gboolean success;
+
+  g_return_val_if_fail (ladder != NULL, FALSE);
+  g_return_val_if_fail (image != NULL, FALSE);
+
+  if (!ladder->pool) {
+    ladder->pool = surface_pool_new (ladder->display, ladder->width,
+        ladder->height);
+    if (!ladder->pool)
+      goto error_create_pool;
+  }
+
+  proxy =
+      gst_vaapi_surface_proxy_new_from_pool (GST_VAAPI_SURFACE_POOL
+      (ladder->pool));
+  if (!proxy)
+    goto error_create_proxy;
+  if (!gst_vaapi_surface_put_image (GST_VAAPI_SURFACE_PROXY_SURFACE (proxy),
+          image))
+    goto error_upload;
+
+  success = gst_vaapi_encoder_ladder_put_surface (ladder, proxy);
+  gst_vaapi_surface_proxy_unref (proxy);
+  return success;
+
+  /* ERRORS */
+error_create_pool:
+  {
+    GST_ERROR ("failed to create source surface pool");
+    return FALSE;
+  }
+error_create_proxy:
+  {
+    GST_ERROR ("failed to get source surface");
+    return FALSE;
+  }
+error_upload:
+  {
+    GST_ERROR ("failed to upload frame %u", ladder->frame_number);
+    gst_vaapi_surface_proxy_unref (proxy);
+    return FALSE;
+  }
+}
+
+/**
+ * gst_vaapi_encoder_ladder_finish:
+ * @ladder: a #GstVaapiEncoderLadder
+ *
+ * Flushes the encoders of all the rungs, and waits for the output
+ * threads to pass the remaining coded frames to the output function.
+ *
+ * Return value: %TRUE if all the frames were encoded and output
+ */
+gboolean
+gst_vaapi_encoder_ladder_finish (GstVaapiEncoderLadder * ladder)
+{
+  gboolean success = TRUE;
+  guint i;
+
+  g_return_val_if_fail (ladder != NULL, FALSE);
+
+  if (!ladder->output_func)
+    return TRUE;
+
+  for (i = 0; i < ladder->rungs->len; i++) {
+    Rung *const rung = g_ptr_array_index (ladder->rungs, i);
+    if (gst_vaapi_encoder_flush (rung->encoder) !=
+        GST_VAAPI_ENCODER_STATUS_SUCCESS)
+      success = FALSE;
+  }
+  g_atomic_int_set (&ladder->input_stopped, TRUE);
+
+  for (i = 0; i < ladder->rungs->len; i++) {
+    Rung *const rung = g_ptr_array_index (ladder->rungs, i);
+    g_thread_join (rung->thread);
+    rung->thread = NULL;
+    if (g_atomic_int_get (&rung->output_failed))
+      success = FALSE;
+  }
+  ladder->output_func = NULL;
+  ladder->output_data = NULL;
+  return success;
+}
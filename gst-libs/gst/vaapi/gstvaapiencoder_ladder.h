@@ -0,0 +1,81 @@
+/*
+ *  gstvaapiencoder_ladder.h - Multi-resolution encoding from one upload
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef GST_VAAPI_ENCODER_LADDER_H
+#define GST_VAAPI_ENCODER_LADDER_H
+
+#include <gst/vaapi/gstvaapidisplay.h>
+#include <gst/vaapi/gstvaapiencoder.h>
+#include <gst/vaapi/gstvaapiimage.h>
+#include <gst/vaapi/gstvaapisurfaceproxy.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstVaapiEncoderLadder GstVaapiEncoderLadder;
+
+/**
+ * GstVaapiEncoderLadderOutputFunc:
+ * @ladder: a #GstVaapiEncoderLadder
+ * @rung: the index of the rung that produced @proxy
+ * @proxy: the #GstVaapiCodedBufferProxy holding the coded frame
+ * @user_data: the data passed to gst_vaapi_encoder_ladder_start()
+ *
+ * Called from the output thread of @rung for each coded frame. The
+ * output threads of the different rungs run concurrently.
+ *
+ * Return value: %FALSE to stop the output of @rung on error
+ */
+typedef gboolean (*GstVaapiEncoderLadderOutputFunc) (
+    GstVaapiEncoderLadder * ladder, guint rung,
+    GstVaapiCodedBufferProxy * proxy, gpointer user_data);
+
+GstVaapiEncoderLadder *
+gst_vaapi_encoder_ladder_new (GstVaapiDisplay * display, guint width,
+    guint height);
+
+void
+gst_vaapi_encoder_ladder_free (GstVaapiEncoderLadder * ladder);
+
+gint
+gst_vaapi_encoder_ladder_add_rung (GstVaapiEncoderLadder * ladder,
+    GstVaapiEncoder * encoder, guint width, guint height);
+
+guint
+gst_vaapi_encoder_ladder_get_num_rungs (GstVaapiEncoderLadder * ladder);
+
+gboolean
+gst_vaapi_encoder_ladder_start (GstVaapiEncoderLadder * ladder,
+    GstVaapiEncoderLadderOutputFunc func, gpointer user_data);
+
+gboolean
+gst_vaapi_encoder_ladder_put_image (GstVaapiEncoderLadder * ladder,
+    GstVaapiImage * image);
+
+gboolean
+gst_vaapi_encoder_ladder_put_surface (GstVaapiEncoderLadder * ladder,
+    GstVaapiSurfaceProxy * src_proxy);
+
+gboolean
+gst_vaapi_encoder_ladder_finish (GstVaapiEncoderLadder * ladder);
+
+G_END_DECLS
+
+#endif /* GST_VAAPI_ENCODER_LADDER_H */
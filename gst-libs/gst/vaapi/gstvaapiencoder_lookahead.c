@@ -0,0 +1,534 @@
+/*
+ *  gstvaapiencoder_lookahead.c - Encoder lookahead and scene cut detection
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#include "sysdeps.h"
+#include "gstvaapiencoder_lookahead.h"
+#include "gstvaapisurfaceproxy.h"
+#include "gstvaapisurface.h"
+#include "gstvaapiimage.h"
+#include <math.h>
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+# define USE_LOOKAHEAD_SSE2 1
+#endif
+
+#define DEBUG 1
+#include "gstvaapidebug.h"
+
+/* The frames are analysed on a luma thumbnail holding one sample per
+   8x8 block: the mean of the 8 pixels of the middle row of the block.
+   Only one row out of 8 is read from the surface */
+#define THUMBNAIL_BLOCK_SIZE 8
+
+/* Number of bins of the thumbnail histograms */
+#define HISTOGRAM_BINS 32
+
+/* A scene cut requires both the mean absolute difference between two
+   thumbnails, out of 255, and the difference between their histograms,
+   in percent of the samples, to exceed these thresholds. The former
+   alone would trigger on fast motion, the latter alone on fades */
+#define SCENE_CUT_SAD_THRESHOLD 20
+#define SCENE_CUT_HISTOGRAM_THRESHOLD 60
+
+/* A frame whose thumbnail differs from the previous one by more than
+   this mean absolute difference, out of 255, has high motion */
+#define HIGH_MOTION_SAD_THRESHOLD 8
+
+/* The QP hint of a frame is QP_HINT_SCALE * log2 (c / C), clamped to
+   QP_HINT_MAX, where c is its complexity, i.e. its thumbnail SAD with
+   the previous frame, and C the mean complexity over the lookahead.
+   This is 6 * (1 - qcomp) with the usual qcomp of 0.6: complex frames
+   get fewer bits than their complexity alone would ask for */
+#define QP_HINT_SCALE 2.4
+#define QP_HINT_MAX 4
+
+/* Number of released frames whose hints are kept for the encoder, which
+   may hold frames for reordering */
+#define HINTS_HISTORY_SIZE 64
+
+typedef struct
+{
+  guint8 *data;
+  guint width;
+  guint height;
+  guint histogram[HISTOGRAM_BINS];
+} Thumbnail;
+
+typedef struct
+{
+  GstVideoCodecFrame *frame;
+  Thumbnail *thumb;
+  /* Mean thumbnail SAD with the previous frame, or -1 if not known */
+  gdouble complexity;
+  /* Set by the analysis thread once thumb is available */
+  gboolean analysed;
+} LookaheadFrame;
+
+typedef struct
+{
+  guint32 frame_number;
+  gboolean valid;
+  GstVaapiEncoderLookaheadHints hints;
+} HintsEntry;
+
+struct _GstVaapiEncoderLookahead
+{
+  guint depth;
+  GQueue frames;
+  /* Thumbnail of the last frame that left the lookahead */
+  Thumbnail *last_thumb;
+  HintsEntry hints[HINTS_HISTORY_SIZE];
+
+  /* The thumbnails are made in a separate thread, so that mapping the
+     surfaces does not stall the streaming thread. The lock protects
+     the analysed flags and the thumb of the queued frames */
+  GThreadPool *analysis_pool;
+  GMutex lock;
+  GCond analysed_cond;
+  guint num_pending;
+  gboolean cancel;
+};
+
+static void
+thumbnail_free (Thumbnail * thumb)
+{
+  if (!thumb)
+    return;
+  g_free (thumb->data);
+  g_slice_free (Thumbnail, thumb);
+}
+
+/* Writes the means of n consecutive groups of 8 pixels of src */
+static void
+thumbnail_fill_row (guint8 * dst, const guint8 * src, guint n)
+{
+  guint i = 0;
+
+#if USE_LOOKAHEAD_SSE2
+  const __m128i zero = _mm_setzero_si128 ();
+  __m128i s;
+
+  for (; i + 2 <= n; i += 2) {
+    s = _mm_sad_epu8 (_mm_loadu_si128 ((const __m128i *) (src + i * 8)),
+        zero);
+    dst[i] = (_mm_cvtsi128_si32 (s) + 4) >> 3;
+    dst[i + 1] = (_mm_extract_epi16 (s, 4) + 4) >> 3;
+  }
+#endif
+  for (; i < n; i++) {
+    const guint8 *const p = src + i * 8;
+    dst[i] = (p[0] + p[1] + p[2] + p[3] + p[4] + p[5] + p[6] + p[7] + 4) >> 3;
+  }
+}
+
+/* Creates the luma thumbnail of the surface of frame, or returns NULL
+   if its luma plane cannot be mapped */
+static Thumbnail *
+thumbnail_new_from_frame (GstVideoCodecFrame * frame)
+{
+  GstVaapiSurfaceProxy *const proxy =
+      gst_video_codec_frame_get_user_data (frame);
+  GstVaapiSurface *surface;
+  GstVaapiImage *image;
+  Thumbnail *thumb = NULL;
+  const guint8 *plane;
+  guint i, n, width, height, pitch;
+
+  if (!proxy)
+    return NULL;
+  surface = GST_VAAPI_SURFACE_PROXY_SURFACE (proxy);
+  gst_vaapi_surface_get_size (surface, &width, &height);
+  if (width < THUMBNAIL_BLOCK_SIZE || height < THUMBNAIL_BLOCK_SIZE)
+    return NULL;
+
+  image = gst_vaapi_surface_derive_image (surface);
+  if (!image)
+    return NULL;
+
+  switch (gst_vaapi_image_get_format (image)) {
+    case GST_VIDEO_FORMAT_NV12:
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_YV12:
+      break;
+    default:
+      goto done;
+  }
+  if (!gst_vaapi_image_map (image))
+    goto done;
+
+  plane = gst_vaapi_image_get_plane (image, 0);
+  pitch = gst_vaapi_image_get_pitch (image, 0);
+
+  thumb = g_slice_new0 (Thumbnail);
+  thumb->width = width / THUMBNAIL_BLOCK_SIZE;
+  thumb->height = height / THUMBNAIL_BLOCK_SIZE;
+  thumb->data = g_malloc (thumb->width * thumb->height);
+  for (i = 0; i < thumb->height; i++) {
+    thumbnail_fill_row (thumb->data + i * thumb->width,
+        plane + (i * THUMBNAIL_BLOCK_SIZE + THUMBNAIL_BLOCK_SIZE / 2) * pitch,
+        thumb->width);
+  }
+  gst_vaapi_image_unmap (image);
+
+  n = thumb->width * thumb->height;
+  for (i = 0; i < n; i++)
+    thumb->histogram[thumb->data[i] * HISTOGRAM_BINS / 256]++;
+
+done:
+  gst_vaapi_object_unref (image);
+  return thumb;
+}
+
+/* Sum of absolute differences between the n bytes of a and b */
+static guint
+compute_sad (const guint8 * a, const guint8 * b, guint n)
+{
+  guint i = 0, sad = 0;
+
+#if USE_LOOKAHEAD_SSE2
+  __m128i s = _mm_setzero_si128 ();
+
+  for (; i + 16 <= n; i += 16) {
+    s = _mm_add_epi64 (s,
+        _mm_sad_epu8 (_mm_loadu_si128 ((const __m128i *) (a + i)),
+            _mm_loadu_si128 ((const __m128i *) (b + i))));
+  }
+  sad = _mm_cvtsi128_si32 (s) + _mm_cvtsi128_si32 (_mm_srli_si128 (s, 8));
+#endif
+  for (; i < n; i++)
+    sad += ABS ((gint) a[i] - (gint) b[i]);
+  return sad;
+}
+
+static gboolean
+is_scene_cut (const Thumbnail * a, const Thumbnail * b)
+{
+  guint i, n, sad, histogram_diff = 0;
+
+  if (!a || !b || a->width != b->width || a->height != b->height)
+    return FALSE;
+
+  n = a->width * a->height;
+  sad = compute_sad (a->data, b->data, n);
+  if (sad <= SCENE_CUT_SAD_THRESHOLD * n)
+    return FALSE;
+
+  for (i = 0; i < HISTOGRAM_BINS; i++)
+    histogram_diff += ABS ((gint) a->histogram[i] - (gint) b->histogram[i]);
+  return histogram_diff * 100 > SCENE_CUT_HISTOGRAM_THRESHOLD * n;
+}
+
+static void
+analyse_frame (LookaheadFrame * lf, GstVaapiEncoderLookahead * lookahead)
+{
+  Thumbnail *thumb = NULL;
+  gboolean cancel;
+
+  g_mutex_lock (&lookahead->lock);
+  cancel = lookahead->cancel;
+  g_mutex_unlock (&lookahead->lock);
+
+  if (!cancel) {
+    thumb = thumbnail_new_from_frame (lf->frame);
+    if (!thumb)
+      GST_DEBUG ("could not analyse frame %u", lf->frame->system_frame_number);
+  }
+
+  g_mutex_lock (&lookahead->lock);
+  lf->thumb = thumb;
+  lf->analysed = TRUE;
+  lookahead->num_pending--;
+  g_cond_broadcast (&lookahead->analysed_cond);
+  g_mutex_unlock (&lookahead->lock);
+}
+
+/* Checks whether the first n queued frames are analysed. If wait is
+   set, waits for them instead. The frames are analysed in order */
+static gboolean
+check_analysed (GstVaapiEncoderLookahead * lookahead, guint n, gboolean wait)
+{
+  LookaheadFrame *lf;
+  gboolean analysed;
+
+  if (n == 0)
+    return TRUE;
+  lf = g_queue_peek_nth (&lookahead->frames, n - 1);
+
+  g_mutex_lock (&lookahead->lock);
+  while (!(analysed = lf->analysed) && wait)
+    g_cond_wait (&lookahead->analysed_cond, &lookahead->lock);
+  g_mutex_unlock (&lookahead->lock);
+  return analysed;
+}
+
+/* Mean absolute difference between two thumbnails, or -1 */
+static gdouble
+compute_complexity (const Thumbnail * a, const Thumbnail * b)
+{
+  guint n;
+
+  if (!a || !b || a->width != b->width || a->height != b->height)
+    return -1;
+
+  n = a->width * a->height;
+  return (gdouble) compute_sad (a->data, b->data, n) / n;
+}
+
+/* Computes the hints of the first queued frame, from its complexity and
+   the one of the frames that follow it in the lookahead */
+static void
+compute_hints (GstVaapiEncoderLookahead * lookahead, gboolean scene_cut,
+    GstVaapiEncoderLookaheadHints * hints)
+{
+  const Thumbnail *prev_thumb = lookahead->last_thumb;
+  LookaheadFrame *first = NULL;
+  gdouble complexity, sum = 0;
+  guint i, n = 0;
+  GList *l;
+
+  /* The complexities are computed once, as the frames come first */
+  for (i = 0, l = lookahead->frames.head; l != NULL && i <= lookahead->depth;
+      i++, l = l->next) {
+    LookaheadFrame *const lf = l->data;
+
+    if (lf->complexity < 0)
+      lf->complexity = compute_complexity (prev_thumb, lf->thumb);
+    if (lf->complexity >= 0) {
+      sum += lf->complexity + 1;
+      n++;
+    }
+    if (!first)
+      first = lf;
+    prev_thumb = lf->thumb;
+  }
+
+  hints->qp_delta = 0;
+  hints->high_motion = FALSE;
+  if (scene_cut || first->complexity < 0)
+    return;
+
+  hints->high_motion = first->complexity > HIGH_MOTION_SAD_THRESHOLD;
+  complexity = (first->complexity + 1) / (sum / n);
+  hints->qp_delta = CLAMP ((gint) floor (QP_HINT_SCALE * log2 (complexity) +
+          0.5), -QP_HINT_MAX, QP_HINT_MAX);
+}
+
+/**
+ * gst_vaapi_encoder_lookahead_new:
+ * @depth: the number of frames held after the one being decided upon
+ *
+ * Creates a lookahead queue. Each frame is analysed in a separate
+ * thread as soon as it is pushed, and it is released once @depth more
+ * frames were pushed and analysed, or on drain. A frame that differs
+ * enough from the previous one starts a new scene, and is marked as a
+ * forced key frame, unless the change does not last for the @depth
+ * frames that follow, e.g. a flash. The other frames get rate control
+ * and reordering hints, see gst_vaapi_encoder_lookahead_get_hints().
+ *
+ * Return value: the newly allocated #GstVaapiEncoderLookahead
+ */
+GstVaapiEncoderLookahead *
+gst_vaapi_encoder_lookahead_new (guint depth)
+{
+  GstVaapiEncoderLookahead *lookahead;
+
+  lookahead = g_slice_new0 (GstVaapiEncoderLookahead);
+  lookahead->depth = depth;
+  g_queue_init (&lookahead->frames);
+  g_mutex_init (&lookahead->lock);
+  g_cond_init (&lookahead->analysed_cond);
+  lookahead->analysis_pool = g_thread_pool_new ((GFunc) analyse_frame,
+      lookahead, 1, FALSE, NULL);
+  return lookahead;
+}
+
+/**
+ * gst_vaapi_encoder_lookahead_free:
+ * @lookahead: a #GstVaapiEncoderLookahead
+ *
+ * Releases the frames still held by @lookahead, and destroys it.
+ */
+void
+gst_vaapi_encoder_lookahead_free (GstVaapiEncoderLookahead * lookahead)
+{
+  if (!lookahead)
+    return;
+  gst_vaapi_encoder_lookahead_reset (lookahead);
+  if (lookahead->analysis_pool)
+    g_thread_pool_free (lookahead->analysis_pool, FALSE, TRUE);
+  g_cond_clear (&lookahead->analysed_cond);
+  g_mutex_clear (&lookahead->lock);
+  g_slice_free (GstVaapiEncoderLookahead, lookahead);
+}
+
+/**
+ * gst_vaapi_encoder_lookahead_push:
+ * @lookahead: a #GstVaapiEncoderLookahead
+ * @frame: a #GstVideoCodecFrame with a #GstVaapiSurfaceProxy as user
+ *   data
+ *
+ * Appends @frame to @lookahead, which holds a new reference to it, and
+ * queues it for analysis.
+ */
+void
+gst_vaapi_encoder_lookahead_push (GstVaapiEncoderLookahead * lookahead,
+    GstVideoCodecFrame * frame)
+{
+  LookaheadFrame *lf;
+
+  lf = g_slice_new0 (LookaheadFrame);
+  lf->frame = gst_video_codec_frame_ref (frame);
+  lf->complexity = -1;
+  g_queue_push_tail (&lookahead->frames, lf);
+
+  g_mutex_lock (&lookahead->lock);
+  lookahead->num_pending++;
+  g_mutex_unlock (&lookahead->lock);
+  if (!lookahead->analysis_pool ||
+      !g_thread_pool_push (lookahead->analysis_pool, lf, NULL))
+    analyse_frame (lf, lookahead);
+}
+
+/**
+ * gst_vaapi_encoder_lookahead_pop:
+ * @lookahead: a #GstVaapiEncoderLookahead
+ * @drain: whether to release the frame regardless of the depth
+ *
+ * Releases the oldest frame of @lookahead, if more than the lookahead
+ * depth frames are held, or if @drain is set. The frame is marked as
+ * a forced key frame if it starts a new scene.
+ *
+ * The frames needed for the decision are waited for if their analysis
+ * is not complete, either on drain, or if the analysis lags behind by
+ * more than one frame. Otherwise, %NULL is returned, and the frame is
+ * released by a later call.
+ *
+ * Return value: (transfer full): the released #GstVideoCodecFrame, or
+ *   %NULL if none is available yet
+ */
+GstVideoCodecFrame *
+gst_vaapi_encoder_lookahead_pop (GstVaapiEncoderLookahead * lookahead,
+    gboolean drain)
+{
+  GstVaapiEncoderLookaheadHints hints;
+  GstVideoCodecFrame *frame;
+  LookaheadFrame *lf;
+  HintsEntry *entry;
+  gboolean scene_cut;
+  guint i, length;
+  GList *l;
+
+  length = g_queue_get_length (&lookahead->frames);
+  if (length <= (drain ? 0 : lookahead->depth))
+    return NULL;
+  if (!check_analysed (lookahead, MIN (length, lookahead->depth + 1),
+          drain || length > lookahead->depth + 1))
+    return NULL;
+
+  lf = g_queue_peek_head (&lookahead->frames);
+  frame = lf->frame;
+
+  /* The new scene has to last over the whole lookahead */
+  scene_cut = is_scene_cut (lookahead->last_thumb, lf->thumb);
+  for (i = 0, l = lookahead->frames.head->next;
+      scene_cut && l != NULL && i < lookahead->depth; i++, l = l->next) {
+    LookaheadFrame *const next = l->data;
+    scene_cut = is_scene_cut (lookahead->last_thumb, next->thumb);
+  }
+  if (scene_cut) {
+    GST_DEBUG ("scene cut at frame %u", frame->system_frame_number);
+    GST_VIDEO_CODEC_FRAME_SET_FORCE_KEYFRAME (frame);
+  }
+
+  compute_hints (lookahead, scene_cut, &hints);
+  GST_LOG ("frame %u: qp delta %d%s", frame->system_frame_number,
+      hints.qp_delta, hints.high_motion ? ", high motion" : "");
+  entry = &lookahead->hints[frame->system_frame_number % HINTS_HISTORY_SIZE];
+  entry->frame_number = frame->system_frame_number;
+  entry->valid = TRUE;
+  entry->hints = hints;
+
+  g_queue_pop_head (&lookahead->frames);
+  thumbnail_free (lookahead->last_thumb);
+  lookahead->last_thumb = lf->thumb;
+  g_slice_free (LookaheadFrame, lf);
+  return frame;
+}
+
+/**
+ * gst_vaapi_encoder_lookahead_get_hints:
+ * @lookahead: a #GstVaapiEncoderLookahead
+ * @frame: a #GstVideoCodecFrame released by @lookahead
+ * @hints: (out caller-allocates): the hints for @frame
+ *
+ * Retrieves the hints computed for @frame when it was released:
+ * - a QP delta, from the complexity of @frame relative to the frames
+ *   around it, for the rate control;
+ * - whether @frame has high motion, in which case it should not be
+ *   coded as a B frame.
+ *
+ * Return value: %TRUE if the hints of @frame are known
+ */
+gboolean
+gst_vaapi_encoder_lookahead_get_hints (GstVaapiEncoderLookahead * lookahead,
+    GstVideoCodecFrame * frame, GstVaapiEncoderLookaheadHints * hints)
+{
+  const HintsEntry *entry;
+
+  entry = &lookahead->hints[frame->system_frame_number % HINTS_HISTORY_SIZE];
+  if (!entry->valid || entry->frame_number != frame->system_frame_number)
+    return FALSE;
+  *hints = entry->hints;
+  return TRUE;
+}
+
+/**
+ * gst_vaapi_encoder_lookahead_reset:
+ * @lookahead: a #GstVaapiEncoderLookahead
+ *
+ * Releases all the frames held by @lookahead, without analysing them
+ * further, and forgets about the previous scene.
+ */
+void
+gst_vaapi_encoder_lookahead_reset (GstVaapiEncoderLookahead * lookahead)
+{
+  LookaheadFrame *lf;
+  guint i;
+
+  /* Let the pending analyses complete without mapping the surfaces */
+  g_mutex_lock (&lookahead->lock);
+  lookahead->cancel = TRUE;
+  while (lookahead->num_pending > 0)
+    g_cond_wait (&lookahead->analysed_cond, &lookahead->lock);
+  lookahead->cancel = FALSE;
+  g_mutex_unlock (&lookahead->lock);
+
+  while ((lf = g_queue_pop_head (&lookahead->frames)) != NULL) {
+    gst_video_codec_frame_unref (lf->frame);
+    thumbnail_free (lf->thumb);
+    g_slice_free (LookaheadFrame, lf);
+  }
+  thumbnail_free (lookahead->last_thumb);
+  lookahead->last_thumb = NULL;
+  for (i = 0; i < HINTS_HISTORY_SIZE; i++)
+    lookahead->hints[i].valid = FALSE;
+}
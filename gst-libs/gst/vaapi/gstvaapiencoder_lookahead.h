@@ -0,0 +1,74 @@
+/*
+ *  gstvaapiencoder_lookahead.h - Encoder lookahead and scene cut detection
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef GST_VAAPI_ENCODER_LOOKAHEAD_H
+#define GST_VAAPI_ENCODER_LOOKAHEAD_H
+
+#include <gst/video/gstvideoutils.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstVaapiEncoderLookahead GstVaapiEncoderLookahead;
+typedef struct _GstVaapiEncoderLookaheadHints GstVaapiEncoderLookaheadHints;
+
+/**
+ * GstVaapiEncoderLookaheadHints:
+ * @qp_delta: the QP offset suggested for the frame
+ * @high_motion: whether the frame has high motion
+ *
+ * The per-frame results of the lookahead analysis.
+ */
+struct _GstVaapiEncoderLookaheadHints
+{
+  gint qp_delta;
+  gboolean high_motion;
+};
+
+G_GNUC_INTERNAL
+GstVaapiEncoderLookahead *
+gst_vaapi_encoder_lookahead_new (guint depth);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_encoder_lookahead_free (GstVaapiEncoderLookahead * lookahead);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_encoder_lookahead_push (GstVaapiEncoderLookahead * lookahead,
+    GstVideoCodecFrame * frame);
+
+G_GNUC_INTERNAL
+GstVideoCodecFrame *
+gst_vaapi_encoder_lookahead_pop (GstVaapiEncoderLookahead * lookahead,
+    gboolean drain);
+
+G_GNUC_INTERNAL
+gboolean
+gst_vaapi_encoder_lookahead_get_hints (GstVaapiEncoderLookahead * lookahead,
+    GstVideoCodecFrame * frame, GstVaapiEncoderLookaheadHints * hints);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_encoder_lookahead_reset (GstVaapiEncoderLookahead * lookahead);
+
+G_END_DECLS
+
+#endif /* GST_VAAPI_ENCODER_LOOKAHEAD_H */
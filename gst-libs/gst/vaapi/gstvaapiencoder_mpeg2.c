@@ -342,11 +342,14 @@ set_sequence_packed_header (GstVaapiEncoderMpeg2 * encoder,
 {
   GstVaapiEncPackedHeader *packed_seq;
   GstBitWriter writer;
+  gint64 start_time;
   VAEncPackedHeaderParameterBuffer packed_header_param_buffer = { 0 };
   const VAEncSequenceParameterBufferMPEG2 *const seq_param = sequence->param;
   guint32 data_bit_size;
   guint8 *data;
 
+  start_time = gst_vaapi_encoder_header_stats_start (GST_VAAPI_ENCODER
+      (encoder));
   gst_bit_writer_init (&writer, 128 * 8);
   if (encoder->new_gop)
     gst_bit_writer_write_sps (&writer, seq_param);
@@ -362,6 +365,8 @@ set_sequence_packed_header (GstVaapiEncoderMpeg2 * encoder,
       &packed_header_param_buffer, sizeof (packed_header_param_buffer),
       data, (data_bit_size + 7) / 8);
   g_assert (packed_seq);
+  gst_vaapi_encoder_header_stats_add (GST_VAAPI_ENCODER (encoder),
+      start_time, (data_bit_size + 7) / 8);
 
   gst_vaapi_enc_picture_add_packed_header (picture, packed_seq);
   gst_vaapi_codec_object_replace (&packed_seq, NULL);
@@ -376,11 +381,14 @@ set_picture_packed_header (GstVaapiEncoderMpeg2 * encoder,
 {
   GstVaapiEncPackedHeader *packed_pic;
   GstBitWriter writer;
+  gint64 start_time;
   VAEncPackedHeaderParameterBuffer packed_header_param_buffer = { 0 };
   const VAEncPictureParameterBufferMPEG2 *const pic_param = picture->param;
   guint32 data_bit_size;
   guint8 *data;
 
+  start_time = gst_vaapi_encoder_header_stats_start (GST_VAAPI_ENCODER
+      (encoder));
   gst_bit_writer_init (&writer, 128 * 8);
   gst_bit_writer_write_pps (&writer, pic_param);
   g_assert (GST_BIT_WRITER_BIT_SIZE (&writer) % 8 == 0);
@@ -395,6 +403,8 @@ set_picture_packed_header (GstVaapiEncoderMpeg2 * encoder,
       &packed_header_param_buffer, sizeof (packed_header_param_buffer),
       data, (data_bit_size + 7) / 8);
   g_assert (packed_pic);
+  gst_vaapi_encoder_header_stats_add (GST_VAAPI_ENCODER (encoder),
+      start_time, (data_bit_size + 7) / 8);
 
   gst_vaapi_enc_picture_add_packed_header (picture, packed_pic);
   gst_vaapi_codec_object_replace (&packed_pic, NULL);
@@ -58,6 +58,7 @@ gst_vaapi_enc_packed_header_create (GstVaapiEncPackedHeader * header,
 
   header->param_id = VA_INVALID_ID;
   header->data_id = VA_INVALID_ID;
+  header->is_cached = FALSE;
 
   success = vaapi_create_buffer (GET_VA_DISPLAY (header),
       GET_VA_CONTEXT (header),
@@ -107,6 +108,118 @@ gst_vaapi_enc_packed_header_set_data (GstVaapiEncPackedHeader * header,
   return TRUE;
 }
 
+/**
+ * gst_vaapi_enc_packed_header_collect_stats:
+ * @encoder: a #GstVaapiEncoder
+ * @stats: (nullable): the counters to accumulate into, or %NULL
+ *
+ * Makes @encoder account for the time spent generating its packed
+ * headers, and for their size, into @stats, which shall stay valid
+ * until this is called again with %NULL. The counters are updated by
+ * the thread that submits the frames to @encoder, without locking.
+ * This is meant for benchmarks, and disabled by default.
+ */
+void
+gst_vaapi_enc_packed_header_collect_stats (GstVaapiEncoder * encoder,
+    GstVaapiEncPackedHeaderStats * stats)
+{
+  g_return_if_fail (encoder != NULL);
+
+  encoder->header_stats = stats;
+}
+
+/* FNV-1a hash of the packed header generation parameters */
+static guint32
+packed_header_cache_hash (gconstpointer key, guint key_size)
+{
+  const guint8 *const bytes = key;
+  guint32 hash = 2166136261U;
+  guint i;
+
+  for (i = 0; i < key_size; i++) {
+    hash ^= bytes[i];
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+/**
+ * gst_vaapi_enc_packed_header_cache_lookup:
+ * @cache: a #GstVaapiEncPackedHeaderCache
+ * @key: the parameters the packed header would be generated from
+ * @key_size: the size of @key, in bytes
+ *
+ * Looks up the packed header generated from @key. Any padding in
+ * @key shall be cleared, since it is compared byte by byte.
+ *
+ * Return value: a new reference to the cached #GstVaapiEncPackedHeader,
+ *   or %NULL if it needs to be generated again
+ */
+GstVaapiEncPackedHeader *
+gst_vaapi_enc_packed_header_cache_lookup (GstVaapiEncPackedHeaderCache * cache,
+    gconstpointer key, guint key_size)
+{
+  g_return_val_if_fail (cache != NULL, NULL);
+  g_return_val_if_fail (key != NULL, NULL);
+
+  if (!cache->header || cache->key_size != key_size)
+    return NULL;
+  if (cache->hash != packed_header_cache_hash (key, key_size))
+    return NULL;
+  if (memcmp (cache->key, key, key_size) != 0)
+    return NULL;
+  return (GstVaapiEncPackedHeader *)
+      gst_vaapi_codec_object_ref (cache->header);
+}
+
+/**
+ * gst_vaapi_enc_packed_header_cache_store:
+ * @cache: a #GstVaapiEncPackedHeaderCache
+ * @header: the #GstVaapiEncPackedHeader generated from @key
+ * @key: the parameters @header was generated from
+ * @key_size: the size of @key, in bytes
+ *
+ * Replaces the packed header held in @cache with @header. From now
+ * on, the VA buffers of @header outlive their submission.
+ */
+void
+gst_vaapi_enc_packed_header_cache_store (GstVaapiEncPackedHeaderCache * cache,
+    GstVaapiEncPackedHeader * header, gconstpointer key, guint key_size)
+{
+  g_return_if_fail (cache != NULL);
+  g_return_if_fail (header != NULL);
+  g_return_if_fail (key != NULL);
+
+  gst_vaapi_enc_packed_header_cache_clear (cache);
+
+  header->is_cached = TRUE;
+  cache->header = (GstVaapiEncPackedHeader *)
+      gst_vaapi_codec_object_ref (header);
+  cache->hash = packed_header_cache_hash (key, key_size);
+  cache->key = g_memdup (key, key_size);
+  cache->key_size = key_size;
+}
+
+/**
+ * gst_vaapi_enc_packed_header_cache_clear:
+ * @cache: a #GstVaapiEncPackedHeaderCache
+ *
+ * Releases the packed header held in @cache, if any. This shall be
+ * called whenever the encoder is reconfigured, since the cached VA
+ * buffers are bound to the current VA context.
+ */
+void
+gst_vaapi_enc_packed_header_cache_clear (GstVaapiEncPackedHeaderCache * cache)
+{
+  g_return_if_fail (cache != NULL);
+
+  gst_vaapi_codec_object_replace (&cache->header, NULL);
+  g_free (cache->key);
+  cache->key = NULL;
+  cache->key_size = 0;
+  cache->hash = 0;
+}
+
 /* ------------------------------------------------------------------------- */
 /* --- Encoder Sequence                                                  --- */
 /* ------------------------------------------------------------------------- */
@@ -506,6 +619,30 @@ do_encode (VADisplay dpy, VAContextID ctx, VABufferID * buf_id, void **buf_ptr)
   return TRUE;
 }
 
+/* Submits a packed header. The VA buffers of cached packed headers are
+   kept, unmapped, so that they can be submitted with later pictures */
+static gboolean
+do_encode_packed_header (VADisplay dpy, VAContextID ctx,
+    GstVaapiEncPackedHeader * header)
+{
+  VABufferID buf_ids[2];
+  VAStatus status;
+
+  if (!header->is_cached)
+    return do_encode (dpy, ctx, &header->param_id, &header->param) &&
+        do_encode (dpy, ctx, &header->data_id, &header->data);
+
+  if (header->param)
+    vaapi_unmap_buffer (dpy, header->param_id, &header->param);
+  if (header->data)
+    vaapi_unmap_buffer (dpy, header->data_id, &header->data);
+
+  buf_ids[0] = header->param_id;
+  buf_ids[1] = header->data_id;
+  status = vaRenderPicture (dpy, ctx, buf_ids, G_N_ELEMENTS (buf_ids));
+  return vaapi_check_status (status, "vaRenderPicture()");
+}
+
 gboolean
 gst_vaapi_enc_picture_encode (GstVaapiEncPicture * picture)
 {
@@ -551,9 +688,7 @@ gst_vaapi_enc_picture_encode (GstVaapiEncPicture * picture)
   for (i = 0; i < picture->packed_headers->len; i++) {
     GstVaapiEncPackedHeader *const header =
         g_ptr_array_index (picture->packed_headers, i);
-    if (!do_encode (va_display, va_context,
-            &header->param_id, &header->param) ||
-        !do_encode (va_display, va_context, &header->data_id, &header->data))
+    if (!do_encode_packed_header (va_display, va_context, header))
       return FALSE;
   }
 
@@ -578,9 +713,7 @@ gst_vaapi_enc_picture_encode (GstVaapiEncPicture * picture)
     for (j = 0; j < slice->packed_headers->len; j++) {
       GstVaapiEncPackedHeader *const header =
           g_ptr_array_index (slice->packed_headers, j);
-      if (!do_encode (va_display, va_context,
-              &header->param_id, &header->param) ||
-          !do_encode (va_display, va_context, &header->data_id, &header->data))
+      if (!do_encode_packed_header (va_display, va_context, header))
         return FALSE;
     }
     if (!do_encode (va_display, va_context, &slice->param_id, &slice->param))
@@ -64,8 +64,45 @@ struct _GstVaapiEncPackedHeader
   gpointer param;
   VABufferID data_id;
   gpointer data;
+  gboolean is_cached;
 };
 
+/**
+ * GstVaapiEncPackedHeaderCache:
+ * @header: the cached #GstVaapiEncPackedHeader, or %NULL
+ * @hash: the hash of @key
+ * @key: a copy of the parameters @header was generated from
+ * @key_size: the size of @key, in bytes
+ *
+ * A packed header kept across pictures, and submitted again as long
+ * as the parameters it was generated from do not change. The VA
+ * buffers of a cached packed header are not destroyed once rendered.
+ */
+typedef struct
+{
+  GstVaapiEncPackedHeader *header;
+  guint32 hash;
+  gpointer key;
+  guint key_size;
+} GstVaapiEncPackedHeaderCache;
+
+/**
+ * GstVaapiEncPackedHeaderStats:
+ * @num_headers: number of packed headers generated
+ * @num_bytes: total size of the packed headers
+ * @elapsed: time spent writing the packed headers and creating their
+ *   VA buffers, in microseconds
+ *
+ * Packed header generation counters of one encoder, only collected
+ * once requested with gst_vaapi_enc_packed_header_collect_stats().
+ */
+typedef struct
+{
+  guint num_headers;
+  gsize num_bytes;
+  gsize elapsed;
+} GstVaapiEncPackedHeaderStats;
+
 G_GNUC_INTERNAL
 GstVaapiEncPackedHeader *
 gst_vaapi_enc_packed_header_new (GstVaapiEncoder * encoder,
@@ -76,6 +113,25 @@ gboolean
 gst_vaapi_enc_packed_header_set_data (GstVaapiEncPackedHeader * header,
     gconstpointer data, guint data_size);
 
+G_GNUC_INTERNAL
+void
+gst_vaapi_enc_packed_header_collect_stats (GstVaapiEncoder * encoder,
+    GstVaapiEncPackedHeaderStats * stats);
+
+G_GNUC_INTERNAL
+GstVaapiEncPackedHeader *
+gst_vaapi_enc_packed_header_cache_lookup (GstVaapiEncPackedHeaderCache * cache,
+    gconstpointer key, guint key_size);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_enc_packed_header_cache_store (GstVaapiEncPackedHeaderCache * cache,
+    GstVaapiEncPackedHeader * header, gconstpointer key, guint key_size);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_enc_packed_header_cache_clear (GstVaapiEncPackedHeaderCache * cache);
+
 /* ------------------------------------------------------------------------- */
 /* --- Encoder Sequence                                                  --- */
 /* ------------------------------------------------------------------------- */
@@ -30,6 +30,7 @@
 #include <gst/vaapi/gstvaapivideopool.h>
 #include <gst/video/gstvideoutils.h>
 #include <gst/vaapi/gstvaapivalue.h>
+#include "gstvaapiencoder_lookahead.h"
 
 G_BEGIN_DECLS
 
@@ -277,8 +278,21 @@ struct _GstVaapiEncoder
   GCond codedbuf_free;
   guint codedbuf_size;
   GstVaapiVideoPool *codedbuf_pool;
-  GAsyncQueue *codedbuf_queue;
+
+  /* Coded buffers submitted to the hardware, oldest first. They are
+   * protected by the mutex, and codedbuf_ready is signalled whenever
+   * one of them may have become ready to be retrieved */
+  GQueue codedbuf_queue;
+  GCond codedbuf_ready;
   guint32 num_codedbuf_queued;
+  guint async_depth;
+  guint export_buffers;
+  gint num_codedbuf_exported;
+  guint lookahead_depth;
+  GstVaapiEncoderLookahead *lookahead;
+  GstVaapiEncPackedHeaderStats *header_stats;
+  guint codedbuf_drain:1;
+  guint codedbuf_flushing:1;
 
   guint got_packed_headers:1;
   guint got_rate_control_mask:1;
@@ -406,6 +420,29 @@ gst_vaapi_encoder_release_surface (GstVaapiEncoder * encoder,
   gst_vaapi_surface_proxy_unref (proxy);
 }
 
+/* Returns the time a packed header generation starts at, if the
+   packed header statistics are collected */
+static inline gint64
+gst_vaapi_encoder_header_stats_start (GstVaapiEncoder * encoder)
+{
+  return G_UNLIKELY (encoder->header_stats) ? g_get_monotonic_time () : 0;
+}
+
+/* Accounts for a packed header that was just generated, if the packed
+   header statistics are collected */
+static inline void
+gst_vaapi_encoder_header_stats_add (GstVaapiEncoder * encoder,
+    gint64 start_time, guint data_size)
+{
+  GstVaapiEncPackedHeaderStats *const stats = encoder->header_stats;
+
+  if (G_LIKELY (!stats))
+    return;
+  stats->num_headers++;
+  stats->num_bytes += data_size;
+  stats->elapsed += MAX (g_get_monotonic_time () - start_time, 0);
+}
+
 G_GNUC_INTERNAL
 gboolean
 gst_vaapi_encoder_ensure_param_quality_level (GstVaapiEncoder * encoder,
@@ -416,6 +453,21 @@ gboolean
 gst_vaapi_encoder_ensure_param_control_rate (GstVaapiEncoder * encoder,
     GstVaapiEncPicture * picture);
 
+G_GNUC_INTERNAL
+gboolean
+gst_vaapi_encoder_ensure_param_roi_regions (GstVaapiEncoder * encoder,
+    GstVaapiEncPicture * picture);
+
+G_GNUC_INTERNAL
+gint
+gst_vaapi_encoder_get_qp_hint (GstVaapiEncoder * encoder,
+    GstVideoCodecFrame * frame);
+
+G_GNUC_INTERNAL
+gboolean
+gst_vaapi_encoder_is_high_motion (GstVaapiEncoder * encoder,
+    GstVideoCodecFrame * frame);
+
 G_GNUC_INTERNAL
 gboolean
 gst_vaapi_encoder_ensure_num_slices (GstVaapiEncoder * encoder,
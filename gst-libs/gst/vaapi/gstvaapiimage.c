@@ -31,6 +31,7 @@
 #include <string.h>
 #include "gstvaapicompat.h"
 #include "gstvaapiutils.h"
+#include "gstvaapiutils_copy.h"
 #include "gstvaapiimage.h"
 #include "gstvaapiimage_priv.h"
 #include "gstvaapiobject_priv.h"
@@ -707,25 +708,10 @@ init_image_from_buffer (GstVaapiImageRaw * raw_image, GstBuffer * buffer)
   return vmeta ? init_image_from_video_meta (raw_image, vmeta) : FALSE;
 }
 
-/* Copy N lines of an image */
-static inline void
-memcpy_pic (guchar * dst,
-    guint dst_stride,
-    const guchar * src, guint src_stride, guint len, guint height)
-{
-  guint i;
-
-  for (i = 0; i < height; i++) {
-    memcpy (dst, src, len);
-    dst += dst_stride;
-    src += src_stride;
-  }
-}
-
 /* Copy NV12 images */
 static void
 copy_image_NV12 (GstVaapiImageRaw * dst_image,
-    GstVaapiImageRaw * src_image, const GstVaapiRectangle * rect)
+    GstVaapiImageRaw * src_image, const GstVaapiRectangle * rect, guint flags)
 {
   guchar *dst, *src;
   guint dst_stride, src_stride;
@@ -735,20 +721,22 @@ copy_image_NV12 (GstVaapiImageRaw * dst_image,
   dst = dst_image->pixels[0] + rect->y * dst_stride + rect->x;
   src_stride = src_image->stride[0];
   src = src_image->pixels[0] + rect->y * src_stride + rect->x;
-  memcpy_pic (dst, dst_stride, src, src_stride, rect->width, rect->height);
+  gst_vaapi_copy_plane (dst, dst_stride, src, src_stride, rect->width,
+      rect->height, flags);
 
   /* UV plane */
   dst_stride = dst_image->stride[1];
   dst = dst_image->pixels[1] + (rect->y / 2) * dst_stride + (rect->x & -2);
   src_stride = src_image->stride[1];
   src = src_image->pixels[1] + (rect->y / 2) * src_stride + (rect->x & -2);
-  memcpy_pic (dst, dst_stride, src, src_stride, rect->width, rect->height / 2);
+  gst_vaapi_copy_plane (dst, dst_stride, src, src_stride, rect->width,
+      rect->height / 2, flags);
 }
 
 /* Copy YV12 images */
 static void
 copy_image_YV12 (GstVaapiImageRaw * dst_image,
-    GstVaapiImageRaw * src_image, const GstVaapiRectangle * rect)
+    GstVaapiImageRaw * src_image, const GstVaapiRectangle * rect, guint flags)
 {
   guchar *dst, *src;
   guint dst_stride, src_stride;
@@ -759,7 +747,8 @@ copy_image_YV12 (GstVaapiImageRaw * dst_image,
   dst = dst_image->pixels[0] + rect->y * dst_stride + rect->x;
   src_stride = src_image->stride[0];
   src = src_image->pixels[0] + rect->y * src_stride + rect->x;
-  memcpy_pic (dst, dst_stride, src, src_stride, rect->width, rect->height);
+  gst_vaapi_copy_plane (dst, dst_stride, src, src_stride, rect->width,
+      rect->height, flags);
 
   /* U/V planes */
   x = rect->x / 2;
@@ -771,14 +760,14 @@ copy_image_YV12 (GstVaapiImageRaw * dst_image,
     dst = dst_image->pixels[i] + y * dst_stride + x;
     src_stride = src_image->stride[i];
     src = src_image->pixels[i] + y * src_stride + x;
-    memcpy_pic (dst, dst_stride, src, src_stride, w, h);
+    gst_vaapi_copy_plane (dst, dst_stride, src, src_stride, w, h, flags);
   }
 }
 
 /* Copy YUY2 images */
 static void
 copy_image_YUY2 (GstVaapiImageRaw * dst_image,
-    GstVaapiImageRaw * src_image, const GstVaapiRectangle * rect)
+    GstVaapiImageRaw * src_image, const GstVaapiRectangle * rect, guint flags)
 {
   guchar *dst, *src;
   guint dst_stride, src_stride;
@@ -788,13 +777,14 @@ copy_image_YUY2 (GstVaapiImageRaw * dst_image,
   dst = dst_image->pixels[0] + rect->y * dst_stride + rect->x * 2;
   src_stride = src_image->stride[0];
   src = src_image->pixels[0] + rect->y * src_stride + rect->x * 2;
-  memcpy_pic (dst, dst_stride, src, src_stride, rect->width * 2, rect->height);
+  gst_vaapi_copy_plane (dst, dst_stride, src, src_stride, rect->width * 2,
+      rect->height, flags);
 }
 
 /* Copy RGBA images */
 static void
 copy_image_RGBA (GstVaapiImageRaw * dst_image,
-    GstVaapiImageRaw * src_image, const GstVaapiRectangle * rect)
+    GstVaapiImageRaw * src_image, const GstVaapiRectangle * rect, guint flags)
 {
   guchar *dst, *src;
   guint dst_stride, src_stride;
@@ -803,20 +793,138 @@ copy_image_RGBA (GstVaapiImageRaw * dst_image,
   dst = dst_image->pixels[0] + rect->y * dst_stride + rect->x;
   src_stride = src_image->stride[0];
   src = src_image->pixels[0] + rect->y * src_stride + rect->x;
-  memcpy_pic (dst, dst_stride, src, src_stride, 4 * rect->width, rect->height);
+  gst_vaapi_copy_plane (dst, dst_stride, src, src_stride, 4 * rect->width,
+      rect->height, flags);
+}
+
+/* Convert I420 or YV12 images to NV12 */
+static void
+convert_image_YV12_to_NV12 (GstVaapiImageRaw * dst_image,
+    GstVaapiImageRaw * src_image, const GstVaapiRectangle * rect, guint flags)
+{
+  const guint u = src_image->format == GST_VIDEO_FORMAT_YV12 ? 2 : 1;
+  const guint v = 3 - u;
+  const guint x = rect->x / 2, y = rect->y / 2;
+
+  gst_vaapi_copy_plane (dst_image->pixels[0] + rect->y * dst_image->stride[0] +
+      rect->x, dst_image->stride[0], src_image->pixels[0] +
+      rect->y * src_image->stride[0] + rect->x, src_image->stride[0],
+      rect->width, rect->height, flags);
+
+  gst_vaapi_copy_interleave_plane (dst_image->pixels[1] +
+      y * dst_image->stride[1] + 2 * x, dst_image->stride[1],
+      src_image->pixels[u] + y * src_image->stride[u] + x,
+      src_image->stride[u], src_image->pixels[v] + y * src_image->stride[v] + x,
+      src_image->stride[v], (rect->width + 1) / 2, (rect->height + 1) / 2,
+      flags);
+}
+
+/* Convert YUY2 or UYVY images to NV12, averaging the chroma of each
+   pair of rows */
+static void
+convert_image_YUY2_to_NV12 (GstVaapiImageRaw * dst_image,
+    GstVaapiImageRaw * src_image, const GstVaapiRectangle * rect, guint flags)
+{
+  gst_vaapi_copy_packed_422_to_nv12 (dst_image->pixels[0] +
+      rect->y * dst_image->stride[0] + rect->x, dst_image->stride[0],
+      dst_image->pixels[1] + (rect->y / 2) * dst_image->stride[1] + rect->x,
+      dst_image->stride[1], src_image->pixels[0] +
+      rect->y * src_image->stride[0] + rect->x * 2, src_image->stride[0],
+      rect->width, rect->height, src_image->format == GST_VIDEO_FORMAT_YUY2,
+      flags);
+}
+
+/* Convert I420_10LE images to P010_10LE, i.e. interleave the chroma
+   and move the 10 bits of each sample to the most significant ones */
+static void
+convert_image_I420_10LE_to_P010 (GstVaapiImageRaw * dst_image,
+    GstVaapiImageRaw * src_image, const GstVaapiRectangle * rect, guint flags)
+{
+  const guint x = rect->x / 2, y = rect->y / 2;
+
+  gst_vaapi_copy_shift_plane_16 (dst_image->pixels[0] +
+      rect->y * dst_image->stride[0] + rect->x * 2, dst_image->stride[0],
+      src_image->pixels[0] + rect->y * src_image->stride[0] + rect->x * 2,
+      src_image->stride[0], rect->width, rect->height, 6, flags);
+
+  gst_vaapi_copy_interleave_plane_16 (dst_image->pixels[1] +
+      y * dst_image->stride[1] + x * 4, dst_image->stride[1],
+      src_image->pixels[1] + y * src_image->stride[1] + x * 2,
+      src_image->stride[1], src_image->pixels[2] + y * src_image->stride[2] +
+      x * 2, src_image->stride[2], (rect->width + 1) / 2,
+      (rect->height + 1) / 2, 6, flags);
+}
+
+typedef void (*ConvertImageFunc) (GstVaapiImageRaw * dst_image,
+    GstVaapiImageRaw * src_image, const GstVaapiRectangle * rect,
+    guint flags);
+
+/* Returns the function converting src_format images to dst_format
+   ones while copying them, or NULL if there is none */
+static ConvertImageFunc
+get_convert_image_func (GstVideoFormat dst_format, GstVideoFormat src_format)
+{
+  switch (dst_format) {
+    case GST_VIDEO_FORMAT_NV12:
+      switch (src_format) {
+        case GST_VIDEO_FORMAT_I420:
+        case GST_VIDEO_FORMAT_YV12:
+          return convert_image_YV12_to_NV12;
+        case GST_VIDEO_FORMAT_YUY2:
+        case GST_VIDEO_FORMAT_UYVY:
+          return convert_image_YUY2_to_NV12;
+        default:
+          break;
+      }
+      break;
+    case GST_VIDEO_FORMAT_P010_10LE:
+      if (src_format == GST_VIDEO_FORMAT_I420_10LE)
+        return convert_image_I420_10LE_to_P010;
+      break;
+    default:
+      break;
+  }
+  return NULL;
+}
+
+/**
+ * gst_vaapi_image_can_convert:
+ * @dst_format: the #GstVideoFormat of the target image
+ * @src_format: the #GstVideoFormat of the source image
+ *
+ * Checks whether images of @src_format can be copied into images of
+ * @dst_format, converting the pixels while copying them if the
+ * formats differ.
+ *
+ * Return value: %TRUE if the images can be copied
+ */
+gboolean
+gst_vaapi_image_can_convert (GstVideoFormat dst_format,
+    GstVideoFormat src_format)
+{
+  return dst_format == src_format ||
+      get_convert_image_func (dst_format, src_format) != NULL;
 }
 
+/* Copy images. flags are #GstVaapiCopyFlags telling which of the
+   images are mapped VA images */
 static gboolean
 copy_image (GstVaapiImageRaw * dst_image,
-    GstVaapiImageRaw * src_image, const GstVaapiRectangle * rect)
+    GstVaapiImageRaw * src_image, const GstVaapiRectangle * rect, guint flags)
 {
   GstVaapiRectangle default_rect;
+  ConvertImageFunc convert = NULL;
 
-  if (dst_image->format != src_image->format ||
-      dst_image->width != src_image->width ||
+  if (dst_image->width != src_image->width ||
       dst_image->height != src_image->height)
     return FALSE;
 
+  if (dst_image->format != src_image->format) {
+    convert = get_convert_image_func (dst_image->format, src_image->format);
+    if (!convert)
+      return FALSE;
+  }
+
   if (rect) {
     if (rect->x >= src_image->width ||
         rect->x + rect->width > src_image->width ||
@@ -831,23 +939,36 @@ copy_image (GstVaapiImageRaw * dst_image,
     rect = &default_rect;
   }
 
+  if (convert) {
+    /* The NV12 chroma covers 2x2 pixels, the region cannot split them
+       but at the right and bottom edges of odd sized images */
+    if ((rect->x | rect->y) & 1)
+      return FALSE;
+    if ((rect->width & 1) && rect->x + rect->width != src_image->width)
+      return FALSE;
+    if ((rect->height & 1) && rect->y + rect->height != src_image->height)
+      return FALSE;
+    convert (dst_image, src_image, rect, flags);
+    return TRUE;
+  }
+
   switch (dst_image->format) {
     case GST_VIDEO_FORMAT_NV12:
-      copy_image_NV12 (dst_image, src_image, rect);
+      copy_image_NV12 (dst_image, src_image, rect, flags);
       break;
     case GST_VIDEO_FORMAT_YV12:
     case GST_VIDEO_FORMAT_I420:
-      copy_image_YV12 (dst_image, src_image, rect);
+      copy_image_YV12 (dst_image, src_image, rect, flags);
       break;
     case GST_VIDEO_FORMAT_YUY2:
     case GST_VIDEO_FORMAT_UYVY:
-      copy_image_YUY2 (dst_image, src_image, rect);
+      copy_image_YUY2 (dst_image, src_image, rect, flags);
       break;
     case GST_VIDEO_FORMAT_ARGB:
     case GST_VIDEO_FORMAT_RGBA:
     case GST_VIDEO_FORMAT_ABGR:
     case GST_VIDEO_FORMAT_BGRA:
-      copy_image_RGBA (dst_image, src_image, rect);
+      copy_image_RGBA (dst_image, src_image, rect, flags);
       break;
     default:
       GST_ERROR ("unsupported image format for copy");
@@ -888,7 +1009,8 @@ gst_vaapi_image_get_buffer (GstVaapiImage * image,
   if (!_gst_vaapi_image_map (image, &src_image))
     return FALSE;
 
-  success = copy_image (&dst_image, &src_image, rect);
+  success = copy_image (&dst_image, &src_image, rect,
+      GST_VAAPI_COPY_FLAG_STREAM_LOAD);
 
   if (!_gst_vaapi_image_unmap (image))
     return FALSE;
@@ -920,7 +1042,8 @@ gst_vaapi_image_get_raw (GstVaapiImage * image,
   if (!_gst_vaapi_image_map (image, &src_image))
     return FALSE;
 
-  success = copy_image (dst_image, &src_image, rect);
+  success = copy_image (dst_image, &src_image, rect,
+      GST_VAAPI_COPY_FLAG_STREAM_LOAD);
 
   if (!_gst_vaapi_image_unmap (image))
     return FALSE;
@@ -960,7 +1083,8 @@ gst_vaapi_image_update_from_buffer (GstVaapiImage * image,
   if (!_gst_vaapi_image_map (image, &dst_image))
     return FALSE;
 
-  success = copy_image (&dst_image, &src_image, rect);
+  success = copy_image (&dst_image, &src_image, rect,
+      GST_VAAPI_COPY_FLAG_STREAM_STORE);
 
   if (!_gst_vaapi_image_unmap (image))
     return FALSE;
@@ -977,7 +1101,9 @@ gst_vaapi_image_update_from_buffer (GstVaapiImage * image,
  *   whole image
  *
  * Transfers pixels data contained in the #GstVaapiImageRaw into the
- * @image. Both image structures shall have the same format.
+ * @image. Both image structures shall have the same format, or be
+ * I420, YV12, YUY2 or UYVY into NV12, or I420_10LE into P010_10LE, in
+ * which case the pixels are converted while being copied.
  *
  * Return value: %TRUE on success
  */
@@ -993,7 +1119,8 @@ gst_vaapi_image_update_from_raw (GstVaapiImage * image,
   if (!_gst_vaapi_image_map (image, &dst_image))
     return FALSE;
 
-  success = copy_image (&dst_image, src_image, rect);
+  success = copy_image (&dst_image, src_image, rect,
+      GST_VAAPI_COPY_FLAG_STREAM_STORE);
 
   if (!_gst_vaapi_image_unmap (image))
     return FALSE;
@@ -1001,13 +1128,55 @@ gst_vaapi_image_update_from_raw (GstVaapiImage * image,
   return success;
 }
 
+/**
+ * gst_vaapi_image_update_from_frame:
+ * @image: a #GstVaapiImage
+ * @frame: a mapped #GstVideoFrame
+ *
+ * Transfers the pixels of @frame into @image, in a single pass. Both
+ * shall have the same size, and their formats shall be supported by
+ * gst_vaapi_image_update_from_raw(). For instance, an I420 frame in
+ * system memory can be uploaded to an NV12 image derived from a
+ * surface, without any intermediate copy.
+ *
+ * Return value: %TRUE on success
+ */
+gboolean
+gst_vaapi_image_update_from_frame (GstVaapiImage * image,
+    GstVideoFrame * frame)
+{
+  GstVaapiImageRaw src_image;
+  guint i;
+
+  g_return_val_if_fail (image != NULL, FALSE);
+  g_return_val_if_fail (frame != NULL, FALSE);
+
+  src_image.format = GST_VIDEO_FRAME_FORMAT (frame);
+  src_image.width = GST_VIDEO_FRAME_WIDTH (frame);
+  src_image.height = GST_VIDEO_FRAME_HEIGHT (frame);
+  src_image.num_planes = GST_VIDEO_FRAME_N_PLANES (frame);
+  if (src_image.num_planes > G_N_ELEMENTS (src_image.pixels))
+    return FALSE;
+
+  for (i = 0; i < src_image.num_planes; i++) {
+    if (GST_VIDEO_FRAME_PLANE_STRIDE (frame, i) < 0)
+      return FALSE;
+    src_image.pixels[i] = GST_VIDEO_FRAME_PLANE_DATA (frame, i);
+    src_image.stride[i] = GST_VIDEO_FRAME_PLANE_STRIDE (frame, i);
+  }
+  return gst_vaapi_image_update_from_raw (image, &src_image, NULL);
+}
+
 /**
  * gst_vaapi_image_copy:
  * @dst_image: the target #GstVaapiImage
  * @src_image: the source #GstVaapiImage
  *
  * Copies pixels data from @src_image to @dst_image. Both images shall
- * have the same format and size.
+ * have the same size and format, except for the conversions that
+ * gst_vaapi_image_update_from_raw() supports. For instance, an I420
+ * image can be copied into an NV12 image derived from a surface,
+ * without any intermediate copy by the driver.
  *
  * Return value: %TRUE on success
  */
@@ -1025,7 +1194,8 @@ gst_vaapi_image_copy (GstVaapiImage * dst_image, GstVaapiImage * src_image)
   if (!_gst_vaapi_image_map (src_image, &src_image_raw))
     goto end;
 
-  success = copy_image (&dst_image_raw, &src_image_raw, NULL);
+  success = copy_image (&dst_image_raw, &src_image_raw, NULL,
+      GST_VAAPI_COPY_FLAG_STREAM_LOAD | GST_VAAPI_COPY_FLAG_STREAM_STORE);
 
 end:
   _gst_vaapi_image_unmap (src_image);
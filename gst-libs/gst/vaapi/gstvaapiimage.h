@@ -128,9 +128,19 @@ gst_vaapi_image_update_from_buffer(
     GstVaapiRectangle *rect
 );
 
+gboolean
+gst_vaapi_image_update_from_frame(
+    GstVaapiImage     *image,
+    GstVideoFrame     *frame
+);
+
 gboolean
 gst_vaapi_image_copy(GstVaapiImage *dst_image, GstVaapiImage *src_image);
 
+gboolean
+gst_vaapi_image_can_convert(GstVideoFormat dst_format,
+    GstVideoFormat src_format);
+
 G_END_DECLS
 
 #endif /* GST_VAAPI_IMAGE_H */
@@ -20,14 +20,68 @@
  *  Boston, MA 02110-1301 USA
  */
 
-#include <string.h>
+#include "sysdeps.h"
 #include "gstvaapiminiobject.h"
 
+#define DEBUG 1
+#include "gstvaapidebug.h"
+
 /* Ensure those symbols are actually defined in the resulting libraries */
 #undef gst_vaapi_mini_object_ref
 #undef gst_vaapi_mini_object_unref
 #undef gst_vaapi_mini_object_replace
 
+/* Allocates an object from the class cache, or from the heap if the
+   cache is empty */
+static gpointer
+object_alloc (const GstVaapiMiniObjectClass * klass)
+{
+  GstVaapiMiniObjectCache *const cache = klass->cache;
+  gpointer object;
+  guint i;
+
+  if (!cache)
+    return g_slice_alloc (klass->size);
+
+  g_atomic_int_inc (&cache->live);
+  for (i = 0; i < G_N_ELEMENTS (cache->slots); i++) {
+    object = g_atomic_pointer_get (&cache->slots[i]);
+    if (object && g_atomic_pointer_compare_and_exchange (&cache->slots[i],
+            object, NULL)) {
+      g_atomic_int_inc (&cache->hits);
+      return object;
+    }
+  }
+  g_atomic_int_inc (&cache->misses);
+
+  GST_LOG ("%s cache miss (hits %d, misses %d, live %d)", cache->name,
+      g_atomic_int_get (&cache->hits), g_atomic_int_get (&cache->misses),
+      g_atomic_int_get (&cache->live));
+  return g_slice_alloc (klass->size);
+}
+
+/* Releases an object to the class cache, or to the heap if the cache
+   is full */
+static void
+object_free (const GstVaapiMiniObjectClass * klass, gpointer object)
+{
+  GstVaapiMiniObjectCache *const cache = klass->cache;
+  guint i;
+
+  if (cache) {
+    g_atomic_int_add (&cache->live, -1);
+    for (i = 0; i < G_N_ELEMENTS (cache->slots); i++) {
+      if (g_atomic_pointer_compare_and_exchange (&cache->slots[i],
+              NULL, object))
+        return;
+    }
+    GST_LOG ("%s cache full (hits %d, misses %d, live %d)", cache->name,
+        g_atomic_int_get (&cache->hits), g_atomic_int_get (&cache->misses),
+        g_atomic_int_get (&cache->live));
+  }
+  g_slice_free1 (klass->size, object);
+}
+
 void
 gst_vaapi_mini_object_free (GstVaapiMiniObject * object)
 {
@@ -38,8 +92,24 @@ gst_vaapi_mini_object_free (GstVaapiMiniObject * object)
   if (klass->finalize)
     klass->finalize (object);
 
-  if (G_LIKELY (g_atomic_int_dec_and_test (&object->ref_count)))
-    g_slice_free1 (klass->size, object);
+  if (G_LIKELY (g_atomic_int_dec_and_test (&object->ref_count))) {
+    if (GST_VAAPI_MINI_OBJECT_FLAG_IS_SET (object,
+            GST_VAAPI_MINI_OBJECT_FLAG_ARENA))
+      gst_vaapi_arena_free (object);
+    else
+      object_free (klass, object);
+  }
+}
+
+static inline void
+clear_object_data (GstVaapiMiniObject * object)
+{
+  const GstVaapiMiniObjectClass *const object_class = object->object_class;
+  guint sub_size;
+
+  sub_size = object_class->size - sizeof (*object);
+  if (sub_size > 0)
+    memset (((guchar *) object) + sizeof (*object), 0, sub_size);
 }
 
 /**
@@ -70,7 +140,7 @@ gst_vaapi_mini_object_new (const GstVaapiMiniObjectClass * object_class)
 
   g_return_val_if_fail (object_class->size >= sizeof (*object), NULL);
 
-  object = g_slice_alloc (object_class->size);
+  object = object_alloc (object_class);
   if (!object)
     return NULL;
 
@@ -94,17 +164,71 @@ GstVaapiMiniObject *
 gst_vaapi_mini_object_new0 (const GstVaapiMiniObjectClass * object_class)
 {
   GstVaapiMiniObject *object;
-  guint sub_size;
 
   object = gst_vaapi_mini_object_new (object_class);
   if (!object)
     return NULL;
 
-  object_class = object->object_class;
+  clear_object_data (object);
+  return object;
+}
 
-  sub_size = object_class->size - sizeof (*object);
-  if (sub_size > 0)
-    memset (((guchar *) object) + sizeof (*object), 0, sub_size);
+/**
+ * gst_vaapi_mini_object_new_with_arena:
+ * @object_class: The object class
+ * @arena: (optional): a #GstVaapiArena
+ *
+ * Creates a new #GstVaapiMiniObject from the memory blocks of @arena.
+ * This is meant for objects that are released shortly after, e.g. by
+ * the time the current frame is decoded. If @arena is NULL, then this
+ * function is equivalent to gst_vaapi_mini_object_new().
+ *
+ * Returns: The newly allocated #GstVaapiMiniObject
+ */
+GstVaapiMiniObject *
+gst_vaapi_mini_object_new_with_arena (const GstVaapiMiniObjectClass *
+    object_class, GstVaapiArena * arena)
+{
+  GstVaapiMiniObject *object;
+
+  if (!arena)
+    return gst_vaapi_mini_object_new (object_class);
+
+  g_return_val_if_fail (object_class != NULL, NULL);
+  g_return_val_if_fail (object_class->size >= sizeof (*object), NULL);
+
+  object = gst_vaapi_arena_alloc (arena, object_class->size);
+  if (!object)
+    return NULL;
+
+  object->object_class = object_class;
+  object->ref_count = 1;
+  object->flags = GST_VAAPI_MINI_OBJECT_FLAG_ARENA;
+  return object;
+}
+
+/**
+ * gst_vaapi_mini_object_new0_with_arena:
+ * @object_class: The object class
+ * @arena: (optional): a #GstVaapiArena
+ *
+ * Creates a new #GstVaapiMiniObject from the memory blocks of @arena.
+ * This function is similar to gst_vaapi_mini_object_new_with_arena()
+ * but derived object data is initialized to zeroes.
+ *
+ * Returns: The newly allocated #GstVaapiMiniObject
+ */
+GstVaapiMiniObject *
+gst_vaapi_mini_object_new0_with_arena (const GstVaapiMiniObjectClass *
+    object_class, GstVaapiArena * arena)
+{
+  GstVaapiMiniObject *object;
+
+  object = gst_vaapi_mini_object_new_with_arena (object_class, arena);
+  if (!object)
+    return NULL;
+
+  clear_object_data (object);
   return object;
 }
 
@@ -24,11 +24,13 @@
 #define GST_VAAPI_MINI_OBJECT_H
 
 #include <glib.h>
+#include "gstvaapiarena.h"
 
 G_BEGIN_DECLS
 
 typedef struct _GstVaapiMiniObject              GstVaapiMiniObject;
 typedef struct _GstVaapiMiniObjectClass         GstVaapiMiniObjectClass;
+typedef struct _GstVaapiMiniObjectCache         GstVaapiMiniObjectCache;
 
 /**
  * GST_VAAPI_MINI_OBJECT:
@@ -75,6 +77,14 @@ typedef struct _GstVaapiMiniObjectClass         GstVaapiMiniObjectClass;
 #define GST_VAAPI_MINI_OBJECT_FLAGS(object) \
   (GST_VAAPI_MINI_OBJECT (object)->flags)
 
+/**
+ * GST_VAAPI_MINI_OBJECT_FLAG_ARENA:
+ *
+ * Flag set on objects allocated from a #GstVaapiArena. This is the
+ * highest bit of the flags, derived classes shall not use it.
+ */
+#define GST_VAAPI_MINI_OBJECT_FLAG_ARENA (1U << 31)
+
 /**
  * GST_VAAPI_MINI_OBJECT_FLAG_IS_SET:
  * @object: a #GstVaapiMiniObject
@@ -124,11 +134,39 @@ struct _GstVaapiMiniObject
   guint flags;
 };
 
+#define GST_VAAPI_MINI_OBJECT_CACHE_SIZE 16
+
+/**
+ * GstVaapiMiniObjectCache:
+ * @name: the name of the cached objects, for debugging purposes
+ * @hits: number of objects recycled from the cache
+ * @misses: number of objects allocated from the heap
+ * @live: number of objects currently in use
+ *
+ * A small lock-free cache of released objects. Each slot holds either
+ * NULL or an object, and is atomically claimed by compare-and-swap, so
+ * that hot-path objects are recycled without going through the global
+ * allocator. A #GstVaapiMiniObjectCache shall be statically allocated,
+ * and referenced by a single #GstVaapiMiniObjectClass.
+ */
+struct _GstVaapiMiniObjectCache
+{
+  const gchar *name;
+  volatile gint hits;
+  volatile gint misses;
+  volatile gint live;
+
+  /*< private >*/
+  gpointer slots[GST_VAAPI_MINI_OBJECT_CACHE_SIZE];
+};
+
 /**
  * GstVaapiMiniObjectClass:
  * @size: size in bytes of the #GstVaapiMiniObject, plus any
  *   additional data for derived classes
  * @finalize: function called to destroy data in derived classes
+ * @cache: (optional): the #GstVaapiMiniObjectCache holding released
+ *   objects of this class for reuse
  *
  * A #GstVaapiMiniObjectClass represents the base object class that
  * defines the size of the #GstVaapiMiniObject and utility function to
@@ -139,6 +177,7 @@ struct _GstVaapiMiniObjectClass
   /*< protected >*/
   guint size;
   GDestroyNotify finalize;
+  GstVaapiMiniObjectCache *cache;
 };
 
 GstVaapiMiniObject *
@@ -170,6 +209,16 @@ G_GNUC_INTERNAL
 void
 gst_vaapi_mini_object_free (GstVaapiMiniObject * object);
 
+G_GNUC_INTERNAL
+GstVaapiMiniObject *
+gst_vaapi_mini_object_new_with_arena (const GstVaapiMiniObjectClass *
+    object_class, GstVaapiArena * arena);
+
+G_GNUC_INTERNAL
+GstVaapiMiniObject *
+gst_vaapi_mini_object_new0_with_arena (const GstVaapiMiniObjectClass *
+    object_class, GstVaapiArena * arena);
+
 /**
  * gst_vaapi_mini_object_ref_internal:
  * @object: a #GstVaapiMiniObject
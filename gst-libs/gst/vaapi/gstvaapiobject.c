@@ -93,6 +93,7 @@ gst_vaapi_object_new (const GstVaapiObjectClass * klass,
 
   object->display = gst_vaapi_display_ref (display);
   object->object_id = VA_INVALID_ID;
+  object->pool = NULL;
 
   sub_size = object_class->size - sizeof (*object);
   if (sub_size > 0)
@@ -172,6 +172,9 @@ struct _GstVaapiObject
 
   GstVaapiDisplay *display;
   GstVaapiID object_id;
+
+  /* the GstVaapiVideoPool the object is currently used from, if any */
+  gpointer pool;
 };
 
 /**
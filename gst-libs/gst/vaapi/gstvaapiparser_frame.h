@@ -61,7 +61,7 @@ struct _GstVaapiParserFrame {
 
 G_GNUC_INTERNAL
 GstVaapiParserFrame *
-gst_vaapi_parser_frame_new(guint width, guint height);
+gst_vaapi_parser_frame_new(GstVaapiArena *arena, guint width, guint height);
 
 G_GNUC_INTERNAL
 void
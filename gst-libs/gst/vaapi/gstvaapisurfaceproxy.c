@@ -76,9 +76,13 @@ gst_vaapi_surface_proxy_finalize (GstVaapiSurfaceProxy * proxy)
 static inline const GstVaapiMiniObjectClass *
 gst_vaapi_surface_proxy_class (void)
 {
+  static GstVaapiMiniObjectCache GstVaapiSurfaceProxyCache = {
+    .name = "GstVaapiSurfaceProxy",
+  };
   static const GstVaapiMiniObjectClass GstVaapiSurfaceProxyClass = {
     sizeof (GstVaapiSurfaceProxy),
-    (GDestroyNotify) gst_vaapi_surface_proxy_finalize
+    (GDestroyNotify) gst_vaapi_surface_proxy_finalize,
+    &GstVaapiSurfaceProxyCache
   };
   return &GstVaapiSurfaceProxyClass;
 }
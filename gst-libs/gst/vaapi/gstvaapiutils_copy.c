@@ -0,0 +1,755 @@
+/*
+ *  gstvaapiutils_copy.c - Plane copy helpers for mapped VA images
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#include "sysdeps.h"
+#include <string.h>
+#include "gstvaapiutils_copy.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+# if defined(__SSE2__)
+#  include <emmintrin.h>
+#  define USE_COPY_SSE2 1
+# endif
+# if defined(__GNUC__) && (__GNUC__ > 4 || \
+    (__GNUC__ == 4 && __GNUC_MINOR__ >= 9) || defined(__clang__))
+#  include <immintrin.h>
+#  define USE_COPY_SSE4_1 1
+# endif
+#endif
+
+#define DEBUG 1
+#include "gstvaapidebug.h"
+
+/* Mapped VA images usually live in uncached or write-combined (USWC)
+   memory. Regular stores to it are fine as long as full cache lines
+   get written in order, but regular loads are not cached at all and
+   are an order of magnitude slower than from system memory. Hence,
+   uploads use non-temporal stores, which also avoid evicting the
+   source from the cache, and downloads use streaming loads, which
+   fetch a full cache line at once from write-combined memory */
+
+typedef void (*CopyRowFunc) (guint8 * dst, const guint8 * src, guint len);
+
+static void
+copy_row_c (guint8 * dst, const guint8 * src, guint len)
+{
+  memcpy (dst, src, len);
+}
+
+#if USE_COPY_SSE2
+static void
+copy_row_stream_store_sse2 (guint8 * dst, const guint8 * src, guint len)
+{
+  __m128i r0, r1, r2, r3;
+  guint i;
+
+  /* Align the destination on 16 bytes */
+  i = MIN ((-(guintptr) dst) & 15, len);
+  memcpy (dst, src, i);
+
+  for (; i + 64 <= len; i += 64) {
+    r0 = _mm_loadu_si128 ((const __m128i *) (src + i));
+    r1 = _mm_loadu_si128 ((const __m128i *) (src + i + 16));
+    r2 = _mm_loadu_si128 ((const __m128i *) (src + i + 32));
+    r3 = _mm_loadu_si128 ((const __m128i *) (src + i + 48));
+    _mm_stream_si128 ((__m128i *) (dst + i), r0);
+    _mm_stream_si128 ((__m128i *) (dst + i + 16), r1);
+    _mm_stream_si128 ((__m128i *) (dst + i + 32), r2);
+    _mm_stream_si128 ((__m128i *) (dst + i + 48), r3);
+  }
+  for (; i + 16 <= len; i += 16) {
+    r0 = _mm_loadu_si128 ((const __m128i *) (src + i));
+    _mm_stream_si128 ((__m128i *) (dst + i), r0);
+  }
+  memcpy (dst + i, src + i, len - i);
+}
+
+static void
+copy_fence_sse2 (void)
+{
+  /* Make the non-temporal stores globally visible before the image
+     gets unmapped */
+  _mm_sfence ();
+}
+#endif
+
+#if USE_COPY_SSE4_1
+__attribute__ ((target ("sse4.1")))
+static void
+copy_row_stream_load_sse4_1 (guint8 * dst, const guint8 * src, guint len)
+{
+  __m128i r0, r1, r2, r3;
+  guint i;
+
+  /* Align the source on 16 bytes, as required by MOVNTDQA */
+  i = MIN ((-(guintptr) src) & 15, len);
+  memcpy (dst, src, i);
+
+  for (; i + 64 <= len; i += 64) {
+    r0 = _mm_stream_load_si128 ((__m128i *) (src + i));
+    r1 = _mm_stream_load_si128 ((__m128i *) (src + i + 16));
+    r2 = _mm_stream_load_si128 ((__m128i *) (src + i + 32));
+    r3 = _mm_stream_load_si128 ((__m128i *) (src + i + 48));
+    _mm_storeu_si128 ((__m128i *) (dst + i), r0);
+    _mm_storeu_si128 ((__m128i *) (dst + i + 16), r1);
+    _mm_storeu_si128 ((__m128i *) (dst + i + 32), r2);
+    _mm_storeu_si128 ((__m128i *) (dst + i + 48), r3);
+  }
+  for (; i + 16 <= len; i += 16) {
+    r0 = _mm_stream_load_si128 ((__m128i *) (src + i));
+    _mm_storeu_si128 ((__m128i *) (dst + i), r0);
+  }
+  memcpy (dst + i, src + i, len - i);
+}
+#endif
+
+/* Returns the row copy function using streaming loads if the running
+   CPU has them, or copy_row_c() otherwise */
+static CopyRowFunc
+get_stream_load_row_func (void)
+{
+  static gsize g_stream_load_func = 0;
+
+  if (g_once_init_enter (&g_stream_load_func)) {
+    CopyRowFunc func = copy_row_c;
+
+#if USE_COPY_SSE4_1
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("sse4.1"))
+      func = copy_row_stream_load_sse4_1;
+#endif
+    g_once_init_leave (&g_stream_load_func, (gsize) func);
+  }
+  return (CopyRowFunc) g_stream_load_func;
+}
+
+static CopyRowFunc
+get_copy_row_func (guint flags, gboolean * needs_fence_ptr)
+{
+  *needs_fence_ptr = FALSE;
+
+  /* Streaming loads take precedence, slow reads are far more costly
+     than slow writes */
+  if (flags & GST_VAAPI_COPY_FLAG_STREAM_LOAD)
+    return get_stream_load_row_func ();
+
+#if USE_COPY_SSE2
+  if (flags & GST_VAAPI_COPY_FLAG_STREAM_STORE) {
+    *needs_fence_ptr = TRUE;
+    return copy_row_stream_store_sse2;
+  }
+#endif
+  return copy_row_c;
+}
+
+static void
+copy_plane (CopyRowFunc func, guint8 * dst, guint dst_stride,
+    const guint8 * src, guint src_stride, guint len, guint height)
+{
+  guint i;
+
+  /* Copy contiguous planes at once */
+  if (dst_stride == len && src_stride == len && height <= G_MAXUINT / len) {
+    func (dst, src, len * height);
+    return;
+  }
+
+  for (i = 0; i < height; i++) {
+    func (dst, src, len);
+    dst += dst_stride;
+    src += src_stride;
+  }
+}
+
+void
+gst_vaapi_copy_plane_c (guint8 * dst, guint dst_stride, const guint8 * src,
+    guint src_stride, guint len, guint height, guint flags)
+{
+  if (!len || !height)
+    return;
+  copy_plane (copy_row_c, dst, dst_stride, src, src_stride, len, height);
+}
+
+/**
+ * gst_vaapi_copy_plane:
+ * @dst: the destination plane
+ * @dst_stride: the stride of @dst, in bytes
+ * @src: the source plane
+ * @src_stride: the stride of @src, in bytes
+ * @len: the number of bytes to copy per row
+ * @height: the number of rows to copy
+ * @flags: #GstVaapiCopyFlags telling which side is a mapped VA image
+ *
+ * Copies @height rows of @len bytes from @src to @dst. The copy
+ * kernel is picked according to @flags and to the features of the
+ * running CPU, on first use.
+ */
+void
+gst_vaapi_copy_plane (guint8 * dst, guint dst_stride, const guint8 * src,
+    guint src_stride, guint len, guint height, guint flags)
+{
+  CopyRowFunc func;
+  gboolean needs_fence;
+
+  if (!len || !height)
+    return;
+
+  func = get_copy_row_func (flags, &needs_fence);
+  copy_plane (func, dst, dst_stride, src, src_stride, len, height);
+
+#if USE_COPY_SSE2
+  if (needs_fence)
+    copy_fence_sse2 ();
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Conversion kernels                                                --- */
+/* ------------------------------------------------------------------------- */
+
+/* These convert while copying, so that uploading a frame whose format
+   the surfaces do not support still takes a single pass over memory.
+   With GST_VAAPI_COPY_FLAG_STREAM_STORE, the destination rows are
+   written with non-temporal stores, provided they are aligned. With
+   GST_VAAPI_COPY_FLAG_STREAM_LOAD, the source rows are first fetched
+   with streaming loads into a small cached buffer, from which the
+   kernels read: each source byte still crosses the bus once */
+
+typedef struct
+{
+  CopyRowFunc load;
+  guint8 *data;
+  gsize size;
+} RowLoader;
+
+/* Sets up loader for up to two source rows of size bytes at once */
+static void
+row_loader_init (RowLoader * loader, guint flags, gsize size)
+{
+  loader->load = NULL;
+  loader->data = NULL;
+  loader->size = GST_ROUND_UP_64 (size);
+
+  if (!(flags & GST_VAAPI_COPY_FLAG_STREAM_LOAD))
+    return;
+  loader->load = get_stream_load_row_func ();
+  if (loader->load == copy_row_c) {
+    loader->load = NULL;
+    return;
+  }
+  loader->data = g_try_malloc (2 * loader->size);
+  if (!loader->data)
+    loader->load = NULL;
+}
+
+static void
+row_loader_clear (RowLoader * loader)
+{
+  g_free (loader->data);
+}
+
+/* Returns the row to read from: src itself, or its copy in the slot
+   (0 or 1) of the cached buffer */
+static inline const guint8 *
+row_loader_load (RowLoader * loader, guint slot, const guint8 * src,
+    gsize size)
+{
+  guint8 *row;
+
+  if (!loader->load)
+    return src;
+  row = loader->data + slot * loader->size;
+  loader->load (row, src, size);
+  return row;
+}
+
+static inline gboolean
+use_stream_store (const guint8 * dst, guint dst_stride, guint flags)
+{
+#if USE_COPY_SSE2
+  return (flags & GST_VAAPI_COPY_FLAG_STREAM_STORE) &&
+      (((guintptr) dst | dst_stride) & 15) == 0;
+#else
+  return FALSE;
+#endif
+}
+
+static inline void
+stream_fence (gboolean stream)
+{
+#if USE_COPY_SSE2
+  if (stream)
+    copy_fence_sse2 ();
+#endif
+}
+
+#if USE_COPY_SSE2
+static inline void
+store_si128 (guint8 * p, __m128i v, gboolean stream)
+{
+  if (stream)
+    _mm_stream_si128 ((__m128i *) p, v);
+  else
+    _mm_storeu_si128 ((__m128i *) p, v);
+}
+#endif
+
+static void
+interleave_row (guint8 * dst, const guint8 * u, const guint8 * v, guint n,
+    gboolean stream)
+{
+  guint i = 0;
+
+#if USE_COPY_SSE2
+  __m128i a, b;
+
+  for (; i + 16 <= n; i += 16) {
+    a = _mm_loadu_si128 ((const __m128i *) (u + i));
+    b = _mm_loadu_si128 ((const __m128i *) (v + i));
+    store_si128 (dst + 2 * i, _mm_unpacklo_epi8 (a, b), stream);
+    store_si128 (dst + 2 * i + 16, _mm_unpackhi_epi8 (a, b), stream);
+  }
+#endif
+  for (; i < n; i++) {
+    dst[2 * i] = u[i];
+    dst[2 * i + 1] = v[i];
+  }
+}
+
+static void
+interleave_row_16 (guint16 * dst, const guint16 * u, const guint16 * v,
+    guint n, guint shift, gboolean stream)
+{
+  guint i = 0;
+
+#if USE_COPY_SSE2 && G_BYTE_ORDER == G_LITTLE_ENDIAN
+  const __m128i count = _mm_cvtsi32_si128 (shift);
+  __m128i a, b;
+
+  for (; i + 8 <= n; i += 8) {
+    a = _mm_sll_epi16 (_mm_loadu_si128 ((const __m128i *) (u + i)), count);
+    b = _mm_sll_epi16 (_mm_loadu_si128 ((const __m128i *) (v + i)), count);
+    store_si128 ((guint8 *) (dst + 2 * i), _mm_unpacklo_epi16 (a, b), stream);
+    store_si128 ((guint8 *) (dst + 2 * i + 8), _mm_unpackhi_epi16 (a, b),
+        stream);
+  }
+#endif
+  for (; i < n; i++) {
+    dst[2 * i] = GUINT16_TO_LE (GUINT16_FROM_LE (u[i]) << shift);
+    dst[2 * i + 1] = GUINT16_TO_LE (GUINT16_FROM_LE (v[i]) << shift);
+  }
+}
+
+static void
+shift_row_16 (guint16 * dst, const guint16 * src, guint n, guint shift,
+    gboolean stream)
+{
+  guint i = 0;
+
+#if USE_COPY_SSE2 && G_BYTE_ORDER == G_LITTLE_ENDIAN
+  const __m128i count = _mm_cvtsi32_si128 (shift);
+
+  for (; i + 8 <= n; i += 8) {
+    store_si128 ((guint8 *) (dst + i),
+        _mm_sll_epi16 (_mm_loadu_si128 ((const __m128i *) (src + i)), count),
+        stream);
+  }
+#endif
+  for (; i < n; i++)
+    dst[i] = GUINT16_TO_LE (GUINT16_FROM_LE (src[i]) << shift);
+}
+
+/* Converts two rows of packed 4:2:2 pixels. The chroma of both rows
+   is averaged into the single NV12 chroma row */
+static void
+packed_422_to_nv12_rows (guint8 * y0, guint8 * y1, guint8 * uv,
+    const guint8 * src0, const guint8 * src1, guint width, gboolean y_first,
+    gboolean stream)
+{
+  const guint yo = y_first ? 0 : 1;
+  const guint co = y_first ? 1 : 0;
+  guint i = 0;
+
+#if USE_COPY_SSE2
+  const __m128i mask = _mm_set1_epi16 (0x00ff);
+  __m128i a0, b0, a1, b1, l0, h0, l1, h1;
+
+  for (; i + 16 <= width; i += 16) {
+    a0 = _mm_loadu_si128 ((const __m128i *) (src0 + 2 * i));
+    b0 = _mm_loadu_si128 ((const __m128i *) (src0 + 2 * i + 16));
+    a1 = _mm_loadu_si128 ((const __m128i *) (src1 + 2 * i));
+    b1 = _mm_loadu_si128 ((const __m128i *) (src1 + 2 * i + 16));
+
+    /* Even bytes (l) and odd bytes (h) of each row */
+    l0 = _mm_packus_epi16 (_mm_and_si128 (a0, mask), _mm_and_si128 (b0, mask));
+    h0 = _mm_packus_epi16 (_mm_srli_epi16 (a0, 8), _mm_srli_epi16 (b0, 8));
+    l1 = _mm_packus_epi16 (_mm_and_si128 (a1, mask), _mm_and_si128 (b1, mask));
+    h1 = _mm_packus_epi16 (_mm_srli_epi16 (a1, 8), _mm_srli_epi16 (b1, 8));
+
+    if (y_first) {
+      store_si128 (y0 + i, l0, stream);
+      store_si128 (y1 + i, l1, stream);
+      store_si128 (uv + i, _mm_avg_epu8 (h0, h1), stream);
+    } else {
+      store_si128 (y0 + i, h0, stream);
+      store_si128 (y1 + i, h1, stream);
+      store_si128 (uv + i, _mm_avg_epu8 (l0, l1), stream);
+    }
+  }
+#endif
+  for (; i < width; i += 2) {
+    const guint8 *const p0 = src0 + 2 * i;
+    const guint8 *const p1 = src1 + 2 * i;
+
+    y0[i] = p0[yo];
+    y1[i] = p1[yo];
+    if (i + 1 < width) {
+      y0[i + 1] = p0[yo + 2];
+      y1[i + 1] = p1[yo + 2];
+    }
+    uv[i] = (p0[co] + p1[co] + 1) >> 1;
+    uv[i + 1] = (p0[co + 2] + p1[co + 2] + 1) >> 1;
+  }
+}
+
+void
+gst_vaapi_copy_interleave_plane (guint8 * dst, guint dst_stride,
+    const guint8 * u, guint u_stride, const guint8 * v, guint v_stride,
+    guint n, guint height, guint flags)
+{
+  const gboolean stream = use_stream_store (dst, dst_stride, flags);
+  RowLoader loader;
+  guint i;
+
+  row_loader_init (&loader, flags, n);
+  for (i = 0; i < height; i++) {
+    interleave_row (dst, row_loader_load (&loader, 0, u, n),
+        row_loader_load (&loader, 1, v, n), n, stream);
+    dst += dst_stride;
+    u += u_stride;
+    v += v_stride;
+  }
+  row_loader_clear (&loader);
+  stream_fence (stream);
+}
+
+void
+gst_vaapi_copy_interleave_plane_16 (guint8 * dst, guint dst_stride,
+    const guint8 * u, guint u_stride, const guint8 * v, guint v_stride,
+    guint n, guint height, guint shift, guint flags)
+{
+  const gboolean stream = use_stream_store (dst, dst_stride, flags);
+  RowLoader loader;
+  guint i;
+
+  row_loader_init (&loader, flags, 2 * n);
+  for (i = 0; i < height; i++) {
+    interleave_row_16 ((guint16 *) dst,
+        (const guint16 *) row_loader_load (&loader, 0, u, 2 * n),
+        (const guint16 *) row_loader_load (&loader, 1, v, 2 * n), n, shift,
+        stream);
+    dst += dst_stride;
+    u += u_stride;
+    v += v_stride;
+  }
+  row_loader_clear (&loader);
+  stream_fence (stream);
+}
+
+void
+gst_vaapi_copy_shift_plane_16 (guint8 * dst, guint dst_stride,
+    const guint8 * src, guint src_stride, guint n, guint height,
+    guint shift, guint flags)
+{
+  const gboolean stream = use_stream_store (dst, dst_stride, flags);
+  RowLoader loader;
+  guint i;
+
+  row_loader_init (&loader, flags, 2 * n);
+  for (i = 0; i < height; i++) {
+    shift_row_16 ((guint16 *) dst,
+        (const guint16 *) row_loader_load (&loader, 0, src, 2 * n), n, shift,
+        stream);
+    dst += dst_stride;
+    src += src_stride;
+  }
+  row_loader_clear (&loader);
+  stream_fence (stream);
+}
+
+void
+gst_vaapi_copy_packed_422_to_nv12 (guint8 * y, guint y_stride, guint8 * uv,
+    guint uv_stride, const guint8 * src, guint src_stride, guint width,
+    guint height, gboolean y_first, guint flags)
+{
+  const gboolean stream = use_stream_store (y, y_stride, flags) &&
+      use_stream_store (uv, uv_stride, flags);
+  const gsize len = 2 * GST_ROUND_UP_2 (width);
+  RowLoader loader;
+  const guint8 *src0, *src1;
+  guint i;
+
+  row_loader_init (&loader, flags, len);
+  for (i = 0; i < height; i += 2) {
+    /* The last row of an odd height has no pair, convert it twice */
+    const guint next = i + 1 < height ? 1 : 0;
+
+    src0 = row_loader_load (&loader, 0, src, len);
+    src1 = next ? row_loader_load (&loader, 1, src + src_stride, len) : src0;
+    packed_422_to_nv12_rows (y, y + next * y_stride, uv, src0, src1, width,
+        y_first, stream);
+    y += 2 * y_stride;
+    uv += uv_stride;
+    src += 2 * src_stride;
+  }
+  row_loader_clear (&loader);
+  stream_fence (stream);
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Copy thread pool                                                  --- */
+/* ------------------------------------------------------------------------- */
+
+/* Below this number of bytes per thread, waking the workers up costs
+   more than what they save */
+#define COPY_POOL_MIN_BYTES_PER_THREAD (128 * 1024)
+
+/* Number of polls of the pending stripes counter before sleeping. The
+   stripes are of the same size, so the workers usually complete them
+   about when the calling thread completes its own */
+#define COPY_POOL_SPIN_COUNT 4000
+
+typedef struct
+{
+  guint8 *dst;
+  guint dst_stride;
+  const guint8 *src;
+  guint src_stride;
+  guint len;
+  guint height;
+  guint flags;
+} CopyJob;
+
+typedef struct
+{
+  GstVaapiCopyPool *pool;
+  GThread *thread;
+  guint index;
+} CopyWorker;
+
+struct _GstVaapiCopyPool
+{
+  /* Including the calling thread */
+  guint n_threads;
+  CopyWorker *workers;
+
+  GMutex lock;
+  GCond job_cond;
+  GCond done_cond;
+  guint generation;
+  gboolean quit;
+  CopyJob job;
+  volatile gint pending;
+};
+
+/* Copies the index-th of the n row stripes of job */
+static void
+copy_job_run_stripe (const CopyJob * job, guint index, guint n)
+{
+  const guint rows = (job->height + n - 1) / n;
+  const guint start = MIN (index * rows, job->height);
+  const guint end = MIN (start + rows, job->height);
+
+  gst_vaapi_copy_plane (job->dst + (gsize) start * job->dst_stride,
+      job->dst_stride, job->src + (gsize) start * job->src_stride,
+      job->src_stride, job->len, end - start, job->flags);
+}
+
+static gpointer
+copy_worker_run (gpointer data)
+{
+  CopyWorker *const worker = data;
+  GstVaapiCopyPool *const pool = worker->pool;
+  guint generation = 0;
+
+  g_mutex_lock (&pool->lock);
+  for (;;) {
+    while (!pool->quit && pool->generation == generation)
+      g_cond_wait (&pool->job_cond, &pool->lock);
+    if (pool->quit)
+      break;
+    generation = pool->generation;
+    g_mutex_unlock (&pool->lock);
+
+    copy_job_run_stripe (&pool->job, worker->index, pool->n_threads);
+
+    g_mutex_lock (&pool->lock);
+    if (g_atomic_int_dec_and_test (&pool->pending))
+      g_cond_signal (&pool->done_cond);
+  }
+  g_mutex_unlock (&pool->lock);
+  return NULL;
+}
+
+/**
+ * gst_vaapi_copy_pool_new:
+ * @n_threads: the number of threads copying, including the caller
+ *
+ * Creates a pool of @n_threads - 1 worker threads, which take part
+ * to the copies issued with gst_vaapi_copy_pool_copy_plane(). The
+ * pool shall only be used from one thread at a time.
+ *
+ * Return value: the newly allocated #GstVaapiCopyPool
+ */
+GstVaapiCopyPool *
+gst_vaapi_copy_pool_new (guint n_threads)
+{
+  GstVaapiCopyPool *pool;
+  CopyWorker *worker;
+  GError *error = NULL;
+  guint i;
+
+  pool = g_slice_new0 (GstVaapiCopyPool);
+  pool->n_threads = MAX (n_threads, 1);
+  g_mutex_init (&pool->lock);
+  g_cond_init (&pool->job_cond);
+  g_cond_init (&pool->done_cond);
+
+  pool->workers = g_new0 (CopyWorker, pool->n_threads - 1);
+  for (i = 1; i < pool->n_threads; i++) {
+    worker = &pool->workers[i - 1];
+    worker->pool = pool;
+    worker->index = i;
+    worker->thread = g_thread_try_new ("vaapi-copy", copy_worker_run, worker,
+        &error);
+    if (!worker->thread) {
+      GST_WARNING ("failed to create copy thread: %s", error->message);
+      g_clear_error (&error);
+      pool->n_threads = i;
+      break;
+    }
+  }
+  return pool;
+}
+
+/**
+ * gst_vaapi_copy_pool_free:
+ * @pool: a #GstVaapiCopyPool
+ *
+ * Stops the worker threads of @pool, and destroys it.
+ */
+void
+gst_vaapi_copy_pool_free (GstVaapiCopyPool * pool)
+{
+  guint i;
+
+  if (!pool)
+    return;
+
+  g_mutex_lock (&pool->lock);
+  pool->quit = TRUE;
+  g_cond_broadcast (&pool->job_cond);
+  g_mutex_unlock (&pool->lock);
+
+  for (i = 1; i < pool->n_threads; i++)
+    g_thread_join (pool->workers[i - 1].thread);
+  g_free (pool->workers);
+
+  g_cond_clear (&pool->done_cond);
+  g_cond_clear (&pool->job_cond);
+  g_mutex_clear (&pool->lock);
+  g_slice_free (GstVaapiCopyPool, pool);
+}
+
+/**
+ * gst_vaapi_copy_pool_get_n_threads:
+ * @pool: a #GstVaapiCopyPool
+ *
+ * Returns the number of threads taking part to the copies, including
+ * the calling thread. This can be less than requested at creation
+ * time, if the worker threads could not all be created.
+ *
+ * Return value: the number of copy threads
+ */
+guint
+gst_vaapi_copy_pool_get_n_threads (GstVaapiCopyPool * pool)
+{
+  return pool ? pool->n_threads : 1;
+}
+
+/**
+ * gst_vaapi_copy_pool_copy_plane:
+ * @pool: a #GstVaapiCopyPool
+ * @dst: the destination plane
+ * @dst_stride: the stride of @dst, in bytes
+ * @src: the source plane
+ * @src_stride: the stride of @src, in bytes
+ * @len: the number of bytes to copy per row
+ * @height: the number of rows to copy
+ * @flags: #GstVaapiCopyFlags telling which side is a mapped VA image
+ *
+ * Copies @height rows of @len bytes from @src to @dst. The rows are
+ * split into one stripe per thread of @pool, and the calling thread
+ * copies the first stripe. This returns once all the stripes were
+ * copied. Small planes are copied by the calling thread alone.
+ */
+void
+gst_vaapi_copy_pool_copy_plane (GstVaapiCopyPool * pool, guint8 * dst,
+    guint dst_stride, const guint8 * src, guint src_stride, guint len,
+    guint height, guint flags)
+{
+  CopyJob *const job = &pool->job;
+  guint i;
+
+  if (pool->n_threads < 2 || height < pool->n_threads ||
+      (guint64) len * height < (guint64) COPY_POOL_MIN_BYTES_PER_THREAD *
+      pool->n_threads) {
+    gst_vaapi_copy_plane (dst, dst_stride, src, src_stride, len, height,
+        flags);
+    return;
+  }
+
+  g_mutex_lock (&pool->lock);
+  job->dst = dst;
+  job->dst_stride = dst_stride;
+  job->src = src;
+  job->src_stride = src_stride;
+  job->len = len;
+  job->height = height;
+  job->flags = flags;
+  g_atomic_int_set (&pool->pending, pool->n_threads - 1);
+  pool->generation++;
+  g_cond_broadcast (&pool->job_cond);
+  g_mutex_unlock (&pool->lock);
+
+  copy_job_run_stripe (job, 0, pool->n_threads);
+
+  /* Wait for the other stripes, polling for a while before sleeping */
+  for (i = 0; i < COPY_POOL_SPIN_COUNT; i++) {
+    if (g_atomic_int_get (&pool->pending) == 0)
+      return;
+  }
+
+  g_mutex_lock (&pool->lock);
+  while (g_atomic_int_get (&pool->pending) > 0)
+    g_cond_wait (&pool->done_cond, &pool->lock);
+  g_mutex_unlock (&pool->lock);
+}
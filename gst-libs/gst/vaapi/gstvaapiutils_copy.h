@@ -0,0 +1,108 @@
+/*
+ *  gstvaapiutils_copy.h - Plane copy helpers for mapped VA images
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef GST_VAAPI_UTILS_COPY_H
+#define GST_VAAPI_UTILS_COPY_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * GstVaapiCopyFlags:
+ * @GST_VAAPI_COPY_FLAG_STREAM_LOAD: the source is uncached or
+ *   write-combined memory, e.g. a mapped VA image to download
+ * @GST_VAAPI_COPY_FLAG_STREAM_STORE: the destination is uncached or
+ *   write-combined memory, e.g. a mapped VA image to upload into
+ */
+typedef enum
+{
+  GST_VAAPI_COPY_FLAG_STREAM_LOAD = 1 << 0,
+  GST_VAAPI_COPY_FLAG_STREAM_STORE = 1 << 1,
+} GstVaapiCopyFlags;
+
+/* Copies @height rows of @len bytes from @src to @dst */
+G_GNUC_INTERNAL
+void
+gst_vaapi_copy_plane (guint8 * dst, guint dst_stride, const guint8 * src,
+    guint src_stride, guint len, guint height, guint flags);
+
+/* Same as above, using only memcpy() */
+G_GNUC_INTERNAL
+void
+gst_vaapi_copy_plane_c (guint8 * dst, guint dst_stride, const guint8 * src,
+    guint src_stride, guint len, guint height, guint flags);
+
+/* Interleaves @n samples of @u and @v per row, e.g. I420 to NV12 */
+G_GNUC_INTERNAL
+void
+gst_vaapi_copy_interleave_plane (guint8 * dst, guint dst_stride,
+    const guint8 * u, guint u_stride, const guint8 * v, guint v_stride,
+    guint n, guint height, guint flags);
+
+/* Same as above, for 16-bit samples shifted left by @shift bits, e.g.
+   I420_10LE to P010_10LE */
+G_GNUC_INTERNAL
+void
+gst_vaapi_copy_interleave_plane_16 (guint8 * dst, guint dst_stride,
+    const guint8 * u, guint u_stride, const guint8 * v, guint v_stride,
+    guint n, guint height, guint shift, guint flags);
+
+/* Copies @n 16-bit samples per row, shifted left by @shift bits */
+G_GNUC_INTERNAL
+void
+gst_vaapi_copy_shift_plane_16 (guint8 * dst, guint dst_stride,
+    const guint8 * src, guint src_stride, guint n, guint height,
+    guint shift, guint flags);
+
+/* Splits packed 4:2:2 pixels, YUY2 if @y_first is set or UYVY
+   otherwise, into the Y and UV planes of NV12 */
+G_GNUC_INTERNAL
+void
+gst_vaapi_copy_packed_422_to_nv12 (guint8 * y, guint y_stride, guint8 * uv,
+    guint uv_stride, const guint8 * src, guint src_stride, guint width,
+    guint height, gboolean y_first, guint flags);
+
+typedef struct _GstVaapiCopyPool GstVaapiCopyPool;
+
+G_GNUC_INTERNAL
+GstVaapiCopyPool *
+gst_vaapi_copy_pool_new (guint n_threads);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_copy_pool_free (GstVaapiCopyPool * pool);
+
+G_GNUC_INTERNAL
+guint
+gst_vaapi_copy_pool_get_n_threads (GstVaapiCopyPool * pool);
+
+/* Same as gst_vaapi_copy_plane(), splitting the rows across the
+   threads of @pool */
+G_GNUC_INTERNAL
+void
+gst_vaapi_copy_pool_copy_plane (GstVaapiCopyPool * pool, guint8 * dst,
+    guint dst_stride, const guint8 * src, guint src_stride, guint len,
+    guint height, guint flags);
+
+G_END_DECLS
+
+#endif /* GST_VAAPI_UTILS_COPY_H */
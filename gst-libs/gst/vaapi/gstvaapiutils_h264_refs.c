@@ -0,0 +1,273 @@
+/*
+ *  gstvaapiutils_h264_refs.c - H.264 reference picture sets
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#include "sysdeps.h"
+#include "gstvaapiutils_h264_refs.h"
+
+/* Sets are small (at most 32 entries) and mostly already ordered, since
+   pictures enter the DPB in decoding order: a stable insertion sort of
+   the indices, comparing contiguous keys, beats qsort() on pointers to
+   pictures by a large margin */
+
+/**
+ * gst_vaapi_h264_ref_set_clear:
+ * @set: a #GstVaapiH264RefSet
+ *
+ * Removes all pictures from @set.
+ */
+void
+gst_vaapi_h264_ref_set_clear (GstVaapiH264RefSet * set)
+{
+  g_return_if_fail (set != NULL);
+
+  set->count = 0;
+}
+
+/**
+ * gst_vaapi_h264_ref_set_add:
+ * @set: a #GstVaapiH264RefSet
+ * @picture: the picture to add
+ * @poc: the PicOrderCnt of @picture
+ * @frame_idx: the FrameNumWrap, or LongTermFrameIdx, of @picture
+ * @pic_num: the PicNum, or LongTermPicNum, of @picture
+ * @structure: the #GstVaapiPictureStructure of @picture
+ *
+ * Appends @picture to @set, and inserts it in the POC order after any
+ * picture with the same POC.
+ *
+ * Return value: %TRUE on success, %FALSE if @set is full
+ */
+gboolean
+gst_vaapi_h264_ref_set_add (GstVaapiH264RefSet * set, gpointer picture,
+    gint32 poc, gint32 frame_idx, gint32 pic_num, guint structure)
+{
+  guint i, n;
+
+  g_return_val_if_fail (set != NULL, FALSE);
+
+  n = set->count;
+  if (n == GST_VAAPI_H264_MAX_REFS)
+    return FALSE;
+
+  set->pictures[n] = picture;
+  set->poc[n] = poc;
+  set->frame_idx[n] = frame_idx;
+  set->pic_num[n] = pic_num;
+  set->structure[n] = structure;
+
+  for (i = n; i > 0 && set->poc[set->poc_order[i - 1]] > poc; i--)
+    set->poc_order[i] = set->poc_order[i - 1];
+  set->poc_order[i] = n;
+  set->count = n + 1;
+  return TRUE;
+}
+
+/**
+ * gst_vaapi_h264_ref_set_remove_index:
+ * @set: a #GstVaapiH264RefSet
+ * @index: the index of the picture to remove
+ *
+ * Removes the picture at @index from @set. The last picture of @set
+ * is moved to @index.
+ */
+void
+gst_vaapi_h264_ref_set_remove_index (GstVaapiH264RefSet * set, guint index)
+{
+  guint i, j, last;
+
+  g_return_if_fail (set != NULL);
+  g_return_if_fail (index < set->count);
+
+  last = --set->count;
+  for (i = 0, j = 0; i <= last; i++) {
+    guint8 k = set->poc_order[i];
+    if (k == index)
+      continue;
+    set->poc_order[j++] = k == last ? index : k;
+  }
+
+  if (index == last)
+    return;
+  set->pictures[index] = set->pictures[last];
+  set->poc[index] = set->poc[last];
+  set->frame_idx[index] = set->frame_idx[last];
+  set->pic_num[index] = set->pic_num[last];
+  set->structure[index] = set->structure[last];
+}
+
+/**
+ * gst_vaapi_h264_ref_set_find:
+ * @set: a #GstVaapiH264RefSet
+ * @keys: one of the key arrays of @set
+ * @value: the key value to look up
+ *
+ * Looks up the first picture of @set whose key in @keys is @value.
+ *
+ * Return value: the index of the picture, or -1 if none was found
+ */
+gint
+gst_vaapi_h264_ref_set_find (const GstVaapiH264RefSet * set,
+    const gint32 * keys, gint32 value)
+{
+  guint i;
+
+  for (i = 0; i < set->count; i++) {
+    if (keys[i] == value)
+      return i;
+  }
+  return -1;
+}
+
+/**
+ * gst_vaapi_h264_ref_set_sort:
+ * @set: a #GstVaapiH264RefSet
+ * @keys: one of the key arrays of @set
+ * @descending: %TRUE to sort by decreasing key values
+ * @order: (out caller-allocates): return location for the indices of
+ *   the pictures, in sorted order
+ *
+ * Sorts the pictures of @set by @keys. Pictures with equal keys are
+ * kept in their order in @set.
+ *
+ * Return value: the number of indices stored into @order
+ */
+guint
+gst_vaapi_h264_ref_set_sort (const GstVaapiH264RefSet * set,
+    const gint32 * keys, gboolean descending, guint8 * order)
+{
+  const gint32 sign = descending ? -1 : 1;
+  guint i, j;
+
+  for (i = 0; i < set->count; i++) {
+    const gint32 key = sign * keys[i];
+    for (j = i; j > 0 && sign * keys[order[j - 1]] > key; j--)
+      order[j] = order[j - 1];
+    order[j] = i;
+  }
+  return set->count;
+}
+
+/**
+ * gst_vaapi_h264_ref_set_sort_by_poc:
+ * @set: a #GstVaapiH264RefSet
+ * @poc: the POC of the current picture
+ * @inclusive: %TRUE if pictures with a POC equal to @poc shall be
+ *   considered as past pictures
+ * @past_first: %TRUE if past pictures come first
+ * @order: (out caller-allocates): return location for the indices of
+ *   the pictures, in sorted order
+ *
+ * Sorts the pictures of @set by distance to @poc: past pictures by
+ * decreasing POC, and future pictures by increasing POC. This derives
+ * from the POC order maintained in @set, so no sorting is involved.
+ *
+ * Return value: the number of indices stored into @order
+ */
+guint
+gst_vaapi_h264_ref_set_sort_by_poc (const GstVaapiH264RefSet * set,
+    gint32 poc, gboolean inclusive, gboolean past_first, guint8 * order)
+{
+  guint i, n, num_past;
+
+  for (num_past = 0; num_past < set->count; num_past++) {
+    const gint32 ref_poc = set->poc[set->poc_order[num_past]];
+    if (ref_poc > poc || (ref_poc == poc && !inclusive))
+      break;
+  }
+
+  n = 0;
+  if (past_first) {
+    for (i = num_past; i > 0; i--)
+      order[n++] = set->poc_order[i - 1];
+  }
+  for (i = num_past; i < set->count; i++)
+    order[n++] = set->poc_order[i];
+  if (!past_first) {
+    for (i = num_past; i > 0; i--)
+      order[n++] = set->poc_order[i - 1];
+  }
+  return n;
+}
+
+/**
+ * gst_vaapi_h264_ref_set_append:
+ * @set: a #GstVaapiH264RefSet
+ * @order: the indices of the pictures to append
+ * @n: the number of indices in @order
+ * @ref_list: the reference picture list to fill in
+ *
+ * Stores the pictures of @set into @ref_list, in the supplied @order.
+ *
+ * Return value: the number of pictures stored into @ref_list
+ */
+guint
+gst_vaapi_h264_ref_set_append (const GstVaapiH264RefSet * set,
+    const guint8 * order, guint n, gpointer * ref_list)
+{
+  guint i;
+
+  for (i = 0; i < n; i++)
+    ref_list[i] = set->pictures[order[i]];
+  return n;
+}
+
+/**
+ * gst_vaapi_h264_ref_set_append_fields:
+ * @set: a #GstVaapiH264RefSet
+ * @order: the indices of the pictures to append
+ * @n: the number of indices in @order
+ * @picture_structure: the #GstVaapiPictureStructure of the current
+ *   picture
+ * @ref_list: the reference picture list to fill in
+ *
+ * Stores the fields of @set into @ref_list, alternating between fields
+ * of the same parity as the current picture, and fields of the opposite
+ * parity, starting with the former (8.2.4.2.5). Fields of each parity
+ * are taken in the supplied @order.
+ *
+ * Return value: the number of pictures stored into @ref_list
+ */
+guint
+gst_vaapi_h264_ref_set_append_fields (const GstVaapiH264RefSet * set,
+    const guint8 * order, guint n, guint picture_structure,
+    gpointer * ref_list)
+{
+  guint i, j, num_refs;
+
+  i = 0;
+  j = 0;
+  num_refs = 0;
+  while (i < n || j < n) {
+    for (; i < n; i++) {
+      if (set->structure[order[i]] == picture_structure) {
+        ref_list[num_refs++] = set->pictures[order[i++]];
+        break;
+      }
+    }
+    for (; j < n; j++) {
+      if (set->structure[order[j]] != picture_structure) {
+        ref_list[num_refs++] = set->pictures[order[j++]];
+        break;
+      }
+    }
+  }
+  return num_refs;
+}
@@ -0,0 +1,102 @@
+/*
+ *  gstvaapiutils_h264_refs.h - H.264 reference picture sets
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef GST_VAAPI_UTILS_H264_REFS_H
+#define GST_VAAPI_UTILS_H264_REFS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define GST_VAAPI_H264_MAX_REFS 32
+
+typedef struct _GstVaapiH264RefSet GstVaapiH264RefSet;
+
+/**
+ * GstVaapiH264RefSet:
+ * @count: number of pictures in the set
+ * @pictures: the pictures
+ * @poc: PicOrderCnt of each picture
+ * @frame_idx: FrameNumWrap of each short-term reference picture, or
+ *   LongTermFrameIdx of each long-term reference picture
+ * @pic_num: PicNum of each short-term reference picture, or
+ *   LongTermPicNum of each long-term reference picture
+ * @structure: #GstVaapiPictureStructure of each picture
+ * @poc_order: indices of the pictures, by increasing POC
+ *
+ * A set of reference pictures of the same kind, i.e. short-term or
+ * long-term ones, kept as a structure of arrays. Sorting the pictures
+ * and looking them up only touches the contiguous key arrays, and the
+ * POC order is maintained as pictures are added and removed.
+ */
+struct _GstVaapiH264RefSet
+{
+  guint count;
+  gpointer pictures[GST_VAAPI_H264_MAX_REFS];
+  gint32 poc[GST_VAAPI_H264_MAX_REFS];
+  gint32 frame_idx[GST_VAAPI_H264_MAX_REFS];
+  gint32 pic_num[GST_VAAPI_H264_MAX_REFS];
+  guint8 structure[GST_VAAPI_H264_MAX_REFS];
+  guint8 poc_order[GST_VAAPI_H264_MAX_REFS];
+};
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_h264_ref_set_clear (GstVaapiH264RefSet * set);
+
+G_GNUC_INTERNAL
+gboolean
+gst_vaapi_h264_ref_set_add (GstVaapiH264RefSet * set, gpointer picture,
+    gint32 poc, gint32 frame_idx, gint32 pic_num, guint structure);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_h264_ref_set_remove_index (GstVaapiH264RefSet * set, guint index);
+
+G_GNUC_INTERNAL
+gint
+gst_vaapi_h264_ref_set_find (const GstVaapiH264RefSet * set,
+    const gint32 * keys, gint32 value);
+
+G_GNUC_INTERNAL
+guint
+gst_vaapi_h264_ref_set_sort (const GstVaapiH264RefSet * set,
+    const gint32 * keys, gboolean descending, guint8 * order);
+
+G_GNUC_INTERNAL
+guint
+gst_vaapi_h264_ref_set_sort_by_poc (const GstVaapiH264RefSet * set,
+    gint32 poc, gboolean inclusive, gboolean past_first, guint8 * order);
+
+G_GNUC_INTERNAL
+guint
+gst_vaapi_h264_ref_set_append (const GstVaapiH264RefSet * set,
+    const guint8 * order, guint n, gpointer * ref_list);
+
+G_GNUC_INTERNAL
+guint
+gst_vaapi_h264_ref_set_append_fields (const GstVaapiH264RefSet * set,
+    const guint8 * order, guint n, guint picture_structure,
+    gpointer * ref_list);
+
+G_END_DECLS
+
+#endif /* GST_VAAPI_UTILS_H264_REFS_H */
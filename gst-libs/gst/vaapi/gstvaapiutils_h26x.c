@@ -23,23 +23,27 @@
  *  Boston, MA 02110-1301 USA
  */
 
+#include "sysdeps.h"
 #include "gstvaapiutils_h26x_priv.h"
+#include "gstvaapiutils_startcode.h"
 
-/* Write an unsigned integer Exp-Golomb-coded syntax element. i.e. ue(v) */
+/* Write an unsigned integer Exp-Golomb-coded syntax element. i.e. ue(v)
+ *
+ * The codeword is value + 1 on N bits, preceded by N - 1 zero bits. It
+ * is written at once as a (2 * N - 1)-bit value when it fits into 32
+ * bits, i.e. for all values lower than 65535 */
 gboolean
 bs_write_ue (GstBitWriter * bs, guint32 value)
 {
-  guint32 size_in_bits = 0;
-  guint32 tmp_value = ++value;
+  const guint32 code = value + 1;
+  const guint size_in_bits = g_bit_storage (code);
 
-  while (tmp_value) {
-    ++size_in_bits;
-    tmp_value >>= 1;
-  }
-  if (size_in_bits > 1
-      && !gst_bit_writer_put_bits_uint32 (bs, 0, size_in_bits - 1))
+  if (size_in_bits <= 16)
+    return gst_bit_writer_put_bits_uint32 (bs, code, 2 * size_in_bits - 1);
+
+  if (!gst_bit_writer_put_bits_uint32 (bs, 0, size_in_bits - 1))
     return FALSE;
-  if (!gst_bit_writer_put_bits_uint32 (bs, value, size_in_bits))
+  if (!gst_bit_writer_put_bits_uint32 (bs, code, size_in_bits))
     return FALSE;
   return TRUE;
 }
@@ -60,37 +64,55 @@ bs_write_se (GstBitWriter * bs, gint32 value)
   return TRUE;
 }
 
+/* Append all the bits written so far into src. Whole bytes are copied
+   at once if bs is byte aligned */
+gboolean
+bs_write_bits (GstBitWriter * bs, const GstBitWriter * src)
+{
+  const guint8 *const data = GST_BIT_WRITER_DATA (src);
+  const guint nbits = GST_BIT_WRITER_BIT_SIZE (src);
+  const guint nbytes = nbits / 8;
+  const guint rest = nbits % 8;
+  guint i;
+
+  if (GST_BIT_WRITER_BIT_SIZE (bs) % 8 == 0) {
+    if (nbytes > 0 && !gst_bit_writer_put_bytes (bs, data, nbytes))
+      return FALSE;
+  } else {
+    for (i = 0; i < nbytes; i++) {
+      if (!gst_bit_writer_put_bits_uint8 (bs, data[i], 8))
+        return FALSE;
+    }
+  }
+  if (rest > 0 &&
+      !gst_bit_writer_put_bits_uint8 (bs, data[nbytes] >> (8 - rest), rest))
+    return FALSE;
+  return TRUE;
+}
+
 /* Copy from src to dst, applying emulation prevention bytes.
  *
- * This is copied from libavcodec written by Mark Thompson
- * <sw@jkqxz.net> from
- * http://git.videolan.org/?p=ffmpeg.git;a=commit;h=2c62fcdf5d617791a653d7957d449f75569eede0
- */
+ * The bytes between two 00 00 0x (x <= 3) patterns are copied at once,
+ * the patterns being located with the vectorized scanner */
 static gboolean
 gst_vaapi_utils_h26x_nal_unit_to_byte_stream (guint8 * dst, guint * dst_len,
     guint8 * src, guint src_len)
 {
-  guint dp = 0, sp;
-  guint zero_run = 0;
+  guint dp = 0, sp = 0, n;
+  gint ofs;
 
-  for (sp = 0; sp < src_len; sp++) {
-    if (dp >= *dst_len)
+  while (sp < src_len) {
+    ofs = gst_vaapi_scan_for_emulation_prevention (src + sp, src_len - sp);
+    n = ofs < 0 ? src_len - sp : ofs + 2;
+    if (dp + n + (ofs >= 0) > *dst_len)
       goto fail;
-    if (zero_run < 2) {
-      if (src[sp] == 0)
-        ++zero_run;
-      else
-        zero_run = 0;
-    } else {
-      if ((src[sp] & ~3) == 0) {
-        /* emulation_prevention_byte: 0x03 */
-        dst[dp++] = 3;
-        if (dp >= *dst_len)
-          goto fail;
-      }
-      zero_run = src[sp] == 0;
+    memcpy (dst + dp, src + sp, n);
+    dp += n;
+    sp += n;
+    if (ofs >= 0) {
+      /* emulation_prevention_byte: 0x03 */
+      dst[dp++] = 3;
     }
-    dst[dp++] = src[sp];
   }
 
   *dst_len = dp;
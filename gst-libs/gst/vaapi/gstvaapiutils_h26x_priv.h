@@ -80,6 +80,10 @@ G_GNUC_INTERNAL
 gboolean
 bs_write_se (GstBitWriter * bs, gint32 value);
 
+G_GNUC_INTERNAL
+gboolean
+bs_write_bits (GstBitWriter * bs, const GstBitWriter * src);
+
 /* Write nal unit, applying emulation prevention bytes */
 G_GNUC_INTERNAL
 gboolean
@@ -0,0 +1,390 @@
+/*
+ *  gstvaapiutils_startcode.c - Start code scanner for elementary streams
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#include "sysdeps.h"
+#include "gstvaapiutils_startcode.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+# if defined(__SSE2__)
+#  include <emmintrin.h>
+#  define USE_SCAN_SSE2 1
+# endif
+# if defined(__GNUC__) && (__GNUC__ > 4 || \
+    (__GNUC__ == 4 && __GNUC_MINOR__ >= 9) || defined(__clang__))
+#  include <immintrin.h>
+#  define USE_SCAN_AVX2 1
+# endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define USE_SCAN_NEON 1
+#endif
+
+typedef gint (*ScanFunc) (const guint8 * buf, guint size);
+
+/* Scans buf[start..size-4] for a start code prefix. This skips up to
+   three bytes at a time, based on the value of the third byte */
+static inline gint
+scan_c (const guint8 * buf, guint start, guint size)
+{
+  guint i = start;
+
+  if (size < 4)
+    return -1;
+
+  while (i <= size - 4) {
+    if (buf[i + 2] > 1)
+      i += 3;
+    else if (buf[i + 1])
+      i += 2;
+    else if (buf[i] || buf[i + 2] != 1)
+      i++;
+    else
+      return i;
+  }
+  return -1;
+}
+
+gint
+gst_vaapi_scan_for_start_code_c (const guint8 * buf, guint size)
+{
+  return scan_c (buf, 0, size);
+}
+
+/* The vectorized scanners check 16 (resp. 32) candidate positions per
+   iteration, and require the 3 bytes that follow the last candidate
+   position to be available. The remaining bytes are handled by the C
+   implementation */
+
+#if USE_SCAN_SSE2
+static gint
+scan_sse2 (const guint8 * buf, guint size)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i one = _mm_set1_epi8 (1);
+  __m128i v0, v1, v2, m;
+  guint i, mask;
+
+  for (i = 0; i + 16 + 3 <= size; i += 16) {
+    v0 = _mm_loadu_si128 ((const __m128i *) (buf + i));
+    v1 = _mm_loadu_si128 ((const __m128i *) (buf + i + 1));
+    v2 = _mm_loadu_si128 ((const __m128i *) (buf + i + 2));
+    m = _mm_and_si128 (_mm_cmpeq_epi8 (v0, zero), _mm_cmpeq_epi8 (v1, zero));
+    m = _mm_and_si128 (m, _mm_cmpeq_epi8 (v2, one));
+    mask = _mm_movemask_epi8 (m);
+    if (mask)
+      return i + __builtin_ctz (mask);
+  }
+  return scan_c (buf, i, size);
+}
+#endif
+
+#if USE_SCAN_AVX2
+__attribute__ ((target ("avx2")))
+static gint
+scan_avx2 (const guint8 * buf, guint size)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i one = _mm256_set1_epi8 (1);
+  __m256i v0, v1, v2, m;
+  guint i, mask;
+
+  for (i = 0; i + 32 + 3 <= size; i += 32) {
+    v0 = _mm256_loadu_si256 ((const __m256i *) (buf + i));
+    v1 = _mm256_loadu_si256 ((const __m256i *) (buf + i + 1));
+    v2 = _mm256_loadu_si256 ((const __m256i *) (buf + i + 2));
+    m = _mm256_and_si256 (_mm256_cmpeq_epi8 (v0, zero),
+        _mm256_cmpeq_epi8 (v1, zero));
+    m = _mm256_and_si256 (m, _mm256_cmpeq_epi8 (v2, one));
+    mask = (guint) _mm256_movemask_epi8 (m);
+    if (mask)
+      return i + __builtin_ctz (mask);
+  }
+  return scan_c (buf, i, size);
+}
+#endif
+
+#if USE_SCAN_NEON
+static gint
+scan_neon (const guint8 * buf, guint size)
+{
+  const uint8x16_t zero = vdupq_n_u8 (0);
+  const uint8x16_t one = vdupq_n_u8 (1);
+  uint8x16_t v0, v1, v2, m;
+  uint64x2_t m64;
+  guint i;
+
+  for (i = 0; i + 16 + 3 <= size; i += 16) {
+    v0 = vld1q_u8 (buf + i);
+    v1 = vld1q_u8 (buf + i + 1);
+    v2 = vld1q_u8 (buf + i + 2);
+    m = vandq_u8 (vceqq_u8 (v0, zero), vceqq_u8 (v1, zero));
+    m = vandq_u8 (m, vceqq_u8 (v2, one));
+    m64 = vreinterpretq_u64_u8 (m);
+    if (vgetq_lane_u64 (m64, 0) | vgetq_lane_u64 (m64, 1))
+      return scan_c (buf, i, i + 16 + 3);
+  }
+  return scan_c (buf, i, size);
+}
+#endif
+
+static ScanFunc
+get_scan_func (void)
+{
+  static gsize g_scan_func = 0;
+
+  if (g_once_init_enter (&g_scan_func)) {
+    ScanFunc func = gst_vaapi_scan_for_start_code_c;
+
+#if USE_SCAN_SSE2
+    func = scan_sse2;
+#endif
+#if USE_SCAN_AVX2
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2"))
+      func = scan_avx2;
+#endif
+#if USE_SCAN_NEON
+    func = scan_neon;
+#endif
+    g_once_init_leave (&g_scan_func, (gsize) func);
+  }
+  return (ScanFunc) g_scan_func;
+}
+
+/**
+ * gst_vaapi_scan_for_start_code:
+ * @buf: the buffer to scan
+ * @size: the size of @buf, in bytes
+ *
+ * Looks for the first 00 00 01 xx start code in @buf. The start code
+ * has to fully fit into @buf, i.e. the last candidate position is
+ * @size - 4. The best implementation available for the running CPU
+ * is selected on first use.
+ *
+ * Return value: the offset of the start code in @buf, or -1 if none
+ *   was found
+ */
+gint
+gst_vaapi_scan_for_start_code (const guint8 * buf, guint size)
+{
+  g_return_val_if_fail (buf != NULL || size == 0, -1);
+
+  return get_scan_func ()(buf, size);
+}
+
+/**
+ * gst_vaapi_adapter_scan_for_start_code:
+ * @adapter: a #GstAdapter
+ * @ofs: the offset in @adapter where to start scanning
+ * @size: the number of bytes to scan
+ * @scp: (out) (allow-none): return location for the start code value
+ *
+ * Looks for the first 00 00 01 xx start code in @adapter, in the range
+ * [@ofs, @ofs + @size). This is a drop-in replacement for
+ * gst_adapter_masked_scan_uint32_peek() with a 0xffffff00 mask and a
+ * 0x00000100 pattern.
+ *
+ * The bytes that are available in the first buffer of @adapter are
+ * scanned in place with gst_vaapi_scan_for_start_code(), i.e. without
+ * any copy. The generic #GstAdapter scanner is only used for the bytes
+ * that spill over into subsequent buffers.
+ *
+ * Return value: the offset of the start code in @adapter, or -1 if
+ *   none was found
+ */
+gint
+gst_vaapi_adapter_scan_for_start_code (GstAdapter * adapter, guint ofs,
+    guint size, guint32 * scp)
+{
+  const guint8 *buf;
+  guint avail, n;
+  gint i;
+
+  avail = gst_adapter_available_fast (adapter);
+  if (avail >= ofs + 4) {
+    n = MIN (size, avail - ofs);
+    buf = gst_adapter_map (adapter, ofs + n);
+    if (buf) {
+      i = gst_vaapi_scan_for_start_code (buf + ofs, n);
+      if (i >= 0 && scp)
+        *scp = GST_READ_UINT32_BE (buf + ofs + i);
+      gst_adapter_unmap (adapter);
+      if (i >= 0)
+        return ofs + i;
+      if (n == size)
+        return -1;
+
+      /* The last three bytes could still be the start of a start code */
+      ofs += n - 3;
+      size -= n - 3;
+    }
+  }
+  return (gint) gst_adapter_masked_scan_uint32_peek (adapter,
+      0xffffff00, 0x00000100, ofs, size, scp);
+}
+
+/* Scans buf[start..size-3] for a 00 00 0x pattern, with x <= 3. This
+   skips up to three bytes at a time, like scan_c() */
+static inline gint
+scan_ep_c (const guint8 * buf, guint start, guint size)
+{
+  guint i = start;
+
+  if (size < 3)
+    return -1;
+
+  while (i <= size - 3) {
+    if (buf[i + 1])
+      i += 2;
+    else if (buf[i])
+      i++;
+    else if (buf[i + 2] & ~3)
+      i += 3;
+    else
+      return i;
+  }
+  return -1;
+}
+
+gint
+gst_vaapi_scan_for_emulation_prevention_c (const guint8 * buf, guint size)
+{
+  return scan_ep_c (buf, 0, size);
+}
+
+#if USE_SCAN_SSE2
+static gint
+scan_ep_sse2 (const guint8 * buf, guint size)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i high = _mm_set1_epi8 (~3);
+  __m128i v0, v1, v2, m;
+  guint i, mask;
+
+  for (i = 0; i + 16 + 2 <= size; i += 16) {
+    v0 = _mm_loadu_si128 ((const __m128i *) (buf + i));
+    v1 = _mm_loadu_si128 ((const __m128i *) (buf + i + 1));
+    v2 = _mm_loadu_si128 ((const __m128i *) (buf + i + 2));
+    m = _mm_and_si128 (_mm_cmpeq_epi8 (v0, zero), _mm_cmpeq_epi8 (v1, zero));
+    m = _mm_and_si128 (m, _mm_cmpeq_epi8 (_mm_and_si128 (v2, high), zero));
+    mask = _mm_movemask_epi8 (m);
+    if (mask)
+      return i + __builtin_ctz (mask);
+  }
+  return scan_ep_c (buf, i, size);
+}
+#endif
+
+#if USE_SCAN_AVX2
+__attribute__ ((target ("avx2")))
+static gint
+scan_ep_avx2 (const guint8 * buf, guint size)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i high = _mm256_set1_epi8 (~3);
+  __m256i v0, v1, v2, m;
+  guint i, mask;
+
+  for (i = 0; i + 32 + 2 <= size; i += 32) {
+    v0 = _mm256_loadu_si256 ((const __m256i *) (buf + i));
+    v1 = _mm256_loadu_si256 ((const __m256i *) (buf + i + 1));
+    v2 = _mm256_loadu_si256 ((const __m256i *) (buf + i + 2));
+    m = _mm256_and_si256 (_mm256_cmpeq_epi8 (v0, zero),
+        _mm256_cmpeq_epi8 (v1, zero));
+    m = _mm256_and_si256 (m,
+        _mm256_cmpeq_epi8 (_mm256_and_si256 (v2, high), zero));
+    mask = (guint) _mm256_movemask_epi8 (m);
+    if (mask)
+      return i + __builtin_ctz (mask);
+  }
+  return scan_ep_c (buf, i, size);
+}
+#endif
+
+#if USE_SCAN_NEON
+static gint
+scan_ep_neon (const guint8 * buf, guint size)
+{
+  const uint8x16_t zero = vdupq_n_u8 (0);
+  const uint8x16_t high = vdupq_n_u8 (~3);
+  uint8x16_t v0, v1, v2, m;
+  uint64x2_t m64;
+  guint i;
+
+  for (i = 0; i + 16 + 2 <= size; i += 16) {
+    v0 = vld1q_u8 (buf + i);
+    v1 = vld1q_u8 (buf + i + 1);
+    v2 = vld1q_u8 (buf + i + 2);
+    m = vandq_u8 (vceqq_u8 (v0, zero), vceqq_u8 (v1, zero));
+    m = vandq_u8 (m, vceqq_u8 (vandq_u8 (v2, high), zero));
+    m64 = vreinterpretq_u64_u8 (m);
+    if (vgetq_lane_u64 (m64, 0) | vgetq_lane_u64 (m64, 1))
+      return scan_ep_c (buf, i, i + 16 + 2);
+  }
+  return scan_ep_c (buf, i, size);
+}
+#endif
+
+static ScanFunc
+get_scan_ep_func (void)
+{
+  static gsize g_scan_ep_func = 0;
+
+  if (g_once_init_enter (&g_scan_ep_func)) {
+    ScanFunc func = gst_vaapi_scan_for_emulation_prevention_c;
+
+#if USE_SCAN_SSE2
+    func = scan_ep_sse2;
+#endif
+#if USE_SCAN_AVX2
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2"))
+      func = scan_ep_avx2;
+#endif
+#if USE_SCAN_NEON
+    func = scan_ep_neon;
+#endif
+    g_once_init_leave (&g_scan_ep_func, (gsize) func);
+  }
+  return (ScanFunc) g_scan_ep_func;
+}
+
+/**
+ * gst_vaapi_scan_for_emulation_prevention:
+ * @buf: the buffer to scan
+ * @size: the size of @buf, in bytes
+ *
+ * Looks for the first 00 00 0x pattern in @buf, with x lower than or
+ * equal to 3, i.e. the first place where an emulation prevention byte
+ * has to be inserted before the third byte when writing a NAL unit.
+ * The best implementation available for the running CPU is selected
+ * on first use.
+ *
+ * Return value: the offset of the pattern in @buf, or -1 if none was
+ *   found
+ */
+gint
+gst_vaapi_scan_for_emulation_prevention (const guint8 * buf, guint size)
+{
+  g_return_val_if_fail (buf != NULL || size == 0, -1);
+
+  return get_scan_ep_func ()(buf, size);
+}
@@ -0,0 +1,58 @@
+/*
+ *  gstvaapiutils_startcode.h - Start code scanner for elementary streams
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#ifndef GST_VAAPI_UTILS_STARTCODE_H
+#define GST_VAAPI_UTILS_STARTCODE_H
+
+#include <glib.h>
+#include <gst/base/gstadapter.h>
+
+G_BEGIN_DECLS
+
+/* Scans the first @size bytes of @buf for a 00 00 01 xx start code */
+G_GNUC_INTERNAL
+gint
+gst_vaapi_scan_for_start_code (const guint8 * buf, guint size);
+
+/* Same as above, using only the portable C implementation */
+G_GNUC_INTERNAL
+gint
+gst_vaapi_scan_for_start_code_c (const guint8 * buf, guint size);
+
+/* Scans @size bytes from @ofs in @adapter for a 00 00 01 xx start code */
+G_GNUC_INTERNAL
+gint
+gst_vaapi_adapter_scan_for_start_code (GstAdapter * adapter, guint ofs,
+    guint size, guint32 * scp);
+
+/* Scans the first @size bytes of @buf for a 00 00 0x pattern, x <= 3 */
+G_GNUC_INTERNAL
+gint
+gst_vaapi_scan_for_emulation_prevention (const guint8 * buf, guint size);
+
+/* Same as above, using only the portable C implementation */
+G_GNUC_INTERNAL
+gint
+gst_vaapi_scan_for_emulation_prevention_c (const guint8 * buf, guint size);
+
+G_END_DECLS
+
+#endif /* GST_VAAPI_UTILS_STARTCODE_H */
@@ -31,6 +31,7 @@
 #include "gstvaapivideopool.h"
 #include "gstvaapivideopool_priv.h"
 #include "gstvaapiobject.h"
+#include "gstvaapiobject_priv.h"
 
 #define DEBUG 1
 #include "gstvaapidebug.h"
@@ -55,27 +56,192 @@ gst_vaapi_video_pool_alloc_object (GstVaapiVideoPool * pool)
   return GST_VAAPI_VIDEO_POOL_GET_CLASS (pool)->alloc_object (pool);
 }
 
+/* Bounded MPMC queue, after D. Vyukov. Each cell carries a sequence
+   number that tells whether it is ready to be written to (seq == pos)
+   or read from (seq == pos + 1), so no ABA issue can arise */
+static void
+free_ring_init (GstVaapiVideoPool * pool)
+{
+  guint i;
+
+  for (i = 0; i < GST_VAAPI_VIDEO_POOL_RING_SIZE; i++) {
+    pool->free_ring[i].seq = i;
+    pool->free_ring[i].object = NULL;
+  }
+  pool->free_ring_head = 0;
+  pool->free_ring_tail = 0;
+}
+
+static gboolean
+free_ring_push (GstVaapiVideoPool * pool, gpointer object)
+{
+  GstVaapiVideoPoolCell *cell;
+  guint pos;
+  gint diff;
+
+  pos = g_atomic_int_get (&pool->free_ring_tail);
+  for (;;) {
+    cell = &pool->free_ring[pos & (GST_VAAPI_VIDEO_POOL_RING_SIZE - 1)];
+    diff = (gint) ((guint) g_atomic_int_get (&cell->seq) - pos);
+    if (diff == 0) {
+      if (g_atomic_int_compare_and_exchange (&pool->free_ring_tail, pos,
+              pos + 1))
+        break;
+    } else if (diff < 0)
+      return FALSE;
+    pos = g_atomic_int_get (&pool->free_ring_tail);
+  }
+  cell->object = object;
+  g_atomic_int_set (&cell->seq, pos + 1);
+  return TRUE;
+}
+
+static gpointer
+free_ring_pop (GstVaapiVideoPool * pool)
+{
+  GstVaapiVideoPoolCell *cell;
+  gpointer object;
+  guint pos;
+  gint diff;
+
+  pos = g_atomic_int_get (&pool->free_ring_head);
+  for (;;) {
+    cell = &pool->free_ring[pos & (GST_VAAPI_VIDEO_POOL_RING_SIZE - 1)];
+    diff = (gint) ((guint) g_atomic_int_get (&cell->seq) - (pos + 1));
+    if (diff == 0) {
+      if (g_atomic_int_compare_and_exchange (&pool->free_ring_head, pos,
+              pos + 1))
+        break;
+    } else if (diff < 0)
+      return NULL;
+    pos = g_atomic_int_get (&pool->free_ring_head);
+  }
+  object = cell->object;
+  cell->object = NULL;
+  g_atomic_int_set (&cell->seq, pos + GST_VAAPI_VIDEO_POOL_RING_SIZE);
+  return object;
+}
+
+/* Wakes up the threads waiting for a free object, or for a chance to
+   allocate one. The mutex shall be held */
+static inline void
+signal_object_available_unlocked (GstVaapiVideoPool * pool)
+{
+  if (g_atomic_int_get (&pool->num_waiters) > 0)
+    g_cond_broadcast (&pool->object_available);
+}
+
+/* Objects go to the overflow queue while it is not empty, so that the
+   free objects are always handed out in FIFO order. Waiters register
+   themselves before looking for a free object, so that either they
+   find this one, or they are counted here and get signalled */
+static void
+push_free_object (GstVaapiVideoPool * pool, gpointer object)
+{
+  if (g_atomic_int_get (&pool->num_overflow_objects) > 0 ||
+      !free_ring_push (pool, object)) {
+    g_mutex_lock (&pool->mutex);
+    g_queue_push_tail (&pool->free_objects, object);
+    g_atomic_int_inc (&pool->num_overflow_objects);
+    g_atomic_int_inc (&pool->free_count);
+    signal_object_available_unlocked (pool);
+    g_mutex_unlock (&pool->mutex);
+    return;
+  }
+  g_atomic_int_inc (&pool->free_count);
+  if (g_atomic_int_get (&pool->num_waiters) > 0) {
+    g_mutex_lock (&pool->mutex);
+    g_cond_broadcast (&pool->object_available);
+    g_mutex_unlock (&pool->mutex);
+  }
+}
+
+static gpointer
+pop_free_object_unlocked (GstVaapiVideoPool * pool)
+{
+  gpointer object;
+
+  object = free_ring_pop (pool);
+  if (!object) {
+    object = g_queue_pop_head (&pool->free_objects);
+    if (object)
+      g_atomic_int_add (&pool->num_overflow_objects, -1);
+  }
+  if (object)
+    g_atomic_int_add (&pool->free_count, -1);
+  return object;
+}
+
+static gpointer
+pop_free_object (GstVaapiVideoPool * pool)
+{
+  gpointer object;
+
+  object = free_ring_pop (pool);
+  if (object) {
+    g_atomic_int_add (&pool->free_count, -1);
+    return object;
+  }
+  if (!g_atomic_int_get (&pool->num_overflow_objects))
+    return NULL;
+
+  g_mutex_lock (&pool->mutex);
+  object = pop_free_object_unlocked (pool);
+  g_mutex_unlock (&pool->mutex);
+  return object;
+}
+
+/* Registers a new object, the pool holds a reference on all of them */
+static inline void
+add_object_unlocked (GstVaapiVideoPool * pool, gpointer object)
+{
+  g_ptr_array_add (pool->objects, object);
+}
+
 void
 gst_vaapi_video_pool_init (GstVaapiVideoPool * pool, GstVaapiDisplay * display,
     GstVaapiVideoPoolObjectType object_type)
 {
   pool->object_type = object_type;
   pool->display = gst_vaapi_display_ref (display);
-  pool->used_objects = NULL;
+  pool->objects = g_ptr_array_new ();
+  pool->num_objects = 0;
+  pool->num_overflow_objects = 0;
+  pool->free_count = 0;
   pool->used_count = 0;
   pool->capacity = 0;
-
+  pool->num_waiters = 0;
+  pool->prewarm_thread = NULL;
+  pool->prewarm_target = 0;
+  pool->prewarm_done = FALSE;
+  pool->prewarm_cancel = FALSE;
+  pool->prewarm_misses = 0;
+
+  free_ring_init (pool);
   g_queue_init (&pool->free_objects);
   g_mutex_init (&pool->mutex);
+  g_cond_init (&pool->object_available);
 }
 
 void
 gst_vaapi_video_pool_finalize (GstVaapiVideoPool * pool)
 {
-  g_list_free_full (pool->used_objects, gst_vaapi_object_unref);
-  g_queue_foreach (&pool->free_objects, (GFunc) gst_vaapi_object_unref, NULL);
+  guint i;
+
+  if (pool->prewarm_thread) {
+    g_atomic_int_set (&pool->prewarm_cancel, TRUE);
+    g_thread_join (pool->prewarm_thread);
+  }
+
+  for (i = 0; i < pool->objects->len; i++) {
+    GstVaapiObject *const object = g_ptr_array_index (pool->objects, i);
+    g_atomic_pointer_compare_and_exchange (&object->pool, pool, NULL);
+    gst_vaapi_object_unref (object);
+  }
+  g_ptr_array_free (pool->objects, TRUE);
   g_queue_clear (&pool->free_objects);
   gst_vaapi_display_replace (&pool->display, NULL);
+  g_cond_clear (&pool->object_available);
   g_mutex_clear (&pool->mutex);
 }
 
@@ -156,6 +322,65 @@ gst_vaapi_video_pool_get_object_type (GstVaapiVideoPool * pool)
   return pool->object_type;
 }
 
+/* Accounts for a new used object, within the pool capacity */
+static gboolean
+reserve_used_object (GstVaapiVideoPool * pool)
+{
+  guint capacity, used_count;
+
+  do {
+    used_count = g_atomic_int_get (&pool->used_count);
+    capacity = g_atomic_int_get (&pool->capacity);
+    if (capacity && used_count >= capacity)
+      return FALSE;
+  } while (!g_atomic_int_compare_and_exchange (&pool->used_count,
+          used_count, used_count + 1));
+  return TRUE;
+}
+
+/* Slow path: allocates a new object, unless the pool reached its
+   capacity. In that case, a free object is on its way back, or being
+   allocated by another thread (e.g. the prewarm thread): wait for it */
+static gpointer
+gst_vaapi_video_pool_get_object_slow (GstVaapiVideoPool * pool)
+{
+  gpointer object;
+  guint capacity;
+
+  g_mutex_lock (&pool->mutex);
+  g_atomic_int_inc (&pool->num_waiters);
+  for (;;) {
+    object = pop_free_object_unlocked (pool);
+    if (object)
+      break;
+    capacity = g_atomic_int_get (&pool->capacity);
+    if (!capacity || pool->num_objects < capacity)
+      break;
+    g_cond_wait (&pool->object_available, &pool->mutex);
+  }
+  g_atomic_int_add (&pool->num_waiters, -1);
+  if (object)
+    goto done;
+
+  if (pool->prewarm_thread && !pool->prewarm_done)
+    pool->prewarm_misses++;
+
+  pool->num_objects++;
+  g_mutex_unlock (&pool->mutex);
+  object = gst_vaapi_video_pool_alloc_object (pool);
+  g_mutex_lock (&pool->mutex);
+  if (object)
+    add_object_unlocked (pool, object);
+  else {
+    pool->num_objects--;
+    signal_object_available_unlocked (pool);
+  }
+
+done:
+  g_mutex_unlock (&pool->mutex);
+  return object;
+}
+
 /**
  * gst_vaapi_video_pool_get_object:
  * @pool: a #GstVaapiVideoPool
@@ -167,41 +392,28 @@ gst_vaapi_video_pool_get_object_type (GstVaapiVideoPool * pool)
  *
  * Return value: a possibly newly allocated object, or %NULL on error
  */
-static gpointer
-gst_vaapi_video_pool_get_object_unlocked (GstVaapiVideoPool * pool)
+gpointer
+gst_vaapi_video_pool_get_object (GstVaapiVideoPool * pool)
 {
   gpointer object;
 
-  if (pool->capacity && pool->used_count >= pool->capacity)
+  g_return_val_if_fail (pool != NULL, NULL);
+
+  if (!reserve_used_object (pool))
     return NULL;
 
-  object = g_queue_pop_head (&pool->free_objects);
+  object = pop_free_object (pool);
+  if (!object)
+    object = gst_vaapi_video_pool_get_object_slow (pool);
+
   if (!object) {
-    g_mutex_unlock (&pool->mutex);
-    object = gst_vaapi_video_pool_alloc_object (pool);
-    g_mutex_lock (&pool->mutex);
-    if (!object)
-      return NULL;
+    g_atomic_int_add (&pool->used_count, -1);
+    return NULL;
   }
-
-  ++pool->used_count;
-  pool->used_objects = g_list_prepend (pool->used_objects, object);
+  g_atomic_pointer_set (&GST_VAAPI_OBJECT (object)->pool, pool);
   return gst_vaapi_object_ref (object);
 }
 
-gpointer
-gst_vaapi_video_pool_get_object (GstVaapiVideoPool * pool)
-{
-  gpointer object;
-
-  g_return_val_if_fail (pool != NULL, NULL);
-
-  g_mutex_lock (&pool->mutex);
-  object = gst_vaapi_video_pool_get_object_unlocked (pool);
-  g_mutex_unlock (&pool->mutex);
-  return object;
-}
-
 /**
  * gst_vaapi_video_pool_put_object:
  * @pool: a #GstVaapiVideoPool
@@ -212,31 +424,19 @@ gst_vaapi_video_pool_get_object (GstVaapiVideoPool * pool)
  * Calling this function with an arbitrary object yields undefined
  * behaviour.
  */
-static void
-gst_vaapi_video_pool_put_object_unlocked (GstVaapiVideoPool * pool,
-    gpointer object)
-{
-  GList *elem;
-
-  elem = g_list_find (pool->used_objects, object);
-  if (!elem)
-    return;
-
-  gst_vaapi_object_unref (object);
-  --pool->used_count;
-  pool->used_objects = g_list_delete_link (pool->used_objects, elem);
-  g_queue_push_tail (&pool->free_objects, object);
-}
-
 void
 gst_vaapi_video_pool_put_object (GstVaapiVideoPool * pool, gpointer object)
 {
   g_return_if_fail (pool != NULL);
   g_return_if_fail (object != NULL);
 
-  g_mutex_lock (&pool->mutex);
-  gst_vaapi_video_pool_put_object_unlocked (pool, object);
-  g_mutex_unlock (&pool->mutex);
+  if (!g_atomic_pointer_compare_and_exchange (&GST_VAAPI_OBJECT (object)->pool,
+          pool, NULL))
+    return;
+
+  gst_vaapi_object_unref (object);
+  push_free_object (pool, object);
+  g_atomic_int_add (&pool->used_count, -1);
 }
 
 /**
@@ -254,7 +454,8 @@ static inline gboolean
 gst_vaapi_video_pool_add_object_unlocked (GstVaapiVideoPool * pool,
     gpointer object)
 {
-  g_queue_push_tail (&pool->free_objects, gst_vaapi_object_ref (object));
+  add_object_unlocked (pool, gst_vaapi_object_ref (object));
+  pool->num_objects++;
   return TRUE;
 }
 
@@ -269,6 +470,8 @@ gst_vaapi_video_pool_add_object (GstVaapiVideoPool * pool, gpointer object)
   g_mutex_lock (&pool->mutex);
   success = gst_vaapi_video_pool_add_object_unlocked (pool, object);
   g_mutex_unlock (&pool->mutex);
+  if (success)
+    push_free_object (pool, object);
   return success;
 }
 
@@ -283,33 +486,21 @@ gst_vaapi_video_pool_add_object (GstVaapiVideoPool * pool, gpointer object)
  *
  * Return value: %TRUE on success.
  */
-static gboolean
-gst_vaapi_video_pool_add_objects_unlocked (GstVaapiVideoPool * pool,
-    GPtrArray * objects)
+gboolean
+gst_vaapi_video_pool_add_objects (GstVaapiVideoPool * pool, GPtrArray * objects)
 {
   guint i;
 
+  g_return_val_if_fail (pool != NULL, FALSE);
+
   for (i = 0; i < objects->len; i++) {
     gpointer const object = g_ptr_array_index (objects, i);
-    if (!gst_vaapi_video_pool_add_object_unlocked (pool, object))
+    if (!gst_vaapi_video_pool_add_object (pool, object))
       return FALSE;
   }
   return TRUE;
 }
 
-gboolean
-gst_vaapi_video_pool_add_objects (GstVaapiVideoPool * pool, GPtrArray * objects)
-{
-  gboolean success;
-
-  g_return_val_if_fail (pool != NULL, FALSE);
-
-  g_mutex_lock (&pool->mutex);
-  success = gst_vaapi_video_pool_add_objects_unlocked (pool, objects);
-  g_mutex_unlock (&pool->mutex);
-  return success;
-}
-
 /**
  * gst_vaapi_video_pool_get_size:
  * @pool: a #GstVaapiVideoPool
@@ -321,14 +512,9 @@ gst_vaapi_video_pool_add_objects (GstVaapiVideoPool * pool, GPtrArray * objects)
 guint
 gst_vaapi_video_pool_get_size (GstVaapiVideoPool * pool)
 {
-  guint size;
-
   g_return_val_if_fail (pool != NULL, 0);
 
-  g_mutex_lock (&pool->mutex);
-  size = g_queue_get_length (&pool->free_objects);
-  g_mutex_unlock (&pool->mutex);
-  return size;
+  return g_atomic_int_get (&pool->free_count);
 }
 
 /**
@@ -346,24 +532,34 @@ gst_vaapi_video_pool_get_size (GstVaapiVideoPool * pool)
 static gboolean
 gst_vaapi_video_pool_reserve_unlocked (GstVaapiVideoPool * pool, guint n)
 {
-  guint i, num_allocated;
+  guint i, num_allocated, capacity;
 
-  num_allocated = gst_vaapi_video_pool_get_size (pool) + pool->used_count;
+  num_allocated = g_atomic_int_get (&pool->free_count) +
+      g_atomic_int_get (&pool->used_count);
   if (n < num_allocated)
     return TRUE;
 
-  if ((n -= num_allocated) > pool->capacity)
-    n = pool->capacity;
+  capacity = g_atomic_int_get (&pool->capacity);
+  if ((n -= num_allocated) > capacity)
+    n = capacity;
 
   for (i = num_allocated; i < n; i++) {
     gpointer object;
 
+    pool->num_objects++;
     g_mutex_unlock (&pool->mutex);
     object = gst_vaapi_video_pool_alloc_object (pool);
     g_mutex_lock (&pool->mutex);
-    if (!object)
+    if (!object) {
+      pool->num_objects--;
+      signal_object_available_unlocked (pool);
       return FALSE;
-    g_queue_push_tail (&pool->free_objects, object);
+    }
+    add_object_unlocked (pool, object);
+
+    g_mutex_unlock (&pool->mutex);
+    push_free_object (pool, object);
+    g_mutex_lock (&pool->mutex);
   }
   return TRUE;
 }
@@ -381,6 +577,106 @@ gst_vaapi_video_pool_reserve (GstVaapiVideoPool * pool, guint n)
   return success;
 }
 
+static gpointer
+prewarm_thread_func (gpointer data)
+{
+  GstVaapiVideoPool *const pool = data;
+  const gint64 start_time = g_get_monotonic_time ();
+  guint num_allocated = 0, num_misses;
+  gpointer object;
+
+  g_mutex_lock (&pool->mutex);
+  while (!g_atomic_int_get (&pool->prewarm_cancel) &&
+      pool->num_objects < pool->prewarm_target) {
+    pool->num_objects++;
+    g_mutex_unlock (&pool->mutex);
+    object = gst_vaapi_video_pool_alloc_object (pool);
+    g_mutex_lock (&pool->mutex);
+    if (!object) {
+      pool->num_objects--;
+      signal_object_available_unlocked (pool);
+      break;
+    }
+    add_object_unlocked (pool, object);
+
+    g_mutex_unlock (&pool->mutex);
+    push_free_object (pool, object);
+    g_mutex_lock (&pool->mutex);
+    num_allocated++;
+  }
+  pool->prewarm_done = TRUE;
+  num_misses = pool->prewarm_misses;
+  g_mutex_unlock (&pool->mutex);
+
+  GST_DEBUG ("pre-allocated %u objects in %" G_GINT64_FORMAT " us, %u "
+      "allocated on demand meanwhile", num_allocated,
+      g_get_monotonic_time () - start_time, num_misses);
+  return NULL;
+}
+
+/**
+ * gst_vaapi_video_pool_prewarm:
+ * @pool: a #GstVaapiVideoPool
+ * @n: the number of objects the pool is expected to hold
+ *
+ * Allocates objects in a background thread, until the @pool holds @n
+ * objects, or reaches its capacity. Each object is available through
+ * gst_vaapi_video_pool_get_object() as soon as it is allocated, and
+ * objects that are requested before still get allocated on demand.
+ * This moves the cost of allocating a new set of e.g. surfaces out of
+ * the processing of the first frames after a format change.
+ *
+ * Calling this function again raises the target while the background
+ * allocation is in progress, or starts a new one.
+ *
+ * Return value: %TRUE on success
+ */
+gboolean
+gst_vaapi_video_pool_prewarm (GstVaapiVideoPool * pool, guint n)
+{
+  GThread *old_thread = NULL;
+  GError *error = NULL;
+  guint capacity;
+  gboolean success = TRUE;
+
+  g_return_val_if_fail (pool != NULL, FALSE);
+
+  capacity = g_atomic_int_get (&pool->capacity);
+  if (capacity && n > capacity)
+    n = capacity;
+
+  g_mutex_lock (&pool->mutex);
+  if (n <= pool->num_objects)
+    goto done;
+
+  /* The background allocation is still in progress */
+  if (pool->prewarm_thread && !pool->prewarm_done) {
+    pool->prewarm_target = MAX (pool->prewarm_target, n);
+    goto done;
+  }
+  pool->prewarm_target = n;
+
+  old_thread = pool->prewarm_thread;
+  pool->prewarm_done = FALSE;
+  pool->prewarm_misses = 0;
+  pool->prewarm_thread = g_thread_try_new ("vaapi-pool-prewarm",
+      prewarm_thread_func, pool, &error);
+  if (!pool->prewarm_thread) {
+    GST_WARNING ("failed to start pre-warming thread: %s", error->message);
+    g_clear_error (&error);
+    pool->prewarm_target = 0;
+    success = FALSE;
+  }
+
+done:
+  g_mutex_unlock (&pool->mutex);
+
+  /* The previous thread already exited */
+  if (old_thread)
+    g_thread_join (old_thread);
+  return success;
+}
+
 /**
  * gst_vaapi_video_pool_get_capacity:
  * @pool: a #GstVaapiVideoPool
@@ -393,15 +689,9 @@ gst_vaapi_video_pool_reserve (GstVaapiVideoPool * pool, guint n)
 guint
 gst_vaapi_video_pool_get_capacity (GstVaapiVideoPool * pool)
 {
-  guint capacity;
-
   g_return_val_if_fail (pool != NULL, 0);
 
-  g_mutex_lock (&pool->mutex);
-  capacity = pool->capacity;
-  g_mutex_unlock (&pool->mutex);
-
-  return capacity;
+  return g_atomic_int_get (&pool->capacity);
 }
 
 /**
@@ -417,6 +707,7 @@ gst_vaapi_video_pool_set_capacity (GstVaapiVideoPool * pool, guint capacity)
   g_return_if_fail (pool != NULL);
 
   g_mutex_lock (&pool->mutex);
-  pool->capacity = capacity;
+  g_atomic_int_set (&pool->capacity, capacity);
+  signal_object_available_unlocked (pool);
   g_mutex_unlock (&pool->mutex);
 }
@@ -85,6 +85,9 @@ gst_vaapi_video_pool_get_size (GstVaapiVideoPool * pool);
 gboolean
 gst_vaapi_video_pool_reserve (GstVaapiVideoPool * pool, guint n);
 
+gboolean
+gst_vaapi_video_pool_prewarm (GstVaapiVideoPool * pool, guint n);
+
 guint
 gst_vaapi_video_pool_get_capacity (GstVaapiVideoPool * pool);
 
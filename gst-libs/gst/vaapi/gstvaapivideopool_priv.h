@@ -35,11 +35,31 @@ G_BEGIN_DECLS
   ((klass) != NULL)
 
 typedef struct _GstVaapiVideoPoolClass GstVaapiVideoPoolClass;
+typedef struct _GstVaapiVideoPoolCell GstVaapiVideoPoolCell;
+
+/* Number of free objects held in the lock-free ring, must be a power
+   of two */
+#define GST_VAAPI_VIDEO_POOL_RING_SIZE 64
+
+struct _GstVaapiVideoPoolCell
+{
+  volatile gint seq;
+  gpointer object;
+};
 
 /**
  * GstVaapiVideoPool:
  *
  * A pool of lazily allocated video objects. e.g. surfaces, images.
+ *
+ * Free objects are kept in FIFO order in a bounded lock-free ring,
+ * and in the @free_objects queue once the ring is full. Used objects
+ * are tagged with their pool, so that they are put back in constant
+ * time. The @mutex is only taken to allocate new objects, or when the
+ * ring overflows. Threads that find the pool at its capacity wait on
+ * @object_available, which is only signalled while @num_waiters is not
+ * zero. The @prewarm_thread allocates objects ahead of their
+ * first use, up to @prewarm_target objects.
  */
 struct _GstVaapiVideoPool
 {
@@ -48,11 +68,26 @@ struct _GstVaapiVideoPool
 
   guint object_type;
   GstVaapiDisplay *display;
+  GPtrArray *objects;
+  guint num_objects;
   GQueue free_objects;
-  GList *used_objects;
-  guint used_count;
-  guint capacity;
+  volatile gint num_overflow_objects;
+  GstVaapiVideoPoolCell free_ring[GST_VAAPI_VIDEO_POOL_RING_SIZE];
+  volatile gint free_ring_head;
+  volatile gint free_ring_tail;
+  volatile gint free_count;
+  volatile gint used_count;
+  volatile gint capacity;
   GMutex mutex;
+  GCond object_available;
+  volatile gint num_waiters;
+
+  /* Background allocation, see gst_vaapi_video_pool_prewarm() */
+  GThread *prewarm_thread;
+  guint prewarm_target;
+  gboolean prewarm_done;
+  volatile gint prewarm_cancel;
+  guint prewarm_misses;
 };
 
 /**
@@ -129,7 +129,8 @@ static const GstVaapiDecoderMap vaapi_decode_map[] = {
   {GST_VAAPI_CODEC_VP9, GST_RANK_PRIMARY, "vp9", "video/x-vp9", NULL},
 #endif
 #if USE_H265_DECODER
-  {GST_VAAPI_CODEC_H265, GST_RANK_PRIMARY, "h265", "video/x-h265", NULL},
+  {GST_VAAPI_CODEC_H265, GST_RANK_PRIMARY, "h265", "video/x-h265",
+      gst_vaapi_decode_h265_install_properties},
 #endif
   {0 /* the rest */ , GST_RANK_PRIMARY + 1, NULL,
       gst_vaapidecode_sink_caps_str, NULL},
@@ -645,6 +646,7 @@ gst_vaapidecode_push_all_decoded_frames (GstVaapiDecode * decode)
   GstFlowReturn ret;
 
   for (;;) {
+    out_frame = NULL;
     status = gst_vaapi_decoder_get_frame (decode->decoder, &out_frame);
 
     switch (status) {
@@ -658,9 +660,17 @@ gst_vaapidecode_push_all_decoded_frames (GstVaapiDecode * decode)
       case GST_VAAPI_DECODER_STATUS_ERROR_NO_DATA:
         return GST_FLOW_OK;
       default:
+        ret = GST_FLOW_OK;
         GST_VIDEO_DECODER_ERROR (vdec, 1, STREAM, DECODE, ("Decoding failed"),
-            ("Unknown decoding error"), ret);
-        return ret;
+            ("Decode error %d", status), ret);
+        if (!out_frame)
+          return ret;
+        /* A frame that failed to decode with pipelined decoding */
+        gst_video_codec_frame_unref (out_frame);
+        gst_video_decoder_drop_frame (vdec, out_frame);
+        if (ret != GST_FLOW_OK)
+          return ret;
+        break;
     }
   }
   g_assert_not_reached ();
@@ -701,7 +711,8 @@ gst_vaapidecode_handle_frame (GstVideoDecoder * vdec,
 
   /* Note that gst_vaapi_decoder_decode cannot return success without
      completing the decode and pushing all decoded frames into the output
-     queue */
+     queue, unless pipelined decoding is enabled. In that case, push the
+     frames that are already decoded */
   return gst_vaapidecode_push_all_decoded_frames (decode);
 
   /* ERRORS */
@@ -752,6 +763,7 @@ static GstFlowReturn
 gst_vaapidecode_drain (GstVideoDecoder * vdec)
 {
   GstVaapiDecode *const decode = GST_VAAPIDECODE (vdec);
+  GstVaapiDecoderStatus status;
 
   if (!decode->decoder)
     return GST_FLOW_NOT_NEGOTIATED;
@@ -759,6 +771,12 @@ gst_vaapidecode_drain (GstVideoDecoder * vdec)
   GST_LOG_OBJECT (decode, "drain");
 
   gst_vaapidecode_flush_output_adapter (decode);
+
+  /* The frames that failed to decode are reported and dropped while
+     pushing the decoded frames */
+  status = gst_vaapi_decoder_sync (decode->decoder);
+  if (status != GST_VAAPI_DECODER_STATUS_SUCCESS)
+    GST_DEBUG_OBJECT (decode, "pending frames failed (status %d)", status);
   return gst_vaapidecode_push_all_decoded_frames (decode);
 }
 
@@ -874,6 +892,8 @@ gst_vaapidecode_create (GstVaapiDecode * decode, GstCaps * caps)
               (decode->decoder), priv->is_low_latency);
           gst_vaapi_decoder_h264_set_base_only (GST_VAAPI_DECODER_H264
               (decode->decoder), priv->base_only);
+          gst_vaapi_decoder_set_pipeline_depth (decode->decoder,
+              priv->pipeline_depth);
         }
       }
       break;
@@ -883,6 +903,8 @@ gst_vaapidecode_create (GstVaapiDecode * decode, GstCaps * caps)
 
       /* Set the stream buffer alignment for better optimizations */
       if (decode->decoder && caps) {
+        GstVaapiDecodeH265Private *priv =
+            gst_vaapi_decode_h265_get_instance_private (decode);
         GstStructure *const structure = gst_caps_get_structure (caps, 0);
         const gchar *str = NULL;
 
@@ -897,6 +919,15 @@ gst_vaapidecode_create (GstVaapiDecode * decode, GstCaps * caps)
           gst_vaapi_decoder_h265_set_alignment (GST_VAAPI_DECODER_H265
               (decode->decoder), alignment);
         }
+
+        if (priv) {
+          gst_vaapi_decoder_h265_set_low_latency (GST_VAAPI_DECODER_H265
+              (decode->decoder), priv->is_low_latency);
+          gst_vaapi_decoder_h265_set_force_low_latency (GST_VAAPI_DECODER_H265
+              (decode->decoder), priv->force_low_latency);
+          gst_vaapi_decoder_set_pipeline_depth (decode->decoder,
+              priv->pipeline_depth);
+        }
       }
       break;
 #endif
@@ -956,7 +987,8 @@ gst_vaapidecode_purge (GstVaapiDecode * decode)
       gst_video_decoder_release_frame (GST_VIDEO_DECODER (decode), frame);
       gst_video_codec_frame_unref (frame);
     }
-  } while (status == GST_VAAPI_DECODER_STATUS_SUCCESS);
+    /* Frames that failed to decode come along with their error */
+  } while (status != GST_VAAPI_DECODER_STATUS_ERROR_NO_DATA && frame);
 }
 
 static void
@@ -25,11 +25,15 @@
 #include "gstvaapidecode.h"
 
 #include <gst/vaapi/gstvaapidecoder_h264.h>
+#if USE_H265_DECODER
+#include <gst/vaapi/gstvaapidecoder_h265.h>
+#endif
 
 enum
 {
   GST_VAAPI_DECODER_H264_PROP_FORCE_LOW_LATENCY = 1,
-  GST_VAAPI_DECODER_H264_PROP_BASE_ONLY
+  GST_VAAPI_DECODER_H264_PROP_BASE_ONLY,
+  GST_VAAPI_DECODER_H264_PROP_PIPELINE_DEPTH
 };
 
 static gint h264_private_offset;
@@ -49,6 +53,9 @@ gst_vaapi_decode_h264_get_property (GObject * object, guint prop_id,
     case GST_VAAPI_DECODER_H264_PROP_BASE_ONLY:
       g_value_set_boolean (value, priv->base_only);
       break;
+    case GST_VAAPI_DECODER_H264_PROP_PIPELINE_DEPTH:
+      g_value_set_uint (value, priv->pipeline_depth);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -77,6 +84,13 @@ gst_vaapi_decode_h264_set_property (GObject * object, guint prop_id,
       if (decoder)
         gst_vaapi_decoder_h264_set_base_only (decoder, priv->base_only);
       break;
+    case GST_VAAPI_DECODER_H264_PROP_PIPELINE_DEPTH:
+      priv->pipeline_depth = g_value_get_uint (value);
+      decoder = GST_VAAPI_DECODER_H264 (GST_VAAPIDECODE (object)->decoder);
+      if (decoder)
+        gst_vaapi_decoder_set_pipeline_depth (GST_VAAPI_DECODER (decoder),
+            priv->pipeline_depth);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -103,6 +117,13 @@ gst_vaapi_decode_h264_install_properties (GObjectClass * klass)
       g_param_spec_boolean ("base-only", "Decode base view only",
           "Drop any NAL unit not defined in Annex.A", FALSE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (klass,
+      GST_VAAPI_DECODER_H264_PROP_PIPELINE_DEPTH,
+      g_param_spec_uint ("pipeline-depth", "Pipeline depth",
+          "Number of frames that can be parsed ahead of the frame being "
+          "decoded, in a separate thread (0 = disabled)", 0, 16, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 GstVaapiDecodeH264Private *
@@ -112,3 +133,115 @@ gst_vaapi_decode_h264_get_instance_private (gpointer self)
     return NULL;
   return (G_STRUCT_MEMBER_P (self, h264_private_offset));
 }
+
+#if USE_H265_DECODER
+enum
+{
+  GST_VAAPI_DECODER_H265_PROP_LOW_LATENCY = 1,
+  GST_VAAPI_DECODER_H265_PROP_FORCE_LOW_LATENCY,
+  GST_VAAPI_DECODER_H265_PROP_PIPELINE_DEPTH
+};
+
+static gint h265_private_offset;
+
+static void
+gst_vaapi_decode_h265_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstVaapiDecodeH265Private *priv;
+
+  priv = gst_vaapi_decode_h265_get_instance_private (object);
+
+  switch (prop_id) {
+    case GST_VAAPI_DECODER_H265_PROP_LOW_LATENCY:
+      g_value_set_boolean (value, priv->is_low_latency);
+      break;
+    case GST_VAAPI_DECODER_H265_PROP_FORCE_LOW_LATENCY:
+      g_value_set_boolean (value, priv->force_low_latency);
+      break;
+    case GST_VAAPI_DECODER_H265_PROP_PIPELINE_DEPTH:
+      g_value_set_uint (value, priv->pipeline_depth);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_vaapi_decode_h265_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstVaapiDecodeH265Private *priv;
+  GstVaapiDecoderH265 *decoder;
+
+  priv = gst_vaapi_decode_h265_get_instance_private (object);
+
+  switch (prop_id) {
+    case GST_VAAPI_DECODER_H265_PROP_LOW_LATENCY:
+      priv->is_low_latency = g_value_get_boolean (value);
+      decoder = GST_VAAPI_DECODER_H265 (GST_VAAPIDECODE (object)->decoder);
+      if (decoder)
+        gst_vaapi_decoder_h265_set_low_latency (decoder, priv->is_low_latency);
+      break;
+    case GST_VAAPI_DECODER_H265_PROP_FORCE_LOW_LATENCY:
+      priv->force_low_latency = g_value_get_boolean (value);
+      decoder = GST_VAAPI_DECODER_H265 (GST_VAAPIDECODE (object)->decoder);
+      if (decoder)
+        gst_vaapi_decoder_h265_set_force_low_latency (decoder,
+            priv->force_low_latency);
+      break;
+    case GST_VAAPI_DECODER_H265_PROP_PIPELINE_DEPTH:
+      priv->pipeline_depth = g_value_get_uint (value);
+      decoder = GST_VAAPI_DECODER_H265 (GST_VAAPIDECODE (object)->decoder);
+      if (decoder)
+        gst_vaapi_decoder_set_pipeline_depth (GST_VAAPI_DECODER (decoder),
+            priv->pipeline_depth);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+void
+gst_vaapi_decode_h265_install_properties (GObjectClass * klass)
+{
+  h265_private_offset = sizeof (GstVaapiDecodeH265Private);
+  g_type_class_adjust_private_offset (klass, &h265_private_offset);
+
+  klass->get_property = gst_vaapi_decode_h265_get_property;
+  klass->set_property = gst_vaapi_decode_h265_set_property;
+
+  g_object_class_install_property (klass,
+      GST_VAAPI_DECODER_H265_PROP_LOW_LATENCY,
+      g_param_spec_boolean ("low-latency", "Low latency mode",
+          "When enabled, frames will be pushed as soon as they are decoded "
+          "if the stream signals that no reordering can occur.", FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (klass,
+      GST_VAAPI_DECODER_H265_PROP_FORCE_LOW_LATENCY,
+      g_param_spec_boolean ("force-low-latency", "Force low latency mode",
+          "When enabled, frames will be pushed as soon as they are decoded, "
+          "even if the stream signals that reordering can occur. This "
+          "violates the H.265 specification, and is only meant for streams "
+          "coded without reordering.", FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (klass,
+      GST_VAAPI_DECODER_H265_PROP_PIPELINE_DEPTH,
+      g_param_spec_uint ("pipeline-depth", "Pipeline depth",
+          "Number of frames that can be parsed ahead of the frame being "
+          "decoded, in a separate thread (0 = disabled)", 0, 16, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+GstVaapiDecodeH265Private *
+gst_vaapi_decode_h265_get_instance_private (gpointer self)
+{
+  if (h265_private_offset == 0)
+    return NULL;
+  return (G_STRUCT_MEMBER_P (self, h265_private_offset));
+}
+#endif
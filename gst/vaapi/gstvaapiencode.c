@@ -50,10 +50,14 @@ G_DEFINE_ABSTRACT_TYPE_WITH_CODE (GstVaapiEncode,
 
 GST_VAAPI_PLUGIN_BASE_DEFINE_SET_CONTEXT (gst_vaapiencode_parent_class);
 
+#define DEFAULT_EXPORT_BUFFERS 0
+
 enum
 {
   PROP_0,
 
+  PROP_EXPORT_BUFFERS,
+  PROP_COPY_THREADS,
   PROP_BASE,
 };
 
@@ -294,10 +298,17 @@ gst_vaapiencode_push_frame (GstVaapiEncode * encode, gint64 timeout)
     goto error_output_state;
   GST_VIDEO_ENCODER_STREAM_UNLOCK (encode);
 
-  /* Allocate and copy buffer into system memory */
+  /* Push the coded buffer as is, unless the subclass rewrites it into
+     a packetized format, or allocate and copy it into system memory */
   out_buffer = NULL;
-  ret = klass->alloc_buffer (encode,
-      GST_VAAPI_CODED_BUFFER_PROXY_BUFFER (codedbuf_proxy), &out_buffer);
+  if (!encode->need_codec_data)
+    out_buffer = gst_vaapi_encoder_export_buffer (encode->encoder,
+        codedbuf_proxy);
+  if (out_buffer)
+    ret = GST_FLOW_OK;
+  else
+    ret = klass->alloc_buffer (encode,
+        GST_VAAPI_CODED_BUFFER_PROXY_BUFFER (codedbuf_proxy), &out_buffer);
 
 #if USE_H264_FEI_ENCODER
   if (klass->save_stats_to_meta) {
@@ -344,11 +355,14 @@ error_output_state:
   }
 }
 
+/* Outputs the coded buffers as they get ready. The encoder wakes this
+   task up when a picture is submitted or when it is set flushing, the
+   timeout is only a safety net */
 static void
 gst_vaapiencode_buffer_loop (GstVaapiEncode * encode)
 {
   GstFlowReturn ret;
-  const gint64 timeout = 50000; /* microseconds */
+  const gint64 timeout = G_TIME_SPAN_SECOND;
 
   ret = gst_vaapiencode_push_frame (encode, timeout);
   if (ret == GST_FLOW_OK || ret == GST_VAAPI_ENCODE_FLOW_TIMEOUT)
@@ -558,12 +572,36 @@ set_codec_state (GstVaapiEncode * encode, GstVideoCodecState * state)
   if (klass->set_config && !klass->set_config (encode))
     return FALSE;
 
+  status = gst_vaapi_encoder_set_export_buffers (encode->encoder,
+      encode->export_buffers);
+  if (status != GST_VAAPI_ENCODER_STATUS_SUCCESS)
+    return FALSE;
+
   status = gst_vaapi_encoder_set_codec_state (encode->encoder, state);
   if (status != GST_VAAPI_ENCODER_STATUS_SUCCESS)
     return FALSE;
   return TRUE;
 }
 
+/* Starts the task that outputs the coded buffers */
+static gboolean
+start_buffer_loop (GstVaapiEncode * encode)
+{
+  if (encode->encoder)
+    gst_vaapi_encoder_set_flushing (encode->encoder, FALSE);
+  return gst_pad_start_task (GST_VAAPI_PLUGIN_BASE_SRC_PAD (encode),
+      (GstTaskFunction) gst_vaapiencode_buffer_loop, encode, NULL);
+}
+
+/* Wakes up the task that outputs the coded buffers, so that it can be
+   paused or stopped */
+static void
+interrupt_buffer_loop (GstVaapiEncode * encode)
+{
+  if (encode->encoder)
+    gst_vaapi_encoder_set_flushing (encode->encoder, TRUE);
+}
+
 static gboolean
 gst_vaapiencode_drain (GstVaapiEncode * encode)
 {
@@ -603,9 +641,7 @@ gst_vaapiencode_set_format (GstVideoEncoder * venc, GstVideoCodecState * state)
   encode->input_state = gst_video_codec_state_ref (state);
   encode->input_state_changed = TRUE;
 
-  ret = gst_pad_start_task (GST_VAAPI_PLUGIN_BASE_SRC_PAD (encode),
-      (GstTaskFunction) gst_vaapiencode_buffer_loop, encode, NULL);
-
+  ret = start_buffer_loop (encode);
   if (!ret)
     return FALSE;
 
@@ -735,6 +771,7 @@ gst_vaapiencode_finish (GstVideoEncoder * venc)
   status = gst_vaapi_encoder_flush (encode->encoder);
 
   GST_VIDEO_ENCODER_STREAM_UNLOCK (encode);
+  interrupt_buffer_loop (encode);
   gst_pad_stop_task (GST_VAAPI_PLUGIN_BASE_SRC_PAD (encode));
   GST_VIDEO_ENCODER_STREAM_LOCK (encode);
 
@@ -753,6 +790,7 @@ gst_vaapiencode_change_state (GstElement * element, GstStateChange transition)
 
   switch (transition) {
     case GST_STATE_CHANGE_PAUSED_TO_READY:
+      interrupt_buffer_loop (encode);
       gst_pad_stop_task (GST_VAAPI_PLUGIN_BASE_SRC_PAD (encode));
       break;
     default:
@@ -826,11 +864,11 @@ gst_vaapiencode_sink_event (GstVideoEncoder * venc, GstEvent * event)
 
   switch (GST_EVENT_TYPE (event)) {
     case GST_EVENT_FLUSH_START:
+      interrupt_buffer_loop (encode);
       gst_pad_pause_task (srcpad);
       break;
     case GST_EVENT_FLUSH_STOP:
-      ret = gst_pad_start_task (srcpad,
-          (GstTaskFunction) gst_vaapiencode_buffer_loop, encode, NULL);
+      ret = start_buffer_loop (encode);
       break;
     default:
       break;
@@ -877,6 +915,47 @@ gst_vaapiencode_finalize (GObject * object)
   G_OBJECT_CLASS (gst_vaapiencode_parent_class)->finalize (object);
 }
 
+static void
+gst_vaapiencode_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstVaapiEncode *const encode = GST_VAAPIENCODE_CAST (object);
+
+  switch (prop_id) {
+    case PROP_EXPORT_BUFFERS:
+      encode->export_buffers = g_value_get_uint (value);
+      break;
+    case PROP_COPY_THREADS:
+      gst_vaapi_plugin_base_set_copy_threads (GST_VAAPI_PLUGIN_BASE (encode),
+          g_value_get_uint (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_vaapiencode_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstVaapiEncode *const encode = GST_VAAPIENCODE_CAST (object);
+
+  switch (prop_id) {
+    case PROP_EXPORT_BUFFERS:
+      g_value_set_uint (value, encode->export_buffers);
+      break;
+    case PROP_COPY_THREADS:
+      g_value_set_uint (value,
+          gst_vaapi_plugin_base_get_copy_threads (GST_VAAPI_PLUGIN_BASE
+              (encode)));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
 static void
 gst_vaapiencode_init (GstVaapiEncode * encode)
 {
@@ -884,6 +963,8 @@ gst_vaapiencode_init (GstVaapiEncode * encode)
 
   gst_vaapi_plugin_base_init (GST_VAAPI_PLUGIN_BASE (encode), GST_CAT_DEFAULT);
   gst_pad_use_fixed_caps (plugin->srcpad);
+
+  encode->export_buffers = DEFAULT_EXPORT_BUFFERS;
 }
 
 static void
@@ -899,6 +980,8 @@ gst_vaapiencode_class_init (GstVaapiEncodeClass * klass)
   gst_vaapi_plugin_base_class_init (GST_VAAPI_PLUGIN_BASE_CLASS (klass));
 
   object_class->finalize = gst_vaapiencode_finalize;
+  object_class->set_property = gst_vaapiencode_set_property;
+  object_class->get_property = gst_vaapiencode_get_property;
 
   element_class->set_context = gst_vaapi_base_set_context;
   element_class->change_state =
@@ -923,6 +1006,34 @@ gst_vaapiencode_class_init (GstVaapiEncodeClass * klass)
 
   venc_class->src_query = GST_DEBUG_FUNCPTR (gst_vaapiencode_src_query);
   venc_class->sink_query = GST_DEBUG_FUNCPTR (gst_vaapiencode_sink_query);
+
+  /**
+   * GstVaapiEncode:export-buffers:
+   *
+   * The maximum number of coded buffers that are pushed downstream
+   * as is, without being copied into system memory. They are held
+   * out of the coded buffer pool until downstream releases them,
+   * past that number the coded buffers are copied again. Zero always
+   * copies the coded buffers. This takes effect on the next caps
+   * negotiation.
+   */
+  g_object_class_install_property (object_class,
+      PROP_EXPORT_BUFFERS,
+      g_param_spec_uint ("export-buffers",
+          "Export Buffers",
+          "Maximum number of coded buffers pushed downstream without a copy",
+          0, 64, DEFAULT_EXPORT_BUFFERS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstVaapiEncode:copy-threads:
+   *
+   * The number of threads copying raw input frames into VA surfaces,
+   * including the streaming thread. Large frames, e.g. 4K or 8K, may
+   * need several threads to be uploaded in real time.
+   */
+  gst_vaapi_plugin_base_install_copy_threads_property (object_class,
+      PROP_COPY_THREADS);
 }
 
 static inline GPtrArray *
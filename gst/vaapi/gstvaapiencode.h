@@ -66,6 +66,7 @@ struct _GstVaapiEncode
   GstVideoCodecState *output_state;
   GPtrArray *prop_values;
   GstCaps *allowed_sinkpad_caps;
+  guint export_buffers;
 };
 
 struct _GstVaapiEncodeClass
@@ -39,6 +39,12 @@
 
 #define BUFFER_POOL_SINK_MIN_BUFFERS 2
 
+#define DEFAULT_COPY_THREADS 0
+#define MAX_COPY_THREADS 64
+
+#define DEFAULT_PREWARM_SURFACES 0
+#define MAX_PREWARM_SURFACES 64
+
 /* GstVideoContext interface */
 static void
 plugin_set_display (GstVaapiPluginBase * plugin, GstVaapiDisplay * display)
@@ -250,6 +256,9 @@ gst_vaapi_plugin_base_init (GstVaapiPluginBase * plugin,
 
   plugin->enable_direct_rendering =
       (g_getenv ("GST_VAAPI_ENABLE_DIRECT_RENDERING") != NULL);
+
+  plugin->copy_threads = DEFAULT_COPY_THREADS;
+  plugin->prewarm_surfaces = DEFAULT_PREWARM_SURFACES;
 }
 
 void
@@ -310,6 +319,9 @@ gst_vaapi_plugin_base_close (GstVaapiPluginBase * plugin)
   gst_caps_replace (&plugin->srcpad_caps, NULL);
   gst_video_info_init (&plugin->srcpad_info);
   gst_caps_replace (&plugin->allowed_raw_caps, NULL);
+
+  gst_vaapi_copy_pool_free (plugin->copy_pool);
+  plugin->copy_pool = NULL;
 }
 
 /**
@@ -372,6 +384,120 @@ gst_vaapi_plugin_base_set_display_name (GstVaapiPluginBase * plugin,
   plugin->display_name = g_strdup (display_name);
 }
 
+/**
+ * gst_vaapi_plugin_base_install_copy_threads_property:
+ * @object_class: the #GObjectClass of an element uploading raw frames
+ * @prop_id: the property id to install
+ *
+ * Installs the "copy-threads" property, which is handled with
+ * gst_vaapi_plugin_base_set_copy_threads() and
+ * gst_vaapi_plugin_base_get_copy_threads().
+ */
+void
+gst_vaapi_plugin_base_install_copy_threads_property (GObjectClass *
+    object_class, guint prop_id)
+{
+  g_object_class_install_property (object_class, prop_id,
+      g_param_spec_uint ("copy-threads", "Copy Threads",
+          "Number of threads copying raw input frames into VA surfaces "
+          "(0 or 1: copy from the streaming thread only)",
+          0, MAX_COPY_THREADS, DEFAULT_COPY_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+/**
+ * gst_vaapi_plugin_base_set_copy_threads:
+ * @plugin: a #GstVaapiPluginBase
+ * @n_threads: the number of threads copying raw input frames
+ *
+ * Sets the number of threads, including the streaming thread, that
+ * copy the raw input frames into VA surfaces. Each plane is split
+ * into one stripe of rows per thread. This takes effect on the next
+ * input frame.
+ */
+void
+gst_vaapi_plugin_base_set_copy_threads (GstVaapiPluginBase * plugin,
+    guint n_threads)
+{
+  g_atomic_int_set (&plugin->copy_threads, n_threads);
+}
+
+/**
+ * gst_vaapi_plugin_base_get_copy_threads:
+ * @plugin: a #GstVaapiPluginBase
+ *
+ * Return value: the number of threads copying raw input frames
+ */
+guint
+gst_vaapi_plugin_base_get_copy_threads (GstVaapiPluginBase * plugin)
+{
+  return g_atomic_int_get (&plugin->copy_threads);
+}
+
+/**
+ * gst_vaapi_plugin_base_install_prewarm_surfaces_property:
+ * @object_class: the #GObjectClass of an element
+ * @prop_id: the property id to install
+ *
+ * Installs the "prewarm-surfaces" property, which is handled with
+ * gst_vaapi_plugin_base_set_prewarm_surfaces() and
+ * gst_vaapi_plugin_base_get_prewarm_surfaces().
+ */
+void
+gst_vaapi_plugin_base_install_prewarm_surfaces_property (GObjectClass *
+    object_class, guint prop_id)
+{
+  g_object_class_install_property (object_class, prop_id,
+      g_param_spec_uint ("prewarm-surfaces", "Pre-warmed surfaces",
+          "Number of surfaces of the negotiated allocators to allocate "
+          "ahead, in the background (0: allocate on demand)",
+          0, MAX_PREWARM_SURFACES, DEFAULT_PREWARM_SURFACES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+/**
+ * gst_vaapi_plugin_base_set_prewarm_surfaces:
+ * @plugin: a #GstVaapiPluginBase
+ * @n: the number of surfaces to allocate ahead
+ *
+ * Sets the number of surfaces that the video allocators allocate in a
+ * background thread once the caps are negotiated, rather than on
+ * demand while the first frames are processed. This takes effect on
+ * the next negotiation.
+ */
+void
+gst_vaapi_plugin_base_set_prewarm_surfaces (GstVaapiPluginBase * plugin,
+    guint n)
+{
+  g_atomic_int_set (&plugin->prewarm_surfaces, n);
+}
+
+/**
+ * gst_vaapi_plugin_base_get_prewarm_surfaces:
+ * @plugin: a #GstVaapiPluginBase
+ *
+ * Return value: the number of surfaces allocated ahead
+ */
+guint
+gst_vaapi_plugin_base_get_prewarm_surfaces (GstVaapiPluginBase * plugin)
+{
+  return g_atomic_int_get (&plugin->prewarm_surfaces);
+}
+
+/* Starts allocating the surfaces of allocator in the background, if
+   requested. Only #GstVaapiVideoAllocator surfaces can be pre-warmed */
+static void
+plugin_prewarm_allocator (GstVaapiPluginBase * plugin,
+    GstAllocator * allocator)
+{
+  const guint n = g_atomic_int_get (&plugin->prewarm_surfaces);
+
+  if (n == 0 || !GST_VAAPI_IS_VIDEO_ALLOCATOR (allocator))
+    return;
+  if (!gst_vaapi_video_allocator_prewarm (allocator, n))
+    GST_WARNING_OBJECT (plugin, "failed to pre-allocate %u surfaces", n);
+}
+
 /**
  * gst_vaapi_plugin_base_ensure_display:
  * @plugin: a #GstVaapiPluginBase
@@ -522,6 +648,8 @@ ensure_sinkpad_allocator (GstVaapiPluginBase * plugin, GstCaps * caps,
   }
   plugin->sinkpad_allocator =
       gst_vaapi_video_allocator_new (plugin->display, &vinfo, 0, usage_flag);
+  if (plugin->sinkpad_allocator)
+    plugin_prewarm_allocator (plugin, plugin->sinkpad_allocator);
 
 bail:
   if (!plugin->sinkpad_allocator)
@@ -979,6 +1107,7 @@ gst_vaapi_plugin_base_decide_allocation (GstVaapiPluginBase * plugin,
   if (!pool) {
     if (!ensure_srcpad_allocator (plugin, &vi, caps))
       goto error;
+    plugin_prewarm_allocator (plugin, plugin->srcpad_allocator);
     size = GST_VIDEO_INFO_SIZE (&vi);   /* size might be updated by
                                          * allocator */
     pool = gst_vaapi_plugin_base_create_pool (plugin, caps, size, min, max,
@@ -1026,6 +1155,75 @@ error:
   }
 }
 
+/* Returns the copy thread pool, or NULL if the frames shall be copied
+   from the streaming thread only */
+static GstVaapiCopyPool *
+plugin_ensure_copy_pool (GstVaapiPluginBase * plugin)
+{
+  const guint n_threads = g_atomic_int_get (&plugin->copy_threads);
+
+  if (plugin->copy_pool && plugin->copy_pool_threads != n_threads) {
+    gst_vaapi_copy_pool_free (plugin->copy_pool);
+    plugin->copy_pool = NULL;
+  }
+  if (!plugin->copy_pool && n_threads > 1) {
+    plugin->copy_pool = gst_vaapi_copy_pool_new (n_threads);
+    plugin->copy_pool_threads = n_threads;
+    GST_INFO_OBJECT (plugin, "copying raw frames with %u threads",
+        gst_vaapi_copy_pool_get_n_threads (plugin->copy_pool));
+  }
+  return plugin->copy_pool;
+}
+
+/* Copies the raw frame src into the VA surface backed frame dst,
+   splitting the planes across the copy threads */
+static gboolean
+plugin_copy_frame (GstVaapiPluginBase * plugin, GstVideoFrame * dst,
+    GstVideoFrame * src)
+{
+  const GstVideoFormatInfo *const finfo = dst->info.finfo;
+  GstVaapiCopyPool *const pool = plugin_ensure_copy_pool (plugin);
+  guint len[GST_VIDEO_MAX_PLANES], height[GST_VIDEO_MAX_PLANES];
+  guint i, c, n_planes, pstride;
+  gint dst_stride, src_stride;
+
+  if (!pool || GST_VIDEO_FORMAT_INFO_IS_TILED (finfo) ||
+      GST_VIDEO_FORMAT_INFO_HAS_PALETTE (finfo) ||
+      GST_VIDEO_FRAME_FORMAT (dst) != GST_VIDEO_FRAME_FORMAT (src))
+    return gst_video_frame_copy (dst, src);
+
+  /* Only handle planes made of whole bytes per pixel */
+  n_planes = GST_VIDEO_FRAME_N_PLANES (dst);
+  for (i = 0; i < n_planes; i++) {
+    for (c = 0; c < GST_VIDEO_FRAME_N_COMPONENTS (dst); c++) {
+      if (GST_VIDEO_FRAME_COMP_PLANE (dst, c) == i)
+        break;
+    }
+    if (c == GST_VIDEO_FRAME_N_COMPONENTS (dst))
+      return gst_video_frame_copy (dst, src);
+
+    pstride = GST_VIDEO_FRAME_COMP_PSTRIDE (dst, c);
+    len[i] = MIN (GST_VIDEO_FRAME_COMP_WIDTH (dst, c),
+        GST_VIDEO_FRAME_COMP_WIDTH (src, c)) * pstride;
+    height[i] = MIN (GST_VIDEO_FRAME_COMP_HEIGHT (dst, c),
+        GST_VIDEO_FRAME_COMP_HEIGHT (src, c));
+    dst_stride = GST_VIDEO_FRAME_PLANE_STRIDE (dst, i);
+    src_stride = GST_VIDEO_FRAME_PLANE_STRIDE (src, i);
+    if (pstride == 0 || dst_stride < (gint) len[i] ||
+        src_stride < (gint) len[i])
+      return gst_video_frame_copy (dst, src);
+  }
+
+  for (i = 0; i < n_planes; i++) {
+    gst_vaapi_copy_pool_copy_plane (pool, GST_VIDEO_FRAME_PLANE_DATA (dst, i),
+        GST_VIDEO_FRAME_PLANE_STRIDE (dst, i),
+        GST_VIDEO_FRAME_PLANE_DATA (src, i),
+        GST_VIDEO_FRAME_PLANE_STRIDE (src, i), len[i], height[i],
+        GST_VAAPI_COPY_FLAG_STREAM_STORE);
+  }
+  return TRUE;
+}
+
 /**
  * gst_vaapi_plugin_base_get_input_buffer:
  * @plugin: a #GstVaapiPluginBase
@@ -1045,6 +1243,7 @@ gst_vaapi_plugin_base_get_input_buffer (GstVaapiPluginBase * plugin,
 {
   GstVaapiVideoMeta *meta;
   GstBuffer *outbuf;
+  GstMemory *mem;
   GstVideoFrame src_frame, out_frame;
   gboolean success;
 
@@ -1082,11 +1281,21 @@ gst_vaapi_plugin_base_get_input_buffer (GstVaapiPluginBase * plugin,
           GST_MAP_READ))
     goto error_map_src_buffer;
 
+  /* Convert the frame right into the surface if possible, rather than
+     into a VA image that gets converted into the surface afterwards */
+  mem = gst_buffer_peek_memory (outbuf, 0);
+  if (GST_VAAPI_IS_VIDEO_MEMORY (mem) &&
+      gst_vaapi_video_memory_upload_frame (GST_VAAPI_VIDEO_MEMORY_CAST (mem),
+          &src_frame)) {
+    gst_video_frame_unmap (&src_frame);
+    goto done;
+  }
+
   if (!gst_video_frame_map (&out_frame, &plugin->sinkpad_info, outbuf,
           GST_MAP_WRITE))
     goto error_map_dst_buffer;
 
-  success = gst_video_frame_copy (&out_frame, &src_frame);
+  success = plugin_copy_frame (plugin, &out_frame, &src_frame);
   gst_video_frame_unmap (&out_frame);
   gst_video_frame_unmap (&src_frame);
   if (!success)
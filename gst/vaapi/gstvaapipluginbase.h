@@ -30,6 +30,7 @@
 #include <gst/video/gstvideoencoder.h>
 #include <gst/video/gstvideosink.h>
 #include <gst/vaapi/gstvaapidisplay.h>
+#include <gst/vaapi/gstvaapiutils_copy.h>
 
 G_BEGIN_DECLS
 
@@ -147,6 +148,14 @@ struct _GstVaapiPluginBase
   gboolean srcpad_can_dmabuf;
 
   gboolean enable_direct_rendering;
+
+  /* Raw input frames copy */
+  volatile guint copy_threads;
+  GstVaapiCopyPool *copy_pool;
+  guint copy_pool_threads;
+
+  /* Surfaces allocated ahead by the video allocators */
+  volatile guint prewarm_surfaces;
 };
 
 struct _GstVaapiPluginBaseClass
@@ -209,6 +218,34 @@ G_GNUC_INTERNAL
 gboolean
 gst_vaapi_plugin_base_ensure_display (GstVaapiPluginBase * plugin);
 
+G_GNUC_INTERNAL
+void
+gst_vaapi_plugin_base_install_copy_threads_property (GObjectClass *
+    object_class, guint prop_id);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_plugin_base_set_copy_threads (GstVaapiPluginBase * plugin,
+    guint n_threads);
+
+G_GNUC_INTERNAL
+guint
+gst_vaapi_plugin_base_get_copy_threads (GstVaapiPluginBase * plugin);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_plugin_base_install_prewarm_surfaces_property (GObjectClass *
+    object_class, guint prop_id);
+
+G_GNUC_INTERNAL
+void
+gst_vaapi_plugin_base_set_prewarm_surfaces (GstVaapiPluginBase * plugin,
+    guint n);
+
+G_GNUC_INTERNAL
+guint
+gst_vaapi_plugin_base_get_prewarm_surfaces (GstVaapiPluginBase * plugin);
+
 G_GNUC_INTERNAL
 gboolean
 gst_vaapi_plugin_base_set_caps (GstVaapiPluginBase * plugin, GstCaps * incaps,
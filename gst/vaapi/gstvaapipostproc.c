@@ -122,6 +122,8 @@ enum
   PROP_CONTRAST,
   PROP_SCALE_METHOD,
   PROP_SKIN_TONE_ENHANCEMENT,
+  PROP_COPY_THREADS,
+  PROP_PREWARM_SURFACES,
 };
 
 #define GST_VAAPI_TYPE_DEINTERLACE_MODE \
@@ -1495,6 +1497,14 @@ gst_vaapipostproc_set_property (GObject * object,
       postproc->skintone_enhance = g_value_get_boolean (value);
       postproc->flags |= GST_VAAPI_POSTPROC_FLAG_SKINTONE;
       break;
+    case PROP_COPY_THREADS:
+      gst_vaapi_plugin_base_set_copy_threads (GST_VAAPI_PLUGIN_BASE
+          (postproc), g_value_get_uint (value));
+      break;
+    case PROP_PREWARM_SURFACES:
+      gst_vaapi_plugin_base_set_prewarm_surfaces (GST_VAAPI_PLUGIN_BASE
+          (postproc), g_value_get_uint (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1555,6 +1565,16 @@ gst_vaapipostproc_get_property (GObject * object,
     case PROP_SKIN_TONE_ENHANCEMENT:
       g_value_set_boolean (value, postproc->skintone_enhance);
       break;
+    case PROP_COPY_THREADS:
+      g_value_set_uint (value,
+          gst_vaapi_plugin_base_get_copy_threads (GST_VAAPI_PLUGIN_BASE
+              (postproc)));
+      break;
+    case PROP_PREWARM_SURFACES:
+      g_value_set_uint (value,
+          gst_vaapi_plugin_base_get_prewarm_surfaces (GST_VAAPI_PLUGIN_BASE
+              (postproc)));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1697,6 +1717,26 @@ gst_vaapipostproc_class_init (GstVaapiPostprocClass * klass)
           "When enabled, scaling will respect original aspect ratio",
           TRUE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * GstVaapiPostproc:copy-threads:
+   *
+   * The number of threads, including the streaming thread, copying
+   * raw input frames into VA surfaces.
+   */
+  gst_vaapi_plugin_base_install_copy_threads_property (object_class,
+      PROP_COPY_THREADS);
+
+  /**
+   * GstVaapiPostproc:prewarm-surfaces:
+   *
+   * The number of surfaces of the output buffer pool, and of the input
+   * one for raw frames, to allocate in a background thread once the
+   * caps are negotiated, rather than on demand while the first frames
+   * are processed. Zero disables it.
+   */
+  gst_vaapi_plugin_base_install_prewarm_surfaces_property (object_class,
+      PROP_PREWARM_SURFACES);
+
   /**
    * GstVaapiPostproc:denoise:
    *
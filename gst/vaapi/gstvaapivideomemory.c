@@ -119,11 +119,173 @@ new_image (GstVaapiDisplay * display, const GstVideoInfo * vip)
       GST_VIDEO_INFO_WIDTH (vip), GST_VIDEO_INFO_HEIGHT (vip));
 }
 
+/* With GST_VAAPI_CACHE_DERIVED_IMAGES set in the environment, the
+   allocator keeps the images derived from the surfaces of its memories,
+   and keeps them mapped across CPU accesses, instead of deriving,
+   mapping, unmapping and destroying an image on each access. A cached
+   image is unmapped once its surface is handed over to the GPU again,
+   and dropped along with the surface reference once the memory gives
+   its surface back, so that the cache never keeps a surface alive */
+#define DERIVED_IMAGES_CACHE_ENV "GST_VAAPI_CACHE_DERIVED_IMAGES"
+
+typedef struct
+{
+  GstVaapiSurface *surface;
+  GstVaapiImage *image;
+  /* Number of memories currently mapping the image */
+  guint map_count;
+} DerivedImage;
+
+static void
+derived_image_free (DerivedImage * entry)
+{
+  gst_vaapi_image_unmap (entry->image);
+  gst_vaapi_object_unref (entry->image);
+  gst_vaapi_object_unref (entry->surface);
+  g_slice_free (DerivedImage, entry);
+}
+
+static inline gboolean
+use_derived_images_cache (GstVaapiVideoMemory * mem)
+{
+  GstVaapiVideoAllocator *const allocator =
+      GST_VAAPI_VIDEO_ALLOCATOR_CAST (GST_MEMORY_CAST (mem)->allocator);
+
+  return allocator->derived_images && !use_native_formats (mem->usage_flag);
+}
+
+/* Returns the entry of the derived images cache holding mem->image, if
+   any. The cache lock shall be held */
+static DerivedImage *
+lookup_derived_image (GstVaapiVideoMemory * mem)
+{
+  GstVaapiVideoAllocator *const allocator =
+      GST_VAAPI_VIDEO_ALLOCATOR_CAST (GST_MEMORY_CAST (mem)->allocator);
+  DerivedImage *entry;
+
+  entry = g_hash_table_lookup (allocator->derived_images, mem->surface);
+  return entry && entry->image == mem->image ? entry : NULL;
+}
+
+/* Returns a new reference to an image derived from mem->surface */
+static GstVaapiImage *
+derive_image (GstVaapiVideoMemory * mem)
+{
+  GstVaapiVideoAllocator *const allocator =
+      GST_VAAPI_VIDEO_ALLOCATOR_CAST (GST_MEMORY_CAST (mem)->allocator);
+  GstVaapiImage *image = NULL;
+  DerivedImage *entry;
+
+  if (!use_derived_images_cache (mem))
+    return gst_vaapi_surface_derive_image (mem->surface);
+
+  g_mutex_lock (&allocator->derived_images_lock);
+  entry = g_hash_table_lookup (allocator->derived_images, mem->surface);
+  if (entry) {
+    allocator->derive_calls_saved++;
+  } else {
+    image = gst_vaapi_surface_derive_image (mem->surface);
+    if (!image)
+      goto out;
+
+    entry = g_slice_new (DerivedImage);
+    entry->surface = gst_vaapi_object_ref (mem->surface);
+    entry->image = image;
+    entry->map_count = 0;
+    g_hash_table_insert (allocator->derived_images, mem->surface, entry);
+  }
+  image = gst_vaapi_object_ref (entry->image);
+
+out:
+  g_mutex_unlock (&allocator->derived_images_lock);
+  return image;
+}
+
+static gboolean
+map_image (GstVaapiVideoMemory * mem)
+{
+  GstVaapiVideoAllocator *const allocator =
+      GST_VAAPI_VIDEO_ALLOCATOR_CAST (GST_MEMORY_CAST (mem)->allocator);
+  DerivedImage *entry;
+  gboolean success;
+
+  if (!use_derived_images_cache (mem))
+    return gst_vaapi_image_map (mem->image);
+
+  g_mutex_lock (&allocator->derived_images_lock);
+  entry = lookup_derived_image (mem);
+  if (entry && gst_vaapi_image_is_mapped (entry->image))
+    allocator->map_calls_saved++;
+  success = gst_vaapi_image_map (mem->image);
+  if (entry && success)
+    entry->map_count++;
+  g_mutex_unlock (&allocator->derived_images_lock);
+  return success;
+}
+
+/* Unmaps mem->image, unless the cache keeps it mapped */
+static void
+unmap_image (GstVaapiVideoMemory * mem)
+{
+  GstVaapiVideoAllocator *const allocator =
+      GST_VAAPI_VIDEO_ALLOCATOR_CAST (GST_MEMORY_CAST (mem)->allocator);
+  DerivedImage *entry = NULL;
+
+  if (use_derived_images_cache (mem)) {
+    g_mutex_lock (&allocator->derived_images_lock);
+    entry = lookup_derived_image (mem);
+    if (entry)
+      entry->map_count--;
+    g_mutex_unlock (&allocator->derived_images_lock);
+  }
+  if (!entry)
+    gst_vaapi_image_unmap (mem->image);
+}
+
+/* Unmaps the cached image derived from mem->surface, as the surface is
+   about to be used by the GPU */
+static void
+release_derived_image (GstVaapiVideoMemory * mem)
+{
+  GstVaapiVideoAllocator *const allocator =
+      GST_VAAPI_VIDEO_ALLOCATOR_CAST (GST_MEMORY_CAST (mem)->allocator);
+  DerivedImage *entry;
+
+  if (!allocator->derived_images || !mem->surface)
+    return;
+
+  g_mutex_lock (&allocator->derived_images_lock);
+  entry = g_hash_table_lookup (allocator->derived_images, mem->surface);
+  if (entry && entry->map_count == 0)
+    gst_vaapi_image_unmap (entry->image);
+  g_mutex_unlock (&allocator->derived_images_lock);
+}
+
+/* Destroys the cached image derived from mem->surface, as the memory
+   gives the surface back to its pool, or is freed. The entry is kept if
+   another memory on the same surface still maps the image */
+static void
+drop_derived_image (GstVaapiVideoMemory * mem)
+{
+  GstVaapiVideoAllocator *const allocator =
+      GST_VAAPI_VIDEO_ALLOCATOR_CAST (GST_MEMORY_CAST (mem)->allocator);
+  DerivedImage *entry;
+
+  if (!allocator->derived_images || !mem->surface)
+    return;
+
+  g_mutex_lock (&allocator->derived_images_lock);
+  entry = g_hash_table_lookup (allocator->derived_images, mem->surface);
+  if (entry && entry->map_count == 0)
+    g_hash_table_remove (allocator->derived_images, mem->surface);
+  g_mutex_unlock (&allocator->derived_images_lock);
+}
+
 static gboolean
 ensure_image (GstVaapiVideoMemory * mem)
 {
   if (!mem->image && !use_native_formats (mem->usage_flag)) {
-    mem->image = gst_vaapi_surface_derive_image (mem->surface);
+    mem->image = derive_image (mem);
     if (!mem->image) {
       reset_image_usage (&mem->usage_flag);
     } else if (gst_vaapi_surface_get_format (mem->surface) !=
@@ -215,9 +377,34 @@ ensure_surface (GstVaapiVideoMemory * mem)
   return mem->surface != NULL;
 }
 
+/* Uploads the image to the surface. If possible, the pixels are
+   converted by the CPU right into the image derived from the surface,
+   instead of vaPutImage() converting a copy of them */
+static gboolean
+put_image (GstVaapiVideoMemory * mem)
+{
+  GstVaapiVideoAllocator *const allocator =
+      GST_VAAPI_VIDEO_ALLOCATOR_CAST (GST_MEMORY_CAST (mem)->allocator);
+  GstVaapiImage *image;
+  gboolean success;
+
+  if (allocator->has_fused_upload) {
+    image = gst_vaapi_surface_derive_image (mem->surface);
+    if (image) {
+      success = gst_vaapi_image_copy (image, mem->image);
+      gst_vaapi_object_unref (image);
+      if (success)
+        return TRUE;
+    }
+  }
+  return gst_vaapi_surface_put_image (mem->surface, mem->image);
+}
+
 static gboolean
 ensure_surface_is_current (GstVaapiVideoMemory * mem)
 {
+  release_derived_image (mem);
+
   if (!use_native_formats (mem->usage_flag))
     return TRUE;
 
@@ -225,7 +412,7 @@ ensure_surface_is_current (GstVaapiVideoMemory * mem)
           GST_VAAPI_VIDEO_MEMORY_FLAG_SURFACE_IS_CURRENT)) {
     if (GST_VAAPI_VIDEO_MEMORY_FLAG_IS_SET (mem,
             GST_VAAPI_VIDEO_MEMORY_FLAG_IMAGE_IS_CURRENT)
-        && !gst_vaapi_surface_put_image (mem->surface, mem->image))
+        && !put_image (mem))
       return FALSE;
 
     GST_VAAPI_VIDEO_MEMORY_FLAG_SET (mem,
@@ -247,7 +434,7 @@ map_vaapi_memory (GstVaapiVideoMemory * mem, GstMapFlags flags)
   if ((flags & GST_MAP_READ) && !ensure_image_is_current (mem))
     goto error_no_current_image;
 
-  if (!gst_vaapi_image_map (mem->image))
+  if (!map_image (mem))
     goto error_map_image;
 
   /* Mark surface as dirty and expect updates from image */
@@ -289,7 +476,7 @@ error_map_image:
 static inline void
 unmap_vaapi_memory (GstVaapiVideoMemory * mem, GstMapFlags flags)
 {
-  gst_vaapi_image_unmap (mem->image);
+  unmap_image (mem);
 
   if (flags & GST_MAP_WRITE) {
     GST_VAAPI_VIDEO_MEMORY_FLAG_SET (mem,
@@ -432,6 +619,7 @@ gst_vaapi_video_memory_reset_image (GstVaapiVideoMemory * mem)
 void
 gst_vaapi_video_memory_reset_surface (GstVaapiVideoMemory * mem)
 {
+  drop_derived_image (mem);
   mem->surface = NULL;
   gst_vaapi_video_memory_reset_image (mem);
   gst_vaapi_surface_proxy_replace (&mem->proxy, NULL);
@@ -450,6 +638,59 @@ gst_vaapi_video_memory_sync (GstVaapiVideoMemory * mem)
   return ensure_surface_is_current (mem);
 }
 
+/**
+ * gst_vaapi_video_memory_upload_frame:
+ * @mem: a #GstVaapiVideoMemory
+ * @frame: a mapped #GstVideoFrame in the format of the allocator images
+ *
+ * Uploads @frame to the surface of @mem, converting it on the CPU
+ * right into the image derived from the surface. Unlike mapping @mem
+ * for writing, which fills a VA image that is later converted into
+ * the surface, the frame only goes once over memory. This is only
+ * possible if the allocator has fused uploading.
+ *
+ * Return value: %TRUE if @frame was uploaded, %FALSE if it shall be
+ *   copied through a mapping of @mem instead
+ */
+gboolean
+gst_vaapi_video_memory_upload_frame (GstVaapiVideoMemory * mem,
+    GstVideoFrame * frame)
+{
+  GstVaapiVideoAllocator *allocator;
+  GstVaapiImage *image;
+  gboolean success = FALSE;
+
+  g_return_val_if_fail (mem, FALSE);
+  g_return_val_if_fail (frame, FALSE);
+
+  allocator = GST_VAAPI_VIDEO_ALLOCATOR_CAST (GST_MEMORY_CAST (mem)->allocator);
+  if (!allocator->has_fused_upload || GST_VIDEO_FRAME_FORMAT (frame) !=
+      GST_VIDEO_INFO_FORMAT (&allocator->image_info))
+    return FALSE;
+
+  g_mutex_lock (&mem->lock);
+  if (mem->map_count > 0 || !ensure_surface (mem))
+    goto out;
+
+  image = gst_vaapi_surface_derive_image (mem->surface);
+  if (!image)
+    goto out;
+  success = gst_vaapi_image_update_from_frame (image, frame);
+  gst_vaapi_object_unref (image);
+  if (!success)
+    goto out;
+
+  /* The surface holds the frame now, any previous image is stale */
+  GST_VAAPI_VIDEO_MEMORY_FLAG_UNSET (mem,
+      GST_VAAPI_VIDEO_MEMORY_FLAG_IMAGE_IS_CURRENT);
+  GST_VAAPI_VIDEO_MEMORY_FLAG_SET (mem,
+      GST_VAAPI_VIDEO_MEMORY_FLAG_SURFACE_IS_CURRENT);
+
+out:
+  g_mutex_unlock (&mem->lock);
+  return success;
+}
+
 static gpointer
 gst_vaapi_video_memory_map (GstMemory * base_mem, gsize maxsize, guint flags)
 {
@@ -627,6 +868,7 @@ gst_vaapi_video_allocator_free (GstAllocator * allocator, GstMemory * base_mem)
 {
   GstVaapiVideoMemory *const mem = GST_VAAPI_VIDEO_MEMORY_CAST (base_mem);
 
+  drop_derived_image (mem);
   mem->surface = NULL;
   gst_vaapi_video_memory_reset_image (mem);
   gst_vaapi_surface_proxy_replace (&mem->proxy, NULL);
@@ -642,6 +884,16 @@ gst_vaapi_video_allocator_finalize (GObject * object)
   GstVaapiVideoAllocator *const allocator =
       GST_VAAPI_VIDEO_ALLOCATOR_CAST (object);
 
+  if (allocator->derived_images) {
+    _init_performance_debug ();
+    GST_CAT_INFO (CAT_PERFORMANCE, "derived images cache saved %u "
+        "vaDeriveImage() and %u vaMapBuffer() calls, and as many "
+        "vaDestroyImage() and vaUnmapBuffer() calls",
+        allocator->derive_calls_saved, allocator->map_calls_saved);
+    g_hash_table_unref (allocator->derived_images);
+  }
+  g_mutex_clear (&allocator->derived_images_lock);
+
   gst_vaapi_video_pool_replace (&allocator->surface_pool, NULL);
   gst_vaapi_video_pool_replace (&allocator->image_pool, NULL);
 
@@ -670,6 +922,8 @@ gst_vaapi_video_allocator_init (GstVaapiVideoAllocator * allocator)
   base_allocator->mem_unmap_full = gst_vaapi_video_memory_unmap_full;
   base_allocator->mem_copy = gst_vaapi_video_memory_copy;
 
+  g_mutex_init (&allocator->derived_images_lock);
+
   GST_OBJECT_FLAG_SET (allocator, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
 }
 
@@ -809,6 +1063,42 @@ error_no_surface:
   }
 }
 
+/* Checks whether images can be converted into the surface format while
+   being copied into a derived image, see put_image(). The surface is
+   only derived, its contents are left untouched */
+static gboolean
+allocator_has_fused_upload (GstVaapiVideoAllocator * allocator)
+{
+  const GstVideoInfo *const vip = &allocator->image_info;
+  GstVaapiSurface *surface;
+  GstVaapiImage *derived_image;
+  gboolean success = FALSE;
+
+  if (GST_VIDEO_INFO_FORMAT (vip) ==
+      GST_VIDEO_INFO_FORMAT (&allocator->surface_info))
+    return FALSE;
+  if (!gst_vaapi_image_can_convert (GST_VIDEO_INFO_FORMAT
+          (&allocator->surface_info), GST_VIDEO_INFO_FORMAT (vip)))
+    return FALSE;
+
+  surface = gst_vaapi_video_pool_get_object (allocator->surface_pool);
+  if (!surface)
+    return FALSE;
+
+  derived_image = gst_vaapi_surface_derive_image (surface);
+  if (derived_image) {
+    success = gst_vaapi_image_get_format (derived_image) ==
+        GST_VIDEO_INFO_FORMAT (&allocator->surface_info) &&
+        gst_vaapi_image_get_width (derived_image) ==
+        GST_VIDEO_INFO_WIDTH (vip) &&
+        gst_vaapi_image_get_height (derived_image) ==
+        GST_VIDEO_INFO_HEIGHT (vip);
+    gst_vaapi_object_unref (derived_image);
+  }
+  gst_vaapi_video_pool_put_object (allocator->surface_pool, surface);
+  return success;
+}
+
 static inline gboolean
 allocator_configure_image_info (GstVaapiDisplay * display,
     GstVaapiVideoAllocator * allocator)
@@ -834,6 +1124,13 @@ allocator_configure_image_info (GstVaapiDisplay * display,
 
   gst_video_info_update_from_image (&allocator->image_info, image);
   gst_vaapi_image_unmap (image);
+
+  allocator->has_fused_upload = allocator_has_fused_upload (allocator);
+  if (allocator->has_fused_upload) {
+    GST_INFO_OBJECT (allocator, "has fused uploading from %s to %s surfaces",
+        GST_VIDEO_INFO_FORMAT_STRING (&allocator->image_info),
+        GST_VIDEO_INFO_FORMAT_STRING (&allocator->surface_info));
+  }
   ret = TRUE;
 
 bail:
@@ -863,6 +1160,12 @@ allocator_params_init (GstVaapiVideoAllocator * allocator,
 
   if (!allocator_configure_surface_info (display, allocator, req_usage_flag))
     return FALSE;
+  if (!use_native_formats (allocator->usage_flag)
+      && g_getenv (DERIVED_IMAGES_CACHE_ENV)) {
+    allocator->derived_images = g_hash_table_new_full (g_direct_hash,
+        g_direct_equal, NULL, (GDestroyNotify) derived_image_free);
+    GST_INFO_OBJECT (allocator, "caching mapped derived images");
+  }
   allocator->surface_pool = gst_vaapi_surface_pool_new_full (display,
       &allocator->surface_info, surface_alloc_flags);
   if (!allocator->surface_pool)
@@ -893,6 +1196,32 @@ error_create_image_pool:
   }
 }
 
+/**
+ * gst_vaapi_video_allocator_prewarm:
+ * @base_allocator: a #GstAllocator
+ * @n: the number of surfaces to allocate ahead
+ *
+ * Allocates @n surfaces of the surface pool of @base_allocator in a
+ * background thread, so that the memories of the first frames do not
+ * wait for them, see gst_vaapi_video_pool_prewarm().
+ *
+ * Return value: %TRUE on success, %FALSE if @base_allocator is not a
+ *   #GstVaapiVideoAllocator or the thread could not be started
+ */
+gboolean
+gst_vaapi_video_allocator_prewarm (GstAllocator * base_allocator, guint n)
+{
+  GstVaapiVideoAllocator *allocator;
+
+  if (!GST_VAAPI_IS_VIDEO_ALLOCATOR (base_allocator))
+    return FALSE;
+
+  allocator = GST_VAAPI_VIDEO_ALLOCATOR_CAST (base_allocator);
+  if (!allocator->surface_pool)
+    return FALSE;
+  return gst_vaapi_video_pool_prewarm (allocator->surface_pool, n);
+}
+
 GstAllocator *
 gst_vaapi_video_allocator_new (GstVaapiDisplay * display,
     const GstVideoInfo * alloc_info, guint surface_alloc_flags,
@@ -154,6 +154,11 @@ G_GNUC_INTERNAL
 gboolean
 gst_vaapi_video_memory_sync (GstVaapiVideoMemory * mem);
 
+G_GNUC_INTERNAL
+gboolean
+gst_vaapi_video_memory_upload_frame (GstVaapiVideoMemory * mem,
+    GstVideoFrame * frame);
+
 /* ------------------------------------------------------------------------ */
 /* --- GstVaapiVideoAllocator                                           --- */
 /* ------------------------------------------------------------------------ */
@@ -187,6 +192,11 @@ struct _GstVaapiVideoAllocator
   GstVideoInfo image_info;
   GstVaapiVideoPool *image_pool;
   GstVaapiImageUsageFlags usage_flag;
+  gboolean has_fused_upload;
+  GHashTable *derived_images;
+  GMutex derived_images_lock;
+  guint derive_calls_saved;
+  guint map_calls_saved;
 };
 
 /**
@@ -209,6 +219,10 @@ gst_vaapi_video_allocator_new (GstVaapiDisplay * display,
     const GstVideoInfo * alloc_info, guint surface_alloc_flags,
     GstVaapiImageUsageFlags req_usage_flag);
 
+G_GNUC_INTERNAL
+gboolean
+gst_vaapi_video_allocator_prewarm (GstAllocator * base_allocator, guint n);
+
 /* ------------------------------------------------------------------------ */
 /* --- GstVaapiDmaBufMemory                                             --- */
 /* ------------------------------------------------------------------------ */
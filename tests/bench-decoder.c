@@ -0,0 +1,856 @@
+/*
+ *  bench-decoder.c - Decoder throughput benchmark
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+/*
+ * This application decodes raw bitstreams as fast as possible, the
+ * same way the vaapidecode element does, i.e. with the parse() and
+ * decode() steps driven by the caller. Decoded surfaces are released
+ * right away. Each stream is decoded once without pipelining, and once
+ * with the requested pipeline depth.
+ *
+ * Several files can be given on the command line, so that a set of
+ * recorded elementary streams covers all the decoders. VP8 and VP9
+ * streams are read from IVF files. For each stream, the time spent in
+ * parse() and in decode(), the number of VA calls and of allocations
+ * per frame, and the frame latency percentiles are reported. Heap
+ * allocations are counted by wrapping malloc() and friends, with glibc
+ * only. Run with G_SLICE=always-malloc to count g_slice_alloc() calls
+ * as well, instead of the magazine refills only. With
+ * --json, the same figures are written out in machine readable form,
+ * for tracking the CPU cost of the decoders across releases. Running
+ * with --output=mock (configured with --enable-mock) takes the GPU out
+ * of the measurement.
+ */
+
+#include "gst/vaapi/sysdeps.h"
+#include <errno.h>
+#include <gst/base/gstadapter.h>
+#include <gst/vaapi/gstvaapidecoder.h>
+#include <gst/vaapi/gstvaapidecoder_h264.h>
+#if USE_H265_DECODER
+#include <gst/vaapi/gstvaapidecoder_h265.h>
+#endif
+#if USE_JPEG_DECODER
+#include <gst/vaapi/gstvaapidecoder_jpeg.h>
+#endif
+#include <gst/vaapi/gstvaapidecoder_mpeg2.h>
+#include <gst/vaapi/gstvaapidecoder_mpeg4.h>
+#include <gst/vaapi/gstvaapidecoder_vc1.h>
+#if USE_VP8_DECODER
+#include <gst/vaapi/gstvaapidecoder_vp8.h>
+#endif
+#if USE_VP9_DECODER
+#include <gst/vaapi/gstvaapidecoder_vp9.h>
+#endif
+#if USE_MOCK
+# include <gst/vaapi/gstvaapidisplay_mock.h>
+#endif
+#include <gst/vaapi/gstvaapisurfaceproxy.h>
+#include "gst/vaapi/gstvaapiarena.h"
+#include "gst/vaapi/gstvaapidecoder_priv.h"
+#include "gst/vaapi/gstvaapidecoder_objects.h"
+#include "codec.h"
+#include "output.h"
+
+#define IVF_FILE_HEADER_SIZE    32
+#define IVF_FRAME_HEADER_SIZE   12
+
+/* Counts the heap allocations of the whole process, i.e. g_malloc() and
+   friends, the GSlice allocator, and the libraries, by overriding the
+   malloc() entry points with wrappers around the glibc ones */
+#if defined (__GLIBC__)
+#define HAVE_HEAP_ALLOC_COUNTER 1
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+
+static volatile gint g_num_heap_allocs;
+
+void *
+malloc (size_t size)
+{
+  g_atomic_int_inc (&g_num_heap_allocs);
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+  g_atomic_int_inc (&g_num_heap_allocs);
+  return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  if (!ptr)
+    g_atomic_int_inc (&g_num_heap_allocs);
+  return __libc_realloc (ptr, size);
+}
+
+int
+posix_memalign (void **memptr, size_t alignment, size_t size)
+{
+  void *const ptr = __libc_memalign (alignment, size);
+
+  if (!ptr)
+    return ENOMEM;
+  g_atomic_int_inc (&g_num_heap_allocs);
+  *memptr = ptr;
+  return 0;
+}
+
+void *
+memalign (size_t alignment, size_t size)
+{
+  g_atomic_int_inc (&g_num_heap_allocs);
+  return __libc_memalign (alignment, size);
+}
+
+void *
+aligned_alloc (size_t alignment, size_t size)
+{
+  g_atomic_int_inc (&g_num_heap_allocs);
+  return __libc_memalign (alignment, size);
+}
+
+static inline guint
+get_num_heap_allocs (void)
+{
+  return g_atomic_int_get (&g_num_heap_allocs);
+}
+#else
+#define HAVE_HEAP_ALLOC_COUNTER 0
+
+static inline guint
+get_num_heap_allocs (void)
+{
+  return 0;
+}
+#endif
+
+static gchar *g_codec_str;
+static guint g_pipeline_depth = 2;
+static guint g_iterations = 1;
+static gchar *g_json_filename;
+
+static GOptionEntry g_options[] = {
+  {"codec", 'c',
+        0,
+        G_OPTION_ARG_STRING, &g_codec_str,
+      "suggested codec", NULL},
+  {"pipeline-depth", 'd',
+        0,
+        G_OPTION_ARG_INT, &g_pipeline_depth,
+      "number of frames parsed ahead of the decoded one", NULL},
+  {"iterations", 'n',
+        0,
+        G_OPTION_ARG_INT, &g_iterations,
+      "number of times each stream is decoded", NULL},
+  {"json", 'j',
+        0,
+        G_OPTION_ARG_FILENAME, &g_json_filename,
+      "write the results as JSON to the specified file (- for stdout)",
+      NULL},
+  {NULL,}
+};
+
+typedef struct
+{
+  GstVaapiDisplay *display;
+  GString *json;
+  guint num_streams;
+} App;
+
+typedef struct
+{
+  const gchar *filename;
+  GstVaapiCodec codec;
+  GMappedFile *file;
+  const guint8 *data;
+  gsize size;
+  GArray *ivf_frames;
+} Stream;
+
+typedef struct
+{
+  gsize offset;
+  gsize size;
+} IvfFrame;
+
+typedef struct
+{
+  guint num_frames;
+  guint num_frames_in;
+  gdouble elapsed;
+  gdouble parse_time;
+  gdouble decode_time;
+  GArray *latencies;
+} BenchResult;
+
+typedef struct
+{
+  GstVaapiDecoder *decoder;
+  BenchResult *result;
+  GArray *start_times;
+} BenchRun;
+
+/* Collects the frame offsets of an IVF file, i.e. the container used
+   for VP8 and VP9 elementary streams */
+static gboolean
+stream_parse_ivf (Stream * stream)
+{
+  const guint8 *const data = stream->data;
+  IvfFrame frame;
+  gsize offset;
+
+  if (stream->size < IVF_FILE_HEADER_SIZE || memcmp (data, "DKIF", 4) != 0)
+    return FALSE;
+
+  if (!stream->codec) {
+    if (memcmp (data + 8, "VP80", 4) == 0)
+      stream->codec = GST_VAAPI_CODEC_VP8;
+    else if (memcmp (data + 8, "VP90", 4) == 0)
+      stream->codec = GST_VAAPI_CODEC_VP9;
+  }
+
+  stream->ivf_frames = g_array_new (FALSE, FALSE, sizeof (IvfFrame));
+  offset = GST_READ_UINT16_LE (data + 6);
+  while (offset + IVF_FRAME_HEADER_SIZE <= stream->size) {
+    frame.size = GST_READ_UINT32_LE (data + offset);
+    frame.offset = offset + IVF_FRAME_HEADER_SIZE;
+    if (frame.size > stream->size - frame.offset)
+      break;
+    g_array_append_val (stream->ivf_frames, frame);
+    offset = frame.offset + frame.size;
+  }
+  return TRUE;
+}
+
+static GstVaapiDecoder *
+create_decoder (App * app, GstVaapiCodec codec)
+{
+  GstVaapiDecoder *decoder;
+  GstCaps *caps;
+
+  caps = caps_from_codec (codec);
+  if (!caps)
+    return NULL;
+
+  switch (codec) {
+    case GST_VAAPI_CODEC_H264:
+      decoder = gst_vaapi_decoder_h264_new (app->display, caps);
+      break;
+#if USE_H265_DECODER
+    case GST_VAAPI_CODEC_H265:
+      decoder = gst_vaapi_decoder_h265_new (app->display, caps);
+      break;
+#endif
+#if USE_JPEG_DECODER
+    case GST_VAAPI_CODEC_JPEG:
+      decoder = gst_vaapi_decoder_jpeg_new (app->display, caps);
+      break;
+#endif
+    case GST_VAAPI_CODEC_MPEG2:
+      decoder = gst_vaapi_decoder_mpeg2_new (app->display, caps);
+      break;
+    case GST_VAAPI_CODEC_MPEG4:
+      decoder = gst_vaapi_decoder_mpeg4_new (app->display, caps);
+      break;
+    case GST_VAAPI_CODEC_VC1:
+      decoder = gst_vaapi_decoder_vc1_new (app->display, caps);
+      break;
+#if USE_VP8_DECODER
+    case GST_VAAPI_CODEC_VP8:
+      decoder = gst_vaapi_decoder_vp8_new (app->display, caps);
+      break;
+#endif
+#if USE_VP9_DECODER
+    case GST_VAAPI_CODEC_VP9:
+      decoder = gst_vaapi_decoder_vp9_new (app->display, caps);
+      break;
+#endif
+    default:
+      decoder = NULL;
+      break;
+  }
+  gst_caps_unref (caps);
+  return decoder;
+}
+
+static GstVideoCodecFrame *
+create_frame (BenchRun * run, guint frame_number)
+{
+  GstVideoCodecFrame *frame;
+  gint64 start_time;
+
+  frame = g_slice_new0 (GstVideoCodecFrame);
+  frame->ref_count = 1;
+  frame->system_frame_number = frame_number;
+  frame->pts = GST_CLOCK_TIME_NONE;
+
+  start_time = g_get_monotonic_time ();
+  g_array_append_val (run->start_times, start_time);
+  return frame;
+}
+
+/* Releases all the decoded frames, once the hardware is done with them.
+   The latency of a frame runs from its first parse() call up to here */
+static void
+release_frames (BenchRun * run, guint64 timeout)
+{
+  GstVaapiDecoderStatus status;
+  GstVideoCodecFrame *frame;
+  GstVaapiSurfaceProxy *proxy;
+  gint64 start_time;
+  gdouble latency;
+
+  for (;;) {
+    frame = NULL;
+    status = gst_vaapi_decoder_get_frame_with_timeout (run->decoder, &frame,
+        timeout);
+    if (status != GST_VAAPI_DECODER_STATUS_SUCCESS) {
+      if (!frame)
+        break;
+      /* A frame that failed to decode with pipelined decoding */
+      g_printerr ("failed to decode frame %u (status %d)\n",
+          frame->system_frame_number, status);
+      gst_video_codec_frame_unref (frame);
+      continue;
+    }
+    if (!GST_VIDEO_CODEC_FRAME_IS_DECODE_ONLY (frame)) {
+      proxy = frame->user_data;
+      gst_vaapi_surface_sync (GST_VAAPI_SURFACE_PROXY_SURFACE (proxy));
+      start_time = g_array_index (run->start_times, gint64,
+          frame->system_frame_number);
+      latency = g_get_monotonic_time () - start_time;
+      g_array_append_val (run->result->latencies, latency);
+      run->result->num_frames++;
+    }
+    gst_video_codec_frame_unref (frame);
+    timeout = 0;
+  }
+}
+
+static gboolean
+decode_frame (BenchRun * run, GstVideoCodecFrame * frame)
+{
+  GstVaapiDecoderStatus status;
+  gint64 start_time;
+
+  for (;;) {
+    start_time = g_get_monotonic_time ();
+    status = gst_vaapi_decoder_decode (run->decoder, frame);
+    run->result->decode_time += (g_get_monotonic_time () - start_time) / 1.0e6;
+    if (status != GST_VAAPI_DECODER_STATUS_ERROR_NO_SURFACE)
+      break;
+
+    /* All surfaces are held by decoded frames we did not release yet */
+    release_frames (run, G_TIME_SPAN_SECOND);
+  }
+  if (status != GST_VAAPI_DECODER_STATUS_SUCCESS) {
+    g_printerr ("failed to decode frame %u (status %d)\n",
+        frame->system_frame_number, status);
+    return FALSE;
+  }
+
+  run->result->num_frames_in++;
+  release_frames (run, 0);
+  return TRUE;
+}
+
+/* Parses and decodes all the frames available from the input adapter */
+static gboolean
+decode_input (BenchRun * run, GstAdapter * input_adapter,
+    GstAdapter * output_adapter, GstVideoCodecFrame ** frame_ptr)
+{
+  GstVideoCodecFrame *frame;
+  GstVaapiDecoderStatus status;
+  GstBuffer *buffer;
+  guint got_unit_size;
+  gboolean got_frame;
+  gint64 start_time;
+
+  for (;;) {
+    if (!*frame_ptr)
+      *frame_ptr = create_frame (run, run->start_times->len);
+    frame = *frame_ptr;
+
+    start_time = g_get_monotonic_time ();
+    status = gst_vaapi_decoder_parse (run->decoder, frame, input_adapter,
+        TRUE, &got_unit_size, &got_frame);
+    run->result->parse_time += (g_get_monotonic_time () - start_time) / 1.0e6;
+    if (status == GST_VAAPI_DECODER_STATUS_ERROR_NO_DATA)
+      break;
+    if (status != GST_VAAPI_DECODER_STATUS_SUCCESS) {
+      g_printerr ("failed to parse frame %u (status %d)\n",
+          frame->system_frame_number, status);
+      return FALSE;
+    }
+
+    if (got_unit_size > 0) {
+      buffer = gst_adapter_take_buffer (input_adapter, got_unit_size);
+      gst_adapter_push (output_adapter, buffer);
+    }
+    if (!got_frame)
+      continue;
+
+    frame->input_buffer = gst_adapter_take_buffer (output_adapter,
+        gst_adapter_available (output_adapter));
+    if (!decode_frame (run, frame))
+      return FALSE;
+    gst_video_codec_frame_unref (frame);
+    *frame_ptr = NULL;
+  }
+  return TRUE;
+}
+
+static GstBuffer *
+wrap_data (const guint8 * data, gsize size)
+{
+  return gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+      (gpointer) data, size, 0, size, NULL, NULL);
+}
+
+static gboolean
+run_decoder (App * app, Stream * stream, guint pipeline_depth,
+    BenchResult * result)
+{
+  BenchRun run;
+  GstAdapter *input_adapter, *output_adapter;
+  GstVideoCodecFrame *frame = NULL;
+  GstVaapiDecoderStatus status;
+  gboolean success = FALSE;
+  gint64 start_time;
+  guint i;
+
+  run.decoder = create_decoder (app, stream->codec);
+  if (!run.decoder) {
+    g_printerr ("failed to create %s decoder\n",
+        string_from_codec (stream->codec));
+    return FALSE;
+  }
+  gst_vaapi_decoder_set_pipeline_depth (run.decoder, pipeline_depth);
+  run.result = result;
+  run.start_times = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  input_adapter = gst_adapter_new ();
+  output_adapter = gst_adapter_new ();
+
+  start_time = g_get_monotonic_time ();
+  if (stream->ivf_frames) {
+    /* The VP8 and VP9 parsers expect exactly one frame per buffer */
+    for (i = 0; i < stream->ivf_frames->len; i++) {
+      const IvfFrame *const f =
+          &g_array_index (stream->ivf_frames, IvfFrame, i);
+
+      gst_adapter_push (input_adapter,
+          wrap_data (stream->data + f->offset, f->size));
+      if (!decode_input (&run, input_adapter, output_adapter, &frame))
+        goto cleanup;
+    }
+  } else {
+    gst_adapter_push (input_adapter, wrap_data (stream->data, stream->size));
+    if (!decode_input (&run, input_adapter, output_adapter, &frame))
+      goto cleanup;
+  }
+
+  status = gst_vaapi_decoder_flush (run.decoder);
+  if (status != GST_VAAPI_DECODER_STATUS_SUCCESS) {
+    g_printerr ("failed to flush decoder (status %d)\n", status);
+    goto cleanup;
+  }
+  release_frames (&run, 0);
+  result->elapsed += (g_get_monotonic_time () - start_time) / 1.0e6;
+  success = TRUE;
+
+cleanup:
+  if (frame)
+    gst_video_codec_frame_unref (frame);
+  g_object_unref (input_adapter);
+  g_object_unref (output_adapter);
+  g_array_free (run.start_times, TRUE);
+  gst_vaapi_decoder_unref (run.decoder);
+  return success;
+}
+
+static gint
+compare_double (gconstpointer a, gconstpointer b)
+{
+  const gdouble x = *(const gdouble *) a;
+  const gdouble y = *(const gdouble *) b;
+
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* Nearest-rank percentile of the sorted latencies, in microseconds */
+static gdouble
+get_latency_percentile (GArray * latencies, guint percent)
+{
+  guint rank;
+
+  if (latencies->len == 0)
+    return 0;
+
+  rank = (latencies->len * percent + 99) / 100;
+  return g_array_index (latencies, gdouble, MAX (rank, 1) - 1);
+}
+
+static gdouble
+per_frame (gdouble value, guint num_frames)
+{
+  return num_frames > 0 ? value / num_frames : 0;
+}
+
+/* Resets the VA driver counters, if the display is a mock one */
+static gboolean
+mock_reset_stats (GstVaapiDisplay * display)
+{
+#if USE_MOCK
+  if (gst_vaapi_display_get_class_type (display) ==
+      GST_VAAPI_DISPLAY_TYPE_MOCK) {
+    gst_vaapi_display_mock_reset_stats (GST_VAAPI_DISPLAY_MOCK (display));
+    return TRUE;
+  }
+#endif
+  return FALSE;
+}
+
+static void
+mock_get_stats (GstVaapiDisplay * display, guint * num_va_calls_ptr,
+    guint * num_buffers_ptr)
+{
+#if USE_MOCK
+  GstVaapiDisplayMockStats stats;
+
+  gst_vaapi_display_mock_get_stats (GST_VAAPI_DISPLAY_MOCK (display), &stats);
+  *num_va_calls_ptr = stats.num_va_calls;
+  *num_buffers_ptr = stats.num_buffers;
+#else
+  *num_va_calls_ptr = 0;
+  *num_buffers_ptr = 0;
+#endif
+}
+
+static void
+json_append_string (GString * json, const gchar * str)
+{
+  const gchar *p;
+
+  g_string_append_c (json, '"');
+  for (p = str; *p != '\0'; p++) {
+    if (*p == '"' || *p == '\\')
+      g_string_append_printf (json, "\\%c", *p);
+    else if ((guchar) * p < 0x20)
+      g_string_append_printf (json, "\\u%04x", (guchar) * p);
+    else
+      g_string_append_c (json, *p);
+  }
+  g_string_append_c (json, '"');
+}
+
+/* Doubles are formatted regardless of the current locale */
+static void
+json_append_double (GString * json, const gchar * name, gdouble value)
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_string_append_printf (json, ",\n        \"%s\": %s", name,
+      g_ascii_formatd (buf, sizeof (buf), "%.3f", value));
+}
+
+static gboolean
+bench_decoder (App * app, Stream * stream, guint pipeline_depth,
+    BenchResult * result)
+{
+  GstVaapiArenaStats stats_before, stats;
+  GstVaapiDecoderRefListStats ref_stats_before, ref_stats;
+  GstVaapiSliceDataStats slice_stats_before, slice_stats;
+  GstVaapiPictureDecodeStats decode_stats_before, decode_stats;
+  guint num_driver_calls = 0, num_driver_buffers = 0;
+  gboolean is_mock;
+  guint i, num_objects, num_arena_allocs, num_pictures, num_va_calls;
+  guint num_heap_allocs;
+  gdouble p50, p99;
+
+  memset (result, 0, sizeof (*result));
+  result->latencies = g_array_new (FALSE, FALSE, sizeof (gdouble));
+
+  is_mock = mock_reset_stats (app->display);
+
+  gst_vaapi_arena_get_stats (&stats_before);
+  gst_vaapi_decoder_get_ref_list_stats (&ref_stats_before);
+  gst_vaapi_slice_get_data_stats (&slice_stats_before);
+  gst_vaapi_picture_get_decode_stats (&decode_stats_before);
+  num_heap_allocs = get_num_heap_allocs ();
+  for (i = 0; i < g_iterations; i++) {
+    if (!run_decoder (app, stream, pipeline_depth, result))
+      return FALSE;
+  }
+  num_heap_allocs = get_num_heap_allocs () - num_heap_allocs;
+  gst_vaapi_arena_get_stats (&stats);
+  gst_vaapi_decoder_get_ref_list_stats (&ref_stats);
+  gst_vaapi_slice_get_data_stats (&slice_stats);
+  gst_vaapi_picture_get_decode_stats (&decode_stats);
+  if (is_mock)
+    mock_get_stats (app->display, &num_driver_calls, &num_driver_buffers);
+
+  g_array_sort (result->latencies, compare_double);
+  p50 = get_latency_percentile (result->latencies, 50);
+  p99 = get_latency_percentile (result->latencies, 99);
+
+  g_print ("  pipeline-depth %u: %u frames in %.2f sec (%.1f fps)\n",
+      pipeline_depth, result->num_frames, result->elapsed,
+      result->elapsed > 0 ? result->num_frames / result->elapsed : 0);
+  g_print ("    %.1f us parse, %.1f us decode per frame, "
+      "latency p50 %.1f us, p99 %.1f us\n",
+      per_frame (result->parse_time * 1.0e6, result->num_frames_in),
+      per_frame (result->decode_time * 1.0e6, result->num_frames_in), p50, p99);
+
+  /* Without the arena, each object would be a separate heap allocation.
+     With it, only new arena blocks and objects that did not fit in the
+     arena (cache misses) are */
+  num_objects = (stats.num_allocs - stats_before.num_allocs) +
+      (stats.num_fallbacks - stats_before.num_fallbacks);
+  num_arena_allocs = (stats.num_blocks - stats_before.num_blocks) +
+      (stats.num_fallbacks - stats_before.num_fallbacks);
+  g_print ("    %u short-lived objects, %u arena blocks and cache misses "
+      "(%u arena blocks reused)\n", num_objects, num_arena_allocs,
+      stats.num_resets - stats_before.num_resets);
+  if (HAVE_HEAP_ALLOC_COUNTER)
+    g_print ("    %u heap allocations (%.1f per frame)\n", num_heap_allocs,
+        per_frame (num_heap_allocs, result->num_frames_in));
+  g_print ("    %u reference list builds, %u reused from the previous slice\n",
+      ref_stats.num_builds - ref_stats_before.num_builds,
+      ref_stats.num_hits - ref_stats_before.num_hits);
+  g_print ("    %" G_GSIZE_FORMAT " slice data bytes copied into %u buffers\n",
+      slice_stats.num_bytes - slice_stats_before.num_bytes,
+      slice_stats.num_buffers - slice_stats_before.num_buffers);
+
+  num_pictures = decode_stats.num_pictures - decode_stats_before.num_pictures;
+  num_va_calls = decode_stats.num_va_calls - decode_stats_before.num_va_calls;
+  g_print ("    %u pictures submitted with %.1f VA calls per picture "
+      "(%u slice buffers created)\n", num_pictures,
+      per_frame (num_va_calls, num_pictures),
+      decode_stats.num_slice_buffers - decode_stats_before.num_slice_buffers);
+  if (is_mock)
+    g_print ("    %u VA driver calls, %u VA buffers created\n",
+        num_driver_calls, num_driver_buffers);
+
+  if (app->json) {
+    GString *const json = app->json;
+
+    g_string_append_printf (json, "%s\n      {\n"
+        "        \"pipeline_depth\": %u,\n"
+        "        \"frames\": %u", pipeline_depth > 0 ? "," : "",
+        pipeline_depth, result->num_frames);
+    json_append_double (json, "elapsed_sec", result->elapsed);
+    json_append_double (json, "fps", result->elapsed > 0 ?
+        result->num_frames / result->elapsed : 0);
+    json_append_double (json, "parse_us_per_frame",
+        per_frame (result->parse_time * 1.0e6, result->num_frames_in));
+    json_append_double (json, "decode_us_per_frame",
+        per_frame (result->decode_time * 1.0e6, result->num_frames_in));
+    json_append_double (json, "va_calls_per_frame",
+        per_frame (num_va_calls, result->num_frames_in));
+    if (is_mock)
+      json_append_double (json, "driver_calls_per_frame",
+          per_frame (num_driver_calls, result->num_frames_in));
+    json_append_double (json, "objects_per_frame",
+        per_frame (num_objects, result->num_frames_in));
+    json_append_double (json, "arena_blocks_plus_cache_misses_per_frame",
+        per_frame (num_arena_allocs, result->num_frames_in));
+    if (HAVE_HEAP_ALLOC_COUNTER)
+      json_append_double (json, "heap_allocs_per_frame",
+          per_frame (num_heap_allocs, result->num_frames_in));
+    json_append_double (json, "latency_p50_us", p50);
+    json_append_double (json, "latency_p99_us", p99);
+    g_string_append (json, "\n      }");
+  }
+  return TRUE;
+}
+
+static void
+bench_result_clear (BenchResult * result)
+{
+  if (result->latencies) {
+    g_array_free (result->latencies, TRUE);
+    result->latencies = NULL;
+  }
+}
+
+static gboolean
+stream_open (Stream * stream, const gchar * filename)
+{
+  stream->filename = filename;
+  stream->codec = identify_codec_from_string (g_codec_str);
+
+  stream->file = g_mapped_file_new (filename, FALSE, NULL);
+  if (!stream->file) {
+    g_printerr ("failed to open '%s'\n", filename);
+    return FALSE;
+  }
+  stream->data = (const guint8 *) g_mapped_file_get_contents (stream->file);
+  stream->size = g_mapped_file_get_length (stream->file);
+
+  if (!stream_parse_ivf (stream) && !stream->codec)
+    stream->codec = identify_codec (filename);
+  if (!stream->codec) {
+    g_printerr ("failed to identify codec for '%s'\n", filename);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static void
+stream_close (Stream * stream)
+{
+  if (stream->ivf_frames)
+    g_array_free (stream->ivf_frames, TRUE);
+  if (stream->file)
+    g_mapped_file_unref (stream->file);
+  memset (stream, 0, sizeof (*stream));
+}
+
+static gboolean
+bench_stream (App * app, Stream * stream)
+{
+  BenchResult ref_result = { 0, };
+  BenchResult result = { 0, };
+  gboolean success = FALSE;
+
+  g_print ("Decoder benchmark (%s, %s bitstream, %" G_GSIZE_FORMAT
+      " bytes)\n", stream->filename, string_from_codec (stream->codec),
+      stream->size);
+
+  if (app->json) {
+    g_string_append (app->json, app->num_streams > 0 ? ",\n" : "\n");
+    g_string_append (app->json, "    {\n      \"file\": ");
+    json_append_string (app->json, stream->filename);
+    g_string_append_printf (app->json, ",\n      \"codec\": \"%s\",\n"
+        "      \"size\": %" G_GSIZE_FORMAT ",\n      \"runs\": [",
+        string_from_codec (stream->codec), stream->size);
+  }
+  app->num_streams++;
+
+  if (!bench_decoder (app, stream, 0, &ref_result))
+    goto cleanup;
+  if (g_pipeline_depth > 0) {
+    if (!bench_decoder (app, stream, g_pipeline_depth, &result))
+      goto cleanup;
+    if (result.num_frames != ref_result.num_frames) {
+      g_printerr ("frame count mismatch: %u vs %u\n", result.num_frames,
+          ref_result.num_frames);
+      goto cleanup;
+    }
+    if (result.elapsed > 0)
+      g_print ("  speedup: %.2fx\n", ref_result.elapsed / result.elapsed);
+  }
+  success = TRUE;
+
+cleanup:
+  if (app->json)
+    g_string_append (app->json, "\n      ]\n    }");
+  bench_result_clear (&ref_result);
+  bench_result_clear (&result);
+  return success;
+}
+
+static gboolean
+write_json (App * app)
+{
+  GError *error = NULL;
+
+  g_string_append (app->json, "\n  ]\n}\n");
+  if (strcmp (g_json_filename, "-") == 0) {
+    fputs (app->json->str, stdout);
+    return TRUE;
+  }
+  if (!g_file_set_contents (g_json_filename, app->json->str, app->json->len,
+          &error)) {
+    g_printerr ("failed to write '%s': %s\n", g_json_filename,
+        error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean
+app_run (App * app, gint num_files, gchar * filenames[])
+{
+  Stream stream = { NULL, };
+  gboolean success = TRUE;
+  gint i;
+
+  app->display = video_output_create_display (NULL);
+  if (!app->display) {
+    g_printerr ("failed to create VA display\n");
+    return FALSE;
+  }
+
+  if (g_json_filename) {
+    app->json = g_string_new ("{\n");
+    g_string_append (app->json, "  \"display\": ");
+    json_append_string (app->json,
+        gst_vaapi_display_get_display_name (app->display) ?
+        gst_vaapi_display_get_display_name (app->display) : "");
+    g_string_append_printf (app->json, ",\n  \"iterations\": %u,\n"
+        "  \"streams\": [", g_iterations);
+  }
+
+  /* A broken stream does not prevent benchmarking the other ones */
+  for (i = 0; i < num_files; i++) {
+    if (!stream_open (&stream, filenames[i]) || !bench_stream (app, &stream))
+      success = FALSE;
+    stream_close (&stream);
+  }
+
+  if (app->json && !write_json (app))
+    success = FALSE;
+  return success;
+}
+
+int
+main (int argc, char *argv[])
+{
+  App app = { NULL, };
+  gboolean success;
+
+  if (!video_output_init (&argc, argv, g_options))
+    g_error ("failed to initialize video output subsystem");
+
+  if (argc < 2) {
+    g_printerr ("no bitstream file specified\n");
+    success = FALSE;
+  } else
+    success = app_run (&app, argc - 1, &argv[1]);
+
+  gst_vaapi_display_replace (&app.display, NULL);
+  if (app.json)
+    g_string_free (app.json, TRUE);
+  g_free (g_codec_str);
+  g_free (g_json_filename);
+  video_output_exit ();
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
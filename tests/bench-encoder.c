@@ -0,0 +1,680 @@
+/*
+ *  bench-encoder.c - Encoder throughput benchmark
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+/*
+ * This application feeds the frames of a Y4M file to the encoders as
+ * fast as possible, the same way the vaapiencode elements do, i.e.
+ * with put_frame() and get_buffer() driven by the caller, and with
+ * the coded buffers copied into regular buffers. The frames are read
+ * once and kept in VA images, so that file I/O is not measured.
+ *
+ * Each of the selected encoders is run in turn. The time spent
+ * uploading the frames, in put_frame() and get_buffer(), generating
+ * the packed headers and in gst_vaapi_coded_buffer_copy_into() is
+ * reported, along with the frame latency percentiles. With --json,
+ * the same figures are written out in machine readable form.
+ *
+ * The --slices option splits the frames into several slices with the
+ * encoders that support it, so that the cost of the packed slice
+ * headers, reported per header, can be measured.
+ */
+
+#include "gst/vaapi/sysdeps.h"
+#include <gst/vaapi/gstvaapiencoder_h264.h>
+#if USE_H265_ENCODER
+#include <gst/vaapi/gstvaapiencoder_h265.h>
+#endif
+#if USE_JPEG_ENCODER
+#include <gst/vaapi/gstvaapiencoder_jpeg.h>
+#endif
+#include <gst/vaapi/gstvaapiencoder_mpeg2.h>
+#if USE_VP8_ENCODER
+#include <gst/vaapi/gstvaapiencoder_vp8.h>
+#endif
+#if USE_VP9_ENCODER
+#include <gst/vaapi/gstvaapiencoder_vp9.h>
+#endif
+#include <gst/vaapi/gstvaapisurfacepool.h>
+#include <gst/vaapi/gstvaapisurfaceproxy.h>
+#include "gst/vaapi/gstvaapiencoder_objects.h"
+#include "output.h"
+#include "y4mreader.h"
+
+static gchar *g_codec_str;
+static guint g_bitrate;
+static guint g_in_flight = 4;
+static guint g_num_slices;
+static guint g_lookahead;
+static guint g_max_frames;
+static guint g_iterations = 1;
+static gchar *g_json_filename;
+
+static GOptionEntry g_options[] = {
+  {"codec", 'c',
+        0,
+        G_OPTION_ARG_STRING, &g_codec_str,
+      "comma separated list of encoders to run (default: all)", NULL},
+  {"bitrate", 'b',
+        0,
+        G_OPTION_ARG_INT, &g_bitrate,
+      "desired bitrate expressed in kbps", NULL},
+  {"in-flight", 'd',
+        0,
+        G_OPTION_ARG_INT, &g_in_flight,
+      "number of frames submitted ahead of the retrieved one", NULL},
+  {"slices", 's',
+        0,
+        G_OPTION_ARG_INT, &g_num_slices,
+      "number of slices per frame, for the encoders that support it", NULL},
+  {"lookahead", 'l',
+        0,
+        G_OPTION_ARG_INT, &g_lookahead,
+      "number of frames analysed ahead for scene cut detection", NULL},
+  {"frames", 'f',
+        0,
+        G_OPTION_ARG_INT, &g_max_frames,
+      "maximum number of frames read from the input file", NULL},
+  {"iterations", 'n',
+        0,
+        G_OPTION_ARG_INT, &g_iterations,
+      "number of times the frames are encoded", NULL},
+  {"json", 'j',
+        0,
+        G_OPTION_ARG_FILENAME, &g_json_filename,
+      "write the results as JSON to the specified file (- for stdout)",
+      NULL},
+  {NULL,}
+};
+
+typedef GstVaapiEncoder *(*CreateEncoderFunc) (GstVaapiDisplay * display);
+
+typedef struct
+{
+  const gchar *name;
+  CreateEncoderFunc create;
+  gint num_slices_prop;         /* 0 if the encoder has no such property */
+} EncoderInfo;
+
+static const EncoderInfo g_encoders[] = {
+  {"h264", gst_vaapi_encoder_h264_new, GST_VAAPI_ENCODER_H264_PROP_NUM_SLICES},
+#if USE_H265_ENCODER
+  {"h265", gst_vaapi_encoder_h265_new, GST_VAAPI_ENCODER_H265_PROP_NUM_SLICES},
+#endif
+  {"mpeg2", gst_vaapi_encoder_mpeg2_new, 0},
+#if USE_VP8_ENCODER
+  {"vp8", gst_vaapi_encoder_vp8_new, 0},
+#endif
+#if USE_VP9_ENCODER
+  {"vp9", gst_vaapi_encoder_vp9_new, 0},
+#endif
+#if USE_JPEG_ENCODER
+  {"jpeg", gst_vaapi_encoder_jpeg_new, 0},
+#endif
+  {NULL,}
+};
+
+typedef struct
+{
+  GstVaapiDisplay *display;
+  Y4MReader *parser;
+  GPtrArray *images;
+  GString *json;
+  guint num_runs;
+} App;
+
+typedef struct
+{
+  guint num_frames;
+  gsize num_bytes;
+  gdouble elapsed;
+  gdouble upload_time;
+  gdouble copy_time;
+  GArray *put_times;
+  GArray *get_times;
+  GArray *latencies;
+  GstVaapiEncPackedHeaderStats header_stats;
+} BenchResult;
+
+typedef struct
+{
+  GstVaapiEncoder *encoder;
+  BenchResult *result;
+  GArray *start_times;
+  guint num_frames_in;
+  guint num_frames_out;
+} BenchRun;
+
+static gboolean
+set_format (GstVaapiEncoder * encoder, Y4MReader * parser)
+{
+  GstVideoCodecState *in_state;
+  GstVaapiEncoderStatus status;
+
+  in_state = g_slice_new0 (GstVideoCodecState);
+  in_state->ref_count = 1;
+  gst_video_info_set_format (&in_state->info, GST_VIDEO_FORMAT_ENCODED,
+      parser->width, parser->height);
+  in_state->info.fps_n = parser->fps_n;
+  in_state->info.fps_d = parser->fps_d;
+
+  status = gst_vaapi_encoder_set_codec_state (encoder, in_state);
+  g_slice_free (GstVideoCodecState, in_state);
+  return status == GST_VAAPI_ENCODER_STATUS_SUCCESS;
+}
+
+/* Reads all the frames, up to --frames, into I420 images */
+static gboolean
+load_images (App * app)
+{
+  GstVaapiImage *image;
+  gboolean success;
+
+  app->images = g_ptr_array_new_with_free_func (gst_vaapi_object_unref);
+  while (g_max_frames == 0 || app->images->len < g_max_frames) {
+    image = gst_vaapi_image_new (app->display, GST_VIDEO_FORMAT_I420,
+        app->parser->width, app->parser->height);
+    if (!image || !gst_vaapi_image_map (image)) {
+      g_printerr ("failed to create %ux%u image\n", app->parser->width,
+          app->parser->height);
+      if (image)
+        gst_vaapi_object_unref (image);
+      return FALSE;
+    }
+    success = y4m_reader_load_image (app->parser, image);
+    gst_vaapi_image_unmap (image);
+    if (!success) {
+      gst_vaapi_object_unref (image);
+      break;
+    }
+    g_ptr_array_add (app->images, image);
+  }
+  return app->images->len > 0;
+}
+
+/* Copies out all the coded buffers available, or waits for one of
+   them at most @timeout microseconds. The latency of a frame runs from
+   its upload up to the copy of its coded buffer */
+static gboolean
+retrieve_buffers (BenchRun * run, guint64 timeout, gboolean drain)
+{
+  BenchResult *const result = run->result;
+  GstVaapiCodedBufferProxy *proxy;
+  GstVaapiCodedBuffer *coded_buf;
+  GstVaapiEncoderStatus status;
+  GstVideoCodecFrame *frame;
+  GstBuffer *buffer;
+  gint64 start_time, end_time;
+  gdouble elapsed;
+  gssize size;
+  gboolean success;
+
+  while (drain || run->num_frames_in - run->num_frames_out > g_in_flight) {
+    start_time = g_get_monotonic_time ();
+    status = gst_vaapi_encoder_get_buffer_with_timeout (run->encoder, &proxy,
+        timeout);
+    if (status == GST_VAAPI_ENCODER_STATUS_NO_BUFFER)
+      break;
+    if (status != GST_VAAPI_ENCODER_STATUS_SUCCESS) {
+      g_printerr ("failed to get coded buffer (status %d)\n", status);
+      return FALSE;
+    }
+    end_time = g_get_monotonic_time ();
+    elapsed = end_time - start_time;
+    g_array_append_val (result->get_times, elapsed);
+
+    coded_buf = GST_VAAPI_CODED_BUFFER_PROXY_BUFFER (proxy);
+    size = gst_vaapi_coded_buffer_get_size (coded_buf);
+    if (size <= 0) {
+      g_printerr ("invalid coded buffer size (%" G_GSSIZE_FORMAT ")\n", size);
+      gst_vaapi_coded_buffer_proxy_unref (proxy);
+      return FALSE;
+    }
+    buffer = gst_buffer_new_allocate (NULL, size, NULL);
+    success = gst_vaapi_coded_buffer_copy_into (buffer, coded_buf);
+    gst_buffer_unref (buffer);
+
+    start_time = end_time;
+    end_time = g_get_monotonic_time ();
+    result->copy_time += (end_time - start_time) / 1.0e6;
+    if (!success) {
+      g_printerr ("failed to copy coded buffer\n");
+      gst_vaapi_coded_buffer_proxy_unref (proxy);
+      return FALSE;
+    }
+
+    frame = gst_vaapi_coded_buffer_proxy_get_user_data (proxy);
+    elapsed = end_time - g_array_index (run->start_times, gint64,
+        frame->system_frame_number);
+    g_array_append_val (result->latencies, elapsed);
+    gst_vaapi_coded_buffer_proxy_unref (proxy);
+
+    result->num_bytes += size;
+    result->num_frames++;
+    run->num_frames_out++;
+    timeout = 0;
+  }
+  return TRUE;
+}
+
+static gboolean
+encode_frame (BenchRun * run, GstVaapiVideoPool * pool, GstVaapiImage * image)
+{
+  BenchResult *const result = run->result;
+  GstVaapiSurfaceProxy *proxy;
+  GstVaapiEncoderStatus status;
+  GstVideoCodecFrame *frame;
+  gint64 start_time, end_time;
+  gdouble elapsed;
+
+  start_time = g_get_monotonic_time ();
+  g_array_append_val (run->start_times, start_time);
+
+  proxy = gst_vaapi_surface_proxy_new_from_pool (GST_VAAPI_SURFACE_POOL (pool));
+  if (!proxy) {
+    g_printerr ("failed to allocate surface\n");
+    return FALSE;
+  }
+  if (!gst_vaapi_surface_put_image (GST_VAAPI_SURFACE_PROXY_SURFACE (proxy),
+          image)) {
+    g_printerr ("failed to upload frame %u\n", run->num_frames_in);
+    gst_vaapi_surface_proxy_unref (proxy);
+    return FALSE;
+  }
+  end_time = g_get_monotonic_time ();
+  result->upload_time += (end_time - start_time) / 1.0e6;
+
+  frame = g_slice_new0 (GstVideoCodecFrame);
+  frame->ref_count = 1;
+  frame->system_frame_number = run->num_frames_in;
+  gst_video_codec_frame_set_user_data (frame, proxy,
+      (GDestroyNotify) gst_vaapi_surface_proxy_unref);
+
+  start_time = end_time;
+  status = gst_vaapi_encoder_put_frame (run->encoder, frame);
+  elapsed = g_get_monotonic_time () - start_time;
+  g_array_append_val (result->put_times, elapsed);
+  gst_video_codec_frame_unref (frame);
+  if (status != GST_VAAPI_ENCODER_STATUS_SUCCESS) {
+    g_printerr ("failed to encode frame %u (status %d)\n",
+        run->num_frames_in, status);
+    return FALSE;
+  }
+  run->num_frames_in++;
+
+  /* Frames held back for reordering cannot be retrieved yet, so this
+     does not wait for a coded buffer */
+  return retrieve_buffers (run, 0, FALSE);
+}
+
+static gboolean
+run_encoder (App * app, const EncoderInfo * info, GstVaapiVideoPool * pool,
+    BenchResult * result)
+{
+  BenchRun run;
+  GstVaapiEncoderStatus status;
+  gboolean success = FALSE;
+  gint64 start_time;
+  guint i;
+
+  run.encoder = info->create (app->display);
+  if (!run.encoder)
+    return FALSE;
+  gst_vaapi_enc_packed_header_collect_stats (run.encoder,
+      &result->header_stats);
+  gst_vaapi_encoder_set_bitrate (run.encoder, g_bitrate);
+  gst_vaapi_encoder_set_lookahead (run.encoder, g_lookahead);
+  if (g_num_slices > 0 && info->num_slices_prop != 0) {
+    GValue value = G_VALUE_INIT;
+
+    g_value_init (&value, G_TYPE_UINT);
+    g_value_set_uint (&value, g_num_slices);
+    gst_vaapi_encoder_set_property (run.encoder, info->num_slices_prop,
+        &value);
+    g_value_unset (&value);
+  }
+  if (!set_format (run.encoder, app->parser)) {
+    gst_vaapi_encoder_unref (run.encoder);
+    return FALSE;
+  }
+  run.result = result;
+  run.start_times = g_array_new (FALSE, FALSE, sizeof (gint64));
+  run.num_frames_in = 0;
+  run.num_frames_out = 0;
+
+  start_time = g_get_monotonic_time ();
+  for (i = 0; i < app->images->len; i++) {
+    if (!encode_frame (&run, pool, g_ptr_array_index (app->images, i)))
+      goto cleanup;
+  }
+
+  status = gst_vaapi_encoder_flush (run.encoder);
+  if (status != GST_VAAPI_ENCODER_STATUS_SUCCESS) {
+    g_printerr ("failed to flush encoder (status %d)\n", status);
+    goto cleanup;
+  }
+  if (!retrieve_buffers (&run, G_TIME_SPAN_SECOND, TRUE))
+    goto cleanup;
+  result->elapsed += (g_get_monotonic_time () - start_time) / 1.0e6;
+  success = TRUE;
+
+cleanup:
+  g_array_free (run.start_times, TRUE);
+  gst_vaapi_encoder_unref (run.encoder);
+  return success;
+}
+
+static gint
+compare_double (gconstpointer a, gconstpointer b)
+{
+  const gdouble x = *(const gdouble *) a;
+  const gdouble y = *(const gdouble *) b;
+
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* Nearest-rank percentile of the sorted values */
+static gdouble
+get_percentile (GArray * values, guint percent)
+{
+  guint rank;
+
+  if (values->len == 0)
+    return 0;
+
+  rank = (values->len * percent + 99) / 100;
+  return g_array_index (values, gdouble, MAX (rank, 1) - 1);
+}
+
+static gdouble
+get_mean (GArray * values)
+{
+  gdouble sum = 0;
+  guint i;
+
+  for (i = 0; i < values->len; i++)
+    sum += g_array_index (values, gdouble, i);
+  return values->len > 0 ? sum / values->len : 0;
+}
+
+static gdouble
+per_frame (gdouble value, guint num_frames)
+{
+  return num_frames > 0 ? value / num_frames : 0;
+}
+
+static void
+json_append_string (GString * json, const gchar * str)
+{
+  const gchar *p;
+
+  g_string_append_c (json, '"');
+  for (p = str; *p != '\0'; p++) {
+    if (*p == '"' || *p == '\\')
+      g_string_append_printf (json, "\\%c", *p);
+    else if ((guchar) * p < 0x20)
+      g_string_append_printf (json, "\\u%04x", (guchar) * p);
+    else
+      g_string_append_c (json, *p);
+  }
+  g_string_append_c (json, '"');
+}
+
+/* Doubles are formatted regardless of the current locale */
+static void
+json_append_double (GString * json, const gchar * name, gdouble value)
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_string_append_printf (json, ",\n      \"%s\": %s", name,
+      g_ascii_formatd (buf, sizeof (buf), "%.3f", value));
+}
+
+static void
+bench_result_clear (BenchResult * result)
+{
+  if (result->put_times)
+    g_array_free (result->put_times, TRUE);
+  if (result->get_times)
+    g_array_free (result->get_times, TRUE);
+  if (result->latencies)
+    g_array_free (result->latencies, TRUE);
+  memset (result, 0, sizeof (*result));
+}
+
+static gboolean
+bench_encoder (App * app, const EncoderInfo * info)
+{
+  GstVaapiVideoPool *pool;
+  GstVideoInfo vi;
+  BenchResult result = { 0, };
+  gdouble put_p50, put_p99, get_p50, get_p99, lat_p50, lat_p99;
+  guint i, num_headers;
+  gdouble header_time;
+  gboolean success = FALSE;
+
+  result.put_times = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  result.get_times = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  result.latencies = g_array_new (FALSE, FALSE, sizeof (gdouble));
+
+  gst_video_info_set_format (&vi, GST_VIDEO_FORMAT_ENCODED,
+      app->parser->width, app->parser->height);
+  pool = gst_vaapi_surface_pool_new_full (app->display, &vi, 0);
+  if (!pool) {
+    g_printerr ("failed to create surface pool\n");
+    goto cleanup;
+  }
+
+  for (i = 0; i < g_iterations; i++) {
+    if (!run_encoder (app, info, pool, &result)) {
+      /* The encoder could not even be configured, most likely because
+         the VA driver does not support it */
+      if (i == 0 && result.put_times->len == 0) {
+        g_print ("  %s: not supported\n", info->name);
+        success = TRUE;
+      } else
+        g_printerr ("failed to run %s encoder\n", info->name);
+      goto cleanup;
+    }
+  }
+  num_headers = result.header_stats.num_headers;
+  header_time = result.header_stats.elapsed / 1.0e6;
+
+  g_array_sort (result.put_times, compare_double);
+  g_array_sort (result.get_times, compare_double);
+  g_array_sort (result.latencies, compare_double);
+  put_p50 = get_percentile (result.put_times, 50);
+  put_p99 = get_percentile (result.put_times, 99);
+  get_p50 = get_percentile (result.get_times, 50);
+  get_p99 = get_percentile (result.get_times, 99);
+  lat_p50 = get_percentile (result.latencies, 50);
+  lat_p99 = get_percentile (result.latencies, 99);
+
+  g_print ("  %s: %u frames in %.2f sec (%.1f fps), %" G_GSIZE_FORMAT
+      " coded bytes\n", info->name, result.num_frames, result.elapsed,
+      result.elapsed > 0 ? result.num_frames / result.elapsed : 0,
+      result.num_bytes);
+  g_print ("    put_frame: %.1f us mean, p50 %.1f us, p99 %.1f us\n",
+      get_mean (result.put_times), put_p50, put_p99);
+  g_print ("    get_buffer: %.1f us mean, p50 %.1f us, p99 %.1f us\n",
+      get_mean (result.get_times), get_p50, get_p99);
+  g_print ("    %.1f us upload, %.1f us packed headers (%u headers, "
+      "%.2f us each), %.1f us copy per frame\n",
+      per_frame (result.upload_time * 1.0e6, result.num_frames),
+      per_frame (header_time * 1.0e6, result.num_frames), num_headers,
+      per_frame (header_time * 1.0e6, num_headers),
+      per_frame (result.copy_time * 1.0e6, result.num_frames));
+  g_print ("    latency p50 %.1f us, p99 %.1f us\n", lat_p50, lat_p99);
+
+  if (app->json) {
+    GString *const json = app->json;
+
+    g_string_append (json, app->num_runs > 0 ? ",\n" : "\n");
+    g_string_append_printf (json, "    {\n      \"codec\": \"%s\",\n"
+        "      \"frames\": %u,\n      \"coded_bytes\": %" G_GSIZE_FORMAT,
+        info->name, result.num_frames, result.num_bytes);
+    json_append_double (json, "elapsed_sec", result.elapsed);
+    json_append_double (json, "fps", result.elapsed > 0 ?
+        result.num_frames / result.elapsed : 0);
+    json_append_double (json, "upload_us_per_frame",
+        per_frame (result.upload_time * 1.0e6, result.num_frames));
+    json_append_double (json, "put_frame_us_mean",
+        get_mean (result.put_times));
+    json_append_double (json, "put_frame_p50_us", put_p50);
+    json_append_double (json, "put_frame_p99_us", put_p99);
+    json_append_double (json, "get_buffer_us_mean",
+        get_mean (result.get_times));
+    json_append_double (json, "get_buffer_p50_us", get_p50);
+    json_append_double (json, "get_buffer_p99_us", get_p99);
+    json_append_double (json, "packed_headers_per_frame",
+        per_frame (num_headers, result.num_frames));
+    json_append_double (json, "packed_header_us_per_frame",
+        per_frame (header_time * 1.0e6, result.num_frames));
+    json_append_double (json, "packed_header_us_mean",
+        per_frame (header_time * 1.0e6, num_headers));
+    json_append_double (json, "copy_us_per_frame",
+        per_frame (result.copy_time * 1.0e6, result.num_frames));
+    json_append_double (json, "latency_p50_us", lat_p50);
+    json_append_double (json, "latency_p99_us", lat_p99);
+    g_string_append (json, "\n    }");
+    app->num_runs++;
+  }
+  success = TRUE;
+
+cleanup:
+  gst_vaapi_video_pool_replace (&pool, NULL);
+  bench_result_clear (&result);
+  return success;
+}
+
+static gboolean
+is_encoder_selected (const EncoderInfo * info)
+{
+  gchar **codecs;
+  gboolean selected = FALSE;
+  guint i;
+
+  if (!g_codec_str)
+    return TRUE;
+
+  codecs = g_strsplit (g_codec_str, ",", -1);
+  for (i = 0; codecs[i] != NULL && !selected; i++)
+    selected = g_ascii_strcasecmp (g_strstrip (codecs[i]), info->name) == 0;
+  g_strfreev (codecs);
+  return selected;
+}
+
+static gboolean
+write_json (App * app)
+{
+  GError *error = NULL;
+
+  g_string_append (app->json, "\n  ]\n}\n");
+  if (strcmp (g_json_filename, "-") == 0) {
+    fputs (app->json->str, stdout);
+    return TRUE;
+  }
+  if (!g_file_set_contents (g_json_filename, app->json->str, app->json->len,
+          &error)) {
+    g_printerr ("failed to write '%s': %s\n", g_json_filename,
+        error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean
+app_run (App * app, const gchar * filename)
+{
+  const EncoderInfo *info;
+  gboolean success = TRUE;
+
+  app->parser = y4m_reader_open (filename);
+  if (!app->parser) {
+    g_printerr ("failed to parse '%s'\n", filename);
+    return FALSE;
+  }
+
+  app->display = video_output_create_display (NULL);
+  if (!app->display) {
+    g_printerr ("failed to create VA display\n");
+    return FALSE;
+  }
+
+  if (!load_images (app)) {
+    g_printerr ("failed to read frames from '%s'\n", filename);
+    return FALSE;
+  }
+
+  g_print ("Encoder benchmark (%s, %ux%u, %u frames, in-flight %u, "
+      "%u slices, lookahead %u)\n", filename, app->parser->width,
+      app->parser->height, app->images->len, g_in_flight,
+      MAX (g_num_slices, 1), g_lookahead);
+
+  if (g_json_filename) {
+    app->json = g_string_new ("{\n  \"file\": ");
+    json_append_string (app->json, filename);
+    g_string_append_printf (app->json, ",\n  \"width\": %u,\n"
+        "  \"height\": %u,\n  \"frames\": %u,\n  \"in_flight\": %u,\n"
+        "  \"slices\": %u,\n  \"lookahead\": %u,\n  \"iterations\": %u,\n"
+        "  \"encoders\": [", app->parser->width, app->parser->height,
+        app->images->len, g_in_flight, MAX (g_num_slices, 1), g_lookahead,
+        g_iterations);
+  }
+
+  /* A failing encoder does not prevent benchmarking the other ones */
+  for (info = g_encoders; info->name != NULL; info++) {
+    if (is_encoder_selected (info) && !bench_encoder (app, info))
+      success = FALSE;
+  }
+
+  if (app->json && !write_json (app))
+    success = FALSE;
+  return success;
+}
+
+int
+main (int argc, char *argv[])
+{
+  App app = { NULL, };
+  gboolean success;
+
+  if (!video_output_init (&argc, argv, g_options))
+    g_error ("failed to initialize video output subsystem");
+
+  if (argc < 2) {
+    g_printerr ("no Y4M file specified\n");
+    success = FALSE;
+  } else
+    success = app_run (&app, argv[1]);
+
+  if (app.images)
+    g_ptr_array_free (app.images, TRUE);
+  if (app.parser)
+    y4m_reader_close (app.parser);
+  gst_vaapi_display_replace (&app.display, NULL);
+  if (app.json)
+    g_string_free (app.json, TRUE);
+  g_free (g_codec_str);
+  g_free (g_json_filename);
+  video_output_exit ();
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
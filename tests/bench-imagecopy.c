@@ -0,0 +1,291 @@
+/*
+ *  bench-imagecopy.c - Benchmark the VA image upload and download paths
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+/*
+ * This application copies frames between system memory and a mapped
+ * VA image, for a few common formats, with the plain memcpy() kernel
+ * and with the one selected for the running CPU, and reports the
+ * throughput of each in MB/s. It also checks that both kernels copy
+ * the same bytes. Then, it reports the throughput of the selected
+ * kernel when the rows are split across 2, 4, 8... copy threads.
+ */
+
+#include "gst/vaapi/sysdeps.h"
+#include <string.h>
+#include <gst/vaapi/gstvaapiimage.h>
+#include "gst/vaapi/gstvaapiutils_copy.h"
+#include "output.h"
+
+static guint g_width = 1920;
+static guint g_height = 1080;
+static guint g_iterations = 100;
+static guint g_max_threads = 8;
+
+static GOptionEntry g_options[] = {
+  {"width", 'W',
+        0,
+        G_OPTION_ARG_INT, &g_width,
+      "width of the images", NULL},
+  {"height", 'H',
+        0,
+        G_OPTION_ARG_INT, &g_height,
+      "height of the images", NULL},
+  {"iterations", 'n',
+        0,
+        G_OPTION_ARG_INT, &g_iterations,
+      "number of copies per format, direction and kernel", NULL},
+  {"threads", 't',
+        0,
+        G_OPTION_ARG_INT, &g_max_threads,
+      "maximum number of copy threads", NULL},
+  {NULL,}
+};
+
+static const GstVideoFormat g_formats[] = {
+  GST_VIDEO_FORMAT_NV12,
+  GST_VIDEO_FORMAT_I420,
+  GST_VIDEO_FORMAT_YUY2,
+  GST_VIDEO_FORMAT_RGBA,
+};
+
+typedef void (*CopyPlaneFunc) (guint8 * dst, guint dst_stride,
+    const guint8 * src, guint src_stride, guint len, guint height,
+    guint flags);
+
+typedef struct
+{
+  guint num_planes;
+  guint len[GST_VIDEO_MAX_PLANES];
+  guint height[GST_VIDEO_MAX_PLANES];
+  /* Mapped VA image */
+  guint8 *image_data[GST_VIDEO_MAX_PLANES];
+  guint image_pitch[GST_VIDEO_MAX_PLANES];
+  /* System memory, with rows of len bytes */
+  guint8 *host_data[GST_VIDEO_MAX_PLANES];
+  gsize size;
+} Frame;
+
+static gboolean
+frame_init (Frame * frame, GstVaapiImage * image)
+{
+  GstVideoInfo vi;
+  guint i, c;
+
+  memset (frame, 0, sizeof (*frame));
+  gst_video_info_set_format (&vi, gst_vaapi_image_get_format (image),
+      g_width, g_height);
+
+  frame->num_planes = GST_VIDEO_INFO_N_PLANES (&vi);
+  if (frame->num_planes != gst_vaapi_image_get_plane_count (image))
+    return FALSE;
+
+  for (i = 0; i < frame->num_planes; i++) {
+    for (c = 0; GST_VIDEO_INFO_COMP_PLANE (&vi, c) != i; c++);
+    frame->len[i] = GST_VIDEO_INFO_COMP_WIDTH (&vi, c) *
+        GST_VIDEO_INFO_COMP_PSTRIDE (&vi, c);
+    frame->height[i] = GST_VIDEO_INFO_COMP_HEIGHT (&vi, c);
+    frame->image_data[i] = gst_vaapi_image_get_plane (image, i);
+    frame->image_pitch[i] = gst_vaapi_image_get_pitch (image, i);
+    if (frame->len[i] > frame->image_pitch[i])
+      return FALSE;
+    frame->host_data[i] = g_malloc (frame->len[i] * frame->height[i]);
+    memset (frame->host_data[i], i + 1, frame->len[i] * frame->height[i]);
+    frame->size += frame->len[i] * frame->height[i];
+  }
+  return TRUE;
+}
+
+static void
+frame_clear (Frame * frame)
+{
+  guint i;
+
+  for (i = 0; i < frame->num_planes; i++)
+    g_free (frame->host_data[i]);
+}
+
+static void
+frame_copy (Frame * frame, gboolean upload, CopyPlaneFunc func,
+    GstVaapiCopyPool * pool)
+{
+  guint i;
+
+  for (i = 0; i < frame->num_planes; i++) {
+    if (upload && pool) {
+      gst_vaapi_copy_pool_copy_plane (pool, frame->image_data[i],
+          frame->image_pitch[i], frame->host_data[i], frame->len[i],
+          frame->len[i], frame->height[i], GST_VAAPI_COPY_FLAG_STREAM_STORE);
+    } else if (upload) {
+      func (frame->image_data[i], frame->image_pitch[i], frame->host_data[i],
+          frame->len[i], frame->len[i], frame->height[i],
+          GST_VAAPI_COPY_FLAG_STREAM_STORE);
+    } else if (pool) {
+      gst_vaapi_copy_pool_copy_plane (pool, frame->host_data[i],
+          frame->len[i], frame->image_data[i], frame->image_pitch[i],
+          frame->len[i], frame->height[i], GST_VAAPI_COPY_FLAG_STREAM_LOAD);
+    } else {
+      func (frame->host_data[i], frame->len[i], frame->image_data[i],
+          frame->image_pitch[i], frame->len[i], frame->height[i],
+          GST_VAAPI_COPY_FLAG_STREAM_LOAD);
+    }
+  }
+}
+
+/* Returns the throughput of the copies, in MB/s */
+static gdouble
+bench_copy (Frame * frame, gboolean upload, CopyPlaneFunc func,
+    GstVaapiCopyPool * pool)
+{
+  gint64 start_time;
+  gdouble elapsed;
+  guint i;
+
+  start_time = g_get_monotonic_time ();
+  for (i = 0; i < g_iterations; i++)
+    frame_copy (frame, upload, func, pool);
+  elapsed = (g_get_monotonic_time () - start_time) / 1.0e6;
+  return elapsed > 0 ? frame->size * (gdouble) g_iterations / elapsed / 1.0e6 :
+      0;
+}
+
+/* Uploads a pattern with one kernel, downloads it with the other one */
+static gboolean
+check_copy (Frame * frame)
+{
+  guint8 *ref[GST_VIDEO_MAX_PLANES];
+  gboolean success = TRUE;
+  guint i, j, n;
+
+  for (i = 0; i < frame->num_planes; i++) {
+    n = frame->len[i] * frame->height[i];
+    for (j = 0; j < n; j++)
+      frame->host_data[i][j] = (j * 7 + i) & 0xff;
+    ref[i] = g_memdup (frame->host_data[i], n);
+  }
+
+  frame_copy (frame, TRUE, gst_vaapi_copy_plane, NULL);
+  for (i = 0; i < frame->num_planes; i++)
+    memset (frame->host_data[i], 0, frame->len[i] * frame->height[i]);
+  frame_copy (frame, FALSE, gst_vaapi_copy_plane_c, NULL);
+  for (i = 0; i < frame->num_planes; i++) {
+    n = frame->len[i] * frame->height[i];
+    if (memcmp (frame->host_data[i], ref[i], n) != 0)
+      success = FALSE;
+  }
+
+  frame_copy (frame, TRUE, gst_vaapi_copy_plane_c, NULL);
+  for (i = 0; i < frame->num_planes; i++)
+    memset (frame->host_data[i], 0, frame->len[i] * frame->height[i]);
+  frame_copy (frame, FALSE, gst_vaapi_copy_plane, NULL);
+  for (i = 0; i < frame->num_planes; i++) {
+    n = frame->len[i] * frame->height[i];
+    if (memcmp (frame->host_data[i], ref[i], n) != 0)
+      success = FALSE;
+    g_free (ref[i]);
+  }
+  return success;
+}
+
+static gboolean
+bench_format (GstVaapiDisplay * display, GstVideoFormat format)
+{
+  GstVaapiImage *image;
+  GstVaapiCopyPool *pool;
+  Frame frame;
+  gboolean success = TRUE;
+  guint n;
+
+  image = gst_vaapi_image_new (display, format, g_width, g_height);
+  if (!image) {
+    g_print ("  %-6s not supported\n", gst_video_format_to_string (format));
+    return TRUE;
+  }
+  if (!gst_vaapi_image_map (image)) {
+    g_printerr ("failed to map %s image\n",
+        gst_video_format_to_string (format));
+    gst_vaapi_object_unref (image);
+    return FALSE;
+  }
+
+  if (!frame_init (&frame, image)) {
+    g_print ("  %-6s unexpected image layout\n",
+        gst_video_format_to_string (format));
+  } else if (!check_copy (&frame)) {
+    g_printerr ("  %-6s copy kernels mismatch\n",
+        gst_video_format_to_string (format));
+    success = FALSE;
+  } else {
+    g_print ("  %-6s upload %8.0f MB/s (memcpy %8.0f MB/s), "
+        "download %8.0f MB/s (memcpy %8.0f MB/s)\n",
+        gst_video_format_to_string (format),
+        bench_copy (&frame, TRUE, gst_vaapi_copy_plane, NULL),
+        bench_copy (&frame, TRUE, gst_vaapi_copy_plane_c, NULL),
+        bench_copy (&frame, FALSE, gst_vaapi_copy_plane, NULL),
+        bench_copy (&frame, FALSE, gst_vaapi_copy_plane_c, NULL));
+
+    for (n = 2; n <= g_max_threads; n *= 2) {
+      pool = gst_vaapi_copy_pool_new (n);
+      g_print ("  %-6s %2u threads: upload %8.0f MB/s, download %8.0f MB/s\n",
+          gst_video_format_to_string (format),
+          gst_vaapi_copy_pool_get_n_threads (pool),
+          bench_copy (&frame, TRUE, NULL, pool),
+          bench_copy (&frame, FALSE, NULL, pool));
+      gst_vaapi_copy_pool_free (pool);
+    }
+  }
+  frame_clear (&frame);
+
+  gst_vaapi_image_unmap (image);
+  gst_vaapi_object_unref (image);
+  return success;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GstVaapiDisplay *display;
+  gboolean success = TRUE;
+  guint i;
+
+  if (!video_output_init (&argc, argv, g_options))
+    g_error ("failed to initialize video output subsystem");
+
+  if (g_width < 16 || g_height < 16 || g_iterations == 0) {
+    g_printerr ("invalid image size or number of iterations\n");
+    video_output_exit ();
+    return EXIT_FAILURE;
+  }
+
+  display = video_output_create_display (NULL);
+  if (!display)
+    g_error ("could not create VA display");
+
+  g_print ("VA image copy benchmark (%ux%u, %u iterations, up to %u "
+      "threads)\n", g_width, g_height, g_iterations, g_max_threads);
+  for (i = 0; i < G_N_ELEMENTS (g_formats); i++) {
+    if (!bench_format (display, g_formats[i]))
+      success = FALSE;
+  }
+
+  gst_vaapi_display_unref (display);
+  video_output_exit ();
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
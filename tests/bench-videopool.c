@@ -0,0 +1,280 @@
+/*
+ *  bench-videopool.c - Multi-threaded video pool stress test
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+/*
+ * This application hammers a surface pool from several threads, each
+ * of them repeatedly getting a surface and putting it back. It checks
+ * that a surface is never handed out twice, and that the pool never
+ * fails while its capacity is at least the number of threads.
+ *
+ * With --startup-frames, it instead measures how long the first frames
+ * wait for their surfaces after the pool is created, as when the caps
+ * were just negotiated, with and without pre-warming the pool.
+ */
+
+#include "gst/vaapi/sysdeps.h"
+#include <gst/vaapi/gstvaapisurface.h>
+#include <gst/vaapi/gstvaapisurfacepool.h>
+#include "output.h"
+
+static guint g_num_threads = 4;
+static guint g_iterations = 100000;
+static guint g_capacity = 8;
+static guint g_startup_frames = 0;
+static guint g_startup_gap = 50;
+static guint g_width = 3840;
+static guint g_height = 2160;
+
+static GOptionEntry g_options[] = {
+  {"threads", 't',
+        0,
+        G_OPTION_ARG_INT, &g_num_threads,
+      "number of threads using the pool", NULL},
+  {"iterations", 'n',
+        0,
+        G_OPTION_ARG_INT, &g_iterations,
+      "number of get/put cycles per thread", NULL},
+  {"capacity", 'c',
+        0,
+        G_OPTION_ARG_INT, &g_capacity,
+      "maximum number of surfaces in the pool", NULL},
+  {"startup-frames", 's',
+        0,
+        G_OPTION_ARG_INT, &g_startup_frames,
+      "measure the latency of the first N frames instead", NULL},
+  {"startup-gap", 'g',
+        0,
+        G_OPTION_ARG_INT, &g_startup_gap,
+      "milliseconds between pool creation and the first frame", NULL},
+  {"width", 0,
+        0,
+        G_OPTION_ARG_INT, &g_width,
+      "width of the surfaces for --startup-frames", NULL},
+  {"height", 0,
+        0,
+        G_OPTION_ARG_INT, &g_height,
+      "height of the surfaces for --startup-frames", NULL},
+  {NULL,}
+};
+
+typedef struct
+{
+  GstVaapiVideoPool *pool;
+  GHashTable *surface_map;      /* surface -> index + 1, read-only */
+  volatile gint *busy;
+  volatile gint num_failures;
+  volatile gint num_conflicts;
+} App;
+
+static gpointer
+worker_thread (gpointer data)
+{
+  App *const app = data;
+  GstVaapiSurface *surface;
+  guint i, index;
+
+  for (i = 0; i < g_iterations; i++) {
+    surface = gst_vaapi_video_pool_get_object (app->pool);
+    if (!surface) {
+      g_atomic_int_inc (&app->num_failures);
+      continue;
+    }
+
+    index = GPOINTER_TO_UINT (g_hash_table_lookup (app->surface_map, surface));
+    if (!index) {
+      /* The pool allocated a surface beyond the reserved ones */
+      g_atomic_int_inc (&app->num_failures);
+    } else if (!g_atomic_int_compare_and_exchange (&app->busy[index - 1], 0,
+            1)) {
+      g_atomic_int_inc (&app->num_conflicts);
+    } else {
+      g_atomic_int_set (&app->busy[index - 1], 0);
+    }
+    gst_vaapi_video_pool_put_object (app->pool, surface);
+  }
+  return NULL;
+}
+
+static gboolean
+app_run (App * app, GstVaapiDisplay * display)
+{
+  GstVaapiSurface *surface;
+  GPtrArray *surfaces;
+  GThread **threads;
+  gint64 start_time;
+  gdouble elapsed;
+  guint i;
+
+  app->pool = gst_vaapi_surface_pool_new (display, GST_VIDEO_FORMAT_ENCODED,
+      320, 240);
+  if (!app->pool) {
+    g_printerr ("failed to create surface pool\n");
+    return FALSE;
+  }
+  gst_vaapi_video_pool_set_capacity (app->pool, g_capacity);
+  if (!gst_vaapi_video_pool_reserve (app->pool, g_capacity)) {
+    g_printerr ("failed to allocate %u surfaces\n", g_capacity);
+    return FALSE;
+  }
+
+  /* Collect all surfaces, so that each of them gets a busy flag */
+  surfaces = g_ptr_array_new ();
+  app->surface_map = g_hash_table_new (g_direct_hash, g_direct_equal);
+  while ((surface = gst_vaapi_video_pool_get_object (app->pool)) != NULL) {
+    g_ptr_array_add (surfaces, surface);
+    g_hash_table_insert (app->surface_map, surface,
+        GUINT_TO_POINTER (surfaces->len));
+  }
+  for (i = 0; i < surfaces->len; i++)
+    gst_vaapi_video_pool_put_object (app->pool,
+        g_ptr_array_index (surfaces, i));
+  app->busy = g_new0 (gint, surfaces->len);
+
+  g_print ("Video pool stress test (%u threads, %u surfaces)\n",
+      g_num_threads, surfaces->len);
+
+  threads = g_new (GThread *, g_num_threads);
+  start_time = g_get_monotonic_time ();
+  for (i = 0; i < g_num_threads; i++)
+    threads[i] = g_thread_new ("worker", worker_thread, app);
+  for (i = 0; i < g_num_threads; i++)
+    g_thread_join (threads[i]);
+  elapsed = (g_get_monotonic_time () - start_time) / 1.0e6;
+  g_free (threads);
+
+  g_print ("  %u get/put cycles in %.2f sec (%.0f ops/s)\n",
+      g_num_threads * g_iterations, elapsed,
+      elapsed > 0 ? g_num_threads * g_iterations / elapsed : 0);
+  g_print ("  %d failures, %d surfaces handed out twice\n",
+      app->num_failures, app->num_conflicts);
+
+  if (gst_vaapi_video_pool_get_size (app->pool) != surfaces->len) {
+    g_printerr ("pool has %u free surfaces, expected %u\n",
+        gst_vaapi_video_pool_get_size (app->pool), surfaces->len);
+    app->num_failures++;
+  }
+
+  g_free ((gpointer) app->busy);
+  g_hash_table_destroy (app->surface_map);
+  g_ptr_array_free (surfaces, TRUE);
+  gst_vaapi_video_pool_replace (&app->pool, NULL);
+
+  if (app->num_conflicts > 0)
+    return FALSE;
+  /* With fewer threads than surfaces, the pool shall never run dry */
+  if (app->num_failures > 0 && g_capacity >= g_num_threads)
+    return FALSE;
+  return TRUE;
+}
+
+/* Creates a pool for the negotiated caps, optionally pre-warms it, and
+   waits for the first frame. Then gets g_startup_frames surfaces, all
+   held as by frames in flight, and reports how long the first and the
+   last of them took */
+static gboolean
+measure_startup (GstVaapiDisplay * display, gboolean prewarm)
+{
+  GstVaapiVideoPool *pool;
+  GstVaapiSurface **surfaces;
+  gint64 start_time, first_time = 0, last_time = 0;
+  gboolean success = TRUE;
+  guint i;
+
+  pool = gst_vaapi_surface_pool_new (display, GST_VIDEO_FORMAT_NV12,
+      g_width, g_height);
+  if (!pool) {
+    g_printerr ("failed to create surface pool\n");
+    return FALSE;
+  }
+  gst_vaapi_video_pool_set_capacity (pool, g_startup_frames);
+  if (prewarm && !gst_vaapi_video_pool_prewarm (pool, g_startup_frames)) {
+    g_printerr ("failed to pre-warm the surface pool\n");
+    gst_vaapi_video_pool_replace (&pool, NULL);
+    return FALSE;
+  }
+  g_usleep (g_startup_gap * 1000);
+
+  surfaces = g_new0 (GstVaapiSurface *, g_startup_frames);
+  start_time = g_get_monotonic_time ();
+  for (i = 0; i < g_startup_frames; i++) {
+    surfaces[i] = gst_vaapi_video_pool_get_object (pool);
+    if (!surfaces[i]) {
+      g_printerr ("failed to get surface %u\n", i);
+      success = FALSE;
+      break;
+    }
+    last_time = g_get_monotonic_time () - start_time;
+    if (i == 0)
+      first_time = last_time;
+  }
+  for (i = 0; i < g_startup_frames && surfaces[i]; i++)
+    gst_vaapi_video_pool_put_object (pool, surfaces[i]);
+  g_free (surfaces);
+  gst_vaapi_video_pool_replace (&pool, NULL);
+
+  if (success)
+    g_print ("  %-16s first frame %8.3f ms, frame %u %8.3f ms\n",
+        prewarm ? "with prewarm:" : "without prewarm:", first_time / 1.0e3,
+        g_startup_frames, last_time / 1.0e3);
+  return success;
+}
+
+static gboolean
+app_run_startup (GstVaapiDisplay * display)
+{
+  g_print ("Video pool startup latency (%u frames, %ux%u, %u ms gap)\n",
+      g_startup_frames, g_width, g_height, g_startup_gap);
+
+  if (!measure_startup (display, FALSE))
+    return FALSE;
+  return measure_startup (display, TRUE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  App app = { NULL, };
+  GstVaapiDisplay *display;
+  gboolean success;
+
+  if (!video_output_init (&argc, argv, g_options))
+    g_error ("failed to initialize video output subsystem");
+
+  if (g_num_threads == 0 || g_capacity == 0 || g_width == 0 ||
+      g_height == 0) {
+    g_printerr ("invalid number of threads, capacity or size\n");
+    video_output_exit ();
+    return EXIT_FAILURE;
+  }
+
+  display = video_output_create_display (NULL);
+  if (!display)
+    g_error ("could not create VA display");
+
+  if (g_startup_frames > 0)
+    success = app_run_startup (display);
+  else
+    success = app_run (&app, display);
+
+  gst_vaapi_display_unref (display);
+  video_output_exit ();
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
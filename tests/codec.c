@@ -34,6 +34,8 @@ typedef struct
 static const CodecMap g_codec_map[] = {
   {"h264", GST_VAAPI_CODEC_H264,
       "video/x-h264"},
+  {"h265", GST_VAAPI_CODEC_H265,
+      "video/x-h265"},
   {"jpeg", GST_VAAPI_CODEC_JPEG,
       "image/jpeg"},
   {"mpeg2", GST_VAAPI_CODEC_MPEG2,
@@ -44,6 +46,10 @@ static const CodecMap g_codec_map[] = {
       "video/x-wmv, wmvversion=3"},
   {"vc1", GST_VAAPI_CODEC_VC1,
       "video/x-wmv, wmvversion=3, format=(string)WVC1"},
+  {"vp8", GST_VAAPI_CODEC_VP8,
+      "video/x-vp8"},
+  {"vp9", GST_VAAPI_CODEC_VP9,
+      "video/x-vp9"},
   {NULL,}
 };
 
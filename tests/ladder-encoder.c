@@ -0,0 +1,400 @@
+/*
+ *  ladder-encoder.c - Encode a multi-resolution ladder from one upload
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+/*
+ * This application encodes a Y4M file at several resolutions at once,
+ * e.g. for an adaptive bitrate ladder, with a GstVaapiEncoderLadder:
+ * each frame is uploaded once, and scaled once per rung of the ladder.
+ */
+
+#include "gst/vaapi/sysdeps.h"
+#include <gst/vaapi/gstvaapiencoder_ladder.h>
+#include <gst/vaapi/gstvaapiencoder_mpeg2.h>
+#include <gst/vaapi/gstvaapiencoder_h264.h>
+#if USE_H265_ENCODER
+#include <gst/vaapi/gstvaapiencoder_h265.h>
+#endif
+
+#include "output.h"
+#include "y4mreader.h"
+
+static gchar *g_codec_str;
+static guint g_bitrate;
+static gchar *g_ladder_str;
+static gchar *g_output_prefix;
+static gchar **g_input_files;
+
+static GOptionEntry g_options[] = {
+  {"codec", 'c', 0, G_OPTION_ARG_STRING, &g_codec_str,
+      "codec to use for video encoding (h264/h265/mpeg2)", NULL},
+  {"bitrate", 'b', 0, G_OPTION_ARG_INT, &g_bitrate,
+      "bitrate of the source resolution rung, expressed in kbps. The other "
+        "rungs get a bitrate proportional to their area", NULL},
+  {"ladder", 'l', 0, G_OPTION_ARG_STRING, &g_ladder_str,
+      "comma separated list of WIDTHxHEIGHT resolutions "
+        "(default: source, half and quarter size)", NULL},
+  {"output", 'o', 0, G_OPTION_ARG_FILENAME, &g_output_prefix,
+      "prefix of the output file names (default: ladder)", NULL},
+  {G_OPTION_REMAINING, ' ', 0, G_OPTION_ARG_FILENAME_ARRAY, &g_input_files,
+      "input file name", NULL},
+  {NULL}
+};
+
+typedef struct
+{
+  guint width;
+  guint height;
+  gchar *output_filename;
+  FILE *output_file;
+  guint encoded_frames;
+  guint64 encoded_bytes;
+} Output;
+
+typedef struct
+{
+  GstVaapiDisplay *display;
+  Y4MReader *parser;
+  GstVaapiImage *image;
+  GstVaapiEncoderLadder *ladder;
+  /* One per rung, in the order of the ladder */
+  GPtrArray *outputs;
+  guint read_frames;
+} App;
+
+static GstVaapiEncoder *
+encoder_new (GstVaapiDisplay * display)
+{
+  if (!g_strcmp0 (g_codec_str, "h264"))
+    return gst_vaapi_encoder_h264_new (display);
+#if USE_H265_ENCODER
+  if (!g_strcmp0 (g_codec_str, "h265"))
+    return gst_vaapi_encoder_h265_new (display);
+#endif
+  if (!g_strcmp0 (g_codec_str, "mpeg2"))
+    return gst_vaapi_encoder_mpeg2_new (display);
+  return NULL;
+}
+
+static gboolean
+set_format (GstVaapiEncoder * encoder, guint width, guint height,
+    gint fps_n, gint fps_d)
+{
+  GstVideoCodecState *state;
+  GstVaapiEncoderStatus status;
+
+  state = g_slice_new0 (GstVideoCodecState);
+  state->ref_count = 1;
+  gst_video_info_set_format (&state->info, GST_VIDEO_FORMAT_ENCODED, width,
+      height);
+  state->info.fps_n = fps_n;
+  state->info.fps_d = fps_d;
+
+  status = gst_vaapi_encoder_set_codec_state (encoder, state);
+  g_slice_free (GstVideoCodecState, state);
+  return status == GST_VAAPI_ENCODER_STATUS_SUCCESS;
+}
+
+static void
+output_free (Output * output)
+{
+  if (output->output_file)
+    fclose (output->output_file);
+  g_free (output->output_filename);
+  g_slice_free (Output, output);
+}
+
+static gboolean
+add_rung (App * app, guint width, guint height)
+{
+  Y4MReader *const parser = app->parser;
+  GstVaapiEncoder *encoder;
+  Output *output;
+  gint rung;
+
+  output = g_slice_new0 (Output);
+  output->width = width;
+  output->height = height;
+  output->output_filename = g_strdup_printf ("%s-%ux%u.%s", g_output_prefix,
+      width, height, g_codec_str);
+  output->output_file = fopen (output->output_filename, "wb");
+  if (!output->output_file) {
+    g_warning ("Could not open file \"%s\" for writing: %s.",
+        output->output_filename, g_strerror (errno));
+    output_free (output);
+    return FALSE;
+  }
+
+  encoder = encoder_new (app->display);
+  if (!encoder) {
+    g_warning ("Could not create encoder.");
+    output_free (output);
+    return FALSE;
+  }
+  if (g_bitrate > 0) {
+    gst_vaapi_encoder_set_bitrate (encoder,
+        MAX ((guint64) g_bitrate * width * height /
+            (parser->width * parser->height), 1));
+  }
+  if (!set_format (encoder, width, height, parser->fps_n, parser->fps_d)) {
+    g_warning ("Could not set %ux%u format.", width, height);
+    rung = -1;
+  } else
+    rung = gst_vaapi_encoder_ladder_add_rung (app->ladder, encoder, width,
+        height);
+  gst_vaapi_encoder_unref (encoder);
+  if (rung < 0) {
+    g_warning ("Could not add %ux%u rung.", width, height);
+    output_free (output);
+    return FALSE;
+  }
+
+  g_assert ((guint) rung == app->outputs->len);
+  g_ptr_array_add (app->outputs, output);
+  return TRUE;
+}
+
+static gboolean
+parse_resolution (const gchar * str, guint * width_ptr, guint * height_ptr)
+{
+  gchar *end;
+  guint64 width, height;
+
+  width = g_ascii_strtoull (str, &end, 10);
+  if (end == str || (*end != 'x' && *end != 'X'))
+    return FALSE;
+  str = end + 1;
+  height = g_ascii_strtoull (str, &end, 10);
+  if (end == str || *end != '\0')
+    return FALSE;
+  if (width < 16 || height < 16 || width > 8192 || height > 8192)
+    return FALSE;
+
+  /* 4:2:0 surfaces */
+  *width_ptr = GST_ROUND_UP_2 (width);
+  *height_ptr = GST_ROUND_UP_2 (height);
+  return TRUE;
+}
+
+static gboolean
+add_rungs (App * app)
+{
+  gchar **resolutions;
+  guint i, width, height;
+  gboolean success = TRUE;
+
+  if (!g_ladder_str) {
+    width = app->parser->width;
+    height = app->parser->height;
+    for (i = 0; i < 3; i++) {
+      if (!add_rung (app, GST_ROUND_UP_2 (width >> i),
+              GST_ROUND_UP_2 (height >> i)))
+        return FALSE;
+    }
+    return TRUE;
+  }
+
+  resolutions = g_strsplit (g_ladder_str, ",", -1);
+  for (i = 0; success && resolutions[i] != NULL; i++) {
+    if (!parse_resolution (g_strstrip (resolutions[i]), &width, &height)) {
+      g_warning ("Invalid ladder resolution \"%s\".", resolutions[i]);
+      success = FALSE;
+    } else
+      success = add_rung (app, width, height);
+  }
+  g_strfreev (resolutions);
+  return success && app->outputs->len > 0;
+}
+
+static void
+app_free (App * app)
+{
+  gst_vaapi_encoder_ladder_free (app->ladder);
+  if (app->outputs)
+    g_ptr_array_unref (app->outputs);
+  if (app->image)
+    gst_vaapi_object_unref (app->image);
+  if (app->parser)
+    y4m_reader_close (app->parser);
+  if (app->display)
+    gst_vaapi_display_unref (app->display);
+  g_slice_free (App, app);
+}
+
+static App *
+app_new (const gchar * input_fn)
+{
+  App *app;
+
+  app = g_slice_new0 (App);
+  app->outputs = g_ptr_array_new_with_free_func ((GDestroyNotify) output_free);
+
+  app->parser = y4m_reader_open (input_fn);
+  if (!app->parser) {
+    g_warning ("Could not parse input stream.");
+    goto error;
+  }
+
+  app->display = video_output_create_display (NULL);
+  if (!app->display) {
+    g_warning ("Could not create VA display.");
+    goto error;
+  }
+
+  app->image = gst_vaapi_image_new (app->display, GST_VIDEO_FORMAT_I420,
+      app->parser->width, app->parser->height);
+  if (!app->image) {
+    g_warning ("Could not allocate source image.");
+    goto error;
+  }
+
+  app->ladder = gst_vaapi_encoder_ladder_new (app->display,
+      app->parser->width, app->parser->height);
+  if (!app->ladder || !add_rungs (app))
+    goto error;
+  return app;
+
+error:
+  app_free (app);
+  return NULL;
+}
+
+/* Called from the output thread of the rung */
+static gboolean
+write_coded_buffer (GstVaapiEncoderLadder * ladder, guint rung,
+    GstVaapiCodedBufferProxy * proxy, gpointer user_data)
+{
+  App *const app = user_data;
+  Output *const output = g_ptr_array_index (app->outputs, rung);
+  GstVaapiCodedBuffer *coded_buf;
+  GstBuffer *buffer;
+  GstMapInfo info;
+  gssize size;
+  gboolean success;
+
+  coded_buf = GST_VAAPI_CODED_BUFFER_PROXY_BUFFER (proxy);
+  size = gst_vaapi_coded_buffer_get_size (coded_buf);
+  if (size <= 0)
+    return FALSE;
+
+  buffer = gst_buffer_new_allocate (NULL, size, NULL);
+  success = gst_vaapi_coded_buffer_copy_into (buffer, coded_buf);
+  if (success && gst_buffer_map (buffer, &info, GST_MAP_READ)) {
+    success =
+        fwrite (info.data, 1, info.size, output->output_file) == info.size;
+    gst_buffer_unmap (buffer, &info);
+  } else
+    success = FALSE;
+  gst_buffer_unref (buffer);
+  if (!success) {
+    g_warning ("Failed to output %ux%u frame.", output->width, output->height);
+    return FALSE;
+  }
+
+  output->encoded_frames++;
+  output->encoded_bytes += size;
+  return TRUE;
+}
+
+static gboolean
+encode_frame (App * app)
+{
+  if (!gst_vaapi_image_map (app->image))
+    return FALSE;
+  if (!y4m_reader_load_image (app->parser, app->image)) {
+    gst_vaapi_image_unmap (app->image);
+    return FALSE;
+  }
+  if (!gst_vaapi_image_unmap (app->image))
+    return FALSE;
+
+  if (!gst_vaapi_encoder_ladder_put_image (app->ladder, app->image)) {
+    g_warning ("Could not encode frame %u.", app->read_frames);
+    return FALSE;
+  }
+  app->read_frames++;
+  return TRUE;
+}
+
+static int
+app_run (App * app)
+{
+  gboolean success = TRUE;
+  guint i;
+
+  if (!gst_vaapi_encoder_ladder_start (app->ladder, write_coded_buffer, app))
+    return EXIT_FAILURE;
+
+  while (encode_frame (app));
+  if (!feof (app->parser->fp))
+    success = FALSE;
+
+  if (!gst_vaapi_encoder_ladder_finish (app->ladder))
+    success = FALSE;
+
+  for (i = 0; i < app->outputs->len; i++) {
+    Output *const output = g_ptr_array_index (app->outputs, i);
+    g_print ("%ux%u: %u frames, %" G_GUINT64_FORMAT " bytes -> %s\n",
+        output->width, output->height, output->encoded_frames,
+        output->encoded_bytes, output->output_filename);
+  }
+  g_print ("%u frames read\n", app->read_frames);
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *ctx;
+  GError *error = NULL;
+  const gchar *input_fn;
+  App *app;
+  int ret = EXIT_FAILURE;
+
+  ctx = g_option_context_new (" - multi-resolution encoder test");
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  g_option_context_add_main_entries (ctx, g_options, NULL);
+  if (!g_option_context_parse (ctx, &argc, &argv, &error)) {
+    g_printerr ("Option parsing failed: %s\n", error->message);
+    g_error_free (error);
+    g_option_context_free (ctx);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free (ctx);
+
+  if (!g_codec_str)
+    g_codec_str = g_strdup ("h264");
+  if (!g_output_prefix)
+    g_output_prefix = g_strdup ("ladder");
+
+  input_fn = g_input_files ? g_input_files[0] : NULL;
+  app = app_new (input_fn);
+  if (app) {
+    ret = app_run (app);
+    app_free (app);
+  }
+
+  g_free (g_codec_str);
+  g_free (g_ladder_str);
+  g_free (g_output_prefix);
+  g_strfreev (g_input_files);
+  gst_deinit ();
+  return ret;
+}
@@ -44,8 +44,19 @@
 # include <gst/vaapi/gstvaapidisplay_wayland.h>
 # include <gst/vaapi/gstvaapiwindow_wayland.h>
 #endif
+#if USE_MOCK
+# include <gst/vaapi/gstvaapidisplay_mock.h>
+#endif
 #include "output.h"
 
+#if USE_MOCK
+static GstVaapiDisplay *
+create_mock_display (const gchar * display_name)
+{
+  return gst_vaapi_display_mock_new ();
+}
+#endif
+
 static const VideoOutputInfo *g_video_output;
 static const VideoOutputInfo g_video_outputs[] = {
   /* Video outputs are sorted in test order for automatic characterisation */
@@ -70,6 +81,11 @@ static const VideoOutputInfo g_video_outputs[] = {
   {"drm",
         gst_vaapi_display_drm_new,
       gst_vaapi_window_drm_new},
+#endif
+#if USE_MOCK
+  /* No GPU, and no window: only used if explicitly requested */
+  {"mock",
+      create_mock_display},
 #endif
   {NULL,}
 };
@@ -178,6 +194,8 @@ video_output_create_display (const gchar * display_name)
       o = video_output_lookup (g_output_name);
     else {
       for (o = g_video_outputs; o->name != NULL; o++) {
+        if (!o->create_window)
+          continue;
         display = o->create_display (display_name);
         if (display) {
           if (gst_vaapi_display_get_display (display))
@@ -217,7 +235,7 @@ video_output_create_window (GstVaapiDisplay * display, guint width,
 {
   GstVaapiWindow *window;
 
-  if (!g_video_output)
+  if (!g_video_output || !g_video_output->create_window)
     return NULL;
 
 #if USE_EGL
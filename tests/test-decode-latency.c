@@ -0,0 +1,409 @@
+/*
+ *  test-decode-latency.c - Decoder output latency test
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+/*
+ * This application feeds an H.264 or H.265 byte-stream to the decoder
+ * one NAL unit at a time, as a live source would, and measures how many
+ * NAL units are fed after the last one of each frame before that frame
+ * gets output. The stream is decoded once in the regular mode, with NAL
+ * unit aligned input, where the decoder only knows that a frame is
+ * complete once the next one starts. It is then decoded in the low
+ * latency mode, with access unit aligned input, as delivered by a
+ * parser upstream, where each frame is known to be complete as soon as
+ * it is received. The access units are those the first run found.
+ * With --check, the application fails unless the low latency mode
+ * reduces the overall delay.
+ */
+
+#include "gst/vaapi/sysdeps.h"
+#include <gst/base/gstadapter.h>
+#include <gst/vaapi/gstvaapidecoder.h>
+#include <gst/vaapi/gstvaapidecoder_h264.h>
+#if USE_H265_DECODER
+#include <gst/vaapi/gstvaapidecoder_h265.h>
+#endif
+#include "codec.h"
+#include "output.h"
+
+static gchar *g_codec_str;
+static gboolean g_check;
+static gboolean g_force;
+
+static GOptionEntry g_options[] = {
+  {"codec", 'c',
+        0,
+        G_OPTION_ARG_STRING, &g_codec_str,
+      "suggested codec", NULL},
+  {"check", 0,
+        0,
+        G_OPTION_ARG_NONE, &g_check,
+      "fail unless the low latency mode reduces the delay", NULL},
+  {"force", 0,
+        0,
+        G_OPTION_ARG_NONE, &g_force,
+      "force the H.265 low latency mode, for streams that signal "
+        "reordering but have none", NULL},
+  {NULL,}
+};
+
+typedef struct
+{
+  GstVaapiDisplay *display;
+  GstVaapiCodec codec;
+  GMappedFile *file;
+  const guint8 *data;
+  gsize size;
+} App;
+
+typedef struct
+{
+  guint num_nalus_in;
+  guint num_frames_in;
+  guint num_frames_out;
+  guint total_delay;
+  guint max_delay;
+  GArray *frame_ends;           /* NAL units up to the end of each frame */
+} LatencyResult;
+
+static GstVaapiDecoder *
+create_decoder (App * app, gboolean low_latency, gboolean au_aligned)
+{
+  GstVaapiDecoder *decoder = NULL;
+  GstCaps *caps;
+
+  caps = caps_from_codec (app->codec);
+  if (!caps)
+    return NULL;
+
+  switch (app->codec) {
+    case GST_VAAPI_CODEC_H264:
+      decoder = gst_vaapi_decoder_h264_new (app->display, caps);
+      if (!decoder)
+        break;
+      gst_vaapi_decoder_h264_set_alignment (GST_VAAPI_DECODER_H264 (decoder),
+          au_aligned ? GST_VAAPI_STREAM_ALIGN_H264_AU :
+          GST_VAAPI_STREAM_ALIGN_H264_NALU);
+      gst_vaapi_decoder_h264_set_low_latency (GST_VAAPI_DECODER_H264
+          (decoder), low_latency);
+      break;
+#if USE_H265_DECODER
+    case GST_VAAPI_CODEC_H265:
+      decoder = gst_vaapi_decoder_h265_new (app->display, caps);
+      if (!decoder)
+        break;
+      gst_vaapi_decoder_h265_set_alignment (GST_VAAPI_DECODER_H265 (decoder),
+          au_aligned ? GST_VAAPI_STREAM_ALIGN_H265_AU :
+          GST_VAAPI_STREAM_ALIGN_H265_NALU);
+      gst_vaapi_decoder_h265_set_low_latency (GST_VAAPI_DECODER_H265
+          (decoder), low_latency);
+      gst_vaapi_decoder_h265_set_force_low_latency (GST_VAAPI_DECODER_H265
+          (decoder), low_latency && g_force);
+      break;
+#endif
+    default:
+      break;
+  }
+  gst_caps_unref (caps);
+  return decoder;
+}
+
+static GstVideoCodecFrame *
+create_frame (guint frame_number)
+{
+  GstVideoCodecFrame *frame;
+
+  frame = g_slice_new0 (GstVideoCodecFrame);
+  frame->ref_count = 1;
+  frame->system_frame_number = frame_number;
+  frame->pts = GST_CLOCK_TIME_NONE;
+  return frame;
+}
+
+/* Returns the size of the NAL unit at the start of @data, including
+   its start code, and up to the start code of the next NAL unit */
+static gsize
+get_nalu_size (const guint8 * data, gsize size)
+{
+  gsize i;
+
+  for (i = 3; i + 3 <= size; i++) {
+    if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1)
+      return i > 3 && data[i - 1] == 0 ? i - 1 : i;
+  }
+  return size;
+}
+
+/* Collects the output frames, and accounts for the number of NAL units
+   that were fed since the last one of each of them */
+static void
+release_frames (GstVaapiDecoder * decoder, LatencyResult * result,
+    guint64 timeout)
+{
+  GstVideoCodecFrame *frame;
+  guint delay;
+
+  while (gst_vaapi_decoder_get_frame_with_timeout (decoder, &frame,
+          timeout) == GST_VAAPI_DECODER_STATUS_SUCCESS) {
+    if (!GST_VIDEO_CODEC_FRAME_IS_DECODE_ONLY (frame)) {
+      delay = result->num_nalus_in - g_array_index (result->frame_ends,
+          guint, frame->system_frame_number);
+      result->total_delay += delay;
+      result->max_delay = MAX (result->max_delay, delay);
+      result->num_frames_out++;
+    }
+    gst_video_codec_frame_unref (frame);
+    timeout = 0;
+  }
+}
+
+static gboolean
+decode_frame (GstVaapiDecoder * decoder, GstVideoCodecFrame * frame,
+    LatencyResult * result)
+{
+  GstVaapiDecoderStatus status;
+
+  result->num_frames_in++;
+  for (;;) {
+    status = gst_vaapi_decoder_decode (decoder, frame);
+    if (status != GST_VAAPI_DECODER_STATUS_ERROR_NO_SURFACE)
+      break;
+    release_frames (decoder, result, G_TIME_SPAN_SECOND);
+  }
+  if (status != GST_VAAPI_DECODER_STATUS_SUCCESS) {
+    g_printerr ("failed to decode frame %u (status %d)\n",
+        frame->system_frame_number, status);
+    return FALSE;
+  }
+
+  /* Only collect what the decoder made available right away */
+  release_frames (decoder, result, 0);
+  return TRUE;
+}
+
+typedef struct
+{
+  GstVaapiDecoder *decoder;
+  GstAdapter *input_adapter;
+  GstAdapter *output_adapter;
+  GstVideoCodecFrame *frame;
+  guint frame_number;
+  guint num_nalus_parsed;
+  LatencyResult *result;
+} Stream;
+
+/* Parses and decodes all the frames that are complete in the input */
+static gboolean
+decode_frames (Stream * stream, gboolean at_eos)
+{
+  LatencyResult *const result = stream->result;
+  GstVaapiDecoderStatus status;
+  GstBuffer *buffer;
+  guint got_unit_size;
+  gboolean got_frame;
+
+  for (;;) {
+    if (!stream->frame)
+      stream->frame = create_frame (stream->frame_number++);
+
+    status = gst_vaapi_decoder_parse (stream->decoder, stream->frame,
+        stream->input_adapter, at_eos, &got_unit_size, &got_frame);
+    if (status == GST_VAAPI_DECODER_STATUS_ERROR_NO_DATA)
+      return TRUE;
+    if (status != GST_VAAPI_DECODER_STATUS_SUCCESS) {
+      g_printerr ("failed to parse frame %u (status %d)\n",
+          stream->frame->system_frame_number, status);
+      return FALSE;
+    }
+
+    if (got_unit_size > 0) {
+      buffer = gst_adapter_take_buffer (stream->input_adapter, got_unit_size);
+      gst_adapter_push (stream->output_adapter, buffer);
+      stream->num_nalus_parsed++;
+    }
+    if (!got_frame)
+      continue;
+
+    /* The parser may only tell a frame is complete once the first NAL
+       unit of the next frame was fed, which accounts for the delay */
+    g_array_append_val (result->frame_ends, stream->num_nalus_parsed);
+    stream->frame->input_buffer =
+        gst_adapter_take_buffer (stream->output_adapter,
+        gst_adapter_available (stream->output_adapter));
+    if (!decode_frame (stream->decoder, stream->frame, result))
+      return FALSE;
+    gst_video_codec_frame_unref (stream->frame);
+    stream->frame = NULL;
+  }
+}
+
+/* Decodes the stream, in the low latency mode if @au_ends is set, with
+   the input aligned on the access units that end at these NAL units */
+static gboolean
+run_decoder (App * app, GArray * au_ends, LatencyResult * result)
+{
+  Stream stream = { NULL, };
+  GstVaapiDecoderStatus status;
+  gsize offset, nalu_size;
+  gboolean success = FALSE;
+  guint au_index = 0;
+
+  memset (result, 0, sizeof (*result));
+  result->frame_ends = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  stream.decoder = create_decoder (app, au_ends != NULL, au_ends != NULL);
+  if (!stream.decoder) {
+    g_printerr ("failed to create %s decoder\n",
+        string_from_codec (app->codec));
+    return FALSE;
+  }
+  stream.input_adapter = gst_adapter_new ();
+  stream.output_adapter = gst_adapter_new ();
+  stream.result = result;
+
+  /* Feed one NAL unit at a time, and decode what can be decoded. With
+     access unit aligned input, only parse once the whole unit is in */
+  for (offset = 0; offset < app->size; offset += nalu_size) {
+    nalu_size = get_nalu_size (app->data + offset, app->size - offset);
+    gst_adapter_push (stream.input_adapter,
+        gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+            (gpointer) (app->data + offset), nalu_size, 0, nalu_size,
+            NULL, NULL));
+    result->num_nalus_in++;
+    if (au_ends && au_index < au_ends->len) {
+      if (result->num_nalus_in < g_array_index (au_ends, guint, au_index))
+        continue;
+      au_index++;
+    }
+    if (!decode_frames (&stream, FALSE))
+      goto cleanup;
+  }
+  if (!decode_frames (&stream, TRUE))
+    goto cleanup;
+
+  status = gst_vaapi_decoder_flush (stream.decoder);
+  if (status != GST_VAAPI_DECODER_STATUS_SUCCESS) {
+    g_printerr ("failed to flush decoder (status %d)\n", status);
+    goto cleanup;
+  }
+  release_frames (stream.decoder, result, 0);
+  success = TRUE;
+
+cleanup:
+  if (stream.frame)
+    gst_video_codec_frame_unref (stream.frame);
+  g_object_unref (stream.input_adapter);
+  g_object_unref (stream.output_adapter);
+  gst_vaapi_decoder_unref (stream.decoder);
+  return success;
+}
+
+static void
+print_result (const gchar * name, const LatencyResult * result)
+{
+  g_print ("  %s: %u frames in, %u frames out, delay %.2f NAL units on "
+      "average, %u at most\n", name, result->num_frames_in,
+      result->num_frames_out, result->num_frames_out > 0 ?
+      (gdouble) result->total_delay / result->num_frames_out : 0,
+      result->max_delay);
+}
+
+static gboolean
+app_run (App * app, const gchar * filename)
+{
+  LatencyResult ref_result, result;
+  gboolean success;
+
+  app->codec = identify_codec (filename);
+  if (!app->codec) {
+    app->codec = identify_codec_from_string (g_codec_str);
+    if (!app->codec) {
+      g_printerr ("failed to identify codec for '%s'\n", filename);
+      return FALSE;
+    }
+  }
+  if (app->codec != GST_VAAPI_CODEC_H264 &&
+      app->codec != GST_VAAPI_CODEC_H265) {
+    g_printerr ("unsupported codec %s\n", string_from_codec (app->codec));
+    return FALSE;
+  }
+
+  app->file = g_mapped_file_new (filename, FALSE, NULL);
+  if (!app->file) {
+    g_printerr ("failed to open '%s'\n", filename);
+    return FALSE;
+  }
+  app->data = (const guint8 *) g_mapped_file_get_contents (app->file);
+  app->size = g_mapped_file_get_length (app->file);
+
+  app->display = video_output_create_display (NULL);
+  if (!app->display) {
+    g_printerr ("failed to create VA display\n");
+    return FALSE;
+  }
+
+  g_print ("Decoder latency (%s bitstream, %" G_GSIZE_FORMAT " bytes)\n",
+      string_from_codec (app->codec), app->size);
+
+  success = run_decoder (app, NULL, &ref_result);
+  if (success) {
+    print_result ("regular", &ref_result);
+    success = run_decoder (app, ref_result.frame_ends, &result);
+    g_array_free (result.frame_ends, TRUE);
+  }
+  g_array_free (ref_result.frame_ends, TRUE);
+  if (!success)
+    return FALSE;
+  print_result ("low-latency", &result);
+
+  if (result.num_frames_out != ref_result.num_frames_out) {
+    g_printerr ("frame count mismatch: %u vs %u\n", result.num_frames_out,
+        ref_result.num_frames_out);
+    return FALSE;
+  }
+  if (g_check && result.total_delay >= ref_result.total_delay) {
+    g_printerr ("the low latency mode did not reduce the delay\n");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+int
+main (int argc, char *argv[])
+{
+  App app = { NULL, };
+  gboolean success;
+
+  if (!video_output_init (&argc, argv, g_options))
+    g_error ("failed to initialize video output subsystem");
+
+  if (argc < 2) {
+    g_printerr ("no bitstream file specified\n");
+    success = FALSE;
+  } else
+    success = app_run (&app, argv[1]);
+
+  gst_vaapi_display_replace (&app.display, NULL);
+  if (app.file)
+    g_mapped_file_unref (app.file);
+  g_free (g_codec_str);
+  video_output_exit ();
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
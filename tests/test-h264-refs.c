@@ -0,0 +1,473 @@
+/*
+ *  test-h264-refs.c - Test and benchmark H.264 reference list construction
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+/*
+ * This application records the slice headers of an H.264 byte-stream,
+ * or synthesizes those of a hierarchical-B stream, and replays them
+ * through a sliding window DPB. The initial reference picture lists of
+ * each slice are built both from qsort()ed picture arrays, as the
+ * decoder used to do, and from a GstVaapiH264RefSet. Both lists shall
+ * be identical. No VA driver is involved. Only frames are considered,
+ * i.e. field pictures are handled as frames.
+ */
+
+#include "gst/vaapi/sysdeps.h"
+#include <gst/codecparsers/gsth264parser.h>
+#include "gst/vaapi/gstvaapiutils_h264_refs.h"
+
+static guint g_iterations = 100;
+static guint g_num_refs = 16;
+static guint g_num_frames = 1000;
+static gchar **g_input_files = NULL;
+
+static GOptionEntry g_options[] = {
+  {"iterations", 'n', 0, G_OPTION_ARG_INT, &g_iterations,
+      "number of passes over the slice headers", NULL},
+  {"refs", 'r', 0, G_OPTION_ARG_INT, &g_num_refs,
+      "number of reference frames of the synthetic stream", NULL},
+  {"frames", 'f', 0, G_OPTION_ARG_INT, &g_num_frames,
+      "number of frames of the synthetic stream", NULL},
+  {G_OPTION_REMAINING, ' ', 0, G_OPTION_ARG_FILENAME_ARRAY, &g_input_files,
+      "H.264 byte-stream file", NULL},
+  {NULL}
+};
+
+/* The parts of a slice header that matter for reference list init */
+typedef struct
+{
+  guint8 slice_type;
+  guint8 is_idr;
+  guint8 is_reference;
+  guint8 is_first_slice;
+  guint16 frame_num;
+  gint32 poc;
+} SliceRecord;
+
+typedef struct
+{
+  GArray *slices;
+  guint max_num_refs;
+  guint max_frame_num;
+} Stream;
+
+typedef struct
+{
+  gint32 poc;
+  gint32 frame_num;
+  gint32 frame_num_wrap;
+  gint32 pic_num;
+} RefPicture;
+
+/* ------------------------------------------------------------------------- */
+/* --- Slice header recording                                            --- */
+/* ------------------------------------------------------------------------- */
+
+static void
+add_slice (Stream * stream, guint slice_type, gboolean is_idr,
+    gboolean is_reference, gboolean is_first_slice, guint frame_num,
+    gint32 poc)
+{
+  SliceRecord r;
+
+  r.slice_type = slice_type;
+  r.is_idr = is_idr;
+  r.is_reference = is_reference;
+  r.is_first_slice = is_first_slice;
+  r.frame_num = frame_num;
+  r.poc = poc;
+  g_array_append_val (stream->slices, r);
+}
+
+/* Dyadic hierarchical-B GOPs of 8 frames, with all frames but the top
+   layer B-frames used for reference */
+static void
+synthesize_stream (Stream * stream)
+{
+  static const guint8 gop_order[8] = { 8, 4, 2, 1, 3, 6, 5, 7 };
+  guint i, gop, frame_num = 0;
+
+  stream->max_num_refs = g_num_refs;
+  stream->max_frame_num = 256;
+
+  add_slice (stream, GST_H264_I_SLICE, TRUE, TRUE, TRUE, 0, 0);
+  frame_num = 1;
+  for (gop = 0; gop * 8 + 1 < g_num_frames; gop++) {
+    for (i = 0; i < 8; i++) {
+      const guint display_index = gop * 8 + gop_order[i];
+      const gboolean is_reference = i < 3 || i == 5;
+      const guint slice_type = i == 0 ? GST_H264_P_SLICE : GST_H264_B_SLICE;
+      guint s;
+
+      /* Four slices per picture */
+      for (s = 0; s < 4; s++)
+        add_slice (stream, slice_type, FALSE, is_reference, s == 0,
+            frame_num % stream->max_frame_num, 2 * display_index);
+      if (is_reference)
+        frame_num++;
+    }
+  }
+}
+
+static gboolean
+record_stream (Stream * stream, const gchar * filename)
+{
+  GstH264NalParser *parser;
+  GstH264NalUnit nalu;
+  GstH264SliceHdr slice_hdr;
+  GstH264ParserResult result;
+  gchar *data;
+  gsize data_size;
+  guint offset = 0;
+  gint32 poc_msb, prev_poc_msb = 0, prev_poc_lsb = 0;
+  guint pic_count = 0;
+  GError *error = NULL;
+
+  if (!g_file_get_contents (filename, &data, &data_size, &error)) {
+    g_printerr ("failed to read %s: %s\n", filename, error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+
+  stream->max_num_refs = 1;
+  stream->max_frame_num = 16;
+
+  parser = gst_h264_nal_parser_new ();
+  for (;;) {
+    result = gst_h264_parser_identify_nalu (parser, (guint8 *) data, offset,
+        data_size, &nalu);
+    if (result == GST_H264_PARSER_NO_NAL_END)
+      result = gst_h264_parser_identify_nalu_unchecked (parser,
+          (guint8 *) data, offset, data_size, &nalu);
+    if (result != GST_H264_PARSER_OK)
+      break;
+    offset = nalu.offset + nalu.size;
+
+    switch (nalu.type) {
+      case GST_H264_NAL_SPS:{
+        GstH264SPS sps;
+        if (gst_h264_parser_parse_sps (parser, &nalu, &sps,
+                FALSE) != GST_H264_PARSER_OK)
+          break;
+        stream->max_num_refs = MAX (sps.num_ref_frames, 1);
+        stream->max_frame_num = 1 << (sps.log2_max_frame_num_minus4 + 4);
+        break;
+      }
+      case GST_H264_NAL_PPS:{
+        GstH264PPS pps;
+        gst_h264_parser_parse_pps (parser, &nalu, &pps);
+        break;
+      }
+      case GST_H264_NAL_SLICE_IDR:
+      case GST_H264_NAL_SLICE:{
+        GstH264SPS *sps;
+        gint32 poc, max_poc_lsb;
+        gboolean is_first_slice;
+
+        if (gst_h264_parser_parse_slice_hdr (parser, &nalu, &slice_hdr,
+                FALSE, FALSE) != GST_H264_PARSER_OK)
+          break;
+        sps = slice_hdr.pps->sequence;
+        is_first_slice = slice_hdr.first_mb_in_slice == 0;
+        if (is_first_slice)
+          pic_count++;
+
+        /* 8.2.1.1, without MMCO5 handling. Other POC types are
+           approximated with the decoding order */
+        if (sps->pic_order_cnt_type == 0) {
+          max_poc_lsb = 1 << (sps->log2_max_pic_order_cnt_lsb_minus4 + 4);
+          if (nalu.idr_pic_flag)
+            prev_poc_msb = prev_poc_lsb = 0;
+          poc_msb = prev_poc_msb;
+          if (slice_hdr.pic_order_cnt_lsb < prev_poc_lsb &&
+              prev_poc_lsb - slice_hdr.pic_order_cnt_lsb >= max_poc_lsb / 2)
+            poc_msb += max_poc_lsb;
+          else if (slice_hdr.pic_order_cnt_lsb > prev_poc_lsb &&
+              slice_hdr.pic_order_cnt_lsb - prev_poc_lsb > max_poc_lsb / 2)
+            poc_msb -= max_poc_lsb;
+          poc = poc_msb + slice_hdr.pic_order_cnt_lsb;
+          if (nalu.ref_idc) {
+            prev_poc_msb = poc_msb;
+            prev_poc_lsb = slice_hdr.pic_order_cnt_lsb;
+          }
+        } else
+          poc = 2 * pic_count;
+
+        add_slice (stream, slice_hdr.type % 5, nalu.idr_pic_flag,
+            nalu.ref_idc != 0, is_first_slice, slice_hdr.frame_num, poc);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  gst_h264_nal_parser_free (parser);
+  g_free (data);
+  return TRUE;
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Reference list construction                                       --- */
+/* ------------------------------------------------------------------------- */
+
+static int
+compare_pic_num_dec (const void *a, const void *b)
+{
+  const RefPicture *const picA = *(RefPicture **) a;
+  const RefPicture *const picB = *(RefPicture **) b;
+
+  return picB->pic_num - picA->pic_num;
+}
+
+static int
+compare_poc_dec (const void *a, const void *b)
+{
+  const RefPicture *const picA = *(RefPicture **) a;
+  const RefPicture *const picB = *(RefPicture **) b;
+
+  return picB->poc - picA->poc;
+}
+
+static int
+compare_poc_inc (const void *a, const void *b)
+{
+  const RefPicture *const picA = *(RefPicture **) a;
+  const RefPicture *const picB = *(RefPicture **) b;
+
+  return picA->poc - picB->poc;
+}
+
+/* The initial reference lists, built the way the decoder used to */
+static void
+init_ref_lists_qsort (RefPicture ** refs, guint num_refs,
+    const SliceRecord * slice, gpointer * list0, guint * list0_count_ptr,
+    gpointer * list1, guint * list1_count_ptr)
+{
+  RefPicture *short_ref[32];
+  guint i, n, list0_count = 0, list1_count = 0;
+
+  for (i = 0; i < num_refs; i++)
+    short_ref[i] = refs[i];
+
+  if (slice->slice_type == GST_H264_P_SLICE) {
+    for (i = 0; i < num_refs; i++)
+      list0[i] = short_ref[i];
+    qsort (list0, num_refs, sizeof (*list0), compare_pic_num_dec);
+    list0_count = num_refs;
+  } else if (slice->slice_type == GST_H264_B_SLICE) {
+    for (n = 0, i = 0; i < num_refs; i++) {
+      if (short_ref[i]->poc < slice->poc)
+        list0[n++] = short_ref[i];
+    }
+    qsort (list0, n, sizeof (*list0), compare_poc_dec);
+    list0_count = n;
+    for (n = 0, i = 0; i < num_refs; i++) {
+      if (short_ref[i]->poc >= slice->poc)
+        list0[list0_count + n++] = short_ref[i];
+    }
+    qsort (&list0[list0_count], n, sizeof (*list0), compare_poc_inc);
+    list0_count += n;
+
+    for (n = 0, i = 0; i < num_refs; i++) {
+      if (short_ref[i]->poc > slice->poc)
+        list1[n++] = short_ref[i];
+    }
+    qsort (list1, n, sizeof (*list1), compare_poc_inc);
+    list1_count = n;
+    for (n = 0, i = 0; i < num_refs; i++) {
+      if (short_ref[i]->poc <= slice->poc)
+        list1[list1_count + n++] = short_ref[i];
+    }
+    qsort (&list1[list1_count], n, sizeof (*list1), compare_poc_dec);
+    list1_count += n;
+  }
+  *list0_count_ptr = list0_count;
+  *list1_count_ptr = list1_count;
+}
+
+/* The initial reference lists, built from a GstVaapiH264RefSet */
+static void
+init_ref_lists_set (RefPicture ** refs, guint num_refs,
+    const SliceRecord * slice, gpointer * list0, guint * list0_count_ptr,
+    gpointer * list1, guint * list1_count_ptr)
+{
+  GstVaapiH264RefSet set;
+  guint8 order[GST_VAAPI_H264_MAX_REFS];
+  guint i, n, list0_count = 0, list1_count = 0;
+
+  gst_vaapi_h264_ref_set_clear (&set);
+  for (i = 0; i < num_refs; i++)
+    gst_vaapi_h264_ref_set_add (&set, refs[i], refs[i]->poc,
+        refs[i]->frame_num_wrap, refs[i]->pic_num, 0);
+
+  if (slice->slice_type == GST_H264_P_SLICE) {
+    n = gst_vaapi_h264_ref_set_sort (&set, set.pic_num, TRUE, order);
+    list0_count = gst_vaapi_h264_ref_set_append (&set, order, n, list0);
+  } else if (slice->slice_type == GST_H264_B_SLICE) {
+    n = gst_vaapi_h264_ref_set_sort_by_poc (&set, slice->poc, FALSE, TRUE,
+        order);
+    list0_count = gst_vaapi_h264_ref_set_append (&set, order, n, list0);
+    n = gst_vaapi_h264_ref_set_sort_by_poc (&set, slice->poc, TRUE, FALSE,
+        order);
+    list1_count = gst_vaapi_h264_ref_set_append (&set, order, n, list1);
+  }
+  *list0_count_ptr = list0_count;
+  *list1_count_ptr = list1_count;
+}
+
+typedef void (*InitRefListsFunc) (RefPicture ** refs, guint num_refs,
+    const SliceRecord * slice, gpointer * list0, guint * list0_count_ptr,
+    gpointer * list1, guint * list1_count_ptr);
+
+/* Replays the slice headers through a sliding window DPB, and returns
+   a checksum of all the reference lists */
+static guint32
+replay_stream (const Stream * stream, InitRefListsFunc init_ref_lists,
+    gdouble * elapsed_ptr)
+{
+  RefPicture *pictures, *refs[32];
+  gpointer list0[32], list1[32];
+  guint i, j, num_refs = 0, list0_count, list1_count;
+  guint32 checksum = 0;
+  gint64 start;
+
+  pictures = g_new (RefPicture, stream->slices->len);
+  start = g_get_monotonic_time ();
+  for (i = 0; i < stream->slices->len; i++) {
+    const SliceRecord *const slice =
+        &g_array_index (stream->slices, SliceRecord, i);
+    RefPicture *const picture = &pictures[i];
+
+    // 8.2.4.1 - Decoding process for picture numbers
+    for (j = 0; j < num_refs; j++) {
+      RefPicture *const pic = refs[j];
+      if (pic->frame_num > slice->frame_num)
+        pic->frame_num_wrap = pic->frame_num - stream->max_frame_num;
+      else
+        pic->frame_num_wrap = pic->frame_num;
+      pic->pic_num = pic->frame_num_wrap;
+    }
+
+    init_ref_lists (refs, num_refs, slice, list0, &list0_count, list1,
+        &list1_count);
+    for (j = 0; j < list0_count; j++)
+      checksum = checksum * 31 + ((RefPicture *) list0[j] - pictures);
+    for (j = 0; j < list1_count; j++)
+      checksum = checksum * 37 + ((RefPicture *) list1[j] - pictures);
+
+    /* Mark the picture once its last slice was seen */
+    if (i + 1 < stream->slices->len &&
+        !g_array_index (stream->slices, SliceRecord, i + 1).is_first_slice)
+      continue;
+    if (!slice->is_reference)
+      continue;
+    if (slice->is_idr)
+      num_refs = 0;
+    else if (num_refs >= stream->max_num_refs) {
+      // 8.2.5.3 - Sliding window decoded reference picture marking
+      guint m = 0;
+      for (j = 1; j < num_refs; j++) {
+        if (refs[j]->frame_num_wrap < refs[m]->frame_num_wrap)
+          m = j;
+      }
+      refs[m] = refs[--num_refs];
+    }
+    picture->poc = slice->poc;
+    picture->frame_num = slice->frame_num;
+    picture->frame_num_wrap = slice->frame_num;
+    picture->pic_num = slice->frame_num;
+    refs[num_refs++] = picture;
+  }
+  *elapsed_ptr = (g_get_monotonic_time () - start) / 1.0e6;
+  g_free (pictures);
+  return checksum;
+}
+
+static gboolean
+bench_stream (const gchar * name, const Stream * stream)
+{
+  gdouble t, t_qsort = 0, t_set = 0, num_slices;
+  guint32 ref_checksum = 0, checksum;
+  gboolean success = TRUE;
+  guint i;
+
+  for (i = 0; i < g_iterations && success; i++) {
+    ref_checksum = replay_stream (stream, init_ref_lists_qsort, &t);
+    t_qsort += t;
+    checksum = replay_stream (stream, init_ref_lists_set, &t);
+    t_set += t;
+    if (checksum != ref_checksum) {
+      g_printerr ("%s: reference lists mismatch\n", name);
+      success = FALSE;
+    }
+  }
+
+  num_slices = (gdouble) stream->slices->len * i;
+  g_print ("%s: %u slices, %u reference frames\n", name,
+      stream->slices->len, stream->max_num_refs);
+  g_print ("  qsort(): %8.1f ns/slice\n",
+      num_slices > 0 ? t_qsort * 1.0e9 / num_slices : 0);
+  g_print ("  GstVaapiH264RefSet: %8.1f ns/slice\n",
+      num_slices > 0 ? t_set * 1.0e9 / num_slices : 0);
+  return success;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *ctx;
+  GError *error = NULL;
+  gboolean success = TRUE;
+  Stream stream;
+  guint i;
+
+  ctx = g_option_context_new (" - H.264 reference lists benchmark");
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  g_option_context_add_main_entries (ctx, g_options, NULL);
+  if (!g_option_context_parse (ctx, &argc, &argv, &error)) {
+    g_printerr ("Option parsing failed: %s\n", error->message);
+    g_error_free (error);
+    g_option_context_free (ctx);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free (ctx);
+
+  g_num_refs = CLAMP (g_num_refs, 1, 16);
+
+  if (!g_input_files) {
+    stream.slices = g_array_new (FALSE, FALSE, sizeof (SliceRecord));
+    synthesize_stream (&stream);
+    success = bench_stream ("hierarchical-B", &stream);
+    g_array_unref (stream.slices);
+  } else {
+    for (i = 0; g_input_files[i] != NULL; i++) {
+      stream.slices = g_array_new (FALSE, FALSE, sizeof (SliceRecord));
+      if (record_stream (&stream, g_input_files[i]))
+        success &= bench_stream (g_input_files[i], &stream);
+      else
+        success = FALSE;
+      g_array_unref (stream.slices);
+    }
+  }
+
+  g_strfreev (g_input_files);
+  gst_deinit ();
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
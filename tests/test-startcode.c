@@ -0,0 +1,246 @@
+/*
+ *  test-startcode.c - Test and benchmark the start code scanner
+ *
+ *  Copyright (C) 2018 Intel Corporation
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301 USA
+ */
+
+#include "gst/vaapi/sysdeps.h"
+#include <gst/base/gstadapter.h>
+#include "gst/vaapi/gstvaapiutils_startcode.h"
+
+static guint g_chunk_size = 65536;
+static guint g_iterations = 10;
+static gchar **g_input_files = NULL;
+
+static GOptionEntry g_options[] = {
+  {"chunk-size", 's', 0, G_OPTION_ARG_INT, &g_chunk_size,
+      "size of the buffers pushed into the adapter", NULL},
+  {"iterations", 'n', 0, G_OPTION_ARG_INT, &g_iterations,
+      "number of passes over the input file", NULL},
+  {G_OPTION_REMAINING, ' ', 0, G_OPTION_ARG_FILENAME_ARRAY, &g_input_files,
+      "elementary stream file", NULL},
+  {NULL}
+};
+
+typedef gint (*ScanFunc) (GstAdapter * adapter, guint ofs, guint size);
+
+static gint
+scan_legacy (GstAdapter * adapter, guint ofs, guint size)
+{
+  return (gint) gst_adapter_masked_scan_uint32_peek (adapter,
+      0xffffff00, 0x00000100, ofs, size, NULL);
+}
+
+static gint
+scan_vaapi (GstAdapter * adapter, guint ofs, guint size)
+{
+  return gst_vaapi_adapter_scan_for_start_code (adapter, ofs, size, NULL);
+}
+
+static void
+fill_adapter (GstAdapter * adapter, const guint8 * data, gsize data_size)
+{
+  gsize ofs, n;
+
+  for (ofs = 0; ofs < data_size; ofs += n) {
+    n = MIN (g_chunk_size, data_size - ofs);
+    gst_adapter_push (adapter,
+        gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+            (gpointer) (data + ofs), n, 0, n, NULL, NULL));
+  }
+}
+
+/* Splits the stream into units the same way the H.264 parser does for
+   unaligned byte-streams, and returns the offsets of all start codes */
+static GArray *
+run_scan (ScanFunc scan, const guint8 * data, gsize data_size,
+    gdouble * elapsed_ptr)
+{
+  GstAdapter *const adapter = gst_adapter_new ();
+  GArray *const offsets = g_array_new (FALSE, FALSE, sizeof (guint64));
+  guint64 pos;
+  gint64 start;
+  gint size, ofs;
+
+  fill_adapter (adapter, data, data_size);
+
+  start = g_get_monotonic_time ();
+  ofs = scan (adapter, 0, gst_adapter_available (adapter));
+  if (ofs >= 0) {
+    gst_adapter_flush (adapter, ofs);
+    pos = ofs;
+    for (;;) {
+      g_array_append_val (offsets, pos);
+      size = gst_adapter_available (adapter);
+      ofs = size < 8 ? -1 : scan (adapter, 4, size - 4);
+      if (ofs < 0)
+        break;
+      gst_adapter_flush (adapter, ofs);
+      pos += ofs;
+    }
+  }
+  *elapsed_ptr = (g_get_monotonic_time () - start) / 1.0e6;
+
+  g_object_unref (adapter);
+  return offsets;
+}
+
+/* Counts the patterns found by scan in a contiguous buffer, resuming
+   skip bytes after each match */
+static guint
+run_scan_raw (gint (*scan) (const guint8 *, guint), guint skip,
+    const guint8 * data, gsize data_size, gdouble * elapsed_ptr)
+{
+  gsize pos = 0;
+  guint count = 0;
+  gint64 start;
+  gint ofs;
+
+  start = g_get_monotonic_time ();
+  while ((ofs = scan (data + pos, data_size - pos)) >= 0) {
+    pos += ofs + skip;
+    count++;
+  }
+  *elapsed_ptr = (g_get_monotonic_time () - start) / 1.0e6;
+  return count;
+}
+
+static gboolean
+check_offsets (GArray * a, GArray * b)
+{
+  guint i;
+
+  if (a->len != b->len) {
+    g_printerr ("start code count mismatch: %u vs %u\n", a->len, b->len);
+    return FALSE;
+  }
+  for (i = 0; i < a->len; i++) {
+    if (g_array_index (a, guint64, i) != g_array_index (b, guint64, i)) {
+      g_printerr ("start code #%u mismatch\n", i);
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static gboolean
+bench_file (const gchar * filename)
+{
+  GArray *ref_offsets = NULL, *offsets;
+  gdouble t, t_legacy = 0, t_vaapi = 0, t_raw_c = 0, t_raw = 0, mbytes;
+  gdouble t_ep_c = 0, t_ep = 0;
+  gchar *data;
+  gsize data_size;
+  GError *error = NULL;
+  gboolean success = TRUE;
+  guint i, count, ep_count = 0;
+
+  if (!g_file_get_contents (filename, &data, &data_size, &error)) {
+    g_printerr ("failed to read %s: %s\n", filename, error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+
+  for (i = 0; i < g_iterations && success; i++) {
+    offsets = run_scan (scan_legacy, (guint8 *) data, data_size, &t);
+    t_legacy += t;
+    if (!ref_offsets)
+      ref_offsets = offsets;
+    else
+      g_array_unref (offsets);
+
+    offsets = run_scan (scan_vaapi, (guint8 *) data, data_size, &t);
+    t_vaapi += t;
+    success = check_offsets (ref_offsets, offsets);
+    g_array_unref (offsets);
+
+    count = run_scan_raw (gst_vaapi_scan_for_start_code_c, 3,
+        (guint8 *) data, data_size, &t);
+    t_raw_c += t;
+    if (count != run_scan_raw (gst_vaapi_scan_for_start_code, 3,
+            (guint8 *) data, data_size, &t))
+      success = FALSE;
+    t_raw += t;
+
+    /* The emulation prevention byte goes before the third byte */
+    ep_count = run_scan_raw (gst_vaapi_scan_for_emulation_prevention_c, 2,
+        (guint8 *) data, data_size, &t);
+    t_ep_c += t;
+    if (ep_count != run_scan_raw (gst_vaapi_scan_for_emulation_prevention,
+            2, (guint8 *) data, data_size, &t)) {
+      g_printerr ("emulation prevention pattern count mismatch\n");
+      success = FALSE;
+    }
+    t_ep += t;
+  }
+
+  mbytes = (gdouble) data_size * i / (1024 * 1024);
+  g_print ("%s: %" G_GSIZE_FORMAT " bytes, %u start codes\n", filename,
+      data_size, ref_offsets ? ref_offsets->len : 0);
+  g_print ("  gst_adapter_masked_scan_uint32_peek: %8.1f MB/s\n",
+      t_legacy > 0 ? mbytes / t_legacy : 0);
+  g_print ("  gst_vaapi_adapter_scan_for_start_code: %8.1f MB/s\n",
+      t_vaapi > 0 ? mbytes / t_vaapi : 0);
+  g_print ("  gst_vaapi_scan_for_start_code_c: %8.1f MB/s\n",
+      t_raw_c > 0 ? mbytes / t_raw_c : 0);
+  g_print ("  gst_vaapi_scan_for_start_code: %8.1f MB/s\n",
+      t_raw > 0 ? mbytes / t_raw : 0);
+  g_print ("  gst_vaapi_scan_for_emulation_prevention_c: %8.1f MB/s "
+      "(%u patterns)\n", t_ep_c > 0 ? mbytes / t_ep_c : 0, ep_count);
+  g_print ("  gst_vaapi_scan_for_emulation_prevention: %8.1f MB/s\n",
+      t_ep > 0 ? mbytes / t_ep : 0);
+
+  if (ref_offsets)
+    g_array_unref (ref_offsets);
+  g_free (data);
+  return success;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *ctx;
+  GError *error = NULL;
+  gboolean success = TRUE;
+  guint i;
+
+  ctx = g_option_context_new (" - start code and emulation prevention scanner benchmark");
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  g_option_context_add_main_entries (ctx, g_options, NULL);
+  if (!g_option_context_parse (ctx, &argc, &argv, &error)) {
+    g_printerr ("Option parsing failed: %s\n", error->message);
+    g_error_free (error);
+    g_option_context_free (ctx);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free (ctx);
+
+  if (!g_input_files) {
+    g_printerr ("no input file specified\n");
+    return EXIT_FAILURE;
+  }
+  if (g_chunk_size == 0)
+    g_chunk_size = 1;
+
+  for (i = 0; g_input_files[i] != NULL; i++)
+    success &= bench_file (g_input_files[i]);
+
+  g_strfreev (g_input_files);
+  gst_deinit ();
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}